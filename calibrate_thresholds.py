@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Compute per-spell confidence thresholds and a softmax temperature from labelled casts.
+
+Input: one or more CSV files of recorded casts, one cast per row:
+  label,x0,y0,x1,y1,...,x49,y49
+where label is a spell name (SPELL_NAMES in src/spell_detector.cpp) or its index,
+and the 100 values are the preprocessed model input (normalized to [0,1]).
+
+The model is run on every cast (tflite_runtime or tensorflow), the temperature is
+fitted by minimizing negative log-likelihood, and each spell gets the lowest
+threshold whose precision on the recorded casts reaches --precision.
+
+Usage:
+  ./calibrate_thresholds.py model.tflite sessions/*.csv
+  ./calibrate_thresholds.py model.tflite sessions/*.csv --precision 0.97 --post http://192.168.4.1
+"""
+import argparse
+import csv
+import json
+import math
+import os
+import re
+import sys
+import urllib.request
+
+INPUT_SIZE = 100
+DEFAULT_THRESHOLD = 0.99   # SPELL_CONFIDENCE_THRESHOLD
+MIN_THRESHOLD = 0.5
+MAX_THRESHOLD = 0.999
+TEMPERATURES = [0.25 + 0.05 * i for i in range(96)]  # 0.25 .. 5.0
+
+
+def load_spell_names():
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "src", "spell_detector.cpp")
+    with open(path) as f:
+        source = f.read()
+    table = re.search(r"SPELL_NAMES\[\d+\]\s*=\s*\{(.*?)\};", source, re.S)
+    if not table:
+        sys.exit("SPELL_NAMES not found in %s" % path)
+    return re.findall(r'"([^"]*)"', table.group(1))
+
+
+def load_casts(paths, names):
+    index = {name: i for i, name in enumerate(names)}
+    casts = []
+    for path in paths:
+        with open(path, newline="") as f:
+            for row in csv.reader(f):
+                if not row or row[0].startswith("#") or row[0] == "label":
+                    continue
+                label = row[0].strip()
+                spell = int(label) if label.isdigit() else index.get(label)
+                if spell is None or spell >= len(names) or len(row) != INPUT_SIZE + 1:
+                    print("skipping row in %s: %r" % (path, row[:2]))
+                    continue
+                casts.append((spell, [float(v) for v in row[1:]]))
+    return casts
+
+
+def make_interpreter(model_path):
+    try:
+        from tflite_runtime.interpreter import Interpreter
+    except ImportError:
+        try:
+            from tensorflow.lite import Interpreter
+        except ImportError:
+            sys.exit("needs tflite_runtime or tensorflow (pip install tflite-runtime)")
+    interpreter = Interpreter(model_path=model_path)
+    interpreter.allocate_tensors()
+    return interpreter
+
+
+def run_model(interpreter, casts):
+    import numpy as np
+    inp = interpreter.get_input_details()[0]
+    out = interpreter.get_output_details()[0]
+    if inp["shape"][0] != 1:
+        interpreter.resize_tensor_input(inp["index"], [1] + list(inp["shape"][1:]))
+        interpreter.allocate_tensors()
+    probabilities = []
+    for _, positions in casts:
+        data = np.array(positions, dtype=np.float32).reshape(inp["shape"][1:])[None, ...]
+        interpreter.set_tensor(inp["index"], data)
+        interpreter.invoke()
+        probabilities.append([float(p) for p in interpreter.get_tensor(out["index"])[0]])
+    return probabilities
+
+
+def scale(probs, temperature):
+    # Same as SpellCalibration::apply(): softmax(z / T) == p^(1/T) / sum
+    scaled = [max(p, 1e-12) ** (1.0 / temperature) for p in probs]
+    total = sum(scaled)
+    return [p / total for p in scaled]
+
+
+def fit_temperature(casts, probabilities):
+    best_t, best_nll = 1.0, float("inf")
+    for t in TEMPERATURES:
+        nll = -sum(math.log(max(scale(p, t)[spell], 1e-12))
+                   for (spell, _), p in zip(casts, probabilities))
+        if nll < best_nll:
+            best_t, best_nll = t, nll
+    return best_t
+
+
+def fit_thresholds(casts, probabilities, class_count, precision):
+    # Per predicted class: (confidence, correct) of every cast the model assigned to it
+    predicted = [[] for _ in range(class_count)]
+    for (spell, _), p in zip(casts, probabilities):
+        top = max(range(class_count), key=lambda i: p[i])
+        predicted[top].append((p[top], top == spell))
+
+    thresholds = []
+    for spell in range(class_count):
+        hits = sorted(predicted[spell], reverse=True)
+        threshold = DEFAULT_THRESHOLD
+        correct = 0
+        for n, (confidence, ok) in enumerate(hits, 1):
+            correct += ok
+            if ok and correct / n >= precision:
+                threshold = confidence
+        thresholds.append(round(min(max(threshold, MIN_THRESHOLD), MAX_THRESHOLD), 3))
+    return thresholds, predicted
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("model")
+    parser.add_argument("sessions", nargs="+")
+    parser.add_argument("--precision", type=float, default=0.98, help="target precision per spell")
+    parser.add_argument("--no-temperature", action="store_true", help="keep temperature at 1.0")
+    parser.add_argument("--output", default="calibration.json")
+    parser.add_argument("--post", metavar="URL", help="upload to http://<wand>/calibration")
+    args = parser.parse_args()
+
+    names = load_spell_names()
+    casts = load_casts(args.sessions, names)
+    if not casts:
+        sys.exit("no labelled casts found")
+
+    probabilities = run_model(make_interpreter(args.model), casts)
+    temperature = 1.0 if args.no_temperature else fit_temperature(casts, probabilities)
+    calibrated = [scale(p, temperature) for p in probabilities]
+    thresholds, predicted = fit_thresholds(casts, calibrated, len(names), args.precision)
+
+    print("%d casts, temperature %.2f" % (len(casts), temperature))
+    for spell, name in enumerate(names):
+        if predicted[spell] or thresholds[spell] != DEFAULT_THRESHOLD:
+            print("  %-34s %5.3f  (%d predicted)" % (name, thresholds[spell], len(predicted[spell])))
+
+    body = json.dumps({"temperature": round(temperature, 3), "thresholds": thresholds})
+    with open(args.output, "w") as f:
+        f.write(body)
+    print("Wrote %s" % args.output)
+
+    if args.post:
+        request = urllib.request.Request(args.post.rstrip("/") + "/calibration", data=body.encode(),
+                                         headers={"Content-Type": "application/json"})
+        with urllib.request.urlopen(request, timeout=10) as response:
+            print("Upload: %s" % response.read().decode())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Decode a dataset capture downloaded from the wand (GET /dataset/download).
+
+The stream is one or more segment files (include/dataset_format.h), each a
+DatasetSegmentHeader followed by records of raw tracked positions (zigzag
+varint deltas), the quantized model input, the prediction and the user label.
+
+Writes up to two CSV files:
+  --tensors   label,x0,y0,...   labelled casts with the 50x2 input (calibrate_thresholds.py format)
+  --positions one cast per row: timestamp_ms,label,predicted,confidence,recognized,truncated,x0,y0,...
+              (positions in mm; label/predicted are spell names, empty if none)
+
+Usage:
+  curl -o wand_dataset.bin http://192.168.4.1/dataset/download
+  ./dataset_decode.py wand_dataset.bin --tensors casts.csv --positions paths.csv
+"""
+import argparse
+import csv
+import os
+import re
+import struct
+import sys
+
+DATASET_MAGIC = 0x43534457  # "WDSC"
+DATASET_VERSION = 1
+LABEL_NONE = 0xFF
+FLAG_RECOGNIZED = 0x01
+FLAG_TRUNCATED = 0x02
+TENSOR_SIZE = 100  # calibrate_thresholds.py INPUT_SIZE
+
+SEGMENT_HEADER = struct.Struct("<IHHI")
+RECORD_HEADER = struct.Struct("<HBBHBBHHI")
+
+
+def load_spell_names():
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "src", "spell_detector.cpp")
+    with open(path) as f:
+        source = f.read()
+    table = re.search(r"SPELL_NAMES\[\d+\]\s*=\s*\{(.*?)\};", source, re.S)
+    if not table:
+        sys.exit("SPELL_NAMES not found in %s" % path)
+    return re.findall(r'"([^"]*)"', table.group(1))
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            break
+        shift += 7
+    return (value >> 1) ^ -(value & 1), pos
+
+
+def decode(data):
+    """Yield one dict per record, oldest first."""
+    pos = 0
+    scale = 1
+    while pos < len(data):
+        magic = struct.unpack_from("<I", data, pos)[0] if pos + 4 <= len(data) else 0
+        if magic == DATASET_MAGIC:
+            _, version, position_scale, sequence = SEGMENT_HEADER.unpack_from(data, pos)
+            if version != DATASET_VERSION:
+                sys.exit("segment %d: unsupported version %d" % (sequence, version))
+            scale = position_scale
+            pos += SEGMENT_HEADER.size
+            continue
+
+        if pos + RECORD_HEADER.size > len(data):
+            print("ignoring %d trailing bytes" % (len(data) - pos))
+            break
+        (size, label, predicted, confidence, flags, _reserved,
+         tensor_size, position_count, timestamp_ms) = RECORD_HEADER.unpack_from(data, pos)
+        body = pos + RECORD_HEADER.size
+        pos = body + size
+
+        tensor = [v / 65535.0 for v in struct.unpack_from("<%dH" % tensor_size, data, body)]
+        p = body + 2 * tensor_size
+        x = y = 0
+        positions = []
+        for _ in range(position_count):
+            dx, p = read_varint(data, p)
+            dy, p = read_varint(data, p)
+            x += dx
+            y += dy
+            positions.append((x / scale, y / scale))
+
+        yield {
+            "timestamp_ms": timestamp_ms,
+            "label": label,
+            "predicted": predicted,
+            "confidence": confidence / 65535.0,
+            "recognized": bool(flags & FLAG_RECOGNIZED),
+            "truncated": bool(flags & FLAG_TRUNCATED),
+            "tensor": tensor,
+            "positions": positions,
+        }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dataset", nargs="+", help="downloaded dataset stream(s)")
+    parser.add_argument("--tensors", help="CSV of labelled model inputs for calibrate_thresholds.py")
+    parser.add_argument("--positions", help="CSV of raw tracked paths")
+    args = parser.parse_args()
+
+    names = load_spell_names()
+
+    def name(index):
+        return names[index] if index != LABEL_NONE and index < len(names) else ""
+
+    records = []
+    for path in args.dataset:
+        with open(path, "rb") as f:
+            records.extend(decode(f.read()))
+
+    labelled = sum(1 for r in records if r["label"] != LABEL_NONE)
+    print("%d casts (%d labelled)" % (len(records), labelled))
+
+    if args.tensors:
+        written = 0
+        with open(args.tensors, "w", newline="") as f:
+            out = csv.writer(f)
+            for r in records:
+                if r["label"] == LABEL_NONE or len(r["tensor"]) != TENSOR_SIZE:
+                    continue
+                out.writerow([name(r["label"])] + ["%.6f" % v for v in r["tensor"]])
+                written += 1
+        print("wrote %d labelled casts to %s" % (written, args.tensors))
+
+    if args.positions:
+        with open(args.positions, "w", newline="") as f:
+            out = csv.writer(f)
+            for r in records:
+                row = [r["timestamp_ms"], name(r["label"]), name(r["predicted"]), "%.4f" % r["confidence"],
+                       int(r["recognized"]), int(r["truncated"])]
+                for x, y in r["positions"]:
+                    row += ["%.1f" % x, "%.1f" % y]
+                out.writerow(row)
+        print("wrote %d paths to %s" % (len(records), args.positions))
+
+
+if __name__ == "__main__":
+    main()
@@ -11,6 +11,15 @@
 #include "services/gatt/ble_svc_gatt.h"
 #include "esp_bt.h"
 #include "spell_detector.h"
+#include "model_registry.h"
+#include "shadow_eval.h"
+#include "custom_gestures.h"
+#include "cascade.h"
+#include "spell_calibration.h"
+#include "spell_personalization.h"
+#include "gesture_segmenter.h"
+#include "dataset_capture.h"
+#include "gesture_history.h"
 #include "wand_commands.h"
 #include "wand_protocol.h"
 #include "spell_effects.h"
@@ -50,8 +59,43 @@ private:
 
     AHRSTracker ahrsTracker;
     SpellDetector spellDetector;
+    SpellCalibration calibration; // Per-spell thresholds + temperature for spellDetector
+    SpellPersonalization personalization; // Per-user score adjustment (SPELL_PERSONALIZATION)
     WandCommands wandCommands;
 
+    // Model registry (runtime model switching)
+    ModelRegistry *modelRegistry;
+    int activeModel;
+    const unsigned char *loadedModelData; // What spellDetector holds, restored after a failed switch
+    size_t loadedModelSize;
+    uint32_t loadedModelId;
+    SemaphoreHandle_t detectorMutex; // Guards spellDetector between detection and model switches
+
+    // Candidate model evaluated alongside production (results logged only)
+    ShadowEvaluator shadowEvaluator;
+
+    // Small first-stage model; full model only for ambiguous casts
+    CascadeRecognizer cascade;
+
+    // Candidate trim windows of the last cast (window 0 = base trim) and their counters
+    float windowBuffer[PREPROCESS_MAX_WINDOWS * SPELL_INPUT_MAX_SIZE];
+    float gestureBuffer[SPELL_INPUT_SIZE]; // 50 x,y path for custom gestures when the model shape differs
+    uint8_t windowIds[PREPROCESS_MAX_WINDOWS];
+    WindowStats windowStats;
+
+    // User-recorded gestures (template matching on preprocessed paths)
+    CustomGestureEngine customGestures;
+
+    // Labelled casts recorded to SPIFFS for retraining
+    DatasetCapture datasetCapture;
+
+    // Last casts in PSRAM for download and replay
+    GestureHistory gestureHistory;
+
+    // Button-free segmentation (CONTINUOUS_SEGMENTATION)
+    GestureSegmenter segmenter;
+    bool segmentTracking; // Tracker was started by the segmenter, not the buttons
+
     SpellDetectedCallback spellCallback;
     ConnectionCallback connectionCallback;
     IMUDataCallback imuCallback;
@@ -93,6 +137,12 @@ private:
     // Internal processing methods
     void processBufferedData();
 
+    // Preprocess + detect one tracked gesture (buttons or segmenter); true if a spell fired
+    bool recognizeGesture(const Position2D *positions, size_t position_count);
+
+    // Start/stop position tracking for a segmenter event
+    void processSegmentEvent(SegmentEvent event);
+
 public:
     WandBLEClient();
     ~WandBLEClient();
@@ -107,7 +157,46 @@ public:
     void updateAHRS(const IMUSample &sample);
 
     // Initialize BLE and load model
-    bool begin(const unsigned char *model_data, size_t model_size);
+    bool begin(const unsigned char *model_data, size_t model_size, uint32_t model_id = 0);
+
+    // Model registry: set available models, switch the active one at runtime
+    void setModelRegistry(ModelRegistry *registry, int active_index);
+    ModelRegistry *getModelRegistry() const { return modelRegistry; }
+    bool selectModel(const char *name);
+    const char *getActiveModelName() const;
+    bool isDetectorReady() { return spellDetector.isReady(); } // False after a failed switch and restore
+
+    // Shadow model (empty name disables)
+    bool selectShadowModel(const char *name);
+    ShadowEvaluator &getShadowEvaluator() { return shadowEvaluator; }
+
+    // Cascade: stage-1 model (empty disables) and its accept threshold
+    bool configureCascade(const char *stage1_name, float accept_threshold, bool persist = true);
+    CascadeRecognizer &getCascade() { return cascade; }
+
+    // Per-spell thresholds/temperature of the production model (save() persists to NVS)
+    SpellCalibration &getCalibration() { return calibration; }
+
+    // Active user profile and its corrections
+    SpellPersonalization &getPersonalization() { return personalization; }
+
+    // Per trim-window evaluation counters
+    const WindowStats &getWindowStats() const { return windowStats; }
+
+    // Button-free segmentation counters
+    const SegmenterStats &getSegmenterStats() const { return segmenter.getStats(); }
+
+    // Custom gesture engine (record/list/delete from web UI)
+    CustomGestureEngine &getCustomGestures() { return customGestures; }
+
+    // Dataset capture (toggle/label/download from web UI)
+    DatasetCapture &getDatasetCapture() { return datasetCapture; }
+
+    // Recent casts (binary download / replay from web UI)
+    GestureHistory &getGestureHistory() { return gestureHistory; }
+
+    // Re-run a stored cast through the active model runs times (timings min/avg/max)
+    bool replayGesture(uint32_t id, int runs, GestureReplayResult *out);
 
     // Connect to wand
     bool connect(const char *address);
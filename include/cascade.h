@@ -0,0 +1,72 @@
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spell_detector.h"
+#include "model_registry.h"
+#include "spell_calibration.h"
+#include "config.h"
+
+// Cascaded recognition: a small first-stage model answers confident casts on its own,
+// only ambiguous ones escalate to the full model.
+#ifndef CASCADE_ACCEPT_THRESHOLD
+#define CASCADE_ACCEPT_THRESHOLD 0.95f // Stage-1 confidence needed to skip the full model
+#endif
+
+struct CascadeStats
+{
+    uint32_t casts;
+    uint32_t escalations; // Stage 1 ran but was below the accept threshold
+    uint32_t stage1_rejects; // Stage 1 answered, but below the spell's (calibrated) threshold
+    uint32_t shape_skips; // Stage 1 not run: its input shape differs from the full model's
+    uint64_t total_us;  // Whole cascade per cast
+    uint64_t stage1_us; // Sum over casts that ran stage 1
+    uint64_t stage2_us; // Sum over escalated casts (or all casts without stage 1)
+};
+
+class CascadeRecognizer
+{
+private:
+    SpellDetector stage1;
+    char stage1Name[MODEL_NAME_LEN];
+    bool stage1Enabled;
+    float acceptThreshold;
+    const SpellCalibration *calibration; // Same temperature + per-spell thresholds as the full model
+    CascadeStats stats;
+
+    // Result of the last cast (whichever stage answered)
+    const char *lastPrediction;
+    int lastIndex;
+    float lastConfidence;
+    bool lastEscalated;
+
+public:
+    CascadeRecognizer();
+
+    // First-stage model (nullptr disables the cascade: every cast uses the full model)
+    bool setStage1Model(const ModelInfo *info);
+    const char *getStage1Name() const { return stage1Name; }
+    bool isEnabled() const { return stage1Enabled; }
+
+    void setAcceptThreshold(float threshold) { acceptThreshold = threshold; }
+
+    // Stage 1 answers under the full model's calibration and personalization
+    void setCalibration(const SpellCalibration *cal) { calibration = cal; }
+    void setPersonalization(SpellPersonalization *p) { stage1.setPersonalization(p); }
+    float getAcceptThreshold() const { return acceptThreshold; }
+
+    // Run the cascade; same contract as SpellDetector::detect (nullptr below threshold)
+    const char *detect(SpellDetector &full, float *positions,
+                       float confidence_threshold = SPELL_CONFIDENCE_THRESHOLD);
+
+    const char *getLastPrediction() const { return lastPrediction; }
+    int getLastPredictionIndex() const { return lastIndex; }
+    float getConfidence() const { return lastConfidence; }
+    bool wasEscalated() const { return lastEscalated; }
+
+    const CascadeStats &getStats() const { return stats; }
+    void resetStats();
+};
+
+#endif // CASCADE_H
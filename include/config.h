@@ -9,6 +9,11 @@
 // Set to 0 to broadcast all gesture points at full IMU rate (~234Hz)
 #define GESTURE_RATE_LIMIT_ENABLE 0
 
+// WebSocket stream batching
+// Binary gesture points / IMU samples are collected for this long and sent as one frame
+// (0 = one frame per sample). Gesture start and end always flush.
+#define WS_BATCH_WINDOW_MS 25
+
 // Wand BLE UUIDs
 #define WAND_SERVICE_UUID "57420001-587e-48a0-974c-544d6163c577"
 #define WAND_COMMAND_UUID "57420002-587e-48a0-974c-544d6163c577"
@@ -48,6 +53,34 @@
 // MAX_POSITIONS defined in spell_detector.h
 #define SPELL_SAMPLE_COUNT 50
 
+// Cascaded recognition (stage-1 model picked at runtime via POST /cascade)
+// Stage-1 top-1 confidence at or above this skips the full model
+#define CASCADE_ACCEPT_THRESHOLD 0.95f
+
+// Multi-window trimming
+// Set to 1 to retry a low-confidence cast with tighter/looser/shifted trims (best window wins)
+#define MULTI_WINDOW_RETRY 1
+
+// Continuous (button-free) gesture segmentation
+// Set to 1 to also detect gestures from motion energy and pauses without holding the buttons
+// (thresholds in gesture_segmenter.h; the AHRS mouse pauses while a segment is tracked)
+#define CONTINUOUS_SEGMENTATION 0
+
+// Per-user personalization
+// Set to 1 to adjust model scores with the corrected casts of the active user profile
+// (nearest class mean + per-spell bias, stored in NVS; corrections via POST /personalize)
+#define SPELL_PERSONALIZATION 1
+
+// Model loading
+// Set to 1 to memory-map the model partition (zero-copy, works without PSRAM)
+// Set to 0 to always copy the model into PSRAM (also used as fallback if mmap fails)
+#define MODEL_USE_MMAP 1
+
+// Tensor arena placement benchmark
+// Set to 1 to time Invoke() at boot with arena/model in internal RAM, PSRAM and split,
+// then keep the fastest placement that fits (stored in NVS, reused on later boots)
+#define TENSOR_ARENA_BENCHMARK 0
+
 // IMU Sensor Scaling (from Android app)
 #define ACCELEROMETER_SCALE 0.00048828125f // Scale to G-forces
 #define GYROSCOPE_SCALE 0.0010908308f      // Scale to rad/s
@@ -58,6 +91,7 @@
 #define DEBUG_SERIAL true
 #define DEBUG_IMU_DATA false
 #define DEBUG_SPELL_TRACKING true
+#define DEBUG_WEB_REQUESTS false // Log every gesture image request (hit/miss, latency)
 
 // Include custom configuration if it exists (not version controlled)
 // Copy config_custom.h.example to config_custom.h and customize as needed
@@ -0,0 +1,75 @@
+#ifndef CUSTOM_GESTURES_H
+#define CUSTOM_GESTURES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "spell_detector.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// User-recorded gestures matched against GesturePreprocessor output (50 x,y in [0,1])
+#define CUSTOM_GESTURE_FILE "/spiffs/custom_gestures.bin"
+#define CUSTOM_GESTURE_MAX_TEMPLATES 64 // Examples across all gestures (100 bytes each)
+#define CUSTOM_GESTURE_NAME_LEN 24
+
+// Accept a match when the RMS point distance is below this (normalized units)
+#define CUSTOM_GESTURE_MAX_DISTANCE 0.08f
+
+// 0 = point-wise Euclidean nearest neighbour, 1 = DTW with a Sakoe-Chiba band
+#define CUSTOM_GESTURE_USE_DTW 0
+#define CUSTOM_GESTURE_DTW_BAND 5 // Max index shift (points) allowed by DTW
+
+// One stored example: coordinates quantized to 0..255
+struct CustomGestureTemplate
+{
+    char name[CUSTOM_GESTURE_NAME_LEN];
+    uint8_t points[SPELL_INPUT_SIZE];
+};
+
+class CustomGestureEngine
+{
+private:
+    CustomGestureTemplate templates[CUSTOM_GESTURE_MAX_TEMPLATES];
+    size_t count;
+    bool loaded;
+    char recordingName[CUSTOM_GESTURE_NAME_LEN]; // Non-empty: next cast is stored as example
+    char matchedName[CUSTOM_GESTURE_NAME_LEN];   // Copy of last match (templates may be deleted)
+    uint32_t lastMatchUs;
+    SemaphoreHandle_t mutex;
+
+    bool ensureLoaded();
+    bool save();
+
+    // Squared distance in quantized units; returns early (> limit) once it can't win.
+    // Plain scalar integer loop (no SIMD): early abandon is what keeps 64 examples cheap.
+    static uint32_t distance(const uint8_t *a, const uint8_t *b, uint32_t limit);
+
+public:
+    CustomGestureEngine();
+
+    // Best matching gesture name or nullptr; score in [0,1] (1 = identical)
+    const char *match(const float *input, float *out_score);
+
+    // Store an example for a gesture (persists to SPIFFS)
+    bool addExample(const char *name, const float *input);
+
+    // Delete every example of a gesture
+    bool removeGesture(const char *name);
+
+    // Recording mode: the next cast becomes an example for `name` (empty cancels)
+    void armRecording(const char *name);
+    bool isRecording() const { return recordingName[0] != '\0'; }
+
+    // Consume the armed recording name (false if not recording)
+    bool takeRecording(char *name_out);
+    const char *getRecordingName() const { return recordingName; }
+
+    // Distinct gesture names with example counts; returns number written
+    size_t list(char (*names)[CUSTOM_GESTURE_NAME_LEN], uint8_t *counts, size_t max);
+
+    size_t getTemplateCount() const { return count; }
+    uint32_t getLastMatchUs() const { return lastMatchUs; }
+};
+
+#endif // CUSTOM_GESTURES_H
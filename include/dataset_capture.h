@@ -0,0 +1,106 @@
+#ifndef DATASET_CAPTURE_H
+#define DATASET_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "spell_detector.h"
+#include "dataset_format.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Labelled cast capture for retraining: raw tracked positions, the model input tensor,
+// the prediction and an optional label, stored delta-encoded in rolling SPIFFS segment
+// files (format in dataset_format.h). dataset_decode.py reads the download stream.
+#define DATASET_FILE_DIR "/spiffs"
+#define DATASET_FILE_PREFIX "dataset_"
+
+#define DATASET_SEGMENT_SIZE (64 * 1024) // Roll over to a new segment file past this size
+#define DATASET_MAX_SEGMENTS 8           // Oldest segment deleted first (512 KB total)
+#define DATASET_MAX_POSITIONS 1024       // ~4.4 s at 234 Hz; longer casts are truncated
+#define DATASET_STAGE_SIZE (16 * 1024)   // RAM staging buffer (x2); flash writes are whole buffers
+#define DATASET_FLUSH_INTERVAL_MS 5000   // Idle time before a partly filled buffer is written
+#define DATASET_TASK_PRIORITY 1          // Below shadow_eval (2) - flash writes never delay a cast
+#define DATASET_TASK_STACK 4096
+
+struct DatasetStats
+{
+    uint32_t captured; // Records accepted into the staging buffer
+    uint32_t dropped;  // Records lost because both staging buffers were busy
+    uint32_t written;  // Records on flash since boot
+    uint32_t evicted;  // Segment files deleted to stay within DATASET_MAX_SEGMENTS
+    uint32_t write_errors;
+};
+
+// Receives the download stream; return false to abort
+typedef bool (*DatasetChunkFn)(const uint8_t *data, size_t len, void *ctx);
+
+class DatasetCapture
+{
+private:
+    bool enabled;
+    uint8_t label;
+
+    // Cast path encodes into `active`; the writer task swaps and writes `pending`
+    uint8_t *active;
+    uint8_t *pending;
+    size_t activeLen;
+    size_t pendingLen;
+    uint32_t activeRecords;
+    uint32_t pendingRecords;
+    int64_t activeSinceUs; // First record in the active buffer
+
+    // Segment files on SPIFFS
+    uint32_t firstSegment;  // Oldest sequence on flash
+    uint32_t nextSegment;   // Sequence of the segment being appended (not yet created if size 0)
+    size_t segmentBytes;    // Bytes in the segment being appended
+    size_t segmentCount;
+    size_t storedBytes;
+    bool scanned;
+
+    DatasetStats stats;
+
+    SemaphoreHandle_t stageMutex; // Guards the staging buffers (held for microseconds)
+    SemaphoreHandle_t fileMutex;  // Guards segment files (writer vs download/clear)
+    TaskHandle_t task;
+
+    static void taskFunc(void *arg);
+    bool start();
+    bool swapStage();
+    bool scanSegments();
+    void writePending();
+    bool evictOldest();
+    static void segmentPath(uint32_t sequence, char *path, size_t len);
+
+public:
+    DatasetCapture();
+
+    // First enable allocates the staging buffers and starts the writer task
+    bool setEnabled(bool on);
+    bool isEnabled() const { return enabled; }
+
+    // Label applied to following casts until changed (DATASET_LABEL_NONE = unlabelled)
+    void setLabel(uint8_t spell_index) { label = spell_index; }
+    uint8_t getLabel() const { return label; }
+
+    // Queue one cast (non-blocking; dropped if both staging buffers are busy)
+    void capture(const Position2D *positions, size_t position_count,
+                 const float *input, size_t input_size,
+                 int predicted_index, float confidence, bool recognized);
+
+    // Write staged records now (blocks on flash; not for the cast path)
+    void flush();
+
+    // Stream every segment oldest-first (flushes staged records first)
+    bool download(DatasetChunkFn fn, void *ctx);
+
+    // Delete every segment file
+    bool clear();
+
+    const DatasetStats &getStats() const { return stats; }
+    size_t getSegmentCount() const { return segmentCount; }
+    size_t getStoredBytes() const { return storedBytes; }
+};
+
+#endif // DATASET_CAPTURE_H
@@ -0,0 +1,46 @@
+#ifndef DATASET_FORMAT_H
+#define DATASET_FORMAT_H
+
+#include <stdint.h>
+
+// On-flash / download format of dataset capture (src/dataset_capture.cpp writes it,
+// dataset_decode.py and tools/session_eval read it).
+//
+// Segment file (dataset_NNNNNNNN.bin, little-endian):
+//   DatasetSegmentHeader
+//   n x { DatasetRecordHeader, tensor_size x uint16 (value * 65535),
+//         position_count x (x, y) zigzag varints - first point absolute, then deltas,
+//         in 1/DATASET_POSITION_SCALE mm }
+// GET /dataset/download streams every segment oldest-first.
+#define DATASET_MAGIC 0x43534457 // "WDSC"
+#define DATASET_VERSION 1
+#define DATASET_POSITION_SCALE 10 // Positions stored in 0.1 mm units
+
+#define DATASET_LABEL_NONE 0xFF // No user label / no prediction
+
+// DatasetRecordHeader.flags
+#define DATASET_FLAG_RECOGNIZED 0x01 // A spell (or custom gesture) fired for this cast
+#define DATASET_FLAG_TRUNCATED 0x02  // More than DATASET_MAX_POSITIONS positions were tracked
+
+struct __attribute__((packed)) DatasetSegmentHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t position_scale; // DATASET_POSITION_SCALE
+    uint32_t sequence;       // Segment number (increasing)
+};
+
+struct __attribute__((packed)) DatasetRecordHeader
+{
+    uint16_t size;           // Bytes following this header
+    uint8_t label;           // User label (index into SPELL_NAMES) or DATASET_LABEL_NONE
+    uint8_t predicted;       // Model top-1 (index into SPELL_NAMES) or DATASET_LABEL_NONE
+    uint16_t confidence;     // Top-1 confidence * 65535
+    uint8_t flags;           // DATASET_FLAG_*
+    uint8_t reserved;
+    uint16_t tensor_size;    // Model input floats
+    uint16_t position_count; // Stored positions
+    uint32_t timestamp_ms;   // Since boot
+};
+
+#endif // DATASET_FORMAT_H
@@ -0,0 +1,63 @@
+#ifndef GESTURE_ATLAS_H
+#define GESTURE_ATLAS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_partition.h"
+
+// All gesture PNGs packed into the "gestures" data partition (subtype 0x41, see
+// tools/pack_gestures.py) and served straight from memory-mapped flash - no filesystem.
+// Layout (little-endian): GestureAtlasHeader, then `count` GestureAtlasEntry records
+// sorted by name, then the PNG bytes at the offsets listed in the entries (4-byte aligned).
+#define GESTURE_ATLAS_MAGIC 0x54414757 // "WGAT" little-endian
+#define GESTURE_ATLAS_VERSION 1
+#define GESTURE_ATLAS_SUBTYPE 0x41
+#define GESTURE_ATLAS_MAX_IMAGES 128
+#define GESTURE_ATLAS_NAME_LEN 32 // SPIFFS file name limit, NUL included
+
+struct __attribute__((packed)) GestureAtlasHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t total_size; // Header + entries + images (the mapped extent)
+    uint32_t reserved;
+    uint64_t hash;       // FNV-1a 64 of bytes [sizeof(header), total_size) - ETag of the whole atlas
+};
+
+struct __attribute__((packed)) GestureAtlasEntry
+{
+    char name[GESTURE_ATLAS_NAME_LEN]; // File name, e.g. "accio.png"
+    uint32_t offset;                   // From partition start
+    uint32_t size;
+    uint64_t hash;                     // FNV-1a 64 of the PNG - same ETag as the SPIFFS copy
+};
+
+class GestureAtlas
+{
+private:
+    const uint8_t *base; // Mapped partition (nullptr if absent or invalid)
+    const GestureAtlasHeader *header;
+    const GestureAtlasEntry *entries;
+    esp_partition_mmap_handle_t mmapHandle;
+
+public:
+    GestureAtlas();
+
+    // Find, validate and map the partition; false if there is no valid atlas
+    bool begin();
+    bool isLoaded() const { return base != nullptr; }
+
+    // Image by file name (binary search), or nullptr
+    const GestureAtlasEntry *find(const char *name) const;
+
+    const uint8_t *data(const GestureAtlasEntry *entry) const { return base + entry->offset; }
+    const uint8_t *image() const { return base; }
+    size_t size() const { return header ? header->total_size : 0; }
+    uint64_t hash() const { return header ? header->hash : 0; }
+    size_t count() const { return header ? header->count : 0; }
+    const GestureAtlasEntry *entry(size_t index) const { return &entries[index]; }
+};
+
+#endif // GESTURE_ATLAS_H
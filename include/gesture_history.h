@@ -0,0 +1,140 @@
+#ifndef GESTURE_HISTORY_H
+#define GESTURE_HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "spell_detector.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// In-memory ring of the last casts for after-the-fact diagnosis and on-device replay:
+// raw tracked positions, the model input tensor, the top-K result and stage timings.
+// Lives in PSRAM (a couple of entries in internal RAM without it) and is lost on reboot.
+//
+// Download (GET /history/download, little-endian):
+//   GestureHistoryFileHeader
+//   up to max_entry_count x { GestureHistoryRecord, position_count x (float x, float y) mm,
+//                             tensor_size x float }
+// Records are oldest-first; ids increase by one per cast since boot. max_entry_count is the
+// ring as of the start of the download; records evicted by casts during it are left out,
+// so read records until the stream ends rather than counting them.
+#define GESTURE_HISTORY_MAGIC 0x48534757 // "WGSH"
+#define GESTURE_HISTORY_VERSION 1
+
+#ifndef GESTURE_HISTORY_DEPTH
+#define GESTURE_HISTORY_DEPTH 16 // Entries kept in PSRAM (~9 KB each)
+#endif
+#define GESTURE_HISTORY_NO_PSRAM_DEPTH 2   // Entries kept when only internal RAM is available
+#define GESTURE_HISTORY_MAX_POSITIONS 1024 // ~4.4 s at 234 Hz; longer casts are truncated
+#define GESTURE_HISTORY_TOP_K 5
+#define GESTURE_REPLAY_MAX_RUNS 50 // Replays timed per request
+
+#define GESTURE_HISTORY_NO_SPELL 0xFF // Unused top-K slot
+
+// GestureHistoryRecord.flags
+#define GESTURE_HISTORY_FLAG_RECOGNIZED 0x01  // A spell (or custom gesture) fired
+#define GESTURE_HISTORY_FLAG_TRUNCATED 0x02   // More than GESTURE_HISTORY_MAX_POSITIONS positions
+#define GESTURE_HISTORY_FLAG_NO_TENSOR 0x04   // Preprocessing rejected the path (too short/no motion)
+#define GESTURE_HISTORY_FLAG_STAGE1 0x08      // Answered by the cascade's first stage (top-1 only)
+#define GESTURE_HISTORY_FLAG_RESCUED 0x10     // Recognized through an alternate trim window
+#define GESTURE_HISTORY_FLAG_CUSTOM 0x20      // A custom gesture matched and replaced the model result
+
+struct __attribute__((packed)) GestureHistoryFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t max_entry_count; // Upper bound - see above
+    uint8_t top_k;        // GESTURE_HISTORY_TOP_K
+    uint8_t reserved[3];
+};
+
+struct __attribute__((packed)) GestureHistoryRecord
+{
+    uint32_t id;
+    uint32_t timestamp_ms;   // Cast finished, since boot
+    uint32_t duration_ms;    // Tracked path length in time (positions x IMU period)
+    uint32_t preprocess_us;  // Trim + resample of every window
+    uint32_t detect_us;      // Model(s), including alternate windows
+    uint32_t custom_us;      // Custom gesture matching
+    uint16_t position_count; // Stored positions
+    uint16_t tensor_size;    // Model input floats (0 if preprocessing failed)
+    uint8_t flags;           // GESTURE_HISTORY_FLAG_*
+    uint8_t window_count;    // Trim windows produced
+    uint8_t top_index[GESTURE_HISTORY_TOP_K]; // Index into SPELL_NAMES, best first
+    float top_score[GESTURE_HISTORY_TOP_K];   // Calibrated probability
+};
+
+// One ring slot; positions/tensor are fixed-size so slots never reallocate
+struct GestureHistoryEntry
+{
+    GestureHistoryRecord record;
+    Position2D positions[GESTURE_HISTORY_MAX_POSITIONS];
+    float tensor[SPELL_INPUT_MAX_SIZE];
+};
+
+struct GestureHistoryStats
+{
+    uint32_t recorded; // Casts stored since boot
+    uint32_t dropped;  // Casts lost because a reader held the ring
+};
+
+// Outcome of re-running a stored cast through the current preprocessor + model
+struct GestureReplayResult
+{
+    uint32_t id;
+    uint16_t runs;
+    const char *spell;       // Accepted spell of the last run (nullptr below threshold)
+    int predicted;           // Top-1 index of the last run (-1 if preprocessing failed)
+    float confidence;
+    uint8_t top_index[GESTURE_HISTORY_TOP_K];
+    float top_score[GESTURE_HISTORY_TOP_K];
+    uint16_t tensor_size;
+    float tensor_max_diff;   // Largest difference to the stored tensor (-1: not comparable)
+    uint32_t preprocess_us_min, preprocess_us_avg, preprocess_us_max;
+    uint32_t detect_us_min, detect_us_avg, detect_us_max;
+};
+
+// Receives the download stream; return false to abort
+typedef bool (*GestureHistoryChunkFn)(const uint8_t *data, size_t len, void *ctx);
+
+class GestureHistory
+{
+private:
+    GestureHistoryEntry *entries;
+    size_t depth;      // Slots allocated (0 until the first cast)
+    size_t count;      // Slots filled
+    size_t next;       // Slot the next cast goes to
+    uint32_t nextId;
+    bool allocFailed;
+    GestureHistoryStats stats;
+    SemaphoreHandle_t mutex; // Held for one entry copy at a time
+
+    bool allocate();
+    int slotOf(uint32_t id) const; // -1 if not held (mutex held)
+
+public:
+    GestureHistory();
+
+    // Store one cast (cast path: never waits, drops the entry if a reader holds the ring)
+    void record(const Position2D *positions, size_t position_count,
+                const float *tensor, size_t tensor_size, const GestureHistoryRecord &result);
+
+    // Copy of the entry with this id; false if it was never recorded or has been overwritten
+    bool get(uint32_t id, GestureHistoryEntry *out);
+
+    // Just the record (no positions/tensor) of the entry with this id
+    bool getRecord(uint32_t id, GestureHistoryRecord *out);
+
+    // Id range currently held (first > last when empty)
+    uint32_t firstId();
+    uint32_t lastId() { return nextId - 1; }
+
+    // Stream header + every entry oldest-first
+    bool download(GestureHistoryChunkFn fn, void *ctx);
+
+    size_t getDepth() const { return depth; }
+    const GestureHistoryStats &getStats() const { return stats; }
+};
+
+#endif // GESTURE_HISTORY_H
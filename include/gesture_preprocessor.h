@@ -0,0 +1,276 @@
+#ifndef GESTURE_PREPROCESSOR_H
+#define GESTURE_PREPROCESSOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "esp_log.h"
+#include "spell_detector.h"
+
+// Gesture Preprocessor - normalizes positions for model input
+// Matches the Python spell_tracker.py implementation for the default [1, 50, 2] model:
+// 1. Calculate bounding box from ALL data first
+// 2. Trim stationary segments (head and tail)
+// 3. Resample to N points WITH normalization (Python-style)
+//
+// Sample count, channels, interpolation and trim policy are template parameters so the
+// loops are fixed-size; SpellDetector picks the instantiation matching the model input.
+
+enum class PreprocessInterp : uint8_t
+{
+    NEAREST, // Python: idx = int(sample_pos)
+    LINEAR,  // Blend the two neighbouring positions
+};
+
+// Python trim constants (_CONST_MILLIMETERMOVETHRESHOLD and the 40/10/120 sample strides)
+struct PythonTrimPolicy
+{
+    static constexpr float THRESHOLD_MM = 8.0f; // Movement below this counts as stationary
+    static constexpr size_t TAIL_LOOKBACK = 40; // Tail compares points this far apart
+    static constexpr size_t STEP = 10;          // Trim granularity (also head comparison distance)
+    static constexpr size_t MIN_POINTS = 120;   // Never trim below this many points
+    static constexpr size_t MIN_INPUT = 100;    // Casts with fewer positions are rejected
+};
+
+template <size_t Samples, size_t Channels = 2,
+          PreprocessInterp Interp = PreprocessInterp::NEAREST,
+          typename TrimPolicy = PythonTrimPolicy>
+class GesturePreprocessorT
+{
+    static_assert(Samples > 1, "need at least two samples");
+    static_assert(Channels == 2, "channels are x and y");
+
+public:
+    static constexpr size_t INPUT_SIZE = Samples * Channels;
+
+    // Preprocess positions: trim, resample, normalize to [0,1]
+    static bool preprocess(const Position2D *input, size_t input_count,
+                           float *output, size_t output_size)
+    {
+        if (!input || !output || output_size != INPUT_SIZE)
+        {
+            ESP_LOGW("preprocess", "Invalid parameters for preprocess");
+            return false;
+        }
+
+        return preprocessWindows(input, input_count, output, nullptr, 1) == 1;
+    }
+
+    // Same as preprocess() but for up to max_windows trim variants (window 0 = preprocess())
+    // outputs holds max_windows * INPUT_SIZE floats; duplicate windows are skipped and
+    // window_ids (optional) receives the id of each produced window. Returns the window count.
+    static size_t preprocessWindows(const Position2D *input, size_t input_count,
+                                    float *outputs, uint8_t *window_ids, size_t max_windows)
+    {
+        // Trim variants per cast (ids match PREPROCESS_WINDOW_NAMES): base, tight, loose, shifted
+        static constexpr float THRESHOLD_SCALE[PREPROCESS_MAX_WINDOWS] = {1.0f, 1.5f, 0.5f, 1.0f};
+        static constexpr int SHIFT_STEPS[PREPROCESS_MAX_WINDOWS] = {0, 0, 0, -1};
+
+        if (!input || !outputs || max_windows == 0)
+        {
+            ESP_LOGW("preprocess", "Invalid parameters for preprocess");
+            return 0;
+        }
+        if (max_windows > PREPROCESS_MAX_WINDOWS)
+            max_windows = PREPROCESS_MAX_WINDOWS;
+
+        // Python: positions: np.ndarray = self._state.positions
+        // Python: position_count: int = self._state.position_count
+        const Position2D *positions = input;
+        size_t position_count = input_count;
+
+        // Python Phase 1: Calculate bounding box (min/max X and Y) - lines 335-352
+        // Shared by every window: normalization always uses the full gesture
+        float min_x = INFINITY;  // Python: np.float32(np.inf)
+        float max_x = -INFINITY; // Python: np.float32(-np.inf)
+        float min_y = INFINITY;  // Python: np.float32(np.inf)
+        float max_y = -INFINITY; // Python: np.float32(-np.inf)
+
+        for (size_t i = 0; i < position_count; i++)
+        {
+            float x = positions[i].x; // Python: x: np.float32 = positions[i, 0]
+            float y = positions[i].y; // Python: y: np.float32 = positions[i, 1]
+
+            if (x < min_x)
+                min_x = x;
+            if (x > max_x)
+                max_x = x;
+            if (y < min_y)
+                min_y = y;
+            if (y > max_y)
+                max_y = y;
+        }
+
+        // Python lines 354-356: Compute bounding box size (larger of width or height)
+        float width = max_x - min_x;
+        float height = max_y - min_y;
+        float bbox_size = fmaxf(width, height); // Python: np.maximum(width, height)
+
+        // Python Phase 2: Early exit checks (lines 358-363)
+        if (bbox_size <= 0.0f) // Python: if bbox_size <= SpellTracker._CONST_0_0
+        {
+            ESP_LOGW("preprocess", "No movement detected");
+            return 0; // Python: return -1
+        }
+
+        if (position_count < TrimPolicy::MIN_INPUT) // Python: if position_count <= 99
+        {
+            ESP_LOGW("preprocess", "Not enough data points: %zu (need >= %zu)", position_count, TrimPolicy::MIN_INPUT);
+            return 0; // Python: return -2
+        }
+
+        size_t starts[PREPROCESS_MAX_WINDOWS];
+        size_t ends[PREPROCESS_MAX_WINDOWS];
+        size_t produced = 0;
+
+        for (size_t w = 0; w < max_windows; w++)
+        {
+            size_t start_index, end_index;
+            trimStationary(positions, position_count, TrimPolicy::THRESHOLD_MM * THRESHOLD_SCALE[w],
+                           start_index, end_index);
+
+            if (SHIFT_STEPS[w] < 0)
+            {
+                size_t back = (size_t)-SHIFT_STEPS[w] * TrimPolicy::STEP;
+                if (back > start_index)
+                    back = start_index;
+                start_index -= back;
+                end_index -= back;
+            }
+            else if (SHIFT_STEPS[w] > 0)
+            {
+                size_t forward = (size_t)SHIFT_STEPS[w] * TrimPolicy::STEP;
+                if (forward > position_count - end_index)
+                    forward = position_count - end_index;
+                start_index += forward;
+                end_index += forward;
+            }
+
+            // Identical trims give identical model input - don't spend an inference on them
+            bool duplicate = false;
+            for (size_t j = 0; j < produced; j++)
+            {
+                if (starts[j] == start_index && ends[j] == end_index)
+                {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (duplicate)
+                continue;
+
+            starts[produced] = start_index;
+            ends[produced] = end_index;
+            resampleWindow(positions, position_count, start_index, end_index,
+                           min_x, min_y, bbox_size, outputs + produced * INPUT_SIZE);
+            if (window_ids)
+                window_ids[produced] = (uint8_t)w;
+            produced++;
+        }
+
+        return produced;
+    }
+
+private:
+    // Python Phases 3-4: trim stationary tail and head for one movement threshold
+    static void trimStationary(const Position2D *positions, size_t position_count, float threshold_mm,
+                               size_t &start_index, size_t &end_index)
+    {
+        // Python Phase 3: Trim stationary tail (end of gesture) - lines 365-381
+        float threshold_sq = threshold_mm * threshold_mm; // Python: _CONST_MILLIMETERMOVETHRESHOLD * _CONST_MILLIMETERMOVETHRESHOLD
+        end_index = position_count;
+
+        if (threshold_sq > 0.0f) // Python: if threshold_sq > SpellTracker._CONST_0_0
+        {
+            while (end_index > TrimPolicy::MIN_POINTS) // Python: while end_index >= 121: (0x79 = 121)
+            {
+                // Python: Compare points 40 apart from the end
+                size_t curr_idx = end_index - 1;
+                size_t prev_idx = curr_idx - TrimPolicy::TAIL_LOOKBACK;
+
+                float dx = positions[curr_idx].x - positions[prev_idx].x;
+                float dy = positions[curr_idx].y - positions[prev_idx].y;
+                float dist_sq = dx * dx + dy * dy;
+
+                if (dist_sq >= threshold_sq)
+                    break;
+
+                end_index -= TrimPolicy::STEP;
+            }
+        }
+
+        // Python Phase 4: Trim stationary head (start of gesture) - lines 383-400
+        start_index = 0;
+
+        if (threshold_sq > 0.0f && end_index > TrimPolicy::MIN_POINTS) // Python: if threshold_sq > 0.0 and end_index > 120
+        {
+            while (start_index < end_index - TrimPolicy::MIN_POINTS) // Python: Keep at least 120 points
+            {
+                // Python: Compare points 10 apart from the start
+                size_t curr_idx = start_index;
+                size_t next_idx = curr_idx + TrimPolicy::STEP;
+
+                float dx = positions[next_idx].x - positions[curr_idx].x;
+                float dy = positions[next_idx].y - positions[curr_idx].y;
+                float dist_sq = dx * dx + dy * dy;
+
+                if (dist_sq >= threshold_sq)
+                    break;
+
+                start_index += TrimPolicy::STEP;
+            }
+        }
+    }
+
+    // Python Phase 5: Resample [start_index, end_index) to Samples normalized points - lines 402-425
+    static void resampleWindow(const Position2D *positions, size_t position_count,
+                               size_t start_index, size_t end_index,
+                               float min_x, float min_y, float bbox_size, float *output)
+    {
+        // Python lines 402-404: Adjust indices for resampling
+        float start_float = (float)(start_index + 1); // Python: np.float32(start_index + 1)
+        size_t trimmed_count = end_index - start_index;
+
+        float step = (float)trimmed_count / (float)Samples; // Python: np.float32(trimmed_count) / np.float32(50.0)
+        float inv_bbox = 1.0f / bbox_size;
+
+        float sample_pos = start_float;
+        for (size_t i = 0; i < Samples; i++) // Python: for i in range(50)
+        {
+            size_t idx = (size_t)sample_pos; // Python: idx = int(sample_pos)
+
+            // Python: Clamp index to valid range
+            if (idx >= position_count)
+                idx = position_count - 1;
+            // Note: size_t is unsigned, no need to check < 0 (Python does: if idx < 0: idx = 0)
+
+            float x = positions[idx].x;
+            float y = positions[idx].y;
+            if (Interp == PreprocessInterp::LINEAR && idx + 1 < position_count)
+            {
+                float frac = sample_pos - (float)idx;
+                x += (positions[idx + 1].x - x) * frac;
+                y += (positions[idx + 1].y - y) * frac;
+            }
+
+            // Python: Normalize to [0, 1] based on bounding box
+            if (Interp == PreprocessInterp::NEAREST)
+            {
+                output[i * Channels] = (x - min_x) / bbox_size;     // Python: pos_inputs[i, 0]
+                output[i * Channels + 1] = (y - min_y) / bbox_size; // Python: pos_inputs[i, 1]
+            }
+            else
+            {
+                output[i * Channels] = (x - min_x) * inv_bbox;
+                output[i * Channels + 1] = (y - min_y) * inv_bbox;
+            }
+
+            sample_pos += step;
+        }
+    }
+};
+
+// The production [1, 50, 2] model: bit-exact with the Python implementation
+using GesturePreprocessor = GesturePreprocessorT<SPELL_SAMPLE_COUNT, 2, PreprocessInterp::NEAREST, PythonTrimPolicy>;
+
+#endif // GESTURE_PREPROCESSOR_H
@@ -0,0 +1,89 @@
+#ifndef GESTURE_SEGMENTER_H
+#define GESTURE_SEGMENTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spell_detector.h"
+#include "config.h"
+
+// Button-free gesture segmentation: watches gyro motion energy on the continuous IMU
+// stream, opens a segment when the wand starts moving and closes it on a pause.
+// Closed segments pass a cheap gate (duration, mean energy) before the model runs.
+// Sample counts assume ~234 Hz (IMU_SAMPLE_PERIOD).
+#ifndef SEGMENT_START_ENERGY
+#define SEGMENT_START_ENERGY 1.5f    // Smoothed |gyro| (rad/s) that opens a segment
+#endif
+#ifndef SEGMENT_STOP_ENERGY
+#define SEGMENT_STOP_ENERGY 0.5f     // Below this counts as pausing
+#endif
+#define SEGMENT_START_SAMPLES 5      // Consecutive samples above start energy (~20 ms)
+#define SEGMENT_PAUSE_SAMPLES 60     // Pause that closes a segment (~250 ms)
+#define SEGMENT_MIN_SAMPLES 105      // Shorter segments are rejected (~450 ms, preprocessor needs 100)
+#define SEGMENT_MAX_SAMPLES 700      // Longer segments are aborted (~3 s)
+#define SEGMENT_COOLDOWN_SAMPLES 117 // Ignore motion after a segment (~500 ms, wand return)
+#define SEGMENT_MIN_MEAN_ENERGY 1.0f // Gate: mean |gyro| over the active part of a segment
+#define SEGMENT_ENERGY_ALPHA 0.2f    // EMA weight of the newest sample
+#ifndef SEGMENT_MIN_EXTENT
+#define SEGMENT_MIN_EXTENT 40.0f     // Gate: bounding box side of the tracked path (position units)
+#endif
+
+enum SegmentEvent : uint8_t
+{
+    SEGMENT_NONE = 0,
+    SEGMENT_START,    // Start tracking positions
+    SEGMENT_END,      // Segment closed and passed the gate - run recognition
+    SEGMENT_REJECTED, // Segment closed but failed the gate - discard positions
+    SEGMENT_ABORTED   // Segment ran too long - discard positions
+};
+
+struct SegmenterStats
+{
+    uint32_t started;   // Segments opened
+    uint32_t evaluated; // Passed the gate, went to preprocess/detect
+    uint32_t rejected;  // Failed the gate (too short / too little energy)
+    uint32_t aborted;   // Exceeded SEGMENT_MAX_SAMPLES
+    uint32_t recognized; // Evaluated segments that produced a spell
+};
+
+class GestureSegmenter
+{
+private:
+    enum State : uint8_t
+    {
+        IDLE,
+        ACTIVE,
+        COOLDOWN
+    };
+
+    State state;
+    float energy;          // EMA of |gyro|
+    uint16_t run;          // Consecutive samples above start / below stop energy
+    uint16_t length;       // Samples in the current segment
+    uint16_t cooldown;
+    float energySum;       // For the mean-energy gate
+    float pauseSum;        // Energy of the trailing pause (excluded from the gate)
+    SegmenterStats stats;
+
+public:
+    GestureSegmenter();
+
+    // Feed one IMU sample; returns what the caller should do with position tracking
+    SegmentEvent update(const IMUSample &sample);
+
+    // Drop any open segment (e.g. buttons took over tracking)
+    void reset();
+
+    bool isActive() const { return state == ACTIVE; }
+    float getEnergy() const { return energy; }
+
+    // Outcome of an evaluated segment reported back by the caller
+    void countRecognized() { stats.recognized++; }
+    void countGateRejected()
+    {
+        stats.evaluated--;
+        stats.rejected++;
+    }
+    const SegmenterStats &getStats() const { return stats; }
+};
+
+#endif // GESTURE_SEGMENTER_H
@@ -13,6 +13,7 @@ private:
     bool connected;
     char chip_id[16];                // Store chip ID for topic paths
     void (*on_connected_callback)(); // Callback when MQTT connects
+    void (*on_model_select_callback)(const char *model_name); // wand/<id>/model/set received
 
     // MQTT event handler
     static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
@@ -41,11 +42,17 @@ public:
     // Publish wand disconnected status
     bool publishWandDisconnected();
 
+    // Publish active model name (retained)
+    bool publishModel(const char *model_name);
+
     // Check if connected to MQTT broker
     bool isConnected() const { return connected; }
 
     // Set callback for when MQTT connects
     void onConnected(void (*callback)()) { on_connected_callback = callback; }
+
+    // Set callback for model switch requests (payload of wand/<id>/model/set)
+    void onModelSelect(void (*callback)(const char *model_name)) { on_model_select_callback = callback; }
 };
 
 #endif // HA_MQTT_H
@@ -0,0 +1,67 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Size-bounded LRU cache of gesture image bytes, so gallery loads skip the SPIFFS
+// open/read after the first request. Entries are keyed on file size and mtime, so the
+// stat each request still does catches a replaced file. Buffers live in PSRAM when present.
+// Used from the httpd task only (handlers run one at a time), so there is no locking.
+#define IMAGE_CACHE_MAX_BYTES (1024 * 1024)   // Upper bound of cached bytes (PSRAM)
+#define IMAGE_CACHE_PSRAM_SHARE 4             // ...and at most 1/4 of the free PSRAM at first use
+#define IMAGE_CACHE_NO_PSRAM_BYTES (64 * 1024) // Budget in internal RAM when there is no PSRAM
+#define IMAGE_CACHE_MAX_ENTRIES 80            // 70 spell images + headroom
+#define IMAGE_CACHE_MAX_ITEM (64 * 1024)      // Larger files are streamed, not cached
+#define IMAGE_CACHE_NAME_LEN 48
+
+struct ImageCacheEntry
+{
+    char name[IMAGE_CACHE_NAME_LEN];
+    uint8_t *data;
+    size_t size;
+    int64_t mtime; // File st_mtime when loaded
+    char etag[20]; // Quoted FNV-1a 64 of the bytes
+    uint32_t last_used;
+};
+
+struct ImageCacheStats
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t invalidated; // Entries dropped because the file changed size or mtime
+    uint32_t uncacheable; // Too large or no memory: streamed from SPIFFS
+};
+
+class ImageCache
+{
+private:
+    ImageCacheEntry entries[IMAGE_CACHE_MAX_ENTRIES];
+    size_t count;
+    size_t bytes;
+    size_t budget; // 0 until the first load
+    uint32_t tick;
+    ImageCacheStats stats;
+
+    void removeAt(size_t index);
+    void evictOldest();
+
+public:
+    ImageCache();
+
+    // Cached image (marked most recently used) or nullptr; an entry whose file has
+    // since changed size or mtime is dropped
+    const ImageCacheEntry *find(const char *name, size_t size, int64_t mtime);
+
+    // Read a file of `size` bytes into the cache, evicting least recently used images;
+    // nullptr if it can't be cached (caller streams it instead)
+    const ImageCacheEntry *load(const char *name, const char *path, size_t size, int64_t mtime);
+
+    const ImageCacheStats &getStats() const { return stats; }
+    size_t getBytes() const { return bytes; }
+    size_t getBudget() const { return budget; }
+    size_t getCount() const { return count; }
+};
+
+#endif // IMAGE_CACHE_H
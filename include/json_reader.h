@@ -0,0 +1,93 @@
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Incremental JSON reader for request bodies, the counterpart of JsonWriter.
+// Bytes are fed in whatever chunks httpd_req_recv returns; the reader keeps only the
+// current key and scalar value, so the body is never buffered. Scalars that are direct
+// members of the top-level object are reported with index -1, elements of a top-level
+// member array with their position. Deeper values are validated but not reported.
+#define JSON_READER_MAX_DEPTH 16
+#define JSON_READER_KEY_LEN 32
+#define JSON_READER_VALUE_LEN 128
+
+enum JsonValueType : uint8_t
+{
+    JSON_VALUE_STRING,
+    JSON_VALUE_NUMBER,
+    JSON_VALUE_TRUE,
+    JSON_VALUE_FALSE,
+    JSON_VALUE_NULL
+};
+
+// value is NUL-terminated (decoded for strings, the literal text otherwise)
+typedef void (*JsonValueHandler)(const char *key, int index, JsonValueType type,
+                                 const char *value, size_t len, void *ctx);
+
+class JsonReader
+{
+private:
+    enum State : uint8_t
+    {
+        VALUE,
+        VALUE_OR_END, // After '['
+        KEY_OR_END,   // After '{'
+        KEY,
+        COLON,
+        AFTER_VALUE,
+        STRING,
+        STRING_ESCAPE,
+        STRING_UNICODE,
+        TOKEN,
+        DONE,
+        FAILED
+    };
+
+    JsonValueHandler handler;
+    void *handlerCtx;
+    State state;
+    uint8_t depth;
+    uint32_t arrays; // Bit per nesting level: the container there is an array
+    bool stringIsKey;
+    bool keyValid;   // Key fitted in the buffer (longer keys cannot match anything)
+    bool overflow;   // Current value did not fit
+    char key[JSON_READER_KEY_LEN];
+    size_t keyLen;
+    char value[JSON_READER_VALUE_LEN];
+    size_t valueLen;
+    int index;
+    uint32_t codepoint;
+    uint8_t hexDigits;
+    uint32_t highSurrogate;
+    size_t consumed;
+    size_t skippedCount;
+
+    bool isArray(uint8_t level) const { return (arrays >> level) & 1u; }
+    bool reportable() const;
+    bool push(bool array);
+    void pop();
+    void afterValue();
+    void appendString(char c);
+    void appendCodepoint(uint32_t cp);
+    void emit(JsonValueType type);
+    bool finishToken();
+    void fail();
+    bool step(char c);
+
+public:
+    JsonReader(JsonValueHandler handler, void *ctx = nullptr);
+
+    // Returns false once the input is not valid JSON; later calls keep failing
+    bool feed(const char *data, size_t len);
+    // End of input: true if a complete document was read
+    bool finish();
+
+    bool ok() const { return state != FAILED; }
+    size_t offset() const { return consumed; }      // Bytes accepted (error position after a failure)
+    size_t skipped() const { return skippedCount; } // Reportable values too long for the buffers
+};
+
+#endif // JSON_READER_H
@@ -0,0 +1,74 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Streaming JSON writer shared by the web handlers, WebSocket broadcasts and MQTT payloads.
+// Writes into a caller-owned buffer (usually on the stack); with a sink the buffer is
+// flushed whenever it fills, so a response of any size needs only that buffer. Without a
+// sink the buffer is the whole document and ok() reports whether it fit.
+// Strings are escaped inline: quotes, backslashes and control characters are escaped,
+// invalid UTF-8 is dropped (wand/BLE names arrive unvalidated). Numbers are formatted
+// without printf (newlib's float printf allocates), except doubles beyond 2^53.
+#define JSON_WRITER_MAX_DEPTH 16
+
+// Receives each full buffer (and the tail on flush()); false aborts the document
+typedef bool (*JsonSink)(const char *data, size_t len, void *ctx);
+
+class JsonWriter
+{
+private:
+    char *buffer;
+    size_t capacity; // One byte is kept back for c_str()'s NUL
+    size_t len;
+    JsonSink sink;
+    void *sinkCtx;
+    uint32_t hasItems; // Bit per nesting level: a value was written there (comma needed)
+    uint8_t depth;
+    bool failed;       // Overflow without a sink, or the sink gave up
+    bool didFlush;
+
+    void put(const char *data, size_t n);
+    void putChar(char c);
+    void putEscaped(const char *value, size_t n);
+    void putUnsigned(unsigned long long value, bool negative);
+    void beginValue(const char *key);
+
+public:
+    JsonWriter(char *buffer, size_t size, JsonSink sink = nullptr, void *ctx = nullptr);
+
+    // key is nullptr for array elements and the top-level value
+    void beginObject(const char *key = nullptr);
+    void endObject();
+    void beginArray(const char *key = nullptr);
+    void endArray();
+
+    void field(const char *key, const char *value); // nullptr writes null
+    void field(const char *key, const char *value, size_t n);
+    void field(const char *key, bool value);
+    void field(const char *key, int value);
+    void field(const char *key, unsigned value);
+    void field(const char *key, long value);
+    void field(const char *key, unsigned long value);
+    void field(const char *key, long long value);
+    void field(const char *key, unsigned long long value);
+    void field(const char *key, double value, int decimals = 3); // Fixed point; NaN/inf write null
+    void fieldNull(const char *key);
+    void fieldRaw(const char *key, const char *json); // Pre-formatted JSON value, copied verbatim
+
+    template <typename T>
+    void item(T value) { field(nullptr, value); }
+    void item(double value, int decimals) { field(nullptr, value, decimals); }
+
+    // Hand what is buffered to the sink
+    bool flush();
+
+    bool ok() const { return !failed; }
+    bool flushed() const { return didFlush; }
+    size_t length() const { return len; }
+    const char *c_str(); // NUL-terminated buffer contents (sink-less documents)
+};
+
+#endif // JSON_WRITER_H
@@ -0,0 +1,74 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Multi-model header table at the start of the "model" partition
+// Layout: ModelRegistryHeader, then `count` ModelRegistryEntry records, then the
+// .tflite flatbuffers at the offsets listed in the entries (see pack_models.py).
+// A partition without the magic is treated as a single legacy model at offset 0.
+#define MODEL_REGISTRY_MAGIC 0x4C444D57 // "WMDL" little-endian
+#define MODEL_REGISTRY_VERSION 1
+#define MODEL_REGISTRY_MAX_MODELS 8
+#define MODEL_NAME_LEN 24
+
+struct __attribute__((packed)) ModelRegistryHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+};
+
+struct __attribute__((packed)) ModelRegistryEntry
+{
+    char name[MODEL_NAME_LEN]; // NUL-terminated model name
+    uint32_t offset;           // Flatbuffer offset from partition start (16-byte aligned)
+    uint32_t size;             // Flatbuffer size in bytes
+    uint16_t input_samples;    // Input shape [1, samples, channels]
+    uint16_t input_channels;
+    uint16_t output_classes;
+    uint16_t reserved;
+    uint32_t crc32;            // esp_rom_crc32_le(0, data, size)
+};
+
+// Resolved model entry (pointers into the mapped/copied partition)
+struct ModelInfo
+{
+    char name[MODEL_NAME_LEN];
+    const unsigned char *data;
+    size_t size;
+    uint16_t input_samples;
+    uint16_t input_channels;
+    uint16_t output_classes;
+    uint32_t crc32;
+    bool crc_checked; // CRC verified once on first selection
+};
+
+class ModelRegistry
+{
+private:
+    ModelInfo models[MODEL_REGISTRY_MAX_MODELS];
+    size_t count;
+
+public:
+    ModelRegistry();
+
+    // Parse the partition image (registry table or legacy single model)
+    bool load(const unsigned char *partition, size_t partition_size);
+
+    // Bytes of the partition actually used by registry + models (0 if empty/invalid)
+    static size_t extent(const unsigned char *partition, size_t partition_size);
+
+    size_t getCount() const { return count; }
+    const ModelInfo *get(size_t index) const { return index < count ? &models[index] : nullptr; }
+
+    // Index of model by name, -1 if unknown
+    int find(const char *name) const;
+
+    // Check the stored CRC (once per model); false if the flatbuffer is corrupt
+    bool verify(size_t index);
+};
+
+#endif // MODEL_REGISTRY_H
@@ -0,0 +1,68 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+
+// Sequence lock around a small plain struct that many tasks read and a few write.
+// Readers never lock: they copy the value and retry only if a write overlapped the copy.
+// Writers never wait on a mutex: they are serialised by a spinlock critical section that
+// lasts as long as the field assignments between beginWrite() and endWrite().
+// The version counts completed writes, so a reader can tell cheaply whether anything
+// changed since its last snapshot.
+template <typename T>
+class Seqlock
+{
+private:
+    std::atomic<uint32_t> sequence; // Odd while a write is in progress
+    T value;
+    portMUX_TYPE writeLock;
+
+public:
+    Seqlock() : sequence(0)
+    {
+        memset(&value, 0, sizeof(value));
+        portMUX_INITIALIZE(&writeLock);
+    }
+
+    // Keep the update to plain assignments: interrupts are off on this core until endWrite()
+    T &beginWrite()
+    {
+        portENTER_CRITICAL(&writeLock);
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return value;
+    }
+
+    void endWrite()
+    {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        portEXIT_CRITICAL(&writeLock);
+    }
+
+    // Consistent copy of the value; returns its version
+    uint32_t read(T &out) const
+    {
+        for (;;)
+        {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue; // Writer on the other core, done within microseconds
+            }
+            memcpy(&out, &value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+            {
+                return before / 2;
+            }
+        }
+    }
+
+    // Version of the last completed write (inside beginWrite/endWrite: of the one before)
+    uint32_t version() const { return sequence.load(std::memory_order_acquire) / 2; }
+};
+
+#endif // SEQLOCK_H
@@ -0,0 +1,87 @@
+#ifndef SHADOW_EVAL_H
+#define SHADOW_EVAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spell_detector.h"
+#include "model_registry.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Shadow-model evaluation: a candidate model sees every cast's preprocessed tensor
+// on a low-priority task; its result is only logged, never acted on.
+#define SHADOW_LOG_SIZE 128     // Ring buffer entries (oldest overwritten)
+#define SHADOW_QUEUE_DEPTH 4    // Pending casts; extra casts are dropped while busy
+#define SHADOW_TASK_PRIORITY 2  // Below ble_process (5) - off the critical path
+#define SHADOW_TASK_STACK 4096
+
+// One cast compared between production and shadow model
+struct ShadowRecord
+{
+    uint32_t timestamp_ms;
+    uint8_t prod_index;   // Index into SPELL_NAMES
+    uint8_t shadow_index;
+    float prod_confidence;
+    float shadow_confidence;
+    float shadow_prod_confidence; // Shadow's probability for the production class
+    uint32_t prod_us;     // Production Invoke() latency
+    uint32_t shadow_us;   // Shadow Invoke() latency
+};
+
+class ShadowEvaluator
+{
+private:
+    struct Job
+    {
+        float input[SPELL_INPUT_MAX_SIZE];
+        uint16_t input_size;
+        uint8_t prod_index;
+        float prod_confidence;
+        uint32_t prod_us;
+    };
+
+    SpellDetector detector;
+    char model_name[MODEL_NAME_LEN];
+    bool enabled;
+
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    SemaphoreHandle_t log_mutex; // Guards ring + counters, and detector swaps
+
+    ShadowRecord ring[SHADOW_LOG_SIZE];
+    size_t ring_head;  // Next write position
+    size_t ring_count;
+    uint32_t total;
+    uint32_t disagreements;
+    uint32_t dropped;
+
+    static void taskFunc(void *arg);
+    void evaluate(const Job &job);
+
+public:
+    ShadowEvaluator();
+
+    // Load a candidate model (nullptr/empty name disables shadow mode)
+    bool setModel(const ModelInfo *info);
+    const char *getModelName() const { return model_name; }
+    bool isEnabled() const { return enabled; }
+
+    // Queue a cast for shadow evaluation (non-blocking, drops when busy)
+    // input is the production model input; positions are re-preprocessed when the shadow shape differs
+    void submit(const Position2D *positions, size_t position_count, const float *input, size_t input_size,
+                int prod_index, float prod_confidence, uint32_t prod_us);
+
+    // Copy the log oldest-first into out (max entries); returns entries copied
+    size_t snapshot(ShadowRecord *out, size_t max);
+
+    // Summary counters
+    uint32_t getTotal() const { return total; }
+    uint32_t getDisagreements() const { return disagreements; }
+    uint32_t getDropped() const { return dropped; }
+
+    void clear();
+};
+
+#endif // SHADOW_EVAL_H
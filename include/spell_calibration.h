@@ -0,0 +1,43 @@
+#ifndef SPELL_CALIBRATION_H
+#define SPELL_CALIBRATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spell_detector.h"
+
+// Per-spell confidence thresholds plus temperature scaling of the model output.
+// Stored in NVS as one blob, edited via POST /calibration, computed on the host
+// with calibrate_thresholds.py.
+#define CALIBRATION_NVS_KEY "spell_cal"
+#define CALIBRATION_MIN_TEMPERATURE 0.05f
+#define CALIBRATION_MAX_TEMPERATURE 20.0f
+
+class SpellCalibration
+{
+private:
+    float thresholds[SPELL_OUTPUT_SIZE]; // Indexed by spell ID (SPELL_NAMES order)
+    float temperature;                   // 1.0 = model output unchanged
+    float invTemperature;
+
+public:
+    SpellCalibration();
+
+    // Load from / store to NVS; load() keeps defaults when nothing is stored
+    bool load();
+    bool save();
+
+    // Every spell back to SPELL_CONFIDENCE_THRESHOLD, temperature 1.0
+    void reset();
+
+    float getThreshold(int spell_id) const;
+    bool setThreshold(int spell_id, float threshold);
+    const float *getThresholds() const { return thresholds; }
+
+    float getTemperature() const { return temperature; }
+    bool setTemperature(float value);
+
+    // Temperature-scale a softmax output in place: softmax(z / T) == p^(1/T) / sum
+    void apply(float *probabilities) const;
+};
+
+#endif // SPELL_CALIBRATION_H
@@ -23,8 +23,11 @@
 // Spell Detection Configuration
 #define SPELL_SAMPLE_COUNT 50   // Resampled positions for model input
 #define SPELL_INPUT_SIZE 100    // 50 positions * 2 coords (x,y) - model shape [1, 50, 2]
+#define SPELL_INPUT_MAX_SIZE 200 // Largest supported model input (100 positions * 2 coords)
 #define SPELL_OUTPUT_SIZE 73    // Number of spell classes
-#define TENSOR_ARENA_SIZE 60000 // 60KB arena for TFLite (model is memory-mapped, plenty of RAM)
+#define TENSOR_ARENA_SIZE 60000     // Probe arena used once to measure the model's real requirement
+#define TENSOR_ARENA_HEADROOM 256   // Slack added to arena_used_bytes() for allocator alignment
+#define TENSOR_BENCHMARK_RUNS 20    // Invoke() calls timed per placement in benchmark mode
 
 #ifndef MAX_POSITIONS
 #define MAX_POSITIONS 8192 // Match Python's buffer size (~35 seconds at 234 Hz)
@@ -32,9 +35,34 @@
 
 #define SPELL_CONFIDENCE_THRESHOLD 0.99f
 
+// Candidate trim windows produced per cast: base, tight, loose, shifted
+#define PREPROCESS_MAX_WINDOWS 4
+
+// Where the tensor arena and model live during inference
+enum TensorPlacement : uint8_t
+{
+    TENSOR_PLACEMENT_SPLIT = 0,    // Arena in internal RAM, model where it was loaded (PSRAM/flash)
+    TENSOR_PLACEMENT_PSRAM = 1,    // Arena in PSRAM, model where it was loaded
+    TENSOR_PLACEMENT_INTERNAL = 2, // Arena and a copy of the model in internal RAM
+    TENSOR_PLACEMENT_COUNT = 3
+};
+
 // Spell names array (71 spells)
 extern const char *SPELL_NAMES[SPELL_OUTPUT_SIZE];
 
+// Trim window names (index = window id)
+extern const char *PREPROCESS_WINDOW_NAMES[PREPROCESS_MAX_WINDOWS];
+
+// Per trim-window counters - shows whether the extra windows pay off
+struct WindowStats
+{
+    uint32_t casts;                             // Casts preprocessed
+    uint32_t rescued;                           // Casts only recognized through an alternate window
+    uint32_t evaluated[PREPROCESS_MAX_WINDOWS]; // Times the window went through the model
+    uint32_t hits[PREPROCESS_MAX_WINDOWS];      // Times it produced the accepted cast
+    uint64_t total_us[PREPROCESS_MAX_WINDOWS];  // Inference time spent on it
+};
+
 // IMU sample structure
 struct IMUSample
 {
@@ -155,19 +183,12 @@ public:
     void reset();
 };
 
-// Gesture Preprocessor - normalizes positions for model input
-// Now matches Python implementation exactly:
-// 1. Calculate bounding box from ALL data first
-// 2. Trim stationary segments (head and tail)
-// 3. Resample to 50 points WITH normalization (Python-style)
-class GesturePreprocessor
-{
-public:
-    // Preprocess positions: trim, resample, normalize to [0,1]
-    // This now matches the Python spell_tracker.py implementation exactly
-    static bool preprocess(const Position2D *input, size_t input_count,
-                           float *output, size_t output_size);
-};
+// Preprocessor instantiation for one model input shape (see gesture_preprocessor.h)
+typedef size_t (*PreprocessWindowsFn)(const Position2D *input, size_t input_count,
+                                      float *outputs, uint8_t *window_ids, size_t max_windows);
+
+class SpellCalibration;
+class SpellPersonalization;
 
 // TensorFlow Lite Spell Detector
 class SpellDetector
@@ -179,32 +200,92 @@ private:
     TfLiteTensor *input_tensor;
     TfLiteTensor *output_tensor;
     uint8_t *tensor_arena;
+    size_t tensor_arena_size;           // Exact arena size (measured arena_used_bytes + headroom)
+    uint8_t placement;                  // Active TensorPlacement
+    const unsigned char *model_source;  // Model as handed to begin()
+    size_t model_source_size;
+    unsigned char *model_copy;          // Internal RAM copy (TENSOR_PLACEMENT_INTERNAL only)
+    uint32_t model_hash;                // Identifies the model the stored arena size belongs to
+    size_t input_batch;                 // Batch dimension of the input tensor (windows per Invoke)
+    int output_row;                     // Output row holding the last prediction (-1 = overwritten)
+
+    // Allocate arena + interpreter for a placement and run AllocateTensors()
+    bool buildInterpreter(uint8_t target_placement, size_t arena_size);
+
+    // Free interpreter, arena and any internal model copy
+    void releaseInterpreter();
+
+    // Average Invoke() latency in microseconds (-1 on failure)
+    int64_t timeInvoke(int runs);
 #else
     unsigned char *model_data;
     size_t model_size;
 #endif
+    size_t inputSize;                  // Model input floats per window (samples * channels)
+    PreprocessWindowsFn preprocessFn;  // Preprocessor matching the model input shape
     bool initialized;
+    const SpellCalibration *calibration; // Per-spell thresholds + temperature (nullptr = global threshold)
+    SpellPersonalization *personalization; // Per-user score adjustment before calibration (nullptr = off)
     float lastConfidence;
     const char *lastPredictedSpell; // Last predicted spell (even if below threshold)
+    int lastPredictedIndex;         // Index into SPELL_NAMES of lastPredictedSpell
 
 public:
     SpellDetector();
     ~SpellDetector();
 
-    // Initialize TFLite model from flash/file
-    bool begin(const unsigned char *model_data, size_t model_size);
+    // Initialize TFLite model from flash/file (may be called again to switch models)
+    // model_id identifies the model for the stored arena size (e.g. registry CRC); 0 = hash it
+    bool begin(const unsigned char *model_data, size_t model_size, uint32_t model_id = 0);
 
-    // Run inference on normalized positions (50x2 float array)
+    // Model input floats per window and the preprocessor instantiation matching it
+    size_t getInputSize() const { return inputSize; }
+    size_t preprocessWindows(const Position2D *input, size_t input_count,
+                             float *outputs, uint8_t *window_ids, size_t max_windows) const;
+
+    // Whether a preprocessor instantiation exists for model input [N, samples, channels]
+    static bool supportsInputShape(int samples, int channels);
+
+    // Run inference on normalized positions (getInputSize() floats, 50x2 for the default model)
     const char *detect(float *positions, float confidence_threshold = SPELL_CONFIDENCE_THRESHOLD);
 
+    // Run inference on several preprocessed windows and keep the most confident one
+    // Windows share one Invoke() when the model has a batch dimension, else the interpreter is reused
+    const char *detectWindows(const float *windows, const uint8_t *window_ids, size_t count,
+                              float confidence_threshold = SPELL_CONFIDENCE_THRESHOLD,
+                              WindowStats *stats = nullptr, int *best_window = nullptr);
+
+    // Per-spell thresholds/temperature; when set they replace confidence_threshold
+    void setCalibration(const SpellCalibration *cal) { calibration = cal; }
+
+    // Per-user adaptation of the output, applied before calibration
+    void setPersonalization(SpellPersonalization *p) { personalization = p; }
+
     // Get last inference confidence
     float getConfidence() { return lastConfidence; }
 
     // Get last predicted spell name (even if confidence was too low)
     const char *getLastPrediction() { return lastPredictedSpell; }
+    int getLastPredictionIndex() { return lastPredictedIndex; }
+
+    // Probability of a class from the last inference
+    float getProbability(int index);
 
     // Check if model is loaded
     bool isReady() { return initialized; }
+
+    // Verify a .tflite flatbuffer and return its real size (0 if not a valid model)
+    static size_t modelSize(const unsigned char *data, size_t max_size);
+
+    // Time Invoke() for every placement that fits, keep and store the fastest
+    bool benchmarkPlacement();
+
+#ifdef USE_TENSORFLOW
+    // Tensor arena size actually allocated / used by the interpreter
+    size_t getArenaSize() const { return tensor_arena_size; }
+    size_t getArenaUsed() const { return interpreter ? interpreter->arena_used_bytes() : 0; }
+    uint8_t getPlacement() const { return placement; }
+#endif
 };
 
 // IMU Parser - extracts samples from BLE packets
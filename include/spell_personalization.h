@@ -0,0 +1,102 @@
+#ifndef SPELL_PERSONALIZATION_H
+#define SPELL_PERSONALIZATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spell_detector.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Per-user adaptation of the model output without retraining.
+// Embedding: the model's log-probabilities, centered (softmax logits up to a constant -
+// a linear projection of the penultimate layer). Corrected casts update, per user profile:
+//  - a nearest-class-mean table: spells whose mean is near the cast get a logit boost,
+//    spells whose mean is far get a penalty
+//  - a per-spell logit bias (one cross-entropy step per correction)
+// Adjusted probabilities then go through the usual calibration/threshold.
+// Each profile is one NVS blob; only the active profile is held in RAM.
+#define PERSONALIZATION_MAX_PROFILES 4
+#define PERSONALIZATION_NAME_LEN 16
+#define PERSONALIZATION_MAX_CLASSES 8    // Adapted spells per profile (fewest examples replaced first)
+#define PERSONALIZATION_MAX_EXAMPLES 5   // Class mean becomes a moving average after this many corrections
+#define PERSONALIZATION_EMBED_SCALE 4.0f // int8 steps per log-probability unit (range +-32)
+#define PERSONALIZATION_BIAS_SCALE 16.0f // int8 steps per logit of bias (range +-8)
+#define PERSONALIZATION_BIAS_RATE 0.5f   // Bias step per correction
+#define PERSONALIZATION_NCM_RADIUS 6.0f  // Distance to a class mean (log-prob units) where the boost turns into a penalty
+#define PERSONALIZATION_NCM_WEIGHT 1.0f  // Logit change per unit of distance inside/outside the radius
+#define PERSONALIZATION_MAX_BOOST 4.0f   // Clamp of the class-mean logit change
+#define PERSONALIZATION_MIN_PROB 1e-7f   // Log floor for zero probabilities
+
+struct PersonalizationClass
+{
+    uint8_t spell; // Index into SPELL_NAMES
+    uint8_t count; // Corrections folded into the mean (saturates at PERSONALIZATION_MAX_EXAMPLES)
+    int8_t mean[SPELL_OUTPUT_SIZE];
+};
+
+struct PersonalizationStats
+{
+    uint32_t applied;     // Casts adjusted
+    uint32_t changed;     // Casts whose top-1 changed
+    uint32_t corrections; // Corrections since boot
+    uint32_t last_us;     // apply() latency of the last cast
+    uint64_t total_us;
+};
+
+class SpellPersonalization
+{
+private:
+    char profileName[PERSONALIZATION_NAME_LEN];
+    int profileSlot;    // NVS slot of the active profile (-1 = none)
+    uint32_t modelId;   // Model the class means were built with
+    int8_t bias[SPELL_OUTPUT_SIZE];
+    PersonalizationClass classes[PERSONALIZATION_MAX_CLASSES];
+    size_t classCount;
+    bool active;        // Anything to apply (classes or non-zero bias)
+
+    float current[SPELL_OUTPUT_SIZE];  // Raw output row being scored
+    float last[SPELL_OUTPUT_SIZE];     // Raw output row of the last cast (target of correct())
+    uint32_t currentModelId;
+    uint32_t lastModelId;
+    bool hasLast;
+
+    PersonalizationStats stats;
+    SemaphoreHandle_t mutex; // apply() on the BLE task vs corrections/profile switches from the web server
+
+    // Adjusted logits for an embedding (embedding + bias + class-mean term)
+    void adjustedLogits(const float *embedding, uint32_t model_id, float *logits) const;
+    void updateActive();
+    bool saveProfile();
+    bool loadSlot(int slot);
+
+public:
+    SpellPersonalization();
+
+    // Restore the profile that was active at last boot
+    bool load();
+
+    // Switch to a profile, creating it if needed (false if every slot is taken)
+    bool selectProfile(const char *name);
+    const char *getProfileName() const { return profileName; }
+
+    // Names of stored profiles; returns number written
+    size_t listProfiles(char (*names)[PERSONALIZATION_NAME_LEN], size_t max);
+
+    // Forget every correction of the active profile
+    bool resetProfile();
+
+    // Adjust one softmax row in place; keepLast() marks it as the cast correct() applies to
+    void apply(float *probabilities, uint32_t model_id);
+    void keepLast();
+
+    // Start of a cast: a cast answered without the production model can't be corrected
+    void clearLast() { hasLast = false; }
+
+    // The last cast was spell_id: update class mean + bias and persist
+    bool correct(int spell_id);
+
+    size_t getClasses(PersonalizationClass *out, size_t max);
+    const PersonalizationStats &getStats() const { return stats; }
+};
+
+#endif // SPELL_PERSONALIZATION_H
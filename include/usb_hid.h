@@ -85,6 +85,9 @@ public:
     uint8_t getSpellKeycode(const char *spell_name) const;
     void setSpellGamepadButton(const char *spell_name, uint8_t button);
     uint8_t getSpellGamepadButton(const char *spell_name) const;
+    // By SPELL_NAMES index, without per-call logging (bulk updates from /settings/save)
+    void setSpellKeycodeAt(int index, uint8_t keycode);
+    void setSpellGamepadButtonAt(int index, uint8_t button);
     void sendSpellGamepadForSpell(const char *spell_name);
 
     // Settings accessors for web interface
@@ -2,13 +2,156 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <atomic>
 #include "esp_http_server.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "ws_protocol.h"
+#include "seqlock.h"
 
 // Forward declaration
 class WandBLEClient;
 
+// URI handlers registered in begin(); httpd refuses registrations past max_uri_handlers,
+// which silently loses whichever endpoints come last. Bump the count with every endpoint.
+#define WEB_URI_HANDLER_COUNT 51
+#define WEB_URI_HANDLER_SLOTS (WEB_URI_HANDLER_COUNT + 7) // Spare slots for future endpoints
+
+// WebSocket fan-out: broadcasts are queued per client and sent by a separate task,
+// so a slow browser never blocks the BLE task that produced the data
+#define WS_MAX_CLIENTS 10
+#define WS_CLIENT_QUEUE_LEN 32    // Outbound messages per client
+#define WS_SENDER_TASK_PRIORITY 4 // Below BLE processing and httpd (both 5)
+#define WS_SENDER_TASK_STACK 4096
+
+// Message classes; the topic decides what happens when a client's queue is full
+enum WsTopic : uint8_t
+{
+    WS_TOPIC_STATUS,         // wand_status, wand_info
+    WS_TOPIC_SPELL,          // spell, low_confidence, custom_recorded (never dropped)
+    WS_TOPIC_GESTURE,        // gesture_start, gesture_end (never dropped)
+    WS_TOPIC_GESTURE_POINTS, // Dropped when the queue is full
+    WS_TOPIC_IMU,            // Latest wins: replaces an IMU message still queued
+    WS_TOPIC_BATTERY,
+    WS_TOPIC_BUTTON,         // Dropped when the queue is full
+    WS_TOPIC_SCAN,           // scan_result, scan_complete
+    WS_TOPIC_COUNT
+};
+
+// Names used in {"type":"subscribe","topics":"spell,gesture_point,imu:10"} (rate in messages/s, 0 = all)
+extern const char *const WS_TOPIC_NAMES[WS_TOPIC_COUNT];
+#define WS_TOPICS_ALL ((1u << WS_TOPIC_COUNT) - 1)
+
+// wantedFormats() result
+#define WS_WANT_JSON 0x01
+#define WS_WANT_BINARY 0x02
+
+// Long-poll (/data/poll) and server-sent events (/data/events): held requests are handed
+// to a task that answers them when the cached data changes, so they cost no httpd time
+#define DATA_WAIT_MAX_CLIENTS 3            // Held connections; more get a 503
+#define DATA_POLL_TIMEOUT_MS 25000         // Default long-poll timeout (?timeout=, in ms)
+#define DATA_POLL_MAX_TIMEOUT_MS 60000
+#define DATA_EVENTS_MIN_INTERVAL_MS 100    // Events are coalesced to at most 10/s per client
+#define DATA_EVENTS_KEEPALIVE_MS 15000     // Comment line sent to an idle stream
+#define DATA_WAIT_TASK_PRIORITY 4
+#define DATA_WAIT_TASK_STACK 4096
+
+// Field groups of cached_data, each versioned; ?fields=imu,spell,battery,status picks them
+#define DATA_GROUP_IMU 0x01
+#define DATA_GROUP_SPELL 0x02
+#define DATA_GROUP_BATTERY 0x04
+#define DATA_GROUP_STATUS 0x08 // connected + wand info
+#define DATA_GROUPS_ALL 0x0F
+
+// A request held by /data/poll or /data/events
+struct DataWaiter
+{
+    httpd_req_t *req;     // Async copy (httpd_req_async_handler_begin)
+    bool events;          // Event stream rather than a single long-poll response
+    bool started;         // Event stream headers sent
+    uint8_t groups;       // DATA_GROUP_* the client asked for
+    uint32_t since;       // Version the client already has
+    int64_t deadline_us;  // Long-poll timeout, or the next keep-alive of a stream
+    int64_t next_send_us; // Earliest next event (coalescing)
+};
+
+// Latest wand state for /data polling and new WebSocket clients. Written by the
+// broadcast* calls from the BLE and main tasks, read without locking by the handlers.
+struct CachedData
+{
+    float ax, ay, az, gx, gy, gz;
+    char spell[64];
+    float confidence;
+    uint8_t battery;
+    bool wand_connected;
+    // Version of the write that last changed each group (0: never)
+    uint32_t imu_version;
+    uint32_t spell_version;
+    uint32_t battery_version;
+    uint32_t status_version;
+    char firmware_version[32];
+    char serial_number[32];
+    char sku[32];
+    char device_id[32];
+    char wand_type[32];
+};
+
+// Per-topic formatting work done vs avoided (GET /ws/stats)
+struct WsTopicStats
+{
+    uint32_t formatted; // Broadcasts formatted for at least one client
+    uint32_t skipped;   // Broadcasts not formatted: no subscriber, or every subscriber over its rate
+};
+
+// Per-format cost of a high-rate stream (GET /ws/stats)
+struct WsFormatStats
+{
+    uint32_t messages;  // Samples formatted
+    uint32_t frames;    // Frames queued to clients
+    uint64_t bytes;     // Payload bytes queued (all clients)
+    uint64_t encode_us; // Time spent formatting
+    uint64_t queue_us;  // Time the producer spent queuing frames
+    uint64_t send_us;   // Time the sender task spent in httpd_ws_send_frame_async
+};
+
+// Per-client outbound queue statistics (GET /ws/stats)
+struct WsClientStats
+{
+    uint32_t queued;     // Messages queued
+    uint32_t sent;
+    uint32_t dropped;    // Refused or evicted because the queue was full
+    uint32_t replaced;   // IMU messages overtaken by a newer one
+    uint32_t decimated;  // Messages skipped by the client's rate limit
+    uint32_t max_depth;
+    uint64_t latency_us; // Queued -> send returned, summed over sent messages
+    uint32_t latency_max_us;
+    uint64_t send_us;    // Time in httpd_ws_send_frame_async
+    uint32_t send_max_us;
+};
+
+struct WsStreamStats
+{
+    WsFormatStats json;
+    WsFormatStats binary;
+    uint64_t batch_wait_us;     // Sum over binary samples of the time spent waiting for their frame
+    uint32_t batch_wait_max_us; // Longest wait of a sample
+    uint32_t batch_dropped;     // Binary samples lost because the batch was full or locked
+};
+
+// One formatted frame shared by every client it is queued for
+struct WsMessage
+{
+    uint32_t refs; // Queues holding it + the sender while in flight (client_mutex held)
+    WsTopic topic;
+    bool binary;
+    WsStreamStats *stats; // Stream cost counters (nullptr for events)
+    int64_t queued_us;
+    size_t len;
+    uint8_t *data; // Follows the struct in the same allocation
+};
+
 class WebServer
 {
 public:
@@ -50,14 +193,19 @@ public:
     void broadcastScanResult(const char *address, const char *name, int rssi);
     void broadcastScanComplete();
 
+    // Custom gesture example recorded (or failed to store)
+    void broadcastCustomGestureRecorded(const char *name, bool stored);
+
 private:
     httpd_handle_t server;
     bool running;
 
     // HTTP handlers
-    static esp_err_t root_handler(httpd_req_t *req);
+    static esp_err_t asset_handler(httpd_req_t *req); // Gzipped UI asset (/, /app.js, /app.css)
     static esp_err_t ws_handler(httpd_req_t *req);   // WebSocket handler
-    static esp_err_t data_handler(httpd_req_t *req); // Polling endpoint
+    static esp_err_t data_handler(httpd_req_t *req); // Polling endpoint (?since=<version> or If-None-Match for 304s)
+    static esp_err_t data_poll_handler(httpd_req_t *req);   // Long-poll: waits for a newer version
+    static esp_err_t data_events_handler(httpd_req_t *req); // Server-sent events of changed fields
     static esp_err_t captive_portal_handler(httpd_req_t *req);
     static esp_err_t scan_handler(httpd_req_t *req);                                // Start BLE scan
     static esp_err_t set_mac_handler(httpd_req_t *req);                             // Set wand MAC address
@@ -76,32 +224,110 @@ private:
     static esp_err_t system_reset_nvs_handler(httpd_req_t *req);                    // Factory reset (clear NVS)
     static esp_err_t system_get_wifi_mode_handler(httpd_req_t *req);                // Get current WiFi mode
     static esp_err_t debug_nvs_handler(httpd_req_t *req);                           // Debug: Show NVS contents
+    static esp_err_t models_get_handler(httpd_req_t *req);                          // List models in registry
+    static esp_err_t models_select_handler(httpd_req_t *req);                       // Switch active model
+    static esp_err_t shadow_status_handler(httpd_req_t *req);                       // Shadow model summary
+    static esp_err_t shadow_log_handler(httpd_req_t *req);                          // Download shadow log (CSV)
+    static esp_err_t shadow_select_handler(httpd_req_t *req);                       // Set/clear shadow model
+    static esp_err_t custom_list_handler(httpd_req_t *req);                         // List custom gestures
+    static esp_err_t custom_record_handler(httpd_req_t *req);                       // Arm recording of next cast
+    static esp_err_t custom_delete_handler(httpd_req_t *req);                       // Delete a custom gesture
+    static esp_err_t cascade_get_handler(httpd_req_t *req);                         // Cascade config + statistics
+    static esp_err_t cascade_set_handler(httpd_req_t *req);                         // Set stage-1 model/threshold
+    static esp_err_t windows_get_handler(httpd_req_t *req);                         // Per trim-window statistics
+    static esp_err_t calibration_get_handler(httpd_req_t *req);                     // Per-spell thresholds + temperature
+    static esp_err_t calibration_set_handler(httpd_req_t *req);                     // Edit/replace calibration
+    static esp_err_t segmenter_get_handler(httpd_req_t *req);                       // Button-free segmentation counters
+    static esp_err_t dataset_get_handler(httpd_req_t *req);                         // Dataset capture status
+    static esp_err_t dataset_set_handler(httpd_req_t *req);                         // Toggle capture / set label / clear
+    static esp_err_t dataset_download_handler(httpd_req_t *req);                    // Stream captured casts (binary)
+    static esp_err_t history_get_handler(httpd_req_t *req);                         // Recent casts summary
+    static esp_err_t history_download_handler(httpd_req_t *req);                    // Recent casts with paths (binary)
+    static esp_err_t history_replay_handler(httpd_req_t *req);                      // Re-run a stored cast, timed
+    static esp_err_t personalize_get_handler(httpd_req_t *req);                     // Active profile + adapted spells
+    static esp_err_t personalize_set_handler(httpd_req_t *req);                     // Select profile / correct last cast
+    static esp_err_t ws_stats_handler(httpd_req_t *req);                            // WebSocket stream cost per format
     static esp_err_t gesture_404_handler(httpd_req_t *req, httpd_err_code_t error); // Intercept 404s for gesture images
-    static esp_err_t gesture_image_handler(httpd_req_t *req);                       // Serve gesture images from SPIFFS
+    static esp_err_t gesture_image_handler(httpd_req_t *req);                       // Serve gesture images (atlas or SPIFFS)
+    static esp_err_t gesture_index_handler(httpd_req_t *req);                       // Atlas index (name, offset, size, hash)
+    static esp_err_t gesture_atlas_handler(httpd_req_t *req);                       // Whole atlas for one-request preload
 
     void addWebSocketClient(int fd);
     void removeWebSocketClient(int fd);
+    void setWebSocketClientBinary(int fd, bool binary);
+    void setWebSocketClientTopics(int fd, const char *topics);
+
+    // Formats some subscriber needs now (WS_WANT_*; 0 = skip formatting). For the gesture point/IMU
+    // streams, binary is wanted whenever a binary client subscribes: their rate applies per batched frame.
+    uint8_t wantedFormats(WsTopic topic);
+
+    // Queue one message: binary clients get `frame` (when given), the others `json` (when given)
+    void sendToClients(WsTopic topic, const char *json, const uint8_t *frame = nullptr, size_t frame_len = 0,
+                       WsStreamStats *stats = nullptr);
 
-    // WebSocket client tracking
-    int ws_clients[10];
+    // WebSocket client tracking; everything below is guarded by client_mutex
+    struct WsClient
+    {
+        int fd;
+        bool binary;     // Client asked for binary gesture/IMU frames
+        uint16_t topics; // Bit per WsTopic (WS_TOPICS_ALL until the client subscribes)
+        uint16_t max_hz[WS_TOPIC_COUNT];
+        int64_t last_us[WS_TOPIC_COUNT]; // Last message queued per topic (rate limit)
+        WsMessage *queue[WS_CLIENT_QUEUE_LEN];
+        uint8_t head;
+        uint8_t depth;
+        WsClientStats stats;
+    };
+    WsClient ws_clients[WS_MAX_CLIENTS];
     int ws_client_count;
+    int ws_binary_client_count;
     SemaphoreHandle_t client_mutex;
 
-    // Cached data for polling
-    struct
+    int findClient(int fd) const;
+    void removeClientAt(int index);
+    bool enqueue(WsClient &client, WsMessage *msg);
+    static void releaseMessage(WsMessage *msg);
+
+    // Sender task: drains the client queues round-robin
+    TaskHandle_t sender_task;
+    static void senderTaskFunc(void *arg);
+    void drainQueues();
+
+    // Binary stream batches: samples collected for WS_BATCH_WINDOW_MS, then sent as one frame
+    struct StreamBatch
     {
-        float ax, ay, az, gx, gy, gz;
-        char spell[64];
-        float confidence;
-        uint8_t battery;
-        bool has_spell;
-        bool wand_connected;
-        uint32_t timestamp;
-        char firmware_version[32];
-        char serial_number[32];
-        char sku[32];
-        char device_id[32];
-        char wand_type[32];
-    } cached_data;
-    SemaphoreHandle_t data_mutex;
+        uint8_t type;   // WS_MSG_*
+        uint8_t stride; // Floats per sample
+        float samples[WS_BATCH_MAX_SAMPLES * 6];
+        size_t count;
+        size_t skipped;         // Samples dropped while full; skipped in the sequence so clients see the gap
+        uint16_t next_sequence; // Stream sequence of the next sample
+        int64_t first_us;       // Arrival of samples[0]
+        int64_t arrival_sum_us; // Sum of sample arrival times (for the wait statistics)
+        bool flush_next;        // Send the next sample immediately (first point of a gesture)
+    };
+    StreamBatch gesture_batch;
+    StreamBatch imu_batch;
+    SemaphoreHandle_t batch_mutex;
+
+    void batchSample(StreamBatch &batch, const float *sample, WsStreamStats &stats);
+    void flushBatch(StreamBatch &batch, WsStreamStats &stats);
+
+    // Per-format cost of the streams
+    WsStreamStats gesture_stats;
+    WsStreamStats imu_stats;
+    WsTopicStats topic_stats[WS_TOPIC_COUNT];
+    int64_t stats_since_us;
+
+    // Held /data/poll and /data/events requests; the wait task owns them once queued
+    TaskHandle_t data_wait_task;
+    QueueHandle_t data_wait_queue;
+    std::atomic<int> data_waiter_count;
+    static void dataWaitTaskFunc(void *arg);
+    bool holdDataRequest(httpd_req_t *req, bool events, uint8_t groups, uint32_t since, int64_t deadline_us);
+    TickType_t serviceDataWaiters(DataWaiter *waiters);
+    void notifyDataWaiters();
+
+    // Latest wand state, see CachedData
+    Seqlock<CachedData> cached_data;
 };
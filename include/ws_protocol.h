@@ -0,0 +1,39 @@
+#ifndef WS_PROTOCOL_H
+#define WS_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Binary WebSocket frames for the high-rate streams (gesture points, IMU).
+// A client opts in with {"type":"format","format":"binary"} on /ws; clients that never
+// ask (and every other message type) keep getting JSON text frames.
+//
+// Frame (little-endian): WsFrameHeader, then count samples of
+//   WS_MSG_GESTURE_POINTS: int16 x, int16 y  in 1/WS_POSITION_SCALE mm, y flipped for the screen
+//   WS_MSG_IMU:            float16 ax, ay, az (g), gx, gy, gz (rad/s)
+// sequence counts samples per stream (wraps at 65536) so the page can spot dropped frames.
+#define WS_MSG_GESTURE_POINTS 0x01
+#define WS_MSG_IMU 0x02
+#define WS_POSITION_SCALE 10 // 0.1 mm steps (+-3.2 m range)
+
+#define WS_GESTURE_POINT_SIZE 4 // 2 x int16
+#define WS_IMU_SAMPLE_SIZE 12   // 6 x float16
+#define WS_BATCH_MAX_SAMPLES 32 // Samples per frame before a batch is sent early (388-byte IMU frame)
+
+struct __attribute__((packed)) WsFrameHeader
+{
+    uint8_t type;      // WS_MSG_*
+    uint8_t count;     // Samples in this frame
+    uint16_t sequence; // Stream sequence of the first sample
+};
+
+// IEEE 754 half precision (round to nearest, saturates to +-inf)
+uint16_t ws_float_to_half(float value);
+
+// Encode a frame into buf; return its length (0 if buf is too small)
+size_t ws_encode_gesture_points(uint8_t *buf, size_t len, uint16_t sequence,
+                                const float *xy, size_t count);
+size_t ws_encode_imu(uint8_t *buf, size_t len, uint16_t sequence,
+                     const float *samples, size_t count);
+
+#endif // WS_PROTOCOL_H
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""Pack several .tflite models into one image for the 'model' partition.
+
+Layout (little-endian, see include/model_registry.h):
+  header  : magic 'WMDL' (u32), version (u16), count (u16)
+  entries : name[24], offset (u32), size (u32), input_samples (u16),
+            input_channels (u16), output_classes (u16), reserved (u16), crc32 (u32)
+  models  : flatbuffers, each 16-byte aligned
+
+Usage:
+  ./pack_models.py models.bin prod=model.tflite candidate=model_v2.tflite
+  ./pack_models.py models.bin small=small.tflite:50,2,73
+  esptool.py --chip esp32s3 write_flash 0x410000 models.bin
+"""
+import struct
+import sys
+import zlib
+
+MAGIC = 0x4C444D57
+VERSION = 1
+MAX_MODELS = 8
+NAME_LEN = 24
+HEADER = struct.Struct("<IHH")
+ENTRY = struct.Struct("<%dsIIHHHHI" % NAME_LEN)
+ALIGN = 16
+DEFAULT_SHAPE = (50, 2, 73)
+PARTITION_SIZE = 0x80000  # partitions-s3.csv; partitions.csv uses 0x70000
+
+
+def parse_arg(arg):
+    if "=" not in arg:
+        sys.exit("expected name=path[:samples,channels,classes], got %r" % arg)
+    name, rest = arg.split("=", 1)
+    shape = DEFAULT_SHAPE
+    if ":" in rest:
+        rest, shape_str = rest.rsplit(":", 1)
+        shape = tuple(int(v) for v in shape_str.split(","))
+        if len(shape) != 3:
+            sys.exit("shape must be samples,channels,classes")
+    if len(name.encode()) >= NAME_LEN:
+        sys.exit("model name %r longer than %d bytes" % (name, NAME_LEN - 1))
+    with open(rest, "rb") as f:
+        data = f.read()
+    if data[4:8] != b"TFL3":
+        sys.exit("%s is not a .tflite flatbuffer" % rest)
+    return name, data, shape
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    out_path = sys.argv[1]
+    models = [parse_arg(a) for a in sys.argv[2:]]
+    if len(models) > MAX_MODELS:
+        sys.exit("at most %d models" % MAX_MODELS)
+
+    offset = HEADER.size + ENTRY.size * len(models)
+    offset = (offset + ALIGN - 1) & ~(ALIGN - 1)
+    entries = []
+    blobs = []
+    for name, data, (samples, channels, classes) in models:
+        entries.append(ENTRY.pack(name.encode(), offset, len(data), samples, channels,
+                                  classes, 0, zlib.crc32(data) & 0xFFFFFFFF))
+        pad = (-len(data)) % ALIGN
+        blobs.append(data + b"\0" * pad)
+        print("  %-24s offset 0x%06x  %7d bytes  [1,%d,%d] -> %d"
+              % (name, offset, len(data), samples, channels, classes))
+        offset += len(data) + pad
+
+    image = HEADER.pack(MAGIC, VERSION, len(models)) + b"".join(entries)
+    image += b"\0" * ((-len(image)) % ALIGN) + b"".join(blobs)
+    with open(out_path, "wb") as f:
+        f.write(image)
+
+    print("Wrote %s: %d bytes (%d models)" % (out_path, len(image), len(models)))
+    if len(image) > PARTITION_SIZE:
+        print("WARNING: image exceeds the 0x%x byte model partition" % PARTITION_SIZE)
+
+
+if __name__ == "__main__":
+    main()
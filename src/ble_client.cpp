@@ -1,11 +1,15 @@
 #include "ble_client.h"
+#include "gesture_preprocessor.h"
 #include "web_server.h"
 #include "config.h"
 #include "usb_hid.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "driver/gpio.h"
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include "nvs_flash.h"
 #include "host/ble_hs.h"
 #include "host/ble_uuid.h"
@@ -132,6 +136,13 @@ WandBLEClient::WandBLEClient()
       spellCallback(nullptr),
       connectionCallback(nullptr),
       imuCallback(nullptr),
+      modelRegistry(nullptr),
+      activeModel(-1),
+      loadedModelData(nullptr),
+      loadedModelSize(0),
+      loadedModelId(0),
+      detectorMutex(nullptr),
+      segmentTracking(false),
       connected(false),
       imuStreaming(false),
       lastButtonState(0),
@@ -146,6 +157,15 @@ WandBLEClient::WandBLEClient()
 {
     g_clientInstance = this;
 
+    detectorMutex = xSemaphoreCreateMutex();
+    memset(&windowStats, 0, sizeof(windowStats));
+    spellDetector.setCalibration(&calibration);
+    cascade.setCalibration(&calibration);
+#if SPELL_PERSONALIZATION
+    spellDetector.setPersonalization(&personalization);
+    cascade.setPersonalization(&personalization);
+#endif
+
     // Initialize wand info strings
     firmware_version[0] = '\0';
     serial_number[0] = '\0';
@@ -679,13 +699,226 @@ int WandBLEClient::gap_event_handler(struct ble_gap_event *event, void *arg)
     return 0;
 }
 
-bool WandBLEClient::begin(const unsigned char *model_data, size_t model_size)
+void WandBLEClient::setModelRegistry(ModelRegistry *registry, int active_index)
+{
+    modelRegistry = registry;
+    activeModel = active_index;
+
+    // Resume shadow evaluation of the candidate stored in NVS
+    nvs_handle_t nvs_handle;
+    if (registry && nvs_open("storage", NVS_READONLY, &nvs_handle) == ESP_OK)
+    {
+        char name[MODEL_NAME_LEN] = {0};
+        size_t len = sizeof(name);
+        esp_err_t err = nvs_get_str(nvs_handle, "shadow_model", name, &len);
+        nvs_close(nvs_handle);
+        if (err == ESP_OK && name[0] != '\0')
+        {
+            int index = registry->find(name);
+            if (index == active_index)
+            {
+                ESP_LOGW(TAG, "Stored shadow model '%s' is now production - shadow mode stays off", name);
+            }
+            else if (index >= 0 && registry->verify(index))
+            {
+                shadowEvaluator.setModel(registry->get(index));
+            }
+        }
+    }
+
+    // Restore cascade configuration (stage-1 model + accept threshold)
+    if (registry && nvs_open("storage", NVS_READONLY, &nvs_handle) == ESP_OK)
+    {
+        char name[MODEL_NAME_LEN] = {0};
+        size_t len = sizeof(name);
+        uint16_t threshold_permille = 0;
+        bool has_name = nvs_get_str(nvs_handle, "cascade_model", name, &len) == ESP_OK && name[0] != '\0';
+        bool has_threshold = nvs_get_u16(nvs_handle, "cascade_thr", &threshold_permille) == ESP_OK;
+        nvs_close(nvs_handle);
+        if (has_name)
+        {
+            configureCascade(name, has_threshold ? threshold_permille / 1000.0f : cascade.getAcceptThreshold(), false);
+        }
+    }
+}
+
+bool WandBLEClient::configureCascade(const char *stage1_name, float accept_threshold, bool persist)
 {
-    if (!spellDetector.begin(model_data, model_size))
+    const ModelInfo *info = nullptr;
+    if (stage1_name && stage1_name[0] != '\0')
+    {
+        int index = modelRegistry ? modelRegistry->find(stage1_name) : -1;
+        if (index < 0 || index == activeModel || !modelRegistry->verify(index))
+        {
+            ESP_LOGW(TAG, "Invalid stage-1 model: %s", stage1_name);
+            return false;
+        }
+        info = modelRegistry->get(index);
+    }
+    if (accept_threshold <= 0.0f || accept_threshold > 1.0f)
+    {
+        ESP_LOGW(TAG, "Invalid cascade threshold: %.3f", accept_threshold);
+        return false;
+    }
+
+    xSemaphoreTake(detectorMutex, portMAX_DELAY);
+    cascade.setAcceptThreshold(accept_threshold);
+    bool ok = cascade.setStage1Model(info);
+    xSemaphoreGive(detectorMutex);
+
+    if (ok && persist)
+    {
+        nvs_handle_t nvs_handle;
+        if (nvs_open("storage", NVS_READWRITE, &nvs_handle) == ESP_OK)
+        {
+            nvs_set_str(nvs_handle, "cascade_model", info ? info->name : "");
+            nvs_set_u16(nvs_handle, "cascade_thr", (uint16_t)(accept_threshold * 1000.0f + 0.5f));
+            nvs_commit(nvs_handle);
+            nvs_close(nvs_handle);
+        }
+    }
+    return ok;
+}
+
+bool WandBLEClient::selectShadowModel(const char *name)
+{
+    const ModelInfo *info = nullptr;
+    if (name && name[0] != '\0')
+    {
+        int index = modelRegistry ? modelRegistry->find(name) : -1;
+        if (index < 0)
+        {
+            ESP_LOGW(TAG, "Unknown shadow model: %s", name);
+            return false;
+        }
+        if (index == activeModel)
+        {
+            ESP_LOGW(TAG, "Shadow model must differ from the production model");
+            return false;
+        }
+        if (!modelRegistry->verify(index))
+            return false;
+        info = modelRegistry->get(index);
+    }
+
+    if (!shadowEvaluator.setModel(info))
+        return false;
+    shadowEvaluator.clear();
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) == ESP_OK)
+    {
+        nvs_set_str(nvs_handle, "shadow_model", info ? info->name : "");
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+    return true;
+}
+
+const char *WandBLEClient::getActiveModelName() const
+{
+    if (!modelRegistry || activeModel < 0)
+        return "";
+    const ModelInfo *info = modelRegistry->get(activeModel);
+    return info ? info->name : "";
+}
+
+bool WandBLEClient::selectModel(const char *name)
+{
+    if (!modelRegistry)
+    {
+        ESP_LOGW(TAG, "No model registry - cannot switch model");
+        return false;
+    }
+
+    int index = modelRegistry->find(name);
+    if (index < 0)
+    {
+        ESP_LOGW(TAG, "Unknown model: %s", name ? name : "(null)");
+        return false;
+    }
+    if (index == activeModel)
+        return true;
+    // A shadow identical to production would only measure agreement with itself
+    const char *shadow = shadowEvaluator.getModelName();
+    if (shadow[0] != '\0' && modelRegistry->find(shadow) == index)
+    {
+        ESP_LOGW(TAG, "Model '%s' is the shadow model - change or clear the shadow first", shadow);
+        return false;
+    }
+
+    const ModelInfo *info = modelRegistry->get(index);
+    if (!SpellDetector::supportsInputShape(info->input_samples, info->input_channels) ||
+        info->output_classes != SPELL_OUTPUT_SIZE)
+    {
+        ESP_LOGW(TAG, "Model '%s' has unsupported shape [1,%u,%u] -> %u",
+                 info->name, info->input_samples, info->input_channels, info->output_classes);
+        return false;
+    }
+    if (!modelRegistry->verify(index))
+        return false;
+
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(detectorMutex, portMAX_DELAY);
+    bool ok = spellDetector.begin(info->data, info->size, info->crc32);
+    bool restored = false;
+    if (!ok && loadedModelData)
+    {
+        // Restore the previous model (registry entry or the one passed to begin) so detection keeps working
+        restored = spellDetector.begin(loadedModelData, loadedModelSize, loadedModelId);
+    }
+    if (ok)
+    {
+        loadedModelData = info->data;
+        loadedModelSize = info->size;
+        loadedModelId = info->crc32;
+    }
+    else if (!restored)
+    {
+        loadedModelData = nullptr;
+        activeModel = -1;
+    }
+    xSemaphoreGive(detectorMutex);
+
+    if (!ok)
+    {
+        ESP_LOGE(TAG, "Failed to switch to model '%s'", info->name);
+        if (!restored)
+        {
+            ESP_LOGE(TAG, "Previous model could not be restored - spell detection is off until a model loads");
+        }
+        return false;
+    }
+
+    activeModel = index;
+    ESP_LOGI(TAG, "Switched to model '%s' in %lld ms", info->name, (esp_timer_get_time() - start) / 1000);
+
+    // Remember selection across reboots
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READWRITE, &nvs_handle) == ESP_OK)
+    {
+        nvs_set_str(nvs_handle, "model_name", info->name);
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+    return true;
+}
+
+bool WandBLEClient::begin(const unsigned char *model_data, size_t model_size, uint32_t model_id)
+{
+    calibration.load();
+#if SPELL_PERSONALIZATION
+    personalization.load();
+#endif
+
+    if (!spellDetector.begin(model_data, model_size, model_id))
     {
         ESP_LOGE(TAG, "Failed to initialize spell detector");
         return false;
     }
+    loadedModelData = model_data;
+    loadedModelSize = model_size;
+    loadedModelId = model_id;
 
     ESP_LOGI(TAG, "Initializing NimBLE...");
     nimble_port_init();
@@ -878,6 +1111,275 @@ void WandBLEClient::setWandCommandHandles(uint16_t conn_handle_param, uint16_t c
     wandCommands.setHandles(conn_handle_param, command_handle);
 }
 
+// Top-K of the detector's last output; only the reported top-1 when that output is stale
+// (cast answered by the cascade's first stage, or overwritten by an alternate window)
+static void fill_top_k(SpellDetector &detector, bool use_detector, int predicted_index, float confidence,
+                       uint8_t *top_index, float *top_score)
+{
+    memset(top_index, GESTURE_HISTORY_NO_SPELL, GESTURE_HISTORY_TOP_K);
+    for (int k = 0; k < GESTURE_HISTORY_TOP_K; k++)
+        top_score[k] = 0.0f;
+
+    if (use_detector)
+    {
+        for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+        {
+            float p = detector.getProbability(i);
+            int k = GESTURE_HISTORY_TOP_K;
+            while (k > 0 && (top_index[k - 1] == GESTURE_HISTORY_NO_SPELL || p > top_score[k - 1]))
+                k--;
+            if (k == GESTURE_HISTORY_TOP_K || p <= 0.0f)
+                continue;
+            memmove(top_index + k + 1, top_index + k, GESTURE_HISTORY_TOP_K - 1 - k);
+            memmove(top_score + k + 1, top_score + k, (GESTURE_HISTORY_TOP_K - 1 - k) * sizeof(float));
+            top_index[k] = (uint8_t)i;
+            top_score[k] = p;
+        }
+    }
+    if (predicted_index >= 0 && top_index[0] != predicted_index)
+    {
+        memset(top_index, GESTURE_HISTORY_NO_SPELL, GESTURE_HISTORY_TOP_K);
+        for (int k = 0; k < GESTURE_HISTORY_TOP_K; k++)
+            top_score[k] = 0.0f;
+        top_index[0] = (uint8_t)predicted_index;
+        top_score[0] = confidence;
+    }
+}
+
+bool WandBLEClient::recognizeGesture(const Position2D *positions, size_t position_count)
+{
+    bool recognized = false;
+
+    // Window 0 is the base trim; the alternates are only inferred if it isn't confident
+    // The detector picks the preprocessor matching its model's input shape, so it is held from
+    // here through inference: a model switch in between would read a buffer of the old shape
+    xSemaphoreTake(detectorMutex, portMAX_DELAY);
+    float *normalized_positions = windowBuffer;
+    size_t input_size = spellDetector.getInputSize();
+    int64_t preprocess_start = esp_timer_get_time();
+    size_t window_count = spellDetector.preprocessWindows(positions, position_count, windowBuffer, windowIds,
+                                                          MULTI_WINDOW_RETRY ? PREPROCESS_MAX_WINDOWS : 1);
+    bool preprocessed = window_count > 0;
+
+    // Custom gestures always use the 50 x,y template shape
+    float *gesture_positions = normalized_positions;
+    if (preprocessed && input_size != SPELL_INPUT_SIZE)
+    {
+        gesture_positions = gestureBuffer;
+        preprocessed = GesturePreprocessor::preprocess(positions, position_count, gestureBuffer, SPELL_INPUT_SIZE);
+    }
+    uint32_t preprocess_us = (uint32_t)(esp_timer_get_time() - preprocess_start);
+
+    GestureHistoryRecord history = {};
+    history.timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    history.duration_ms = (uint32_t)(position_count * IMU_SAMPLE_PERIOD * 1000.0f);
+    history.preprocess_us = preprocess_us;
+    history.window_count = (uint8_t)window_count;
+    memset(history.top_index, GESTURE_HISTORY_NO_SPELL, sizeof(history.top_index));
+
+    char record_name[CUSTOM_GESTURE_NAME_LEN];
+    bool recording = preprocessed && customGestures.takeRecording(record_name);
+    if (!preprocessed || recording)
+    {
+        xSemaphoreGive(detectorMutex); // Nothing to infer
+    }
+
+    if (recording)
+    {
+        // Training example for a custom gesture - store it instead of casting
+        bool stored = customGestures.addExample(record_name, gesture_positions);
+        if (webServer)
+        {
+            webServer->broadcastCustomGestureRecorded(record_name, stored);
+        }
+    }
+    else if (preprocessed)
+    {
+        personalization.clearLast();
+        int64_t detect_start = esp_timer_get_time();
+        const char *spell_name = cascade.detect(spellDetector, normalized_positions);
+        float confidence = cascade.getConfidence();
+        const char *predicted = cascade.getLastPrediction();
+        int predicted_index = cascade.getLastPredictionIndex();
+
+        windowStats.casts++;
+        windowStats.evaluated[0]++;
+        windowStats.total_us[0] += esp_timer_get_time() - detect_start;
+        if (spell_name)
+        {
+            windowStats.hits[0]++;
+        }
+        else if (window_count > 1 && spellDetector.isReady())
+        {
+            // Base trim not confident - give the other trims one pass through the full model
+            int best_window = -1;
+            const char *retry = spellDetector.detectWindows(windowBuffer + input_size, windowIds + 1,
+                                                            window_count - 1, SPELL_CONFIDENCE_THRESHOLD,
+                                                            &windowStats, &best_window);
+            if (spellDetector.getConfidence() > confidence)
+            {
+                confidence = spellDetector.getConfidence();
+                predicted = spellDetector.getLastPrediction();
+                predicted_index = spellDetector.getLastPredictionIndex();
+            }
+            if (retry)
+            {
+                spell_name = retry;
+                history.flags |= GESTURE_HISTORY_FLAG_RESCUED;
+                windowStats.rescued++;
+                ESP_LOGI(TAG, "Cast rescued by '%s' trim window (%lu rescued / %lu casts)",
+                         PREPROCESS_WINDOW_NAMES[best_window], (unsigned long)windowStats.rescued,
+                         (unsigned long)windowStats.casts);
+            }
+        }
+        uint32_t detect_us = (uint32_t)(esp_timer_get_time() - detect_start);
+        bool full_model = cascade.wasEscalated();
+        uint8_t top_index[GESTURE_HISTORY_TOP_K];
+        float top_score[GESTURE_HISTORY_TOP_K];
+        fill_top_k(spellDetector, full_model, predicted_index, confidence, top_index, top_score);
+        xSemaphoreGive(detectorMutex);
+
+        // Same tensor to the candidate model on its own low-priority task
+        shadowEvaluator.submit(positions, position_count, normalized_positions, input_size,
+                               predicted_index, confidence, detect_us);
+
+        // User-recorded gestures run alongside the model and win when they match
+        float custom_score = 0.0f;
+        const char *custom_name = customGestures.match(gesture_positions, &custom_score);
+        ESP_LOGI(TAG, "Cast latency: preprocess %lu us, model %lu us (personalization %lu us), custom %lu us (%zu examples)",
+                 (unsigned long)preprocess_us, (unsigned long)detect_us,
+                 (unsigned long)personalization.getStats().last_us,
+                 (unsigned long)customGestures.getLastMatchUs(), customGestures.getTemplateCount());
+        // Labelled dataset capture (web UI toggle); staged in RAM and written by its own task
+        datasetCapture.capture(positions, position_count, normalized_positions, input_size,
+                               predicted_index, confidence, spell_name != nullptr || custom_name != nullptr);
+
+        // Diagnosis ring (GET /history/download, /history/replay); a memcpy into PSRAM
+        history.detect_us = detect_us;
+        history.custom_us = customGestures.getLastMatchUs();
+        history.flags |= (spell_name || custom_name ? GESTURE_HISTORY_FLAG_RECOGNIZED : 0) |
+                         (full_model ? 0 : GESTURE_HISTORY_FLAG_STAGE1) |
+                         (custom_name ? GESTURE_HISTORY_FLAG_CUSTOM : 0);
+        memcpy(history.top_index, top_index, sizeof(top_index));
+        memcpy(history.top_score, top_score, sizeof(top_score));
+        gestureHistory.record(positions, position_count, normalized_positions, input_size, history);
+
+        if (custom_name)
+        {
+            spell_name = custom_name;
+            confidence = custom_score;
+        }
+        recognized = spell_name != nullptr;
+
+        if (spell_name && spellCallback)
+        {
+            spellCallback(spell_name, confidence);
+
+            // Send mapped keyboard key for detected spell
+#if USE_USB_HID_DEVICE
+            usbHID.sendSpellKeyboardForSpell(spell_name);
+            usbHID.sendSpellGamepadForSpell(spell_name);
+#endif
+        }
+        else if (!spell_name)
+        {
+            // Low confidence - get the prediction anyway for GUI display
+            // Broadcast to web GUI even though confidence is too low
+            if (webServer && predicted)
+            {
+                webServer->broadcastLowConfidence(predicted, confidence);
+            }
+        }
+    }
+    else if (!preprocessed)
+    {
+        // Rejected before the model (too short / no motion) - the path is still worth keeping
+        gestureHistory.record(positions, position_count, nullptr, 0, history);
+    }
+    return recognized;
+}
+
+bool WandBLEClient::replayGesture(uint32_t id, int runs, GestureReplayResult *out)
+{
+    if (!out || !spellDetector.isReady())
+        return false;
+    if (runs < 1)
+        runs = 1;
+    if (runs > GESTURE_REPLAY_MAX_RUNS)
+        runs = GESTURE_REPLAY_MAX_RUNS;
+
+    // Entry copy + model input scratch are too big for the caller's (httpd) stack
+    GestureHistoryEntry *entry = (GestureHistoryEntry *)heap_caps_malloc(sizeof(GestureHistoryEntry), MALLOC_CAP_SPIRAM);
+    if (!entry)
+        entry = (GestureHistoryEntry *)malloc(sizeof(GestureHistoryEntry));
+    float *input = (float *)malloc(SPELL_INPUT_MAX_SIZE * sizeof(float));
+    bool ok = entry && input && gestureHistory.get(id, entry);
+
+    memset(out, 0, sizeof(*out));
+    out->id = id;
+    out->predicted = -1;
+    out->tensor_max_diff = -1.0f;
+    out->preprocess_us_min = UINT32_MAX;
+    out->detect_us_min = UINT32_MAX;
+    uint64_t preprocess_total = 0, detect_total = 0;
+
+    for (int run = 0; ok && run < runs; run++)
+    {
+        // Released between runs so a real cast never waits for a whole benchmark
+        xSemaphoreTake(detectorMutex, portMAX_DELAY);
+        int64_t start = esp_timer_get_time();
+        size_t produced = spellDetector.preprocessWindows(entry->positions, entry->record.position_count,
+                                                          input, nullptr, 1);
+        int64_t preprocessed = esp_timer_get_time();
+        const char *spell = produced ? spellDetector.detect(input) : nullptr;
+        int64_t done = esp_timer_get_time();
+
+        out->spell = spell;
+        out->predicted = produced ? spellDetector.getLastPredictionIndex() : -1;
+        out->confidence = produced ? spellDetector.getConfidence() : 0.0f;
+        fill_top_k(spellDetector, produced > 0, out->predicted, out->confidence, out->top_index, out->top_score);
+        // A replay must not become the target of the user's next correction
+        personalization.clearLast();
+        xSemaphoreGive(detectorMutex);
+
+        uint32_t preprocess_us = (uint32_t)(preprocessed - start);
+        uint32_t detect_us = (uint32_t)(done - preprocessed);
+        preprocess_total += preprocess_us;
+        detect_total += detect_us;
+        if (preprocess_us < out->preprocess_us_min)
+            out->preprocess_us_min = preprocess_us;
+        if (preprocess_us > out->preprocess_us_max)
+            out->preprocess_us_max = preprocess_us;
+        if (detect_us < out->detect_us_min)
+            out->detect_us_min = detect_us;
+        if (detect_us > out->detect_us_max)
+            out->detect_us_max = detect_us;
+        out->runs++;
+
+        if (run == 0 && produced)
+        {
+            // Same input as the live cast unless the model (or preprocessing) changed since
+            out->tensor_size = (uint16_t)spellDetector.getInputSize();
+            if (out->tensor_size == entry->record.tensor_size)
+            {
+                float max_diff = 0.0f;
+                for (size_t i = 0; i < out->tensor_size; i++)
+                    max_diff = fmaxf(max_diff, fabsf(input[i] - entry->tensor[i]));
+                out->tensor_max_diff = max_diff;
+            }
+        }
+    }
+    if (out->runs > 0)
+    {
+        out->preprocess_us_avg = (uint32_t)(preprocess_total / out->runs);
+        out->detect_us_avg = (uint32_t)(detect_total / out->runs);
+    }
+
+    free(input);
+    free(entry);
+    return ok;
+}
+
 void WandBLEClient::processButtonPacket(const uint8_t *data, size_t length)
 {
     uint8_t buttonState;
@@ -920,6 +1422,17 @@ void WandBLEClient::processButtonPacket(const uint8_t *data, size_t length)
 
         // Enable purple LED on wand tip to indicate tracking
         wandCommands.setLED(LedGroup::TIP, 255, 0, 255);
+#if CONTINUOUS_SEGMENTATION
+        if (segmentTracking)
+        {
+            // Buttons take over: drop the motion segment and track from the press
+            Position2D *discard = nullptr;
+            size_t discard_count = 0;
+            ahrsTracker.stopTracking(&discard, &discard_count);
+            segmentTracking = false;
+        }
+        segmenter.reset();
+#endif
         if (!ahrsTracker.isTracking())
         {
             ahrsTracker.startTracking();
@@ -949,34 +1462,7 @@ void WandBLEClient::processButtonPacket(const uint8_t *data, size_t length)
 
             if (ahrsTracker.stopTracking(&positions, &position_count))
             {
-                float normalized_positions[SPELL_INPUT_SIZE];
-                if (GesturePreprocessor::preprocess(positions, position_count,
-                                                    normalized_positions, SPELL_INPUT_SIZE))
-                {
-                    const char *spell_name = spellDetector.detect(normalized_positions);
-                    if (spell_name && spellCallback)
-                    {
-                        spellCallback(spell_name, spellDetector.getConfidence());
-
-                        // Send mapped keyboard key for detected spell
-#if USE_USB_HID_DEVICE
-                        usbHID.sendSpellKeyboardForSpell(spell_name);
-                        usbHID.sendSpellGamepadForSpell(spell_name);
-#endif
-                    }
-                    else if (!spell_name)
-                    {
-                        // Low confidence - get the prediction anyway for GUI display
-                        const char *predicted = spellDetector.getLastPrediction();
-                        float conf = spellDetector.getConfidence();
-
-                        // Broadcast to web GUI even though confidence is too low
-                        if (webServer && predicted)
-                        {
-                            webServer->broadcastLowConfidence(predicted, conf);
-                        }
-                    }
-                }
+                recognizeGesture(positions, position_count);
                 // Do NOT free positions - it's owned by ahrsTracker
             }
 
@@ -1014,6 +1500,59 @@ void WandBLEClient::processIMUPacket(const uint8_t *data, size_t length)
     }
 }
 
+void WandBLEClient::processSegmentEvent(SegmentEvent event)
+{
+    if (event == SEGMENT_START && !ahrsTracker.isTracking())
+    {
+        ahrsTracker.startTracking();
+        segmentTracking = true;
+        if (webServer)
+        {
+            webServer->broadcastGestureStart();
+        }
+        return;
+    }
+
+    if (!segmentTracking || (event != SEGMENT_END && event != SEGMENT_REJECTED && event != SEGMENT_ABORTED))
+        return;
+
+    Position2D *positions = nullptr;
+    size_t position_count = 0;
+    bool stopped = ahrsTracker.stopTracking(&positions, &position_count);
+    segmentTracking = false;
+
+    if (event == SEGMENT_END && stopped)
+    {
+        // Second gate on the path itself: wrist rotation in place has energy but no extent
+        float min_x = INFINITY, max_x = -INFINITY, min_y = INFINITY, max_y = -INFINITY;
+        for (size_t i = 0; i < position_count; i++)
+        {
+            min_x = fminf(min_x, positions[i].x);
+            max_x = fmaxf(max_x, positions[i].x);
+            min_y = fminf(min_y, positions[i].y);
+            max_y = fmaxf(max_y, positions[i].y);
+        }
+        float extent = fmaxf(max_x - min_x, max_y - min_y);
+        if (position_count > 0 && extent >= SEGMENT_MIN_EXTENT)
+        {
+            if (recognizeGesture(positions, position_count))
+            {
+                segmenter.countRecognized();
+            }
+        }
+        else
+        {
+            segmenter.countGateRejected();
+            ESP_LOGD(TAG, "Segment rejected: path extent %.1f", extent);
+        }
+    }
+
+    if (webServer)
+    {
+        webServer->broadcastGestureEnd();
+    }
+}
+
 void WandBLEClient::updateAHRS(const IMUSample &sample)
 {
     // ALWAYS update AHRS to maintain orientation quaternion
@@ -1029,6 +1568,15 @@ void WandBLEClient::updateAHRS(const IMUSample &sample)
 
     ahrsTracker.update(sample);
 
+#if CONTINUOUS_SEGMENTATION
+    // Button-free mode: motion energy opens/closes segments while the buttons are idle
+    bool buttons_tracking = __builtin_popcount(lastButtonState & 0x0F) >= BUTTON_MIN_FOR_TRACKING;
+    if (!buttons_tracking)
+    {
+        processSegmentEvent(segmenter.update(sample));
+    }
+#endif
+
     bool is_tracking = ahrsTracker.isTracking();
 
     if (is_tracking != was_tracking)
@@ -0,0 +1,126 @@
+#include "cascade.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "cascade";
+
+CascadeRecognizer::CascadeRecognizer()
+    : stage1Enabled(false), acceptThreshold(CASCADE_ACCEPT_THRESHOLD), calibration(nullptr),
+      lastPrediction(nullptr), lastIndex(-1), lastConfidence(0.0f), lastEscalated(false)
+{
+    stage1Name[0] = '\0';
+    resetStats();
+}
+
+void CascadeRecognizer::resetStats()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool CascadeRecognizer::setStage1Model(const ModelInfo *info)
+{
+    stage1Enabled = false;
+    stage1Name[0] = '\0';
+    resetStats();
+
+    if (!info)
+    {
+        stage1.begin(nullptr, 0); // Release arena + interpreter
+        ESP_LOGI(TAG, "Cascade disabled - every cast uses the full model");
+        return true;
+    }
+
+    if (info->output_classes != SPELL_OUTPUT_SIZE)
+    {
+        ESP_LOGW(TAG, "Stage-1 model '%s' has %u classes, need %d", info->name, info->output_classes, SPELL_OUTPUT_SIZE);
+        return false;
+    }
+
+    if (!stage1.begin(info->data, info->size, info->crc32) || !stage1.isReady())
+    {
+        ESP_LOGE(TAG, "Failed to load stage-1 model '%s'", info->name);
+        stage1.begin(nullptr, 0);
+        return false;
+    }
+
+    strncpy(stage1Name, info->name, sizeof(stage1Name) - 1);
+    stage1Name[sizeof(stage1Name) - 1] = '\0';
+    stage1Enabled = true;
+    ESP_LOGI(TAG, "Cascade enabled: stage 1 '%s', accept at %.2f", stage1Name, acceptThreshold);
+    return true;
+}
+
+const char *CascadeRecognizer::detect(SpellDetector &full, float *positions, float confidence_threshold)
+{
+    int64_t start = esp_timer_get_time();
+    const char *result = nullptr;
+    lastEscalated = true;
+
+    // Both stages read the same preprocessed input, so stage 1 only runs when the shapes match
+    if (stage1Enabled && stage1.getInputSize() == full.getInputSize())
+    {
+        // Threshold 0: any top-1 comes back (nullptr only if inference failed); the accept
+        // threshold alone decides whether stage 1 answers
+        bool ran = stage1.detect(positions, 0.0f) != nullptr;
+        float probs[SPELL_OUTPUT_SIZE];
+        for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+        {
+            probs[i] = stage1.getProbability(i);
+        }
+        if (calibration)
+        {
+            calibration->apply(probs); // Temperature keeps the top-1, only its confidence moves
+        }
+        int index = stage1.getLastPredictionIndex();
+        stats.stage1_us += esp_timer_get_time() - start;
+
+        if (ran && index >= 0 && index < SPELL_OUTPUT_SIZE && probs[index] >= acceptThreshold)
+        {
+            lastPrediction = stage1.getLastPrediction();
+            lastIndex = index;
+            lastConfidence = probs[index];
+            lastEscalated = false;
+
+            // The answer still has to pass the spell's threshold, calibrated like the full model's
+            float spell_threshold = calibration ? calibration->getThreshold(index) : confidence_threshold;
+            result = lastConfidence >= spell_threshold ? lastPrediction : nullptr;
+            if (!result)
+            {
+                stats.stage1_rejects++;
+            }
+        }
+        else
+        {
+            stats.escalations++;
+        }
+    }
+    else if (stage1Enabled)
+    {
+        stats.shape_skips++;
+    }
+
+    if (lastEscalated)
+    {
+        int64_t stage2_start = esp_timer_get_time();
+        result = full.detect(positions, confidence_threshold);
+        stats.stage2_us += esp_timer_get_time() - stage2_start;
+        lastPrediction = full.getLastPrediction();
+        lastIndex = full.getLastPredictionIndex();
+        lastConfidence = full.getConfidence();
+    }
+
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+    stats.casts++;
+    stats.total_us += elapsed;
+
+    if (stage1Enabled)
+    {
+        ESP_LOGI(TAG, "Cast %s in %lu us (escalation rate %lu/%lu, %lu skipped on input shape)",
+                 lastEscalated ? "escalated" : (result ? "answered by stage 1" : "rejected by stage 1"),
+                 (unsigned long)elapsed,
+                 (unsigned long)stats.escalations, (unsigned long)(stats.casts - stats.shape_skips),
+                 (unsigned long)stats.shape_skips);
+    }
+    return result;
+}
@@ -0,0 +1,318 @@
+#include "custom_gestures.h"
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_spiffs.h"
+
+static const char *TAG = "custom_gestures";
+
+#define CUSTOM_GESTURE_MAGIC 0x47435557 // "WUCG"
+#define CUSTOM_GESTURE_VERSION 1
+
+struct __attribute__((packed)) CustomGestureFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+};
+
+static void quantize(const float *input, uint8_t *out)
+{
+    for (int i = 0; i < SPELL_INPUT_SIZE; i++)
+    {
+        float v = input[i] * 255.0f + 0.5f;
+        out[i] = v <= 0.0f ? 0 : (v >= 255.0f ? 255 : (uint8_t)v);
+    }
+}
+
+CustomGestureEngine::CustomGestureEngine()
+    : count(0), loaded(false), lastMatchUs(0)
+{
+    recordingName[0] = '\0';
+    matchedName[0] = '\0';
+    mutex = xSemaphoreCreateMutex();
+}
+
+bool CustomGestureEngine::ensureLoaded()
+{
+    if (loaded)
+        return true;
+
+    // SPIFFS is mounted by the web server; try again on a later cast if it isn't yet
+    if (!esp_spiffs_mounted("spiffs"))
+        return false;
+
+    loaded = true;
+    count = 0;
+
+    FILE *f = fopen(CUSTOM_GESTURE_FILE, "rb");
+    if (!f)
+    {
+        ESP_LOGI(TAG, "No custom gestures stored yet");
+        return true;
+    }
+
+    CustomGestureFileHeader header;
+    if (fread(&header, sizeof(header), 1, f) == 1 &&
+        header.magic == CUSTOM_GESTURE_MAGIC && header.version == CUSTOM_GESTURE_VERSION)
+    {
+        size_t n = header.count < CUSTOM_GESTURE_MAX_TEMPLATES ? header.count : CUSTOM_GESTURE_MAX_TEMPLATES;
+        count = fread(templates, sizeof(CustomGestureTemplate), n, f);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Ignoring invalid %s", CUSTOM_GESTURE_FILE);
+    }
+    fclose(f);
+
+    ESP_LOGI(TAG, "Loaded %zu custom gesture examples", count);
+    return true;
+}
+
+bool CustomGestureEngine::save()
+{
+    FILE *f = fopen(CUSTOM_GESTURE_FILE, "wb");
+    if (!f)
+    {
+        ESP_LOGE(TAG, "Failed to open %s for writing", CUSTOM_GESTURE_FILE);
+        return false;
+    }
+
+    CustomGestureFileHeader header = {CUSTOM_GESTURE_MAGIC, CUSTOM_GESTURE_VERSION, (uint16_t)count};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(templates, sizeof(CustomGestureTemplate), count, f) == count;
+    fclose(f);
+
+    if (!ok)
+        ESP_LOGE(TAG, "Failed to write custom gestures");
+    return ok;
+}
+
+#if CUSTOM_GESTURE_USE_DTW
+uint32_t CustomGestureEngine::distance(const uint8_t *a, const uint8_t *b, uint32_t limit)
+{
+    // Banded DTW over 50 2-D points, two rolling rows
+    const int n = SPELL_SAMPLE_COUNT;
+    const uint32_t INF = UINT32_MAX / 2;
+    uint32_t prev[SPELL_SAMPLE_COUNT + 1];
+    uint32_t curr[SPELL_SAMPLE_COUNT + 1];
+
+    for (int j = 0; j <= n; j++)
+        prev[j] = INF;
+    prev[0] = 0;
+
+    for (int i = 1; i <= n; i++)
+    {
+        for (int j = 0; j <= n; j++)
+            curr[j] = INF;
+
+        int j_start = i - CUSTOM_GESTURE_DTW_BAND > 1 ? i - CUSTOM_GESTURE_DTW_BAND : 1;
+        int j_end = i + CUSTOM_GESTURE_DTW_BAND < n ? i + CUSTOM_GESTURE_DTW_BAND : n;
+        uint32_t row_min = INF;
+
+        for (int j = j_start; j <= j_end; j++)
+        {
+            int dx = (int)a[(i - 1) * 2] - (int)b[(j - 1) * 2];
+            int dy = (int)a[(i - 1) * 2 + 1] - (int)b[(j - 1) * 2 + 1];
+            uint32_t cost = (uint32_t)(dx * dx + dy * dy);
+
+            uint32_t best = prev[j - 1];
+            if (prev[j] < best)
+                best = prev[j];
+            if (curr[j - 1] < best)
+                best = curr[j - 1];
+
+            curr[j] = best + cost;
+            if (curr[j] < row_min)
+                row_min = curr[j];
+        }
+
+        // Early abandon: every warping path passes through this row
+        if (row_min > limit)
+            return row_min;
+
+        memcpy(prev, curr, sizeof(prev));
+    }
+    return prev[n];
+}
+#else
+uint32_t CustomGestureEngine::distance(const uint8_t *a, const uint8_t *b, uint32_t limit)
+{
+    // Point-wise squared Euclidean, abandoned once it exceeds the best so far
+    uint32_t sum = 0;
+    for (int i = 0; i < SPELL_INPUT_SIZE; i += 2)
+    {
+        int dx = (int)a[i] - (int)b[i];
+        int dy = (int)a[i + 1] - (int)b[i + 1];
+        sum += (uint32_t)(dx * dx + dy * dy);
+        if (sum > limit)
+            return sum;
+    }
+    return sum;
+}
+#endif
+
+const char *CustomGestureEngine::match(const float *input, float *out_score)
+{
+    if (!input || xSemaphoreTake(mutex, pdMS_TO_TICKS(50)) != pdTRUE)
+        return nullptr;
+
+    int64_t start = esp_timer_get_time();
+    const char *best_name = nullptr;
+    float score = 0.0f;
+
+    if (ensureLoaded() && count > 0)
+    {
+        uint8_t query[SPELL_INPUT_SIZE];
+        quantize(input, query);
+
+        // Anything worse than the acceptance threshold is pruned from the start
+        float max_q = CUSTOM_GESTURE_MAX_DISTANCE * 255.0f;
+        uint32_t limit = (uint32_t)(max_q * max_q * SPELL_SAMPLE_COUNT);
+        uint32_t best = limit;
+        size_t best_index = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t d = distance(query, templates[i].points, best);
+            if (d < best)
+            {
+                best = d;
+                best_index = i;
+                best_name = templates[i].name;
+            }
+        }
+
+        if (best_name)
+        {
+            strncpy(matchedName, best_name, sizeof(matchedName) - 1);
+            matchedName[sizeof(matchedName) - 1] = '\0';
+            best_name = matchedName;
+            float rms = sqrtf((float)best / SPELL_SAMPLE_COUNT) / 255.0f;
+            score = 1.0f - rms / CUSTOM_GESTURE_MAX_DISTANCE;
+            ESP_LOGI(TAG, "Custom match: %s (example %zu, rms %.3f)", best_name, best_index, rms);
+        }
+    }
+
+    lastMatchUs = (uint32_t)(esp_timer_get_time() - start);
+    xSemaphoreGive(mutex);
+
+    if (out_score)
+        *out_score = score;
+    return best_name;
+}
+
+bool CustomGestureEngine::addExample(const char *name, const float *input)
+{
+    if (!name || !name[0] || !input)
+        return false;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool ok = false;
+    if (!ensureLoaded())
+    {
+        ESP_LOGE(TAG, "SPIFFS not mounted - cannot store custom gesture");
+    }
+    else if (count >= CUSTOM_GESTURE_MAX_TEMPLATES)
+    {
+        ESP_LOGW(TAG, "Custom gesture storage full (%d examples)", CUSTOM_GESTURE_MAX_TEMPLATES);
+    }
+    else
+    {
+        CustomGestureTemplate &t = templates[count];
+        memset(t.name, 0, sizeof(t.name));
+        strncpy(t.name, name, sizeof(t.name) - 1);
+        quantize(input, t.points);
+        count++;
+        ok = save();
+        if (!ok)
+            count--;
+    }
+    xSemaphoreGive(mutex);
+
+    if (ok)
+        ESP_LOGI(TAG, "Stored example for '%s' (%zu total)", name, count);
+    return ok;
+}
+
+bool CustomGestureEngine::removeGesture(const char *name)
+{
+    if (!name)
+        return false;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool removed = false;
+    if (ensureLoaded())
+    {
+        size_t out = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (strncmp(templates[i].name, name, CUSTOM_GESTURE_NAME_LEN) == 0)
+            {
+                removed = true;
+                continue;
+            }
+            if (out != i)
+                templates[out] = templates[i];
+            out++;
+        }
+        count = out;
+        if (removed)
+            save();
+    }
+    xSemaphoreGive(mutex);
+    return removed;
+}
+
+void CustomGestureEngine::armRecording(const char *name)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    memset(recordingName, 0, sizeof(recordingName));
+    if (name)
+        strncpy(recordingName, name, sizeof(recordingName) - 1);
+    xSemaphoreGive(mutex);
+}
+
+bool CustomGestureEngine::takeRecording(char *name_out)
+{
+    if (!isRecording())
+        return false;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool armed = recordingName[0] != '\0';
+    if (armed)
+    {
+        memcpy(name_out, recordingName, CUSTOM_GESTURE_NAME_LEN);
+        recordingName[0] = '\0';
+    }
+    xSemaphoreGive(mutex);
+    return armed;
+}
+
+size_t CustomGestureEngine::list(char (*names)[CUSTOM_GESTURE_NAME_LEN], uint8_t *counts, size_t max)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    size_t n = 0;
+    if (ensureLoaded())
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t j = 0;
+            while (j < n && strncmp(names[j], templates[i].name, CUSTOM_GESTURE_NAME_LEN) != 0)
+                j++;
+            if (j == n)
+            {
+                if (n >= max)
+                    continue;
+                memcpy(names[n], templates[i].name, CUSTOM_GESTURE_NAME_LEN);
+                counts[n] = 0;
+                n++;
+            }
+            counts[j]++;
+        }
+    }
+    xSemaphoreGive(mutex);
+    return n;
+}
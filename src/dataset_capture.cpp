@@ -0,0 +1,461 @@
+#include "dataset_capture.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_spiffs.h"
+
+static const char *TAG = "dataset";
+
+// Worst-case bytes of one zigzag varint (32-bit)
+#define VARINT_MAX_BYTES 5
+
+static uint8_t *putVarint(uint8_t *p, int32_t value)
+{
+    uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    while (zigzag >= 0x80)
+    {
+        *p++ = (uint8_t)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    *p++ = (uint8_t)zigzag;
+    return p;
+}
+
+static int32_t quantizePosition(float mm)
+{
+    return (int32_t)lroundf(mm * DATASET_POSITION_SCALE);
+}
+
+DatasetCapture::DatasetCapture()
+    : enabled(false), label(DATASET_LABEL_NONE),
+      active(nullptr), pending(nullptr), activeLen(0), pendingLen(0),
+      activeRecords(0), pendingRecords(0), activeSinceUs(0),
+      firstSegment(0), nextSegment(0), segmentBytes(0), segmentCount(0), storedBytes(0), scanned(false),
+      stats{}, task(nullptr)
+{
+    stageMutex = xSemaphoreCreateMutex();
+    fileMutex = xSemaphoreCreateMutex();
+}
+
+bool DatasetCapture::start()
+{
+    if (task)
+        return true;
+
+    // Staging buffers prefer PSRAM; internal RAM is kept for the BLE/inference path
+    if (!active)
+    {
+        active = (uint8_t *)heap_caps_malloc(DATASET_STAGE_SIZE, MALLOC_CAP_SPIRAM);
+        if (!active)
+            active = (uint8_t *)malloc(DATASET_STAGE_SIZE);
+    }
+    if (!pending)
+    {
+        pending = (uint8_t *)heap_caps_malloc(DATASET_STAGE_SIZE, MALLOC_CAP_SPIRAM);
+        if (!pending)
+            pending = (uint8_t *)malloc(DATASET_STAGE_SIZE);
+    }
+    if (!active || !pending || !stageMutex || !fileMutex)
+    {
+        ESP_LOGE(TAG, "Failed to allocate dataset staging buffers");
+        return false;
+    }
+
+    if (xTaskCreate(taskFunc, "dataset_writer", DATASET_TASK_STACK, this, DATASET_TASK_PRIORITY, &task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create dataset writer task");
+        task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool DatasetCapture::setEnabled(bool on)
+{
+    if (on && !start())
+        return false;
+    enabled = on;
+    ESP_LOGI(TAG, "Dataset capture %s", on ? "enabled" : "disabled");
+    return true;
+}
+
+void DatasetCapture::segmentPath(uint32_t sequence, char *path, size_t len)
+{
+    snprintf(path, len, DATASET_FILE_DIR "/" DATASET_FILE_PREFIX "%08lu.bin", (unsigned long)sequence);
+}
+
+bool DatasetCapture::swapStage()
+{
+    // Caller holds stageMutex
+    if (pendingLen > 0 || activeLen == 0)
+        return false;
+
+    uint8_t *tmp = pending;
+    pending = active;
+    active = tmp;
+    pendingLen = activeLen;
+    pendingRecords = activeRecords;
+    activeLen = 0;
+    activeRecords = 0;
+    return true;
+}
+
+void DatasetCapture::capture(const Position2D *positions, size_t position_count,
+                             const float *input, size_t input_size,
+                             int predicted_index, float confidence, bool recognized)
+{
+    if (!enabled || !task || !positions || position_count == 0)
+        return;
+
+    size_t count = position_count < DATASET_MAX_POSITIONS ? position_count : DATASET_MAX_POSITIONS;
+    size_t tensor_size = input ? input_size : 0;
+    if (tensor_size > SPELL_INPUT_MAX_SIZE)
+        tensor_size = SPELL_INPUT_MAX_SIZE;
+    size_t bound = sizeof(DatasetRecordHeader) + tensor_size * sizeof(uint16_t) + count * 2 * VARINT_MAX_BYTES;
+
+    // Held by the writer only to swap pointers, never across a flash write
+    xSemaphoreTake(stageMutex, portMAX_DELAY);
+    bool notify = false;
+    if (activeLen + bound > DATASET_STAGE_SIZE)
+    {
+        notify = swapStage();
+        if (!notify)
+        {
+            // Previous buffer still being written - never wait for flash here
+            stats.dropped++;
+            xSemaphoreGive(stageMutex);
+            return;
+        }
+    }
+
+    uint8_t *start = active + activeLen;
+    uint8_t *p = start + sizeof(DatasetRecordHeader);
+    for (size_t i = 0; i < tensor_size; i++)
+    {
+        float v = input[i] * 65535.0f + 0.5f;
+        uint16_t q = v <= 0.0f ? 0 : (v >= 65535.0f ? 65535 : (uint16_t)v);
+        memcpy(p, &q, sizeof(q));
+        p += sizeof(q);
+    }
+
+    // First point absolute, then deltas of the quantized path (no drift)
+    int32_t prev_x = 0, prev_y = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t x = quantizePosition(positions[i].x);
+        int32_t y = quantizePosition(positions[i].y);
+        p = putVarint(p, x - prev_x);
+        p = putVarint(p, y - prev_y);
+        prev_x = x;
+        prev_y = y;
+    }
+
+    DatasetRecordHeader header;
+    header.size = (uint16_t)(p - start - sizeof(DatasetRecordHeader));
+    header.label = label;
+    header.predicted = predicted_index >= 0 && predicted_index < SPELL_OUTPUT_SIZE ? (uint8_t)predicted_index : DATASET_LABEL_NONE;
+    float c = confidence * 65535.0f + 0.5f;
+    header.confidence = c <= 0.0f ? 0 : (c >= 65535.0f ? 65535 : (uint16_t)c);
+    header.flags = (recognized ? DATASET_FLAG_RECOGNIZED : 0) | (count < position_count ? DATASET_FLAG_TRUNCATED : 0);
+    header.reserved = 0;
+    header.tensor_size = (uint16_t)tensor_size;
+    header.position_count = (uint16_t)count;
+    header.timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    memcpy(start, &header, sizeof(header));
+
+    if (activeLen == 0)
+        activeSinceUs = esp_timer_get_time();
+    activeLen += p - start;
+    activeRecords++;
+    stats.captured++;
+    notify |= activeLen >= DATASET_STAGE_SIZE / 2;
+    xSemaphoreGive(stageMutex);
+
+    if (notify)
+        xTaskNotifyGive(task);
+}
+
+void DatasetCapture::taskFunc(void *arg)
+{
+    DatasetCapture *self = (DatasetCapture *)arg;
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+
+        // Write half-full buffers right away, anything else once it has sat for the flush interval
+        xSemaphoreTake(self->stageMutex, portMAX_DELAY);
+        if (self->activeLen >= DATASET_STAGE_SIZE / 2 ||
+            (self->activeLen > 0 && esp_timer_get_time() - self->activeSinceUs >= DATASET_FLUSH_INTERVAL_MS * 1000LL))
+        {
+            self->swapStage();
+        }
+        bool has_pending = self->pendingLen > 0;
+        xSemaphoreGive(self->stageMutex);
+
+        if (has_pending)
+        {
+            xSemaphoreTake(self->fileMutex, portMAX_DELAY);
+            self->writePending();
+            xSemaphoreGive(self->fileMutex);
+        }
+    }
+}
+
+bool DatasetCapture::scanSegments()
+{
+    // Caller holds fileMutex; SPIFFS is mounted by the web server
+    if (scanned)
+        return true;
+    if (!esp_spiffs_mounted("spiffs"))
+        return false;
+
+    DIR *dir = opendir(DATASET_FILE_DIR);
+    if (!dir)
+        return false;
+
+    const size_t prefix_len = strlen(DATASET_FILE_PREFIX);
+    uint32_t min_seq = UINT32_MAX, max_seq = 0;
+    size_t max_size = 0;
+    segmentCount = 0;
+    storedBytes = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        if (strncmp(entry->d_name, DATASET_FILE_PREFIX, prefix_len) != 0)
+            continue;
+        uint32_t seq = (uint32_t)strtoul(entry->d_name + prefix_len, nullptr, 10);
+
+        char path[64];
+        segmentPath(seq, path, sizeof(path));
+        struct stat st;
+        size_t size = stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+
+        segmentCount++;
+        storedBytes += size;
+        if (seq < min_seq)
+            min_seq = seq;
+        if (seq >= max_seq)
+        {
+            max_seq = seq;
+            max_size = size;
+        }
+    }
+    closedir(dir);
+
+    if (segmentCount > 0)
+    {
+        firstSegment = min_seq;
+        nextSegment = max_seq;
+        segmentBytes = max_size;
+    }
+    else
+    {
+        firstSegment = 0;
+        nextSegment = 0;
+        segmentBytes = 0;
+    }
+    scanned = true;
+    ESP_LOGI(TAG, "%zu dataset segments on flash (%zu bytes)", segmentCount, storedBytes);
+    return true;
+}
+
+bool DatasetCapture::evictOldest()
+{
+    // Sequences can have gaps (files deleted by hand) - skip to the next one that exists
+    while (segmentCount > 0 && firstSegment <= nextSegment)
+    {
+        char path[64];
+        segmentPath(firstSegment++, path, sizeof(path));
+        struct stat st;
+        if (stat(path, &st) != 0)
+            continue;
+
+        remove(path);
+        storedBytes = storedBytes > (size_t)st.st_size ? storedBytes - st.st_size : 0;
+        segmentCount--;
+        stats.evicted++;
+        ESP_LOGI(TAG, "Evicted %s (%ld bytes)", path, (long)st.st_size);
+        return true;
+    }
+    return false;
+}
+
+void DatasetCapture::writePending()
+{
+    // Caller holds fileMutex; only this path clears pending, so it is stable until then
+    xSemaphoreTake(stageMutex, portMAX_DELAY);
+    size_t len = pendingLen;
+    uint32_t records = pendingRecords;
+    xSemaphoreGive(stageMutex);
+    if (len == 0 || !scanSegments())
+        return; // Retried on the next pass once SPIFFS is mounted
+
+    if (segmentBytes > 0 && segmentBytes + len > DATASET_SEGMENT_SIZE)
+    {
+        nextSegment++;
+        segmentBytes = 0;
+    }
+
+    bool new_segment = segmentBytes == 0;
+    if (new_segment)
+    {
+        segmentCount++;
+        while (segmentCount > DATASET_MAX_SEGMENTS && evictOldest())
+        {
+        }
+    }
+
+    // Leave room on the partition for gesture images and custom gestures
+    size_t total = 0, used = 0;
+    while (segmentCount > 1 && esp_spiffs_info("spiffs", &total, &used) == ESP_OK &&
+           (used < total ? total - used : 0) < len + sizeof(DatasetSegmentHeader) + DATASET_SEGMENT_SIZE)
+    {
+        if (!evictOldest())
+            break;
+    }
+
+    char path[64];
+    segmentPath(nextSegment, path, sizeof(path));
+    FILE *f = fopen(path, new_segment ? "wb" : "ab");
+    bool ok = f != nullptr;
+    if (ok && new_segment)
+    {
+        DatasetSegmentHeader header = {DATASET_MAGIC, DATASET_VERSION, DATASET_POSITION_SCALE, nextSegment};
+        ok = fwrite(&header, sizeof(header), 1, f) == 1;
+        segmentBytes += sizeof(header);
+        storedBytes += sizeof(header);
+    }
+    if (ok)
+        ok = fwrite(pending, 1, len, f) == len;
+    if (f)
+        fclose(f);
+
+    if (ok)
+    {
+        segmentBytes += len;
+        storedBytes += len;
+        stats.written += records;
+    }
+    else
+    {
+        // Drop the batch rather than retry forever on a full or failing partition
+        ESP_LOGE(TAG, "Failed to write %zu dataset bytes to %s", len, path);
+        stats.write_errors++;
+        if (new_segment && !f)
+            segmentCount--;
+    }
+
+    xSemaphoreTake(stageMutex, portMAX_DELAY);
+    pendingLen = 0;
+    pendingRecords = 0;
+    xSemaphoreGive(stageMutex);
+}
+
+void DatasetCapture::flush()
+{
+    if (!task)
+        return;
+
+    xSemaphoreTake(fileMutex, portMAX_DELAY);
+    writePending();
+    xSemaphoreTake(stageMutex, portMAX_DELAY);
+    swapStage();
+    xSemaphoreGive(stageMutex);
+    writePending();
+    xSemaphoreGive(fileMutex);
+}
+
+bool DatasetCapture::download(DatasetChunkFn fn, void *ctx)
+{
+    if (!fn)
+        return false;
+    flush();
+
+    const size_t CHUNK = 2048;
+    uint8_t *chunk = (uint8_t *)malloc(CHUNK);
+    if (!chunk)
+        return false;
+
+    // Segments as of now; the last one only up to its current length (later appends wait for the next download)
+    xSemaphoreTake(fileMutex, portMAX_DELAY);
+    bool ok = scanSegments();
+    bool empty = segmentCount == 0;
+    uint32_t first = firstSegment;
+    uint32_t last = nextSegment;
+    size_t last_bytes = segmentBytes;
+    xSemaphoreGive(fileMutex);
+
+    for (uint32_t seq = first; ok && !empty && seq <= last; seq++)
+    {
+        char path[64];
+        segmentPath(seq, path, sizeof(path));
+        size_t limit = seq == last ? last_bytes : SIZE_MAX;
+        size_t offset = 0;
+        while (ok && offset < limit)
+        {
+            // fileMutex is held per read, never across the send, so a slow client can't stall the writer
+            xSemaphoreTake(fileMutex, portMAX_DELAY);
+            FILE *f = fopen(path, "rb");
+            size_t n = 0;
+            if (f && fseek(f, (long)offset, SEEK_SET) == 0)
+                n = fread(chunk, 1, limit - offset < CHUNK ? limit - offset : CHUNK, f);
+            if (f)
+                fclose(f);
+            xSemaphoreGive(fileMutex);
+
+            if (!f && offset > 0)
+            {
+                // Evicted (or cleared) mid-segment - a partial segment can't be decoded, so stop here
+                ESP_LOGW(TAG, "%s removed during download, stream truncated", path);
+                ok = false;
+            }
+            if (n == 0)
+                break;
+            ok = fn(chunk, n, ctx);
+            offset += n;
+        }
+    }
+
+    free(chunk);
+    return ok;
+}
+
+bool DatasetCapture::clear()
+{
+    xSemaphoreTake(fileMutex, portMAX_DELAY);
+    xSemaphoreTake(stageMutex, portMAX_DELAY);
+    activeLen = 0;
+    activeRecords = 0;
+    pendingLen = 0;
+    pendingRecords = 0;
+    xSemaphoreGive(stageMutex);
+
+    bool ok = scanSegments();
+    for (uint32_t seq = firstSegment; ok && segmentCount > 0 && seq <= nextSegment; seq++)
+    {
+        char path[64];
+        segmentPath(seq, path, sizeof(path));
+        remove(path);
+    }
+    if (ok)
+    {
+        // Sequences carry on rather than restart at 0, so a download in flight never reads
+        // a new segment under an old name
+        segmentCount = 0;
+        firstSegment = nextSegment + 1;
+        nextSegment = firstSegment;
+        segmentBytes = 0;
+        storedBytes = 0;
+    }
+    xSemaphoreGive(fileMutex);
+
+    ESP_LOGI(TAG, "Dataset %s", ok ? "cleared" : "clear failed (SPIFFS not mounted)");
+    return ok;
+}
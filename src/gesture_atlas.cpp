@@ -0,0 +1,90 @@
+#include "gesture_atlas.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "gesture_atlas";
+
+GestureAtlas::GestureAtlas() : base(nullptr), header(nullptr), entries(nullptr), mmapHandle(0)
+{
+}
+
+bool GestureAtlas::begin()
+{
+    if (base)
+        return true;
+
+    int64_t start_us = esp_timer_get_time();
+    const esp_partition_t *partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)GESTURE_ATLAS_SUBTYPE, "gestures");
+    if (!partition)
+    {
+        ESP_LOGI(TAG, "No gestures partition - images come from SPIFFS");
+        return false;
+    }
+
+    // Read the header first so only the used extent gets mapped
+    GestureAtlasHeader probe;
+    if (esp_partition_read(partition, 0, &probe, sizeof(probe)) != ESP_OK ||
+        probe.magic != GESTURE_ATLAS_MAGIC || probe.version != GESTURE_ATLAS_VERSION ||
+        probe.count == 0 || probe.count > GESTURE_ATLAS_MAX_IMAGES ||
+        probe.total_size > partition->size ||
+        sizeof(GestureAtlasHeader) + probe.count * sizeof(GestureAtlasEntry) > probe.total_size)
+    {
+        ESP_LOGW(TAG, "gestures partition holds no atlas - run tools/pack_gestures.py or 'idf.py flash'");
+        return false;
+    }
+
+    const void *mapped = nullptr;
+    esp_err_t err = esp_partition_mmap(partition, 0, probe.total_size, ESP_PARTITION_MMAP_DATA,
+                                       &mapped, &mmapHandle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_partition_mmap failed (%s)", esp_err_to_name(err));
+        return false;
+    }
+
+    const GestureAtlasHeader *mapped_header = (const GestureAtlasHeader *)mapped;
+    const GestureAtlasEntry *mapped_entries = (const GestureAtlasEntry *)(mapped_header + 1);
+    for (uint16_t i = 0; i < mapped_header->count; i++)
+    {
+        const GestureAtlasEntry &entry = mapped_entries[i];
+        if (memchr(entry.name, '\0', sizeof(entry.name)) == nullptr ||
+            (size_t)entry.offset + entry.size > mapped_header->total_size ||
+            (i > 0 && strcmp(mapped_entries[i - 1].name, entry.name) >= 0))
+        {
+            ESP_LOGE(TAG, "Corrupt atlas entry %u", i);
+            esp_partition_munmap(mmapHandle);
+            return false;
+        }
+    }
+
+    base = (const uint8_t *)mapped;
+    header = mapped_header;
+    entries = mapped_entries;
+    ESP_LOGI(TAG, "Gesture atlas mapped: %u images, %lu bytes at 0x%lx (%lld us)",
+             header->count, (unsigned long)header->total_size, (unsigned long)partition->address,
+             (long long)(esp_timer_get_time() - start_us));
+    return true;
+}
+
+const GestureAtlasEntry *GestureAtlas::find(const char *name) const
+{
+    if (!base)
+        return nullptr;
+
+    size_t low = 0;
+    size_t high = header->count;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        int cmp = strcmp(entries[mid].name, name);
+        if (cmp == 0)
+            return &entries[mid];
+        if (cmp < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return nullptr;
+}
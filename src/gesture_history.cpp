@@ -0,0 +1,172 @@
+#include "gesture_history.h"
+#include <string.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "history";
+
+GestureHistory::GestureHistory()
+    : entries(nullptr), depth(0), count(0), next(0), nextId(1), allocFailed(false), stats{}
+{
+    mutex = xSemaphoreCreateMutex();
+}
+
+bool GestureHistory::allocate()
+{
+    if (entries)
+        return true;
+    if (allocFailed || !mutex)
+        return false;
+
+    // Whole ring in PSRAM; without it keep just the last couple of casts in internal RAM
+    depth = GESTURE_HISTORY_DEPTH;
+    entries = (GestureHistoryEntry *)heap_caps_malloc(depth * sizeof(GestureHistoryEntry), MALLOC_CAP_SPIRAM);
+    if (!entries)
+    {
+        depth = GESTURE_HISTORY_NO_PSRAM_DEPTH;
+        entries = (GestureHistoryEntry *)malloc(depth * sizeof(GestureHistoryEntry));
+    }
+    if (!entries)
+    {
+        ESP_LOGE(TAG, "Failed to allocate gesture history");
+        depth = 0;
+        allocFailed = true;
+        return false;
+    }
+    ESP_LOGI(TAG, "Gesture history: %u entries (%u bytes)", (unsigned)depth,
+             (unsigned)(depth * sizeof(GestureHistoryEntry)));
+    return true;
+}
+
+void GestureHistory::record(const Position2D *positions, size_t position_count,
+                            const float *tensor, size_t tensor_size, const GestureHistoryRecord &result)
+{
+    if (!positions || !allocate())
+        return;
+
+    // A download/replay copy holds the mutex for one entry; never make the cast wait for it
+    if (xSemaphoreTake(mutex, 0) != pdTRUE)
+    {
+        stats.dropped++;
+        return;
+    }
+
+    GestureHistoryEntry &entry = entries[next];
+    size_t stored = position_count < GESTURE_HISTORY_MAX_POSITIONS ? position_count : GESTURE_HISTORY_MAX_POSITIONS;
+    if (!tensor)
+        tensor_size = 0;
+    if (tensor_size > SPELL_INPUT_MAX_SIZE)
+        tensor_size = SPELL_INPUT_MAX_SIZE;
+
+    entry.record = result;
+    entry.record.id = nextId++;
+    entry.record.position_count = (uint16_t)stored;
+    entry.record.tensor_size = (uint16_t)tensor_size;
+    if (stored < position_count)
+        entry.record.flags |= GESTURE_HISTORY_FLAG_TRUNCATED;
+    if (tensor_size == 0)
+        entry.record.flags |= GESTURE_HISTORY_FLAG_NO_TENSOR;
+    memcpy(entry.positions, positions, stored * sizeof(Position2D));
+    if (tensor_size > 0)
+        memcpy(entry.tensor, tensor, tensor_size * sizeof(float));
+
+    next = (next + 1) % depth;
+    if (count < depth)
+        count++;
+    stats.recorded++;
+    xSemaphoreGive(mutex);
+}
+
+uint32_t GestureHistory::firstId()
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t first = nextId - (uint32_t)count;
+    xSemaphoreGive(mutex);
+    return first;
+}
+
+int GestureHistory::slotOf(uint32_t id) const
+{
+    // Ids are consecutive, so the slot follows from the distance to the newest entry
+    uint32_t age = nextId - 1 - id; // 0 = newest
+    if (id >= nextId || age >= count)
+        return -1;
+    return (int)((next + depth - 1 - age) % depth);
+}
+
+bool GestureHistory::get(uint32_t id, GestureHistoryEntry *out)
+{
+    if (!out || !entries)
+        return false;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    int slot = slotOf(id);
+    if (slot >= 0)
+    {
+        const GestureHistoryEntry &entry = entries[slot];
+        out->record = entry.record;
+        memcpy(out->positions, entry.positions, entry.record.position_count * sizeof(Position2D));
+        memcpy(out->tensor, entry.tensor, entry.record.tensor_size * sizeof(float));
+    }
+    xSemaphoreGive(mutex);
+    return slot >= 0;
+}
+
+bool GestureHistory::getRecord(uint32_t id, GestureHistoryRecord *out)
+{
+    if (!out || !entries)
+        return false;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    int slot = slotOf(id);
+    if (slot >= 0)
+        *out = entries[slot].record;
+    xSemaphoreGive(mutex);
+    return slot >= 0;
+}
+
+bool GestureHistory::download(GestureHistoryChunkFn fn, void *ctx)
+{
+    if (!fn)
+        return false;
+
+    // Both ends from one snapshot, so the header bounds exactly the ids streamed below
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t first = nextId - (uint32_t)count;
+    uint32_t last = nextId - 1;
+    xSemaphoreGive(mutex);
+
+    GestureHistoryFileHeader header = {};
+    header.magic = GESTURE_HISTORY_MAGIC;
+    header.version = GESTURE_HISTORY_VERSION;
+    header.max_entry_count = (uint16_t)(last - first + 1);
+    header.top_k = GESTURE_HISTORY_TOP_K;
+    if (!fn((const uint8_t *)&header, sizeof(header), ctx))
+        return false;
+    if (header.max_entry_count == 0)
+        return true;
+
+    // One entry at a time through a scratch copy, so a slow client never holds the ring
+    GestureHistoryEntry *scratch = (GestureHistoryEntry *)heap_caps_malloc(sizeof(GestureHistoryEntry), MALLOC_CAP_SPIRAM);
+    if (!scratch)
+        scratch = (GestureHistoryEntry *)malloc(sizeof(GestureHistoryEntry));
+    if (!scratch)
+        return false;
+
+    bool ok = true;
+    for (uint32_t id = first; ok && id <= last; id++)
+    {
+        // Entries overwritten by casts during the download are skipped (fewer than max_entry_count)
+        if (!get(id, scratch))
+            continue;
+        const GestureHistoryRecord &record = scratch->record;
+        ok = fn((const uint8_t *)&record, sizeof(record), ctx) &&
+             fn((const uint8_t *)scratch->positions, record.position_count * sizeof(Position2D), ctx) &&
+             (record.tensor_size == 0 ||
+              fn((const uint8_t *)scratch->tensor, record.tensor_size * sizeof(float), ctx));
+    }
+
+    free(scratch);
+    return ok;
+}
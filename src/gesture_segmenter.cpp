@@ -0,0 +1,94 @@
+#include "gesture_segmenter.h"
+#include <string.h>
+#include <math.h>
+#include "esp_log.h"
+
+static const char *TAG = "segmenter";
+
+GestureSegmenter::GestureSegmenter()
+    : state(IDLE), energy(0.0f), run(0), length(0), cooldown(0), energySum(0.0f), pauseSum(0.0f)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void GestureSegmenter::reset()
+{
+    state = IDLE;
+    run = 0;
+    length = 0;
+    cooldown = 0;
+    energySum = 0.0f;
+    pauseSum = 0.0f;
+}
+
+SegmentEvent GestureSegmenter::update(const IMUSample &sample)
+{
+    float gyro = sqrtf(sample.gyro_x * sample.gyro_x + sample.gyro_y * sample.gyro_y +
+                       sample.gyro_z * sample.gyro_z);
+    energy += SEGMENT_ENERGY_ALPHA * (gyro - energy);
+
+    switch (state)
+    {
+    case COOLDOWN:
+        if (--cooldown == 0)
+            state = IDLE;
+        return SEGMENT_NONE;
+
+    case IDLE:
+        run = energy > SEGMENT_START_ENERGY ? run + 1 : 0;
+        if (run < SEGMENT_START_SAMPLES)
+            return SEGMENT_NONE;
+
+        state = ACTIVE;
+        run = 0;
+        length = 0;
+        energySum = 0.0f;
+        pauseSum = 0.0f;
+        stats.started++;
+        return SEGMENT_START;
+
+    case ACTIVE:
+        break;
+    }
+
+    length++;
+    energySum += energy;
+    if (energy < SEGMENT_STOP_ENERGY)
+    {
+        run++;
+        pauseSum += energy;
+    }
+    else
+    {
+        run = 0;
+        pauseSum = 0.0f;
+    }
+
+    if (length > SEGMENT_MAX_SAMPLES)
+    {
+        stats.aborted++;
+        ESP_LOGD(TAG, "Segment aborted after %u samples", length);
+        state = COOLDOWN;
+        cooldown = SEGMENT_COOLDOWN_SAMPLES;
+        return SEGMENT_ABORTED;
+    }
+    if (run < SEGMENT_PAUSE_SAMPLES)
+        return SEGMENT_NONE;
+
+    // Pause reached - gate on the moving part only (trailing pause excluded)
+    state = COOLDOWN;
+    cooldown = SEGMENT_COOLDOWN_SAMPLES;
+    uint16_t moving = length - run;
+    float mean_energy = moving ? (energySum - pauseSum) / moving : 0.0f;
+
+    if (length < SEGMENT_MIN_SAMPLES || moving == 0 || mean_energy < SEGMENT_MIN_MEAN_ENERGY)
+    {
+        stats.rejected++;
+        ESP_LOGD(TAG, "Segment rejected: %u samples (%u moving), mean energy %.2f", length, moving, mean_energy);
+        return SEGMENT_REJECTED;
+    }
+
+    stats.evaluated++;
+    ESP_LOGI(TAG, "Segment: %u samples (%u moving), mean energy %.2f rad/s", length, moving, mean_energy);
+    return SEGMENT_END;
+}
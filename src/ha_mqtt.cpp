@@ -5,6 +5,7 @@
 #include "esp_netif.h"
 #include "esp_idf_version.h"
 #include "esp_mac.h"
+#include "json_writer.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -12,8 +13,74 @@
 
 static const char *TAG = "ha_mqtt";
 
+#define DISCOVERY_BUFFER_SIZE 1200
+
+// Identity of this gateway, repeated in every discovery payload
+struct DiscoveryDevice
+{
+    const char *chip_id;
+    const char *idf_version;
+    const char *ip;
+};
+
+// Opens a discovery payload with the fields every sensor shares
+static void begin_discovery(JsonWriter &json, const DiscoveryDevice &device, const char *name,
+                            const char *suffix, const char *state_topic)
+{
+    char id[48];
+    char topic[64];
+    snprintf(id, sizeof(id), "wand_%s_%s", device.chip_id, suffix);
+    snprintf(topic, sizeof(topic), "wand/%s/%s", device.chip_id, state_topic);
+    json.beginObject();
+    json.field("name", name);
+    json.field("unique_id", id);
+    json.field("object_id", id);
+    json.field("state_topic", topic);
+}
+
+// Appends the device block, closes the payload and publishes it retained
+static int publish_discovery(esp_mqtt_client_handle_t mqtt, JsonWriter &json, const DiscoveryDevice &device,
+                             const char *component, const char *suffix)
+{
+    char value[64];
+    json.beginObject("device");
+    json.beginArray("identifiers");
+    snprintf(value, sizeof(value), "wand_%s", device.chip_id);
+    json.item(value);
+    json.endArray();
+    snprintf(value, sizeof(value), "Wand Gateway %s", device.chip_id);
+    json.field("name", value);
+    json.field("manufacturer", "DIY");
+    json.field("model", "ESP32-S3");
+    json.field("sw_version", FIRMWARE_VERSION);
+    snprintf(value, sizeof(value), "ESP-IDF %s", device.idf_version);
+    json.field("hw_version", value);
+    snprintf(value, sizeof(value), "http://%s", device.ip);
+    json.field("configuration_url", value);
+    json.beginArray("connections");
+    json.beginArray();
+    json.item("mac");
+    json.item(device.chip_id);
+    json.endArray();
+    json.endArray();
+    json.endObject();
+    json.endObject();
+
+    char topic[128];
+    snprintf(topic, sizeof(topic), "homeassistant/%s/wand_%s_%s/config", component, device.chip_id, suffix);
+    if (!json.ok())
+    {
+        ESP_LOGE(TAG, "Discovery payload for %s does not fit in %d bytes", topic, DISCOVERY_BUFFER_SIZE);
+        return -1;
+    }
+    ESP_LOGI(TAG, "📤 Publishing discovery to: %s", topic);
+    ESP_LOGD(TAG, "📤 Discovery payload: %s", json.c_str());
+    return esp_mqtt_client_publish(mqtt, topic, json.c_str(), json.length(), 1, true);
+}
+
 HAMqttClient::HAMqttClient()
-    : mqtt_client(nullptr), connected(false), on_connected_callback(nullptr)
+    : mqtt_client(nullptr), connected(false), on_connected_callback(nullptr),
+      on_model_select_callback(nullptr)
 {
 }
 
@@ -65,176 +132,98 @@ void HAMqttClient::mqtt_event_handler(void *handler_args, esp_event_base_t base,
             ESP_LOGI(TAG, "Firmware: %s (ESP-IDF %s)", FIRMWARE_VERSION, idf_version);
 
             // Reusable buffer for all discovery payloads (reduce stack usage)
-            char *discovery_buffer = (char *)malloc(1200);
+            char *discovery_buffer = (char *)malloc(DISCOVERY_BUFFER_SIZE);
             if (!discovery_buffer)
             {
                 ESP_LOGE(TAG, "Failed to allocate memory for discovery messages");
                 break;
             }
-
-            // Common device info JSON block (used by all sensors)
-            char device_info[400];
-            snprintf(device_info, sizeof(device_info),
-                     "\"device\":{"
-                     "\"identifiers\":[\"wand_%s\"],"
-                     "\"name\":\"Wand Gateway %s\","
-                     "\"manufacturer\":\"DIY\","
-                     "\"model\":\"ESP32-S3\","
-                     "\"sw_version\":\"%s\","
-                     "\"hw_version\":\"ESP-IDF %s\","
-                     "\"configuration_url\":\"http://%s\","
-                     "\"connections\":[[\"mac\",\"%s\"]]"
-                     "}",
-                     chip_id, chip_id, FIRMWARE_VERSION, idf_version, ip_str, chip_id);
+            esp_mqtt_client_handle_t mqtt = (esp_mqtt_client_handle_t)client->mqtt_client;
+            DiscoveryDevice device = {chip_id, idf_version, ip_str};
 
             // Spell sensor discovery - tracks last detected spell
-            char discovery_topic[128];
-            snprintf(discovery_topic, sizeof(discovery_topic), "homeassistant/sensor/wand_%s_spell/config", chip_id);
-            snprintf(discovery_buffer, 1200,
-                     "{"
-                     "\"name\":\"Last Spell Cast\","
-                     "\"unique_id\":\"wand_%s_spell\","
-                     "\"object_id\":\"wand_%s_spell\","
-                     "\"state_topic\":\"wand/%s/spell\","
-                     "\"value_template\":\"{{ value_json.spell }}\","
-                     "\"json_attributes_topic\":\"wand/%s/spell\","
-                     "\"icon\":\"mdi:magic-staff\","
-                     "%s"
-                     "}",
-                     chip_id, chip_id, chip_id, chip_id, device_info);
-
-            ESP_LOGI(TAG, "📤 Publishing discovery to: %s", discovery_topic);
-            ESP_LOGD(TAG, "📤 Discovery payload: %s", discovery_buffer);
-            int msg_id1 = esp_mqtt_client_publish((esp_mqtt_client_handle_t)client->mqtt_client,
-                                                  discovery_topic, discovery_buffer, 0, 1, true);
-            ESP_LOGI(TAG, "   Spell discovery msg_id: %d", msg_id1);
+            {
+                JsonWriter json(discovery_buffer, DISCOVERY_BUFFER_SIZE);
+                begin_discovery(json, device, "Last Spell Cast", "spell", "spell");
+                json.field("value_template", "{{ value_json.spell }}");
+                char attributes_topic[64];
+                snprintf(attributes_topic, sizeof(attributes_topic), "wand/%s/spell", chip_id);
+                json.field("json_attributes_topic", attributes_topic);
+                json.field("icon", "mdi:magic-staff");
+                int msg_id1 = publish_discovery(mqtt, json, device, "sensor", "spell");
+                ESP_LOGI(TAG, "   Spell discovery msg_id: %d", msg_id1);
+            }
 
             // Battery sensor discovery
-            snprintf(discovery_topic, sizeof(discovery_topic), "homeassistant/sensor/wand_%s_battery/config", chip_id);
-            snprintf(discovery_buffer, 1200,
-                     "{"
-                     "\"name\":\"Wand Battery\","
-                     "\"unique_id\":\"wand_%s_battery\","
-                     "\"object_id\":\"wand_%s_battery\","
-                     "\"state_topic\":\"wand/%s/battery\","
-                     "\"unit_of_measurement\":\"%%\","
-                     "\"device_class\":\"battery\","
-                     "\"state_class\":\"measurement\","
-                     "\"value_template\":\"{{ value_json.level }}\","
-                     "\"icon\":\"mdi:battery\","
-                     "%s"
-                     "}",
-                     chip_id, chip_id, chip_id, device_info);
-
-            ESP_LOGI(TAG, "📤 Publishing discovery to: %s", discovery_topic);
-            ESP_LOGD(TAG, "📤 Discovery payload: %s", discovery_buffer);
-            int msg_id2 = esp_mqtt_client_publish((esp_mqtt_client_handle_t)client->mqtt_client,
-                                                  discovery_topic, discovery_buffer, 0, 1, true);
-            ESP_LOGI(TAG, "   Battery discovery msg_id: %d", msg_id2);
+            {
+                JsonWriter json(discovery_buffer, DISCOVERY_BUFFER_SIZE);
+                begin_discovery(json, device, "Wand Battery", "battery", "battery");
+                json.field("unit_of_measurement", "%");
+                json.field("device_class", "battery");
+                json.field("state_class", "measurement");
+                json.field("value_template", "{{ value_json.level }}");
+                json.field("icon", "mdi:battery");
+                int msg_id2 = publish_discovery(mqtt, json, device, "sensor", "battery");
+                ESP_LOGI(TAG, "   Battery discovery msg_id: %d", msg_id2);
+            }
 
             // Spell confidence sensor discovery
-            snprintf(discovery_topic, sizeof(discovery_topic), "homeassistant/sensor/wand_%s_confidence/config", chip_id);
-            snprintf(discovery_buffer, 1200,
-                     "{"
-                     "\"name\":\"Spell Confidence\","
-                     "\"unique_id\":\"wand_%s_confidence\","
-                     "\"object_id\":\"wand_%s_confidence\","
-                     "\"state_topic\":\"wand/%s/spell\","
-                     "\"unit_of_measurement\":\"%%\","
-                     "\"value_template\":\"{{ (value_json.confidence * 100) | round(1) }}\","
-                     "\"icon\":\"mdi:gauge\","
-                     "\"state_class\":\"measurement\","
-                     "%s"
-                     "}",
-                     chip_id, chip_id, chip_id, device_info);
-
-            ESP_LOGI(TAG, "📤 Publishing discovery to: %s", discovery_topic);
-            ESP_LOGD(TAG, "📤 Discovery payload: %s", discovery_buffer);
-            int msg_id3 = esp_mqtt_client_publish((esp_mqtt_client_handle_t)client->mqtt_client,
-                                                  discovery_topic, discovery_buffer, 0, 1, true);
-            ESP_LOGI(TAG, "   Confidence discovery msg_id: %d", msg_id3);
+            {
+                JsonWriter json(discovery_buffer, DISCOVERY_BUFFER_SIZE);
+                begin_discovery(json, device, "Spell Confidence", "confidence", "spell");
+                json.field("unit_of_measurement", "%");
+                json.field("value_template", "{{ (value_json.confidence * 100) | round(1) }}");
+                json.field("icon", "mdi:gauge");
+                json.field("state_class", "measurement");
+                int msg_id3 = publish_discovery(mqtt, json, device, "sensor", "confidence");
+                ESP_LOGI(TAG, "   Confidence discovery msg_id: %d", msg_id3);
+            }
 
             // Wand connection status sensor
-            snprintf(discovery_topic, sizeof(discovery_topic), "homeassistant/binary_sensor/wand_%s_connected/config", chip_id);
-            snprintf(discovery_buffer, 1200,
-                     "{"
-                     "\"name\":\"Wand Connected\","
-                     "\"unique_id\":\"wand_%s_connected\","
-                     "\"object_id\":\"wand_%s_connected\","
-                     "\"state_topic\":\"wand/%s/info\","
-                     "\"value_template\":\"{{ value_json.connected }}\","
-                     "\"payload_on\":\"True\","
-                     "\"payload_off\":\"False\","
-                     "\"device_class\":\"connectivity\","
-                     "\"icon\":\"mdi:magic-staff\","
-                     "%s"
-                     "}",
-                     chip_id, chip_id, chip_id, device_info);
-
-            ESP_LOGI(TAG, "📤 Publishing discovery to: %s", discovery_topic);
-            int msg_id4 = esp_mqtt_client_publish((esp_mqtt_client_handle_t)client->mqtt_client,
-                                                  discovery_topic, discovery_buffer, 0, 1, true);
-            ESP_LOGI(TAG, "   Wand status discovery msg_id: %d", msg_id4);
+            {
+                JsonWriter json(discovery_buffer, DISCOVERY_BUFFER_SIZE);
+                begin_discovery(json, device, "Wand Connected", "connected", "info");
+                json.field("value_template", "{{ value_json.connected }}");
+                json.field("payload_on", "True");
+                json.field("payload_off", "False");
+                json.field("device_class", "connectivity");
+                json.field("icon", "mdi:magic-staff");
+                int msg_id4 = publish_discovery(mqtt, json, device, "binary_sensor", "connected");
+                ESP_LOGI(TAG, "   Wand status discovery msg_id: %d", msg_id4);
+            }
 
             // Wand firmware version sensor
-            snprintf(discovery_topic, sizeof(discovery_topic), "homeassistant/sensor/wand_%s_firmware/config", chip_id);
-            snprintf(discovery_buffer, 1200,
-                     "{"
-                     "\"name\":\"Wand Firmware\","
-                     "\"unique_id\":\"wand_%s_firmware\","
-                     "\"object_id\":\"wand_%s_firmware\","
-                     "\"state_topic\":\"wand/%s/info\","
-                     "\"value_template\":\"{{ value_json.firmware }}\","
-                     "\"icon\":\"mdi:chip\","
-                     "\"entity_category\":\"diagnostic\","
-                     "%s"
-                     "}",
-                     chip_id, chip_id, chip_id, device_info);
-
-            ESP_LOGI(TAG, "📤 Publishing discovery to: %s", discovery_topic);
-            int msg_id5 = esp_mqtt_client_publish((esp_mqtt_client_handle_t)client->mqtt_client,
-                                                  discovery_topic, discovery_buffer, 0, 1, true);
-            ESP_LOGI(TAG, "   Wand firmware discovery msg_id: %d", msg_id5);
+            {
+                JsonWriter json(discovery_buffer, DISCOVERY_BUFFER_SIZE);
+                begin_discovery(json, device, "Wand Firmware", "firmware", "info");
+                json.field("value_template", "{{ value_json.firmware }}");
+                json.field("icon", "mdi:chip");
+                json.field("entity_category", "diagnostic");
+                int msg_id5 = publish_discovery(mqtt, json, device, "sensor", "firmware");
+                ESP_LOGI(TAG, "   Wand firmware discovery msg_id: %d", msg_id5);
+            }
 
             // Wand serial number sensor
-            snprintf(discovery_topic, sizeof(discovery_topic), "homeassistant/sensor/wand_%s_serial/config", chip_id);
-            snprintf(discovery_buffer, 1200,
-                     "{"
-                     "\"name\":\"Wand Serial Number\","
-                     "\"unique_id\":\"wand_%s_serial\","
-                     "\"object_id\":\"wand_%s_serial\","
-                     "\"state_topic\":\"wand/%s/info\","
-                     "\"value_template\":\"{{ value_json.serial }}\","
-                     "\"icon\":\"mdi:identifier\","
-                     "\"entity_category\":\"diagnostic\","
-                     "%s"
-                     "}",
-                     chip_id, chip_id, chip_id, device_info);
-
-            ESP_LOGI(TAG, "📤 Publishing discovery to: %s", discovery_topic);
-            int msg_id6 = esp_mqtt_client_publish((esp_mqtt_client_handle_t)client->mqtt_client,
-                                                  discovery_topic, discovery_buffer, 0, 1, true);
-            ESP_LOGI(TAG, "   Wand serial discovery msg_id: %d", msg_id6);
+            {
+                JsonWriter json(discovery_buffer, DISCOVERY_BUFFER_SIZE);
+                begin_discovery(json, device, "Wand Serial Number", "serial", "info");
+                json.field("value_template", "{{ value_json.serial }}");
+                json.field("icon", "mdi:identifier");
+                json.field("entity_category", "diagnostic");
+                int msg_id6 = publish_discovery(mqtt, json, device, "sensor", "serial");
+                ESP_LOGI(TAG, "   Wand serial discovery msg_id: %d", msg_id6);
+            }
 
             // Wand MAC address sensor
-            snprintf(discovery_topic, sizeof(discovery_topic), "homeassistant/sensor/wand_%s_mac/config", chip_id);
-            snprintf(discovery_buffer, 1200,
-                     "{"
-                     "\"name\":\"Wand MAC Address\","
-                     "\"unique_id\":\"wand_%s_mac\","
-                     "\"object_id\":\"wand_%s_mac\","
-                     "\"state_topic\":\"wand/%s/info\","
-                     "\"value_template\":\"{{ value_json.wand_mac }}\","
-                     "\"icon\":\"mdi:bluetooth\","
-                     "\"entity_category\":\"diagnostic\","
-                     "%s"
-                     "}",
-                     chip_id, chip_id, chip_id, device_info);
-
-            ESP_LOGI(TAG, "📤 Publishing discovery to: %s", discovery_topic);
-            int msg_id7 = esp_mqtt_client_publish((esp_mqtt_client_handle_t)client->mqtt_client,
-                                                  discovery_topic, discovery_buffer, 0, 1, true);
-            ESP_LOGI(TAG, "   Wand MAC discovery msg_id: %d", msg_id7);
+            {
+                JsonWriter json(discovery_buffer, DISCOVERY_BUFFER_SIZE);
+                begin_discovery(json, device, "Wand MAC Address", "mac", "info");
+                json.field("value_template", "{{ value_json.wand_mac }}");
+                json.field("icon", "mdi:bluetooth");
+                json.field("entity_category", "diagnostic");
+                int msg_id7 = publish_discovery(mqtt, json, device, "sensor", "mac");
+                ESP_LOGI(TAG, "   Wand MAC discovery msg_id: %d", msg_id7);
+            }
 
             // Free the discovery buffer
             free(discovery_buffer);
@@ -282,6 +271,13 @@ void HAMqttClient::mqtt_event_handler(void *handler_args, esp_event_base_t base,
                                                    "wand/test", 0);
             ESP_LOGI(TAG, "📥 Subscribed to wand/test for connectivity verification [msg_id=%d]", sub_id);
 
+            // Subscribe to model switch requests
+            char model_set_topic[64];
+            snprintf(model_set_topic, sizeof(model_set_topic), "wand/%s/model/set", chip_id);
+            int model_sub_id = esp_mqtt_client_subscribe((esp_mqtt_client_handle_t)client->mqtt_client,
+                                                         model_set_topic, 1);
+            ESP_LOGI(TAG, "📥 Subscribed to %s [msg_id=%d]", model_set_topic, model_sub_id);
+
             // Call onConnected callback if registered
             if (client->on_connected_callback)
             {
@@ -307,6 +303,20 @@ void HAMqttClient::mqtt_event_handler(void *handler_args, esp_event_base_t base,
     case MQTT_EVENT_DATA:
         ESP_LOGI(TAG, "📥 MQTT data received on topic: %.*s", event->topic_len, event->topic);
         ESP_LOGI(TAG, "   Payload: %.*s", event->data_len, event->data);
+        {
+            char model_set_topic[64];
+            snprintf(model_set_topic, sizeof(model_set_topic), "wand/%s/model/set", client->chip_id);
+            if (client->on_model_select_callback &&
+                event->topic_len == (int)strlen(model_set_topic) &&
+                strncmp(event->topic, model_set_topic, event->topic_len) == 0)
+            {
+                char model_name[32];
+                int len = event->data_len < (int)sizeof(model_name) - 1 ? event->data_len : (int)sizeof(model_name) - 1;
+                memcpy(model_name, event->data, len);
+                model_name[len] = '\0';
+                client->on_model_select_callback(model_name);
+            }
+        }
         break;
 
     case MQTT_EVENT_ERROR:
@@ -406,22 +416,29 @@ bool HAMqttClient::publishSpell(const char *spell_name, float confidence)
     }
 
     // Publish JSON payload with spell name and confidence
-    char json[256];
-    snprintf(json, sizeof(json),
-             "{\"spell\":\"%s\",\"confidence\":%.3f}",
-             spell_name, confidence);
+    char buf[256];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("spell", spell_name);
+    json.field("confidence", (double)confidence, 3);
+    json.endObject();
+    if (!json.ok())
+    {
+        ESP_LOGW(TAG, "  ❌ Cannot publish: spell payload too long");
+        return false;
+    }
 
     char topic[64];
     snprintf(topic, sizeof(topic), "wand/%s/spell", chip_id);
 
     ESP_LOGI(TAG, "  📤 Publishing to topic '%s'", topic);
-    ESP_LOGI(TAG, "  📤 Payload: %s", json);
+    ESP_LOGI(TAG, "  📤 Payload: %s", json.c_str());
     ESP_LOGI(TAG, "  📤 QoS: 1, Retain: false");
 
     int msg_id = esp_mqtt_client_publish((esp_mqtt_client_handle_t)mqtt_client,
                                          topic,
-                                         json,
-                                         strlen(json), // Explicit length instead of 0
+                                         json.c_str(),
+                                         json.length(), // Explicit length instead of 0
                                          1,            // QoS 1
                                          false);       // retain
 
@@ -456,20 +473,23 @@ bool HAMqttClient::publishBattery(uint8_t level)
         return false;
     }
 
-    char json[64];
-    snprintf(json, sizeof(json), "{\"level\":%d}", level);
+    char buf[64];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("level", (unsigned)level);
+    json.endObject();
 
     char topic[64];
     snprintf(topic, sizeof(topic), "wand/%s/battery", chip_id);
 
     ESP_LOGI(TAG, "  📤 Publishing to topic '%s'", topic);
-    ESP_LOGI(TAG, "  📤 Payload: %s", json);
+    ESP_LOGI(TAG, "  📤 Payload: %s", json.c_str());
     ESP_LOGI(TAG, "  📤 QoS: 1, Retain: false");
 
     int msg_id = esp_mqtt_client_publish((esp_mqtt_client_handle_t)mqtt_client,
                                          topic,
-                                         json,
-                                         0,
+                                         json.c_str(),
+                                         json.length(),
                                          1,
                                          false);
 
@@ -508,18 +528,22 @@ bool HAMqttClient::publishWandInfo(const char *firmware_version, const char *ser
     const char *wt = (wand_type && wand_type[0]) ? wand_type : "unknown";
     const char *mac = (wand_mac && wand_mac[0]) ? wand_mac : "unknown";
 
-    char json[512];
-    snprintf(json, sizeof(json),
-             "{"
-             "\"firmware\":\"%s\","
-             "\"serial\":\"%s\","
-             "\"sku\":\"%s\","
-             "\"device_id\":\"%s\","
-             "\"wand_type\":\"%s\","
-             "\"wand_mac\":\"%s\","
-             "\"connected\":true"
-             "}",
-             fw, sn, sk, did, wt, mac);
+    char buf[512];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("firmware", fw);
+    json.field("serial", sn);
+    json.field("sku", sk);
+    json.field("device_id", did);
+    json.field("wand_type", wt);
+    json.field("wand_mac", mac);
+    json.field("connected", true);
+    json.endObject();
+    if (!json.ok())
+    {
+        ESP_LOGW(TAG, "  ❌ Cannot publish: wand info payload too long");
+        return false;
+    }
 
     char topic[64];
     snprintf(topic, sizeof(topic), "wand/%s/info", chip_id);
@@ -527,12 +551,12 @@ bool HAMqttClient::publishWandInfo(const char *firmware_version, const char *ser
     ESP_LOGI(TAG, "  📤 Publishing to topic '%s'", topic);
     ESP_LOGI(TAG, "  📤 Wand FW: %s, Serial: %s, Type: %s, MAC: %s",
              fw, sn, wt, mac);
-    ESP_LOGI(TAG, "  📤 Payload: %s", json);
+    ESP_LOGI(TAG, "  📤 Payload: %s", json.c_str());
 
     int msg_id = esp_mqtt_client_publish((esp_mqtt_client_handle_t)mqtt_client,
                                          topic,
-                                         json,
-                                         strlen(json),
+                                         json.c_str(),
+                                         json.length(),
                                          1,
                                          true); // retain=true so HA always has latest
 
@@ -548,6 +572,32 @@ bool HAMqttClient::publishWandInfo(const char *firmware_version, const char *ser
     }
 }
 
+bool HAMqttClient::publishModel(const char *model_name)
+{
+    if (!connected || !mqtt_client || !model_name || model_name[0] == '\0')
+    {
+        return false;
+    }
+
+    char buf[64];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("model", model_name);
+    json.endObject();
+    if (!json.ok())
+    {
+        return false;
+    }
+
+    char topic[64];
+    snprintf(topic, sizeof(topic), "wand/%s/model", chip_id);
+
+    int msg_id = esp_mqtt_client_publish((esp_mqtt_client_handle_t)mqtt_client,
+                                         topic, json.c_str(), json.length(), 1, true);
+    ESP_LOGI(TAG, "📤 Published active model '%s' [msg_id=%d]", model_name, msg_id);
+    return msg_id >= 0;
+}
+
 bool HAMqttClient::publishWandDisconnected()
 {
     ESP_LOGI(TAG, "publishWandDisconnected() called");
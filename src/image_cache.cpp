@@ -0,0 +1,127 @@
+#include "image_cache.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "image_cache";
+
+ImageCache::ImageCache()
+    : entries{}, count(0), bytes(0), budget(0), tick(0), stats{}
+{
+}
+
+const ImageCacheEntry *ImageCache::find(const char *name, size_t size, int64_t mtime)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strcmp(entries[i].name, name) != 0)
+        {
+            continue;
+        }
+        if (entries[i].size != size || entries[i].mtime != mtime)
+        {
+            // File replaced on SPIFFS: reload it (new bytes, new ETag)
+            ESP_LOGI(TAG, "%s changed on SPIFFS, reloading", name);
+            removeAt(i);
+            stats.invalidated++;
+            break;
+        }
+        entries[i].last_used = ++tick;
+        stats.hits++;
+        return &entries[i];
+    }
+    stats.misses++;
+    return nullptr;
+}
+
+void ImageCache::removeAt(size_t index)
+{
+    bytes -= entries[index].size;
+    heap_caps_free(entries[index].data);
+    entries[index] = entries[--count];
+}
+
+void ImageCache::evictOldest()
+{
+    size_t oldest = 0;
+    for (size_t i = 1; i < count; i++)
+    {
+        if (entries[i].last_used < entries[oldest].last_used)
+        {
+            oldest = i;
+        }
+    }
+
+    removeAt(oldest);
+    stats.evictions++;
+}
+
+const ImageCacheEntry *ImageCache::load(const char *name, const char *path, size_t size, int64_t mtime)
+{
+    if (budget == 0)
+    {
+        // Sized once: a share of the PSRAM left after the model/arena, capped
+        size_t psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+        budget = psram ? psram / IMAGE_CACHE_PSRAM_SHARE : IMAGE_CACHE_NO_PSRAM_BYTES;
+        if (budget > IMAGE_CACHE_MAX_BYTES)
+        {
+            budget = IMAGE_CACHE_MAX_BYTES;
+        }
+        ESP_LOGI(TAG, "Image cache budget %u bytes (%s)", (unsigned)budget, psram ? "PSRAM" : "internal RAM");
+    }
+
+    if (size == 0 || size > IMAGE_CACHE_MAX_ITEM || size > budget || strlen(name) >= IMAGE_CACHE_NAME_LEN)
+    {
+        stats.uncacheable++;
+        return nullptr;
+    }
+
+    while (count > 0 && (bytes + size > budget || count >= IMAGE_CACHE_MAX_ENTRIES))
+    {
+        evictOldest();
+    }
+
+    uint8_t *data = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!data)
+    {
+        data = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    if (!data)
+    {
+        ESP_LOGW(TAG, "No memory to cache %s (%u bytes)", name, (unsigned)size);
+        stats.uncacheable++;
+        return nullptr;
+    }
+
+    FILE *file = fopen(path, "rb");
+    size_t got = file ? fread(data, 1, size, file) : 0;
+    if (file)
+    {
+        fclose(file);
+    }
+    if (got != size)
+    {
+        ESP_LOGE(TAG, "Short read of %s (%u of %u bytes)", path, (unsigned)got, (unsigned)size);
+        heap_caps_free(data);
+        return nullptr;
+    }
+
+    // Strong validator over the bytes; a replaced file is reloaded (see find) and hashed again
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+
+    ImageCacheEntry &entry = entries[count++];
+    strcpy(entry.name, name);
+    entry.data = data;
+    entry.size = size;
+    entry.mtime = mtime;
+    snprintf(entry.etag, sizeof(entry.etag), "\"%016llx\"", (unsigned long long)hash);
+    entry.last_used = ++tick;
+    bytes += size;
+    return &entry;
+}
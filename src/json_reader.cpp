@@ -0,0 +1,457 @@
+#include "json_reader.h"
+#include <string.h>
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_token_char(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool is_number(const char *s)
+{
+    if (*s == '-')
+        s++;
+    if (*s == '0')
+        s++;
+    else if (*s >= '1' && *s <= '9')
+        while (*s >= '0' && *s <= '9')
+            s++;
+    else
+        return false;
+
+    if (*s == '.')
+    {
+        s++;
+        if (!(*s >= '0' && *s <= '9'))
+            return false;
+        while (*s >= '0' && *s <= '9')
+            s++;
+    }
+    if (*s == 'e' || *s == 'E')
+    {
+        s++;
+        if (*s == '+' || *s == '-')
+            s++;
+        if (!(*s >= '0' && *s <= '9'))
+            return false;
+        while (*s >= '0' && *s <= '9')
+            s++;
+    }
+    return *s == '\0';
+}
+
+JsonReader::JsonReader(JsonValueHandler handler, void *ctx)
+    : handler(handler), handlerCtx(ctx), state(VALUE), depth(0), arrays(0), stringIsKey(false),
+      keyValid(false), overflow(false), keyLen(0), valueLen(0), index(-1), codepoint(0),
+      hexDigits(0), highSurrogate(0), consumed(0), skippedCount(0)
+{
+    key[0] = '\0';
+    value[0] = '\0';
+}
+
+bool JsonReader::reportable() const
+{
+    if (!keyValid)
+        return false;
+    if (depth == 1)
+        return !isArray(1);
+    return depth == 2 && isArray(2) && !isArray(1);
+}
+
+bool JsonReader::push(bool array)
+{
+    if (depth >= JSON_READER_MAX_DEPTH)
+    {
+        fail();
+        return false;
+    }
+    depth++;
+    if (array)
+        arrays |= 1u << depth;
+    else
+        arrays &= ~(1u << depth);
+    if (depth == 2 && array)
+        index = 0;
+    return true;
+}
+
+void JsonReader::pop()
+{
+    depth--;
+    afterValue();
+}
+
+void JsonReader::afterValue()
+{
+    state = depth == 0 ? DONE : AFTER_VALUE;
+}
+
+void JsonReader::fail()
+{
+    state = FAILED;
+}
+
+void JsonReader::appendString(char c)
+{
+    if (stringIsKey)
+    {
+        // Only top-level keys name what gets reported
+        if (depth != 1)
+            return;
+        if (keyLen + 1 < sizeof(key))
+            key[keyLen++] = c;
+        else
+            keyValid = false;
+        return;
+    }
+    if (!reportable())
+        return;
+    if (valueLen + 1 < sizeof(value))
+        value[valueLen++] = c;
+    else
+        overflow = true;
+}
+
+void JsonReader::appendCodepoint(uint32_t cp)
+{
+    if (cp < 0x80)
+    {
+        appendString((char)cp);
+    }
+    else if (cp < 0x800)
+    {
+        appendString((char)(0xC0 | (cp >> 6)));
+        appendString((char)(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000)
+    {
+        appendString((char)(0xE0 | (cp >> 12)));
+        appendString((char)(0x80 | ((cp >> 6) & 0x3F)));
+        appendString((char)(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+        appendString((char)(0xF0 | (cp >> 18)));
+        appendString((char)(0x80 | ((cp >> 12) & 0x3F)));
+        appendString((char)(0x80 | ((cp >> 6) & 0x3F)));
+        appendString((char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+void JsonReader::emit(JsonValueType type)
+{
+    if (!reportable())
+        return;
+    if (overflow)
+    {
+        skippedCount++;
+        return;
+    }
+    value[valueLen] = '\0';
+    handler(key, depth == 1 ? -1 : index, type, value, valueLen, handlerCtx);
+}
+
+bool JsonReader::finishToken()
+{
+    value[valueLen] = '\0';
+    JsonValueType type;
+    if (strcmp(value, "true") == 0)
+        type = JSON_VALUE_TRUE;
+    else if (strcmp(value, "false") == 0)
+        type = JSON_VALUE_FALSE;
+    else if (strcmp(value, "null") == 0)
+        type = JSON_VALUE_NULL;
+    else if (is_number(value))
+        type = JSON_VALUE_NUMBER;
+    else
+        return false;
+    emit(type);
+    return true;
+}
+
+// Consumes c, or returns false when c ended a number/literal and must be read again
+bool JsonReader::step(char c)
+{
+    switch (state)
+    {
+    case VALUE:
+    case VALUE_OR_END:
+        if (is_space(c))
+            return true;
+        if (c == ']' && state == VALUE_OR_END)
+        {
+            pop();
+            return true;
+        }
+        if (c == '"')
+        {
+            stringIsKey = false;
+            valueLen = 0;
+            overflow = false;
+            highSurrogate = 0;
+            state = STRING;
+        }
+        else if (c == '{')
+        {
+            if (push(false))
+                state = KEY_OR_END;
+        }
+        else if (c == '[')
+        {
+            if (push(true))
+                state = VALUE_OR_END;
+        }
+        else if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n')
+        {
+            value[0] = c;
+            valueLen = 1;
+            overflow = false;
+            state = TOKEN;
+        }
+        else
+        {
+            fail();
+        }
+        return true;
+
+    case KEY_OR_END:
+    case KEY:
+        if (is_space(c))
+            return true;
+        if (c == '}' && state == KEY_OR_END)
+        {
+            pop();
+        }
+        else if (c == '"')
+        {
+            stringIsKey = true;
+            if (depth == 1)
+            {
+                keyLen = 0;
+                keyValid = true;
+            }
+            highSurrogate = 0;
+            state = STRING;
+        }
+        else
+        {
+            fail();
+        }
+        return true;
+
+    case COLON:
+        if (is_space(c))
+            return true;
+        if (c == ':')
+            state = VALUE;
+        else
+            fail();
+        return true;
+
+    case AFTER_VALUE:
+        if (is_space(c))
+            return true;
+        if (c == ',')
+        {
+            if (isArray(depth))
+            {
+                if (depth == 2)
+                    index++;
+                state = VALUE;
+            }
+            else
+            {
+                state = KEY;
+            }
+        }
+        else if (c == (isArray(depth) ? ']' : '}'))
+        {
+            pop();
+        }
+        else
+        {
+            fail();
+        }
+        return true;
+
+    case STRING:
+        if (c != '\\' && highSurrogate)
+        {
+            appendCodepoint(0xFFFD); // Unpaired surrogate
+            highSurrogate = 0;
+        }
+        if (c == '"')
+        {
+            if (stringIsKey)
+            {
+                if (depth == 1)
+                    key[keyLen] = '\0';
+                state = COLON;
+            }
+            else
+            {
+                emit(JSON_VALUE_STRING);
+                afterValue();
+            }
+        }
+        else if (c == '\\')
+        {
+            state = STRING_ESCAPE;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            fail();
+        }
+        else
+        {
+            appendString(c);
+        }
+        return true;
+
+    case STRING_ESCAPE:
+        if (c == 'u')
+        {
+            codepoint = 0;
+            hexDigits = 0;
+            state = STRING_UNICODE;
+            return true;
+        }
+        if (highSurrogate)
+        {
+            appendCodepoint(0xFFFD);
+            highSurrogate = 0;
+        }
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            appendString(c);
+            break;
+        case 'b':
+            appendString('\b');
+            break;
+        case 'f':
+            appendString('\f');
+            break;
+        case 'n':
+            appendString('\n');
+            break;
+        case 'r':
+            appendString('\r');
+            break;
+        case 't':
+            appendString('\t');
+            break;
+        default:
+            fail();
+            return true;
+        }
+        state = STRING;
+        return true;
+
+    case STRING_UNICODE:
+    {
+        int digit = hex_value(c);
+        if (digit < 0)
+        {
+            fail();
+            return true;
+        }
+        codepoint = (codepoint << 4) | (uint32_t)digit;
+        if (++hexDigits < 4)
+            return true;
+
+        if (highSurrogate && codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+        {
+            appendCodepoint(0x10000 + ((highSurrogate - 0xD800) << 10) + (codepoint - 0xDC00));
+            highSurrogate = 0;
+        }
+        else
+        {
+            if (highSurrogate)
+            {
+                appendCodepoint(0xFFFD);
+                highSurrogate = 0;
+            }
+            if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+                highSurrogate = codepoint; // Wait for the low half
+            else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+                appendCodepoint(0xFFFD);
+            else
+                appendCodepoint(codepoint);
+        }
+        state = STRING;
+        return true;
+    }
+
+    case TOKEN:
+        if (is_token_char(c))
+        {
+            if (valueLen + 1 < sizeof(value))
+                value[valueLen++] = c;
+            else
+                fail();
+            return true;
+        }
+        if (!finishToken())
+        {
+            fail();
+            return true;
+        }
+        afterValue();
+        return false;
+
+    case DONE:
+        if (!is_space(c))
+            fail();
+        return true;
+
+    case FAILED:
+        break;
+    }
+    return true;
+}
+
+bool JsonReader::feed(const char *data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && state != FAILED)
+    {
+        if (step(data[i]))
+        {
+            i++;
+            consumed++;
+        }
+    }
+    return state != FAILED;
+}
+
+bool JsonReader::finish()
+{
+    // A top-level number has no delimiter after it
+    if (state == TOKEN && depth == 0)
+    {
+        if (finishToken())
+            afterValue();
+        else
+            fail();
+    }
+    return state == DONE;
+}
@@ -0,0 +1,346 @@
+#include "json_writer.h"
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+static const uint32_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+#define JSON_MAX_DECIMALS 6
+
+JsonWriter::JsonWriter(char *buffer, size_t size, JsonSink sink, void *ctx)
+    : buffer(buffer), capacity(size > 0 ? size - 1 : 0), len(0), sink(sink), sinkCtx(ctx),
+      hasItems(0), depth(0), failed(size == 0), didFlush(false)
+{
+}
+
+bool JsonWriter::flush()
+{
+    if (failed)
+        return false;
+    if (!sink || len == 0)
+        return true;
+
+    if (!sink(buffer, len, sinkCtx))
+    {
+        failed = true;
+    }
+    len = 0;
+    didFlush = true;
+    return !failed;
+}
+
+void JsonWriter::put(const char *data, size_t n)
+{
+    while (n > 0 && !failed)
+    {
+        if (len == capacity && (!sink || !flush()))
+        {
+            failed = true;
+            return;
+        }
+        size_t chunk = capacity - len < n ? capacity - len : n;
+        memcpy(buffer + len, data, chunk);
+        len += chunk;
+        data += chunk;
+        n -= chunk;
+    }
+}
+
+void JsonWriter::putChar(char c)
+{
+    if (len < capacity && !failed)
+    {
+        buffer[len++] = c;
+        return;
+    }
+    put(&c, 1);
+}
+
+// Bytes of the UTF-8 sequence starting at s (0 if it is invalid or truncated)
+static size_t utf8_sequence(const unsigned char *s, size_t n)
+{
+    unsigned char c = s[0];
+    size_t need;
+    unsigned char lo = 0x80, hi = 0xBF; // Allowed range of the second byte
+    if (c >= 0xC2 && c <= 0xDF)
+        need = 2;
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+        need = 3;
+        if (c == 0xE0)
+            lo = 0xA0; // Overlong
+        else if (c == 0xED)
+            hi = 0x9F; // Surrogates
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+        need = 4;
+        if (c == 0xF0)
+            lo = 0x90;
+        else if (c == 0xF4)
+            hi = 0x8F; // Above U+10FFFF
+    }
+    else
+        return 0;
+
+    if (n < need || s[1] < lo || s[1] > hi)
+        return 0;
+    for (size_t i = 2; i < need; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+            return 0;
+    }
+    return need;
+}
+
+void JsonWriter::putEscaped(const char *value, size_t n)
+{
+    const unsigned char *s = (const unsigned char *)value;
+    size_t i = 0;
+    while (i < n)
+    {
+        // Copy runs of plain ASCII in one go
+        size_t run = i;
+        while (run < n && s[run] >= 0x20 && s[run] < 0x80 && s[run] != '"' && s[run] != '\\')
+            run++;
+        if (run > i)
+        {
+            put(value + i, run - i);
+            i = run;
+            if (i == n)
+                break;
+        }
+
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\')
+        {
+            char esc[2] = {'\\', (char)c};
+            put(esc, 2);
+            i++;
+        }
+        else if (c < 0x20)
+        {
+            char esc[7];
+            switch (c)
+            {
+            case '\n':
+                put("\\n", 2);
+                break;
+            case '\r':
+                put("\\r", 2);
+                break;
+            case '\t':
+                put("\\t", 2);
+                break;
+            default:
+                memcpy(esc, "\\u00", 4);
+                esc[4] = "0123456789abcdef"[c >> 4];
+                esc[5] = "0123456789abcdef"[c & 0x0F];
+                put(esc, 6);
+                break;
+            }
+            i++;
+        }
+        else
+        {
+            size_t seq = utf8_sequence(s + i, n - i);
+            if (seq)
+            {
+                put(value + i, seq);
+                i += seq;
+            }
+            else
+            {
+                i++; // Invalid byte: dropped
+            }
+        }
+    }
+}
+
+void JsonWriter::putUnsigned(unsigned long long value, bool negative)
+{
+    char digits[21];
+    size_t pos = sizeof(digits);
+    do
+    {
+        digits[--pos] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    if (negative)
+        digits[--pos] = '-';
+    put(digits + pos, sizeof(digits) - pos);
+}
+
+void JsonWriter::beginValue(const char *key)
+{
+    uint32_t bit = 1u << depth;
+    if (hasItems & bit)
+    {
+        putChar(',');
+    }
+    hasItems |= bit;
+    if (key)
+    {
+        putChar('"');
+        putEscaped(key, strlen(key));
+        put("\":", 2);
+    }
+}
+
+void JsonWriter::beginObject(const char *key)
+{
+    beginValue(key);
+    putChar('{');
+    if (depth >= JSON_WRITER_MAX_DEPTH)
+    {
+        failed = true;
+        return;
+    }
+    depth++;
+    hasItems &= ~(1u << depth);
+}
+
+void JsonWriter::endObject()
+{
+    putChar('}');
+    if (depth > 0)
+        depth--;
+}
+
+void JsonWriter::beginArray(const char *key)
+{
+    beginValue(key);
+    putChar('[');
+    if (depth >= JSON_WRITER_MAX_DEPTH)
+    {
+        failed = true;
+        return;
+    }
+    depth++;
+    hasItems &= ~(1u << depth);
+}
+
+void JsonWriter::endArray()
+{
+    putChar(']');
+    if (depth > 0)
+        depth--;
+}
+
+void JsonWriter::field(const char *key, const char *value)
+{
+    if (!value)
+    {
+        fieldNull(key);
+        return;
+    }
+    field(key, value, strlen(value));
+}
+
+void JsonWriter::field(const char *key, const char *value, size_t n)
+{
+    beginValue(key);
+    putChar('"');
+    putEscaped(value, n);
+    putChar('"');
+}
+
+void JsonWriter::field(const char *key, bool value)
+{
+    beginValue(key);
+    if (value)
+        put("true", 4);
+    else
+        put("false", 5);
+}
+
+void JsonWriter::field(const char *key, int value)
+{
+    field(key, (long long)value);
+}
+
+void JsonWriter::field(const char *key, unsigned value)
+{
+    field(key, (unsigned long long)value);
+}
+
+void JsonWriter::field(const char *key, long value)
+{
+    field(key, (long long)value);
+}
+
+void JsonWriter::field(const char *key, unsigned long value)
+{
+    field(key, (unsigned long long)value);
+}
+
+void JsonWriter::field(const char *key, long long value)
+{
+    beginValue(key);
+    if (value < 0)
+        putUnsigned(0ULL - (unsigned long long)value, true);
+    else
+        putUnsigned((unsigned long long)value, false);
+}
+
+void JsonWriter::field(const char *key, unsigned long long value)
+{
+    beginValue(key);
+    putUnsigned(value, false);
+}
+
+void JsonWriter::field(const char *key, double value, int decimals)
+{
+    if (isnan(value) || isinf(value))
+    {
+        fieldNull(key); // Not representable in JSON
+        return;
+    }
+    if (decimals < 0)
+        decimals = 0;
+    if (decimals > JSON_MAX_DECIMALS)
+        decimals = JSON_MAX_DECIMALS;
+
+    beginValue(key);
+    uint32_t scale = POW10[decimals];
+    double scaled = fabs(value) * scale + 0.5;
+    if (scaled >= 9007199254740992.0) // 2^53: no longer exact as an integer
+    {
+        char text[32];
+        int n = snprintf(text, sizeof(text), "%.17g", value);
+        put(text, n > 0 ? (size_t)n : 0);
+        return;
+    }
+
+    unsigned long long fixed = (unsigned long long)scaled;
+    putUnsigned(fixed / scale, value < 0 && fixed != 0);
+    if (decimals > 0)
+    {
+        char frac[JSON_MAX_DECIMALS + 1];
+        unsigned long long rest = fixed % scale;
+        frac[0] = '.';
+        for (int i = decimals; i >= 1; i--)
+        {
+            frac[i] = (char)('0' + rest % 10);
+            rest /= 10;
+        }
+        put(frac, decimals + 1);
+    }
+}
+
+void JsonWriter::fieldNull(const char *key)
+{
+    beginValue(key);
+    put("null", 4);
+}
+
+void JsonWriter::fieldRaw(const char *key, const char *json)
+{
+    beginValue(key);
+    put(json, strlen(json));
+}
+
+const char *JsonWriter::c_str()
+{
+    buffer[len] = '\0';
+    return buffer;
+}
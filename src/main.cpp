@@ -6,6 +6,8 @@
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_partition.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_wifi_types.h"
 #include "esp_event.h"
@@ -44,6 +46,11 @@ static const char *TAG = "main";
 // Model data
 const unsigned char *model_data = nullptr;
 size_t model_size = 0;
+uint32_t model_id = 0;
+
+// Models available in the model partition
+ModelRegistry modelRegistry;
+int active_model = -1;
 
 // BLE Client
 WandBLEClient wandClient;
@@ -113,42 +120,75 @@ WebServer webServer;
 HAMqttClient mqttClient;
 
 // Function to load model from filesystem
-bool loadModel()
+#if MODEL_USE_MMAP
+static esp_partition_mmap_handle_t model_mmap_handle;
+#endif
+static size_t model_partition_used = 0; // Registry + models, without trailing erased flash
+
+// Parse the model registry and pick the model stored in NVS (or the first one)
+static bool selectInitialModel(const unsigned char *partition, size_t size)
 {
-    ESP_LOGI(TAG, "Loading TFLite model from flash partition...");
+    if (!modelRegistry.load(partition, size))
+    {
+        return false;
+    }
 
-    // Find the model partition
-    const esp_partition_t *model_partition = esp_partition_find_first(
-        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, "model");
+    active_model = 0;
+    nvs_handle_t nvs_handle;
+    if (nvs_open("storage", NVS_READONLY, &nvs_handle) == ESP_OK)
+    {
+        char name[MODEL_NAME_LEN] = {0};
+        size_t len = sizeof(name);
+        if (nvs_get_str(nvs_handle, "model_name", name, &len) == ESP_OK)
+        {
+            int index = modelRegistry.find(name);
+            if (index >= 0 && modelRegistry.verify(index))
+            {
+                active_model = index;
+            }
+            else
+            {
+                ESP_LOGW(TAG, "Stored model '%s' not available, using '%s'", name, modelRegistry.get(0)->name);
+            }
+        }
+        nvs_close(nvs_handle);
+    }
 
-    if (!model_partition)
+    if (!modelRegistry.verify(active_model))
     {
-        ESP_LOGE(TAG, "Model partition not found!");
         return false;
     }
 
-    ESP_LOGI(TAG, "Model partition found: size=%lu bytes at offset=0x%lx",
-             model_partition->size, model_partition->address);
+    const ModelInfo *info = modelRegistry.get(active_model);
+    model_data = info->data;
+    model_size = info->size;
+    model_id = info->crc32;
+    ESP_LOGI(TAG, "✓ Active model: %s", info->name);
+    return true;
+}
 
+// Copy the model into PSRAM (fallback when the partition cannot be memory-mapped)
+static bool loadModelToPSRAM(const esp_partition_t *model_partition)
+{
     size_t free_psram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
     size_t free_heap = esp_get_free_heap_size();
     ESP_LOGI(TAG, "Free heap: %lu bytes, Free PSRAM: %lu bytes", free_heap, free_psram);
 
-    // Allocate model in PSRAM (ESP32-S3 cannot use memory-mapped flash for TFLite)
-    model_size = model_partition->size;
-    unsigned char *buffer = (unsigned char *)heap_caps_malloc(model_size, MALLOC_CAP_SPIRAM);
+    // Read the whole partition once, then shrink to the model's real size
+    size_t partition_size = model_partition->size;
+    unsigned char *buffer = (unsigned char *)heap_caps_malloc(partition_size, MALLOC_CAP_SPIRAM);
 
     if (!buffer)
     {
-        ESP_LOGE(TAG, "Failed to allocate %lu bytes in PSRAM!", model_size);
+        ESP_LOGE(TAG, "Failed to allocate %lu bytes in PSRAM!", partition_size);
         ESP_LOGE(TAG, "Free PSRAM: %lu bytes, Free heap: %lu bytes", free_psram, free_heap);
         return false;
     }
 
-    ESP_LOGI(TAG, "✓ Allocated %lu bytes in PSRAM at %p", model_size, buffer);
+    ESP_LOGI(TAG, "✓ Allocated %lu bytes in PSRAM at %p", partition_size, buffer);
 
     // Read model from flash into PSRAM
-    esp_err_t err = esp_partition_read(model_partition, 0, buffer, model_size);
+    esp_err_t err = esp_partition_read(model_partition, 0, buffer, partition_size);
     if (err != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to read model: %s", esp_err_to_name(err));
@@ -156,16 +196,93 @@ bool loadModel()
         return false;
     }
 
-    model_data = buffer;
+    size_t used_size = ModelRegistry::extent(buffer, partition_size);
+    if (used_size == 0)
+    {
+        ESP_LOGE(TAG, "Model partition does not contain a valid .tflite model");
+        heap_caps_free(buffer);
+        return false;
+    }
+
+    if (used_size < partition_size)
+    {
+        unsigned char *shrunk = (unsigned char *)heap_caps_realloc(buffer, used_size, MALLOC_CAP_SPIRAM);
+        if (shrunk)
+        {
+            buffer = shrunk;
+        }
+    }
+
+    if (!selectInitialModel(buffer, used_size))
+    {
+        heap_caps_free(buffer);
+        return false;
+    }
+    model_partition_used = used_size;
 
     ESP_LOGI(TAG, "✓ Model loaded into PSRAM!");
     ESP_LOGI(TAG, "   Model pointer: %p", model_data);
-    ESP_LOGI(TAG, "   Model size: %zu bytes", model_size);
+    ESP_LOGI(TAG, "   Model size: %zu bytes (%zu used of partition %lu bytes)", model_size, used_size, partition_size);
     ESP_LOGI(TAG, "   Free PSRAM: %lu bytes", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
 
     return true;
 }
 
+bool loadModel()
+{
+    ESP_LOGI(TAG, "Loading TFLite model from flash partition...");
+    int64_t load_start = esp_timer_get_time();
+
+    // Find the model partition
+    const esp_partition_t *model_partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, "model");
+
+    if (!model_partition)
+    {
+        ESP_LOGE(TAG, "Model partition not found!");
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Model partition found: size=%lu bytes at offset=0x%lx",
+             model_partition->size, model_partition->address);
+
+#if MODEL_USE_MMAP
+    // Map the partition into the data address space - no copy, no PSRAM needed
+    const void *mapped = nullptr;
+    esp_err_t err = esp_partition_mmap(model_partition, 0, model_partition->size,
+                                       ESP_PARTITION_MMAP_DATA, &mapped, &model_mmap_handle);
+    if (err == ESP_OK)
+    {
+        size_t used_size = ModelRegistry::extent((const unsigned char *)mapped, model_partition->size);
+        if (used_size == 0 || !selectInitialModel((const unsigned char *)mapped, used_size))
+        {
+            ESP_LOGE(TAG, "Model partition does not contain a valid .tflite model");
+            esp_partition_munmap(model_mmap_handle);
+            return false;
+        }
+        model_partition_used = used_size;
+
+        ESP_LOGI(TAG, "✓ Model memory-mapped from flash (zero-copy)");
+        ESP_LOGI(TAG, "   Model pointer: %p", model_data);
+        ESP_LOGI(TAG, "   Model size: %zu bytes (partition %lu bytes)", model_size, model_partition->size);
+        ESP_LOGI(TAG, "   PSRAM saved: %lu bytes, load time: %lld us",
+                 model_partition->size, esp_timer_get_time() - load_start);
+        return true;
+    }
+
+    ESP_LOGW(TAG, "esp_partition_mmap failed (%s) - falling back to PSRAM copy", esp_err_to_name(err));
+#endif
+
+    bool loaded = loadModelToPSRAM(model_partition);
+    if (loaded)
+    {
+        ESP_LOGI(TAG, "   Load time: %lld us (PSRAM saved vs. partition copy: %lu bytes)",
+                 esp_timer_get_time() - load_start,
+                 model_partition->size - model_partition_used);
+    }
+    return loaded;
+}
+
 // Callback when spell is detected
 void onSpellDetected(const char *spell_name, float confidence)
 {
@@ -237,6 +354,19 @@ void onMQTTConnected()
     {
         ESP_LOGI(TAG, "No wand connected yet");
     }
+
+    // Report active model so automations can see which one is running
+    mqttClient.publishModel(wandClient.getActiveModelName());
+}
+
+// Callback for MQTT model switch requests (wand/<id>/model/set)
+void onMQTTModelSelect(const char *model_name)
+{
+    ESP_LOGI(TAG, "MQTT model switch requested: %s", model_name);
+    if (wandClient.selectModel(model_name))
+    {
+        mqttClient.publishModel(wandClient.getActiveModelName());
+    }
 }
 
 // Callback when connection state changes
@@ -926,6 +1056,7 @@ extern "C" void app_main()
 
                         // Register callback to publish wand info if already connected
                         mqttClient.onConnected(onMQTTConnected);
+                        mqttClient.onModelSelect(onMQTTModelSelect);
                     }
                     else
                     {
@@ -995,7 +1126,7 @@ extern "C" void app_main()
     }
 
     // Initialize BLE client and spell detector (can work without model)
-    if (!wandClient.begin(model_data, model_size))
+    if (!wandClient.begin(model_data, model_size, model_id))
     {
         ESP_LOGE(TAG, "ERROR: Failed to initialize wand client!");
         if (model_loaded)
@@ -1012,6 +1143,9 @@ extern "C" void app_main()
         }
     }
 
+    // Models available for runtime switching (web UI / MQTT)
+    wandClient.setModelRegistry(model_loaded ? &modelRegistry : nullptr, active_model);
+
     // Set callbacks
     wandClient.onSpellDetected(onSpellDetected);
     wandClient.onConnectionChange(onConnectionChange);
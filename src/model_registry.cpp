@@ -0,0 +1,139 @@
+#include "model_registry.h"
+#include "spell_detector.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "model_registry";
+
+static const ModelRegistryHeader *registryHeader(const unsigned char *partition, size_t partition_size)
+{
+    if (!partition || partition_size < sizeof(ModelRegistryHeader))
+        return nullptr;
+
+    const ModelRegistryHeader *header = (const ModelRegistryHeader *)partition;
+    if (header->magic != MODEL_REGISTRY_MAGIC || header->version != MODEL_REGISTRY_VERSION ||
+        header->count == 0 || header->count > MODEL_REGISTRY_MAX_MODELS ||
+        sizeof(ModelRegistryHeader) + header->count * sizeof(ModelRegistryEntry) > partition_size)
+    {
+        return nullptr;
+    }
+    return header;
+}
+
+ModelRegistry::ModelRegistry() : count(0)
+{
+    memset(models, 0, sizeof(models));
+}
+
+size_t ModelRegistry::extent(const unsigned char *partition, size_t partition_size)
+{
+    const ModelRegistryHeader *header = registryHeader(partition, partition_size);
+    if (!header)
+    {
+        // Legacy layout: one flatbuffer at offset 0
+        return SpellDetector::modelSize(partition, partition_size);
+    }
+
+    const ModelRegistryEntry *entries = (const ModelRegistryEntry *)(header + 1);
+    size_t end = sizeof(ModelRegistryHeader) + header->count * sizeof(ModelRegistryEntry);
+    for (uint16_t i = 0; i < header->count; i++)
+    {
+        size_t entry_end = (size_t)entries[i].offset + entries[i].size;
+        if (entry_end <= partition_size && entry_end > end)
+            end = entry_end;
+    }
+    return end;
+}
+
+bool ModelRegistry::load(const unsigned char *partition, size_t partition_size)
+{
+    count = 0;
+
+    const ModelRegistryHeader *header = registryHeader(partition, partition_size);
+    if (!header)
+    {
+        size_t size = SpellDetector::modelSize(partition, partition_size);
+        if (size == 0)
+        {
+            ESP_LOGW(TAG, "No model registry and no valid model in partition");
+            return false;
+        }
+
+        ModelInfo &info = models[0];
+        strncpy(info.name, "default", sizeof(info.name) - 1);
+        info.data = partition;
+        info.size = size;
+        info.input_samples = SPELL_SAMPLE_COUNT;
+        info.input_channels = 2;
+        info.output_classes = SPELL_OUTPUT_SIZE;
+        info.crc32 = 0;
+        info.crc_checked = true; // Nothing to check against
+        count = 1;
+        ESP_LOGI(TAG, "Legacy single-model partition (%zu bytes)", size);
+        return true;
+    }
+
+    const ModelRegistryEntry *entries = (const ModelRegistryEntry *)(header + 1);
+    for (uint16_t i = 0; i < header->count; i++)
+    {
+        const ModelRegistryEntry &entry = entries[i];
+        if (entry.size == 0 || (size_t)entry.offset + entry.size > partition_size || (entry.offset & 15) != 0)
+        {
+            ESP_LOGW(TAG, "Skipping model %u: bad offset/size (0x%lx, %lu)",
+                     i, (unsigned long)entry.offset, (unsigned long)entry.size);
+            continue;
+        }
+
+        ModelInfo &info = models[count];
+        memcpy(info.name, entry.name, sizeof(info.name));
+        info.name[sizeof(info.name) - 1] = '\0';
+        info.data = partition + entry.offset;
+        info.size = entry.size;
+        info.input_samples = entry.input_samples;
+        info.input_channels = entry.input_channels;
+        info.output_classes = entry.output_classes;
+        info.crc32 = entry.crc32;
+        info.crc_checked = false;
+        count++;
+
+        ESP_LOGI(TAG, "  [%u] %-24s %7lu bytes  input [1,%u,%u]  classes %u",
+                 i, info.name, (unsigned long)info.size,
+                 info.input_samples, info.input_channels, info.output_classes);
+    }
+
+    ESP_LOGI(TAG, "Model registry: %zu model(s)", count);
+    return count > 0;
+}
+
+int ModelRegistry::find(const char *name) const
+{
+    if (!name)
+        return -1;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (strncmp(models[i].name, name, sizeof(models[i].name)) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+bool ModelRegistry::verify(size_t index)
+{
+    if (index >= count)
+        return false;
+
+    ModelInfo &info = models[index];
+    if (info.crc_checked)
+        return true;
+
+    uint32_t crc = esp_rom_crc32_le(0, info.data, info.size);
+    if (crc != info.crc32)
+    {
+        ESP_LOGE(TAG, "CRC mismatch for model '%s': stored 0x%08lx, computed 0x%08lx",
+                 info.name, (unsigned long)info.crc32, (unsigned long)crc);
+        return false;
+    }
+    info.crc_checked = true;
+    return true;
+}
@@ -0,0 +1,187 @@
+#include "shadow_eval.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "shadow_eval";
+
+ShadowEvaluator::ShadowEvaluator()
+    : enabled(false), queue(nullptr), task(nullptr), log_mutex(nullptr),
+      ring_head(0), ring_count(0), total(0), disagreements(0), dropped(0)
+{
+    model_name[0] = '\0';
+}
+
+bool ShadowEvaluator::setModel(const ModelInfo *info)
+{
+    if (!log_mutex)
+    {
+        log_mutex = xSemaphoreCreateMutex();
+        queue = xQueueCreate(SHADOW_QUEUE_DEPTH, sizeof(Job));
+        if (!log_mutex || !queue)
+        {
+            ESP_LOGE(TAG, "Failed to create shadow queue/mutex");
+            return false;
+        }
+    }
+
+    // Detector is swapped under the mutex so an in-flight evaluation finishes first
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    enabled = false;
+    model_name[0] = '\0';
+    bool ok = true;
+    if (info)
+    {
+        ok = detector.begin(info->data, info->size, info->crc32) && detector.isReady();
+        if (ok)
+        {
+            strncpy(model_name, info->name, sizeof(model_name) - 1);
+            model_name[sizeof(model_name) - 1] = '\0';
+            enabled = true;
+        }
+    }
+    else
+    {
+        detector.begin(nullptr, 0); // Releases arena + interpreter
+    }
+    xSemaphoreGive(log_mutex);
+
+    if (!ok)
+    {
+        ESP_LOGE(TAG, "Failed to load shadow model '%s'", info->name);
+        return false;
+    }
+
+    if (enabled && !task)
+    {
+        xTaskCreate(taskFunc, "shadow_eval", SHADOW_TASK_STACK, this, SHADOW_TASK_PRIORITY, &task);
+    }
+
+    ESP_LOGI(TAG, "Shadow mode %s%s", enabled ? "enabled with model " : "disabled", model_name);
+    return true;
+}
+
+void ShadowEvaluator::submit(const Position2D *positions, size_t position_count, const float *input, size_t input_size,
+                             int prod_index, float prod_confidence, uint32_t prod_us)
+{
+    if (!enabled || !queue || !input || prod_index < 0)
+        return;
+
+    // The detector's shape decides the input, so setModel must not swap it meanwhile; like the
+    // queue below this never waits on the cast path (busy = an evaluation or a swap is running)
+    if (xSemaphoreTake(log_mutex, 0) != pdTRUE)
+    {
+        dropped++;
+        return;
+    }
+    Job job;
+    bool ready = enabled;
+    if (ready && detector.getInputSize() == input_size)
+    {
+        memcpy(job.input, input, input_size * sizeof(float));
+    }
+    else if (ready)
+    {
+        ready = positions && detector.preprocessWindows(positions, position_count, job.input, nullptr, 1) == 1;
+    }
+    job.input_size = (uint16_t)detector.getInputSize();
+    xSemaphoreGive(log_mutex);
+    if (!ready)
+    {
+        return;
+    }
+    job.prod_index = (uint8_t)prod_index;
+    job.prod_confidence = prod_confidence;
+    job.prod_us = prod_us;
+
+    // Never block the detection path
+    if (xQueueSend(queue, &job, 0) != pdTRUE)
+    {
+        dropped++;
+    }
+}
+
+void ShadowEvaluator::taskFunc(void *arg)
+{
+    ShadowEvaluator *self = (ShadowEvaluator *)arg;
+    Job job;
+    while (true)
+    {
+        if (xQueueReceive(self->queue, &job, portMAX_DELAY) == pdTRUE)
+        {
+            self->evaluate(job);
+        }
+    }
+}
+
+void ShadowEvaluator::evaluate(const Job &job)
+{
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    if (!enabled || job.input_size != detector.getInputSize())
+    {
+        // Disabled, or the shadow model changed shape since the cast was queued
+        xSemaphoreGive(log_mutex);
+        return;
+    }
+
+    // Threshold 0: we want the shadow's top-1 regardless of confidence
+    int64_t start = esp_timer_get_time();
+    detector.detect((float *)job.input, 0.0f);
+    uint32_t shadow_us = (uint32_t)(esp_timer_get_time() - start);
+
+    ShadowRecord &rec = ring[ring_head];
+    rec.timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    rec.prod_index = job.prod_index;
+    rec.shadow_index = (uint8_t)detector.getLastPredictionIndex();
+    rec.prod_confidence = job.prod_confidence;
+    rec.shadow_confidence = detector.getConfidence();
+    rec.shadow_prod_confidence = detector.getProbability(job.prod_index);
+    rec.prod_us = job.prod_us;
+    rec.shadow_us = shadow_us;
+
+    ring_head = (ring_head + 1) % SHADOW_LOG_SIZE;
+    if (ring_count < SHADOW_LOG_SIZE)
+        ring_count++;
+    total++;
+    bool disagree = rec.prod_index != rec.shadow_index;
+    if (disagree)
+        disagreements++;
+    xSemaphoreGive(log_mutex);
+
+    if (disagree)
+    {
+        ESP_LOGI(TAG, "Disagreement: prod %s (%.2f) vs shadow %s (%.2f), %lu/%lu us",
+                 SPELL_NAMES[rec.prod_index], rec.prod_confidence,
+                 SPELL_NAMES[rec.shadow_index], rec.shadow_confidence,
+                 (unsigned long)rec.prod_us, (unsigned long)rec.shadow_us);
+    }
+}
+
+size_t ShadowEvaluator::snapshot(ShadowRecord *out, size_t max)
+{
+    if (!log_mutex || !out)
+        return 0;
+
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    size_t n = ring_count < max ? ring_count : max;
+    size_t start = (ring_head + SHADOW_LOG_SIZE - ring_count) % SHADOW_LOG_SIZE;
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = ring[(start + i) % SHADOW_LOG_SIZE];
+    }
+    xSemaphoreGive(log_mutex);
+    return n;
+}
+
+void ShadowEvaluator::clear()
+{
+    if (!log_mutex)
+        return;
+    xSemaphoreTake(log_mutex, portMAX_DELAY);
+    ring_head = 0;
+    ring_count = 0;
+    total = 0;
+    disagreements = 0;
+    dropped = 0;
+    xSemaphoreGive(log_mutex);
+}
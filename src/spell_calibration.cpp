@@ -0,0 +1,141 @@
+#include "spell_calibration.h"
+#include <string.h>
+#include <math.h>
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char *TAG = "spell_calibration";
+
+#define CALIBRATION_NVS_NAMESPACE "storage"
+#define CALIBRATION_VERSION 1
+
+struct __attribute__((packed)) CalibrationBlob
+{
+    uint16_t version;
+    uint16_t count;
+    float temperature;
+    float thresholds[SPELL_OUTPUT_SIZE];
+};
+
+SpellCalibration::SpellCalibration()
+{
+    reset();
+}
+
+void SpellCalibration::reset()
+{
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        thresholds[i] = SPELL_CONFIDENCE_THRESHOLD;
+    }
+    temperature = 1.0f;
+    invTemperature = 1.0f;
+}
+
+bool SpellCalibration::load()
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK)
+    {
+        return false;
+    }
+
+    CalibrationBlob blob;
+    size_t len = sizeof(blob);
+    esp_err_t err = nvs_get_blob(nvs_handle, CALIBRATION_NVS_KEY, &blob, &len);
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGI(TAG, "No stored calibration - using %.2f for every spell", SPELL_CONFIDENCE_THRESHOLD);
+        return false;
+    }
+    if (len != sizeof(blob) || blob.version != CALIBRATION_VERSION || blob.count != SPELL_OUTPUT_SIZE)
+    {
+        ESP_LOGW(TAG, "Stored calibration doesn't match this firmware (%u classes) - ignored", blob.count);
+        return false;
+    }
+
+    reset();
+    setTemperature(blob.temperature);
+    int custom = 0;
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        if (setThreshold(i, blob.thresholds[i]) && thresholds[i] != SPELL_CONFIDENCE_THRESHOLD)
+            custom++;
+    }
+    ESP_LOGI(TAG, "Calibration loaded: temperature %.2f, %d custom thresholds", temperature, custom);
+    return true;
+}
+
+bool SpellCalibration::save()
+{
+    CalibrationBlob blob;
+    blob.version = CALIBRATION_VERSION;
+    blob.count = SPELL_OUTPUT_SIZE;
+    blob.temperature = temperature;
+    memcpy(blob.thresholds, thresholds, sizeof(thresholds));
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open NVS");
+        return false;
+    }
+    esp_err_t err = nvs_set_blob(nvs_handle, CALIBRATION_NVS_KEY, &blob, sizeof(blob));
+    if (err == ESP_OK)
+        err = nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save calibration: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+float SpellCalibration::getThreshold(int spell_id) const
+{
+    if (spell_id < 0 || spell_id >= SPELL_OUTPUT_SIZE)
+        return SPELL_CONFIDENCE_THRESHOLD;
+    return thresholds[spell_id];
+}
+
+bool SpellCalibration::setThreshold(int spell_id, float threshold)
+{
+    if (spell_id < 0 || spell_id >= SPELL_OUTPUT_SIZE || !(threshold > 0.0f && threshold <= 1.0f))
+        return false;
+    thresholds[spell_id] = threshold;
+    return true;
+}
+
+bool SpellCalibration::setTemperature(float value)
+{
+    if (!(value >= CALIBRATION_MIN_TEMPERATURE && value <= CALIBRATION_MAX_TEMPERATURE))
+        return false;
+    temperature = value;
+    invTemperature = 1.0f / value;
+    return true;
+}
+
+void SpellCalibration::apply(float *probabilities) const
+{
+    if (temperature == 1.0f)
+        return;
+
+    float sum = 0.0f;
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        probabilities[i] = powf(probabilities[i], invTemperature);
+        sum += probabilities[i];
+    }
+    if (sum <= 0.0f)
+        return;
+
+    float inv_sum = 1.0f / sum;
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        probabilities[i] *= inv_sum;
+    }
+}
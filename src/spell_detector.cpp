@@ -1,8 +1,16 @@
 #include "spell_detector.h"
+#include "spell_calibration.h"
+#include "spell_personalization.h"
+#include "gesture_preprocessor.h"
 #include <cmath>
 #include <algorithm>
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "config.h"
+#include <new>
+#include <stdio.h>
 
 static const char *TAG = "spell_detector";
 
@@ -584,163 +592,285 @@ Quaternion AHRSTracker::multiply(const Quaternion &a, const Quaternion &b)
 // Gesture Preprocessor Implementation
 // ============================================================================
 
-bool GesturePreprocessor::preprocess(const Position2D *input, size_t input_count,
-                                     float *output, size_t output_size)
+const char *PREPROCESS_WINDOW_NAMES[PREPROCESS_MAX_WINDOWS] = {"base", "tight", "loose", "shifted"};
+
+// Model input shapes with a preprocessor instantiation; begin() picks one from the input tensor dims
+struct PreprocessorVariant
 {
-    // EXACT Python translation from spell_tracker.py _recognize_spell() (lines 313-425)
+    uint16_t samples;
+    uint8_t channels;
+    PreprocessWindowsFn preprocess;
+};
+
+static const PreprocessorVariant PREPROCESSOR_VARIANTS[] = {
+    {SPELL_SAMPLE_COUNT, 2, &GesturePreprocessor::preprocessWindows}, // Production model (Python-exact)
+    {32, 2, &GesturePreprocessorT<32, 2>::preprocessWindows},
+    {64, 2, &GesturePreprocessorT<64, 2>::preprocessWindows},
+    {100, 2, &GesturePreprocessorT<100, 2, PreprocessInterp::LINEAR>::preprocessWindows},
+};
 
-    if (!input || !output || output_size != SPELL_INPUT_SIZE)
+static_assert(GesturePreprocessorT<100, 2>::INPUT_SIZE <= SPELL_INPUT_MAX_SIZE, "SPELL_INPUT_MAX_SIZE too small");
+
+static const PreprocessorVariant *findPreprocessor(int samples, int channels)
+{
+    for (const PreprocessorVariant &variant : PREPROCESSOR_VARIANTS)
     {
-        ESP_LOGW(TAG, "Invalid parameters for preprocess");
-        return false;
+        if (variant.samples == samples && variant.channels == channels)
+            return &variant;
     }
+    return nullptr;
+}
 
-    // Python: positions: np.ndarray = self._state.positions
-    // Python: position_count: int = self._state.position_count
-    const Position2D *positions = input;
-    size_t position_count = input_count;
+bool SpellDetector::supportsInputShape(int samples, int channels)
+{
+    return findPreprocessor(samples, channels) != nullptr;
+}
 
-    // Python Phase 1: Calculate bounding box (min/max X and Y) - lines 335-352
-    float min_x = INFINITY;  // Python: np.float32(np.inf)
-    float max_x = -INFINITY; // Python: np.float32(-np.inf)
-    float min_y = INFINITY;  // Python: np.float32(np.inf)
-    float max_y = -INFINITY; // Python: np.float32(-np.inf)
+size_t SpellDetector::preprocessWindows(const Position2D *input, size_t input_count,
+                                        float *outputs, uint8_t *window_ids, size_t max_windows) const
+{
+    return preprocessFn(input, input_count, outputs, window_ids, max_windows);
+}
 
-    for (size_t i = 0; i < position_count; i++)
-    {
-        float x = positions[i].x; // Python: x: np.float32 = positions[i, 0]
-        float y = positions[i].y; // Python: y: np.float32 = positions[i, 1]
+// ============================================================================
+// SpellDetector Implementation
+// ============================================================================
 
-        if (x < min_x)
-            min_x = x;
-        if (x > max_x)
-            max_x = x;
-        if (y < min_y)
-            min_y = y;
-        if (y > max_y)
-            max_y = y;
-    }
+#ifdef USE_TENSORFLOW
+// TensorFlow Lite enabled implementation
+
+// NVS entry per model ("a" + model hash): arena size << 4 | placement
+// Keyed by model so production and shadow/registry models don't evict each other
+#define ARENA_NVS_NAMESPACE "storage"
 
-    // Python lines 354-356: Compute bounding box size (larger of width or height)
-    float width = max_x - min_x;
-    float height = max_y - min_y;
-    float bbox_size = fmaxf(width, height); // Python: np.maximum(width, height)
+static const char *PLACEMENT_NAMES[TENSOR_PLACEMENT_COUNT] = {"split", "psram", "internal"};
 
-    // Python Phase 2: Early exit checks (lines 358-363)
-    if (bbox_size <= 0.0f) // Python: if bbox_size <= SpellTracker._CONST_0_0
+// Op resolver shared by every interpreter (ops may only be registered once)
+static tflite::MicroMutableOpResolver<15> &getOpResolver()
+{
+    static tflite::MicroMutableOpResolver<15> micro_op_resolver;
+    static bool registered = false;
+    if (!registered)
     {
-        ESP_LOGW(TAG, "No movement detected");
-        return false; // Python: return -1
+        micro_op_resolver.AddFullyConnected();
+        micro_op_resolver.AddSoftmax();
+        micro_op_resolver.AddReshape();
+        micro_op_resolver.AddQuantize();
+        micro_op_resolver.AddDequantize();
+        micro_op_resolver.AddLogistic(); // Sigmoid activation (LOGISTIC op)
+        micro_op_resolver.AddRelu();     // Common activation
+        micro_op_resolver.AddTanh();     // Common activation
+        micro_op_resolver.AddMul();      // Multiplication
+        micro_op_resolver.AddAdd();      // Addition
+        registered = true;
     }
+    return micro_op_resolver;
+}
 
-    if (position_count <= 99) // Python: if position_count <= 99
+// FNV-1a over the model so a re-flashed model triggers a fresh arena measurement
+static uint32_t hashModel(const unsigned char *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
     {
-        ESP_LOGW(TAG, "Not enough data points: %zu (need > 99)", position_count);
-        return false; // Python: return -2
+        hash ^= data[i];
+        hash *= 16777619u;
     }
+    return hash;
+}
 
-    // Python Phase 3: Trim stationary tail (end of gesture) - lines 365-381
-    float threshold_sq = 8.0f * 8.0f; // Python: _CONST_MILLIMETERMOVETHRESHOLD * _CONST_MILLIMETERMOVETHRESHOLD
-    size_t end_index = position_count;
-
-    if (threshold_sq > 0.0f) // Python: if threshold_sq > SpellTracker._CONST_0_0
-    {
-        while (end_index >= 121) // Python: while end_index >= 121: (0x79 = 121)
-        {
-            // Python: Compare points 40 apart from the end
-            size_t curr_idx = end_index - 1;
-            size_t prev_idx = curr_idx - 40;
+static void arenaKey(uint32_t model_hash, char *key, size_t key_len)
+{
+    snprintf(key, key_len, "a%08lx", (unsigned long)model_hash);
+}
 
-            float dx = positions[curr_idx].x - positions[prev_idx].x;
-            float dy = positions[curr_idx].y - positions[prev_idx].y;
-            float dist_sq = dx * dx + dy * dy;
+static bool loadArenaInfo(uint32_t model_hash, size_t *arena_size, uint8_t *placement)
+{
+    nvs_handle_t handle;
+    if (nvs_open(ARENA_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return false;
 
-            if (dist_sq >= threshold_sq)
-                break;
+    char key[16];
+    arenaKey(model_hash, key, sizeof(key));
+    uint32_t packed = 0;
+    bool ok = nvs_get_u32(handle, key, &packed) == ESP_OK && (packed >> 4) > 0;
+    nvs_close(handle);
 
-            end_index -= 10;
-        }
+    if (ok)
+    {
+        *arena_size = packed >> 4;
+        uint8_t stored_place = packed & 0x0F;
+        if (stored_place < TENSOR_PLACEMENT_COUNT)
+            *placement = stored_place;
     }
+    return ok;
+}
 
-    // Python Phase 4: Trim stationary head (start of gesture) - lines 383-400
-    size_t start_index = 0;
-
-    if (threshold_sq > 0.0f && end_index > 120) // Python: if threshold_sq > 0.0 and end_index > 120
+static void saveArenaInfo(uint32_t model_hash, size_t arena_size, uint8_t placement)
+{
+    nvs_handle_t handle;
+    if (nvs_open(ARENA_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
     {
-        while (start_index < end_index - 120) // Python: Keep at least 120 points
-        {
-            // Python: Compare points 10 apart from the start
-            size_t curr_idx = start_index;
-            size_t next_idx = curr_idx + 10;
-
-            float dx = positions[next_idx].x - positions[curr_idx].x;
-            float dy = positions[next_idx].y - positions[curr_idx].y;
-            float dist_sq = dx * dx + dy * dy;
-
-            if (dist_sq >= threshold_sq)
-                break;
-
-            start_index += 10;
-        }
+        ESP_LOGW(TAG, "Could not open NVS to store arena size");
+        return;
     }
+    char key[16];
+    arenaKey(model_hash, key, sizeof(key));
+    nvs_set_u32(handle, key, ((uint32_t)arena_size << 4) | (placement & 0x0F));
+    nvs_commit(handle);
+    nvs_close(handle);
+}
 
-    // Python lines 402-404: Adjust indices for resampling
-    float start_float = (float)(start_index + 1); // Python: np.float32(start_index + 1)
-    size_t trimmed_count = end_index - start_index;
-
-    // Python Phase 5: Resample to 50 normalized points (100 floats) - lines 406-425
-    float step = (float)trimmed_count / 50.0f; // Python: np.float32(trimmed_count) / np.float32(50.0)
-
-    float sample_pos = start_float;
-    for (size_t i = 0; i < 50; i++) // Python: for i in range(50)
+size_t SpellDetector::modelSize(const unsigned char *data, size_t max_size)
+{
+    if (!data || max_size < 8)
+        return 0;
+
+    // Erased flash / garbage fails verification instead of crashing the interpreter
+    flatbuffers::Verifier verifier(data, max_size);
+    if (!tflite::VerifyModelBuffer(verifier))
+        return 0;
+
+    // The shortest length that still verifies ends at the furthest table, vector or string the
+    // verifier reaches - metadata and anything else placed after the weights included.
+    // Verification only gets easier with more bytes, so the search is monotonic.
+    size_t lo = 8, hi = max_size;
+    while (lo < hi)
     {
-        size_t idx = (size_t)sample_pos; // Python: idx = int(sample_pos)
-
-        // Python: Clamp index to valid range
-        if (idx >= position_count)
-            idx = position_count - 1;
-        // Note: size_t is unsigned, no need to check < 0 (Python does: if idx < 0: idx = 0)
-
-        // Python: Normalize to [0, 1] based on bounding box
-        output[i * 2] = (positions[idx].x - min_x) / bbox_size;     // Python: pos_inputs[i, 0]
-        output[i * 2 + 1] = (positions[idx].y - min_y) / bbox_size; // Python: pos_inputs[i, 1]
+        size_t mid = lo + (hi - lo) / 2;
+        flatbuffers::Verifier probe(data, mid);
+        if (tflite::VerifyModelBuffer(probe))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    size_t end = hi;
 
-        sample_pos += step;
+    // Buffers stored outside the flatbuffer (offset/size) are not reached by the verifier
+    const tflite::Model *m = tflite::GetModel(data);
+    const auto *buffers = m->buffers();
+    if (buffers)
+    {
+        for (const auto *buffer : *buffers)
+        {
+            if (buffer->offset() > 1)
+                end = max(end, (size_t)(buffer->offset() + buffer->size()));
+        }
     }
 
-    return true;
+    // Round up to the flatbuffer alignment; anything implausible means "use the whole region"
+    end = (end + 15) & ~(size_t)15;
+    if (end == 0 || end > max_size)
+        return max_size;
+    return end;
 }
 
-// ============================================================================
-// SpellDetector Implementation
-// ============================================================================
-
-#ifdef USE_TENSORFLOW
-// TensorFlow Lite enabled implementation
 SpellDetector::SpellDetector()
     : model(nullptr), interpreter(nullptr),
       input_tensor(nullptr), output_tensor(nullptr),
-      tensor_arena(nullptr), initialized(false), lastConfidence(0.0f),
-      lastPredictedSpell(nullptr)
+      tensor_arena(nullptr), tensor_arena_size(0), placement(TENSOR_PLACEMENT_SPLIT),
+      model_source(nullptr), model_source_size(0), model_copy(nullptr), model_hash(0),
+      input_batch(1), output_row(0),
+      inputSize(SPELL_INPUT_SIZE), preprocessFn(&GesturePreprocessor::preprocessWindows),
+      initialized(false), calibration(nullptr), personalization(nullptr), lastConfidence(0.0f), lastPredictedSpell(nullptr), lastPredictedIndex(-1)
 {
 }
 
 SpellDetector::~SpellDetector()
+{
+    releaseInterpreter();
+}
+
+void SpellDetector::releaseInterpreter()
 {
     if (interpreter)
     {
         delete interpreter;
+        interpreter = nullptr;
     }
     if (tensor_arena)
     {
-        delete[] tensor_arena;
+        heap_caps_free(tensor_arena);
+        tensor_arena = nullptr;
     }
+    if (model_copy)
+    {
+        heap_caps_free(model_copy);
+        model_copy = nullptr;
+    }
+    input_tensor = nullptr;
+    output_tensor = nullptr;
+    tensor_arena_size = 0;
+    model = model_source ? tflite::GetModel(model_source) : nullptr;
 }
 
-bool SpellDetector::begin(const unsigned char *model_data_ptr, size_t size)
+bool SpellDetector::buildInterpreter(uint8_t target_placement, size_t arena_size)
+{
+    releaseInterpreter();
+
+    const uint32_t internal_caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    const uint32_t psram_caps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+
+    // Model placement: INTERNAL runs from an internal RAM copy, the others use the caller's buffer
+    const unsigned char *model_ptr = model_source;
+    if (target_placement == TENSOR_PLACEMENT_INTERNAL)
+    {
+        model_copy = (unsigned char *)heap_caps_malloc(model_source_size, internal_caps);
+        if (!model_copy)
+        {
+            ESP_LOGW(TAG, "No internal RAM for %zu byte model copy", model_source_size);
+            return false;
+        }
+        memcpy(model_copy, model_source, model_source_size);
+        model_ptr = model_copy;
+    }
+    model = tflite::GetModel(model_ptr);
+
+    uint32_t arena_caps = (target_placement == TENSOR_PLACEMENT_PSRAM) ? psram_caps : internal_caps;
+    tensor_arena = (uint8_t *)heap_caps_aligned_alloc(16, arena_size, arena_caps);
+    if (!tensor_arena)
+    {
+        ESP_LOGW(TAG, "Failed to allocate %zu byte tensor arena (%s)",
+                 arena_size, PLACEMENT_NAMES[target_placement]);
+        releaseInterpreter();
+        return false;
+    }
+    tensor_arena_size = arena_size;
+
+    interpreter = new (std::nothrow) tflite::MicroInterpreter(
+        model, getOpResolver(), tensor_arena, arena_size);
+    if (!interpreter)
+    {
+        ESP_LOGE(TAG, "Failed to create interpreter");
+        releaseInterpreter();
+        return false;
+    }
+
+    if (interpreter->AllocateTensors() != kTfLiteOk)
+    {
+        ESP_LOGE(TAG, "AllocateTensors() failed (arena %zu bytes, %s)",
+                 arena_size, PLACEMENT_NAMES[target_placement]);
+        releaseInterpreter();
+        return false;
+    }
+
+    input_tensor = interpreter->input(0);
+    output_tensor = interpreter->output(0);
+    placement = target_placement;
+    return true;
+}
+
+bool SpellDetector::begin(const unsigned char *model_data_ptr, size_t size, uint32_t model_id)
 {
     ESP_LOGI(TAG, "Initializing TensorFlow Lite spell detector...");
 
+    // Drop any previously loaded model (runtime model switch)
+    initialized = false;
+    model_source = nullptr;
+    releaseInterpreter();
+    inputSize = SPELL_INPUT_SIZE;
+    preprocessFn = &GesturePreprocessor::preprocessWindows;
+
     // Check if model data is provided
     if (!model_data_ptr || size == 0)
     {
@@ -760,43 +890,45 @@ bool SpellDetector::begin(const unsigned char *model_data_ptr, size_t size)
         return false;
     }
 
-    // Allocate tensor arena
-    tensor_arena = new (std::nothrow) uint8_t[TENSOR_ARENA_SIZE];
-    if (!tensor_arena)
+    model_source = model_data_ptr;
+    model_source_size = size;
+    model_hash = model_id ? model_id : hashModel(model_data_ptr, size);
+
+    // Use the stored arena requirement for this model, or measure it once with a probe arena
+    size_t arena_size = 0;
+    uint8_t wanted_placement = TENSOR_PLACEMENT_SPLIT;
+    if (loadArenaInfo(model_hash, &arena_size, &wanted_placement))
     {
-        ESP_LOGE(TAG, "Failed to allocate tensor arena");
-        return false;
+        ESP_LOGI(TAG, "Stored arena size: %zu bytes (%s)", arena_size, PLACEMENT_NAMES[wanted_placement]);
     }
-
-    // Create op resolver with all needed operations for the model
-    static tflite::MicroMutableOpResolver<15> micro_op_resolver; // Increased from 10 to 15
-    micro_op_resolver.AddFullyConnected();
-    micro_op_resolver.AddSoftmax();
-    micro_op_resolver.AddReshape();
-    micro_op_resolver.AddQuantize();
-    micro_op_resolver.AddDequantize();
-    micro_op_resolver.AddLogistic(); // Sigmoid activation (LOGISTIC op)
-    micro_op_resolver.AddRelu();     // Common activation
-    micro_op_resolver.AddTanh();     // Common activation
-    micro_op_resolver.AddMul();      // Multiplication
-    micro_op_resolver.AddAdd();      // Addition
-
-    // Build interpreter
-    static tflite::MicroInterpreter static_interpreter(
-        model, micro_op_resolver, tensor_arena, TENSOR_ARENA_SIZE);
-    interpreter = &static_interpreter;
-
-    // Allocate tensors
-    TfLiteStatus allocate_status = interpreter->AllocateTensors();
-    if (allocate_status != kTfLiteOk)
-    {
-        ESP_LOGE(TAG, "AllocateTensors() failed");
-        return false;
+    else
+    {
+        uint8_t probe_placement = heap_caps_get_free_size(MALLOC_CAP_SPIRAM) > TENSOR_ARENA_SIZE
+                                      ? TENSOR_PLACEMENT_PSRAM
+                                      : TENSOR_PLACEMENT_SPLIT;
+        if (!buildInterpreter(probe_placement, TENSOR_ARENA_SIZE))
+        {
+            ESP_LOGE(TAG, "Probe arena of %d bytes failed", TENSOR_ARENA_SIZE);
+            return false;
+        }
+        arena_size = interpreter->arena_used_bytes() + TENSOR_ARENA_HEADROOM;
+        ESP_LOGI(TAG, "Measured arena requirement: %zu bytes used, allocating %zu",
+                 interpreter->arena_used_bytes(), arena_size);
+        releaseInterpreter();
+        saveArenaInfo(model_hash, arena_size, wanted_placement);
     }
 
-    // Get input and output tensors
-    input_tensor = interpreter->input(0);
-    output_tensor = interpreter->output(0);
+    // Exact allocation; fall back to PSRAM when internal RAM is too tight
+    if (!buildInterpreter(wanted_placement, arena_size))
+    {
+        if (wanted_placement == TENSOR_PLACEMENT_PSRAM ||
+            !buildInterpreter(TENSOR_PLACEMENT_PSRAM, arena_size))
+        {
+            ESP_LOGE(TAG, "Failed to allocate tensor arena");
+            return false;
+        }
+        ESP_LOGW(TAG, "Tensor arena fell back to PSRAM");
+    }
 
     // Verify input tensor shape
     ESP_LOGI(TAG, "Input tensor details:");
@@ -807,31 +939,38 @@ bool SpellDetector::begin(const unsigned char *model_data_ptr, size_t size)
     }
     ESP_LOGI(TAG, "  Type: %d", input_tensor->type);
 
-    // Model expects [1, 50, 2] - batch_size=1, positions=50, coords=2 (x,y)
-    if (input_tensor->dims->size != 3 ||
-        input_tensor->dims->data[0] != 1 ||
-        input_tensor->dims->data[1] != SPELL_SAMPLE_COUNT ||
-        input_tensor->dims->data[2] != 2)
+    // Model expects [N, samples, channels] - batch_size=N (usually 1), 50 positions x 2 coords by default
+    const PreprocessorVariant *variant = nullptr;
+    if (input_tensor->dims->size == 3 && input_tensor->dims->data[0] >= 1)
     {
-        ESP_LOGE(TAG, "Invalid input shape: expected [1, %d, 2], got [%d, %d, %d]",
-                 SPELL_SAMPLE_COUNT,
+        variant = findPreprocessor(input_tensor->dims->data[1], input_tensor->dims->data[2]);
+    }
+    if (!variant)
+    {
+        ESP_LOGE(TAG, "Unsupported input shape: [%d, %d, %d] (no preprocessor for it, default [1, %d, 2])",
                  input_tensor->dims->data[0],
-                 input_tensor->dims->data[1],
-                 input_tensor->dims->size >= 3 ? input_tensor->dims->data[2] : 0);
+                 input_tensor->dims->size >= 2 ? input_tensor->dims->data[1] : 0,
+                 input_tensor->dims->size >= 3 ? input_tensor->dims->data[2] : 0,
+                 SPELL_SAMPLE_COUNT);
         return false;
     }
 
     // Verify output tensor shape
     if (output_tensor->dims->size != 2 ||
+        output_tensor->dims->data[0] != input_tensor->dims->data[0] ||
         output_tensor->dims->data[1] != SPELL_OUTPUT_SIZE)
     {
-        ESP_LOGE(TAG, "Invalid output shape: expected [1, %d], got [%d, %d]",
-                 SPELL_OUTPUT_SIZE,
+        ESP_LOGE(TAG, "Invalid output shape: expected [%d, %d], got [%d, %d]",
+                 input_tensor->dims->data[0], SPELL_OUTPUT_SIZE,
                  output_tensor->dims->data[0],
                  output_tensor->dims->data[1]);
         return false;
     }
 
+    input_batch = (size_t)input_tensor->dims->data[0];
+    inputSize = (size_t)variant->samples * variant->channels;
+    preprocessFn = variant->preprocess;
+
     ESP_LOGI(TAG, "TensorFlow Lite model loaded successfully");
     ESP_LOGI(TAG, "Input shape: [%d, %d]",
              input_tensor->dims->data[0],
@@ -839,8 +978,86 @@ bool SpellDetector::begin(const unsigned char *model_data_ptr, size_t size)
     ESP_LOGI(TAG, "Output shape: [%d, %d]",
              output_tensor->dims->data[0],
              output_tensor->dims->data[1]);
+    ESP_LOGI(TAG, "Tensor arena: %zu bytes (%zu used), placement: %s",
+             tensor_arena_size, interpreter->arena_used_bytes(), PLACEMENT_NAMES[placement]);
 
     initialized = true;
+
+#if TENSOR_ARENA_BENCHMARK
+    benchmarkPlacement();
+#endif
+
+    return true;
+}
+
+float SpellDetector::getProbability(int index)
+{
+    if (!output_tensor || output_row < 0 || index < 0 || index >= SPELL_OUTPUT_SIZE)
+        return 0.0f;
+    return output_tensor->data.f[output_row * SPELL_OUTPUT_SIZE + index];
+}
+
+int64_t SpellDetector::timeInvoke(int runs)
+{
+    // Fixed ramp input so every placement runs identical work
+    for (size_t i = 0; i < inputSize; i++)
+    {
+        input_tensor->data.f[i] = (float)i / inputSize;
+    }
+
+    // Warm-up run (first Invoke touches cold caches)
+    if (interpreter->Invoke() != kTfLiteOk)
+        return -1;
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < runs; i++)
+    {
+        if (interpreter->Invoke() != kTfLiteOk)
+            return -1;
+    }
+    return (esp_timer_get_time() - start) / runs;
+}
+
+bool SpellDetector::benchmarkPlacement()
+{
+    if (!initialized || !model_source)
+    {
+        return false;
+    }
+
+    size_t arena_size = tensor_arena_size;
+    uint8_t original = placement;
+    uint8_t best = original;
+    int64_t best_us = -1;
+
+    ESP_LOGI(TAG, "Benchmarking tensor placement (%d runs, arena %zu bytes, model %zu bytes)...",
+             TENSOR_BENCHMARK_RUNS, arena_size, model_source_size);
+
+    for (uint8_t p = 0; p < TENSOR_PLACEMENT_COUNT; p++)
+    {
+        if (!buildInterpreter(p, arena_size))
+        {
+            ESP_LOGI(TAG, "  %-8s: does not fit", PLACEMENT_NAMES[p]);
+            continue;
+        }
+        int64_t us = timeInvoke(TENSOR_BENCHMARK_RUNS);
+        ESP_LOGI(TAG, "  %-8s: %lld us per Invoke()", PLACEMENT_NAMES[p], us);
+        if (us >= 0 && (best_us < 0 || us < best_us))
+        {
+            best_us = us;
+            best = p;
+        }
+    }
+
+    if (!buildInterpreter(best, arena_size) && !buildInterpreter(original, arena_size))
+    {
+        ESP_LOGE(TAG, "Could not rebuild interpreter after benchmark");
+        initialized = false;
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Fastest placement: %s (%lld us) - stored in NVS", PLACEMENT_NAMES[placement], best_us);
+    saveArenaInfo(model_hash, arena_size, placement);
     return true;
 }
 
@@ -862,7 +1079,7 @@ const char *SpellDetector::detect(float *positions, float confidence_threshold)
     // }
 
     // Copy input data to tensor
-    for (int i = 0; i < SPELL_INPUT_SIZE; i++)
+    for (size_t i = 0; i < inputSize; i++)
     {
         input_tensor->data.f[i] = positions[i];
     }
@@ -875,6 +1092,16 @@ const char *SpellDetector::detect(float *positions, float confidence_threshold)
         return nullptr;
     }
 
+    if (personalization)
+    {
+        personalization->apply(output_tensor->data.f, model_hash);
+        personalization->keepLast();
+    }
+    if (calibration)
+    {
+        calibration->apply(output_tensor->data.f);
+    }
+
     // Find highest probability spell
     int best_idx = 0;
     float best_prob = output_tensor->data.f[0];
@@ -906,7 +1133,14 @@ const char *SpellDetector::detect(float *positions, float confidence_threshold)
     }
 
     lastPredictedSpell = SPELL_NAMES[best_idx];
+    lastPredictedIndex = best_idx;
     lastConfidence = best_prob;
+    output_row = 0;
+
+    if (calibration)
+    {
+        confidence_threshold = calibration->getThreshold(best_idx);
+    }
 
     // Check confidence threshold
     if (best_prob < confidence_threshold)
@@ -919,11 +1153,102 @@ const char *SpellDetector::detect(float *positions, float confidence_threshold)
     return SPELL_NAMES[best_idx];
 }
 
+const char *SpellDetector::detectWindows(const float *windows, const uint8_t *window_ids, size_t count,
+                                         float confidence_threshold, WindowStats *stats, int *best_window)
+{
+    if (best_window)
+        *best_window = -1;
+    if (!initialized || !windows || count == 0 || !interpreter || !model)
+    {
+        return nullptr;
+    }
+
+    int best_idx = -1;
+    float best_prob = 0.0f;
+    size_t best = 0;
+    output_row = -1;
+
+    // input_batch windows per Invoke(); a [1, 50, 2] model just reuses the interpreter per window
+    for (size_t first = 0; first < count; first += input_batch)
+    {
+        size_t rows = count - first < input_batch ? count - first : input_batch;
+        memcpy(input_tensor->data.f, windows + first * inputSize, rows * inputSize * sizeof(float));
+
+        int64_t invoke_start = esp_timer_get_time();
+        if (interpreter->Invoke() != kTfLiteOk)
+        {
+            ESP_LOGE(TAG, "Invoke() failed");
+            return nullptr;
+        }
+        uint32_t window_us = (uint32_t)((esp_timer_get_time() - invoke_start) / rows);
+
+        for (size_t r = 0; r < rows; r++)
+        {
+            float *probs = output_tensor->data.f + r * SPELL_OUTPUT_SIZE;
+            if (personalization)
+                personalization->apply(probs, model_hash);
+            if (calibration)
+                calibration->apply(probs);
+            int idx = 0;
+            for (int i = 1; i < SPELL_OUTPUT_SIZE; i++)
+            {
+                if (probs[i] > probs[idx])
+                    idx = i;
+            }
+
+            uint8_t id = window_ids ? window_ids[first + r] : (uint8_t)(first + r);
+            if (stats && id < PREPROCESS_MAX_WINDOWS)
+            {
+                stats->evaluated[id]++;
+                stats->total_us[id] += window_us;
+            }
+
+            if (best_idx < 0 || probs[idx] > best_prob)
+            {
+                best_idx = idx;
+                best_prob = probs[idx];
+                best = first + r;
+                output_row = (int)r;
+                if (personalization)
+                    personalization->keepLast();
+            }
+        }
+
+        // The next Invoke() overwrites this batch's rows
+        if (first + rows < count && output_row >= 0)
+            output_row = -1;
+    }
+
+    uint8_t best_id = window_ids ? window_ids[best] : (uint8_t)best;
+    if (best_window)
+        *best_window = best_id;
+
+    lastPredictedSpell = SPELL_NAMES[best_idx];
+    lastPredictedIndex = best_idx;
+    lastConfidence = best_prob;
+
+    ESP_LOGI(TAG, "Best of %zu windows: '%s' %s at %.2f%%", count,
+             best_id < PREPROCESS_MAX_WINDOWS ? PREPROCESS_WINDOW_NAMES[best_id] : "?",
+             SPELL_NAMES[best_idx], best_prob * 100.0f);
+
+    if (calibration)
+        confidence_threshold = calibration->getThreshold(best_idx);
+    if (best_prob < confidence_threshold)
+    {
+        return nullptr;
+    }
+
+    if (stats && best_id < PREPROCESS_MAX_WINDOWS)
+        stats->hits[best_id]++;
+    return SPELL_NAMES[best_idx];
+}
+
 #else
 // Mock implementation when TensorFlow is disabled
 SpellDetector::SpellDetector()
     : model_data(nullptr), model_size(0),
-      initialized(false), lastConfidence(0.0f)
+      inputSize(SPELL_INPUT_SIZE), preprocessFn(&GesturePreprocessor::preprocessWindows),
+      initialized(false), calibration(nullptr), personalization(nullptr), lastConfidence(0.0f), lastPredictedSpell(nullptr), lastPredictedIndex(-1)
 {
 }
 
@@ -931,7 +1256,7 @@ SpellDetector::~SpellDetector()
 {
 }
 
-bool SpellDetector::begin(const unsigned char *model_data_ptr, size_t size)
+bool SpellDetector::begin(const unsigned char *model_data_ptr, size_t size, uint32_t model_id)
 {
     ESP_LOGI(TAG, "Initializing spell detector (MOCK MODE - TensorFlow disabled)...");
     ESP_LOGI(TAG, "To enable real inference:");
@@ -959,6 +1284,34 @@ const char *SpellDetector::detect(float *positions, float confidence_threshold)
 
     // Mock: Return test spell
     lastConfidence = 0.95f;
+    lastPredictedSpell = SPELL_NAMES[0];
+    lastPredictedIndex = 0;
     return SPELL_NAMES[0]; // "The_Force_Spell"
 }
-#endif
\ No newline at end of file
+
+const char *SpellDetector::detectWindows(const float *windows, const uint8_t *window_ids, size_t count,
+                                         float confidence_threshold, WindowStats *stats, int *best_window)
+{
+    if (best_window)
+        *best_window = (count && window_ids) ? window_ids[0] : 0;
+    if (stats && count)
+        stats->evaluated[window_ids ? window_ids[0] : 0]++;
+    return count ? detect((float *)windows, confidence_threshold) : nullptr;
+}
+
+size_t SpellDetector::modelSize(const unsigned char *data, size_t max_size)
+{
+    return data ? max_size : 0;
+}
+
+float SpellDetector::getProbability(int index)
+{
+    return index == lastPredictedIndex ? lastConfidence : 0.0f;
+}
+
+bool SpellDetector::benchmarkPlacement()
+{
+    ESP_LOGI(TAG, "MOCK MODE: no tensor placement to benchmark");
+    return false;
+}
+#endif
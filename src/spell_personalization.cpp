@@ -0,0 +1,486 @@
+#include "spell_personalization.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+static const char *TAG = "personalization";
+
+#define PERSONALIZATION_NVS_NAMESPACE "storage"
+#define PERSONALIZATION_NVS_ACTIVE "pz_active" // u8: slot of the active profile
+#define PERSONALIZATION_NVS_NAMES "pz_names"   // blob: char[MAX_PROFILES][NAME_LEN]
+#define PERSONALIZATION_VERSION 1
+
+// One profile ("pz0".."pz3"): ~700 bytes
+struct __attribute__((packed)) PersonalizationBlob
+{
+    uint16_t version;
+    uint16_t count;     // SPELL_OUTPUT_SIZE
+    uint32_t model_id;
+    uint8_t class_count;
+    uint8_t reserved[3];
+    int8_t bias[SPELL_OUTPUT_SIZE];
+    PersonalizationClass classes[PERSONALIZATION_MAX_CLASSES];
+};
+
+static int8_t quantize(float value, float scale)
+{
+    float v = roundf(value * scale);
+    return v <= -127.0f ? -127 : (v >= 127.0f ? 127 : (int8_t)v);
+}
+
+// Centered log-probabilities (softmax logits up to a constant)
+static void embed(const float *probabilities, float *embedding)
+{
+    float mean = 0.0f;
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        embedding[i] = logf(fmaxf(probabilities[i], PERSONALIZATION_MIN_PROB));
+        mean += embedding[i];
+    }
+    mean /= SPELL_OUTPUT_SIZE;
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        embedding[i] -= mean;
+    }
+}
+
+// In-place softmax; returns the argmax
+static int softmax(float *values)
+{
+    int best = 0;
+    for (int i = 1; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        if (values[i] > values[best])
+            best = i;
+    }
+    float max_value = values[best];
+    float sum = 0.0f;
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        values[i] = expf(values[i] - max_value);
+        sum += values[i];
+    }
+    float inv_sum = 1.0f / sum;
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        values[i] *= inv_sum;
+    }
+    return best;
+}
+
+static bool loadNames(char (*names)[PERSONALIZATION_NAME_LEN])
+{
+    memset(names, 0, PERSONALIZATION_MAX_PROFILES * PERSONALIZATION_NAME_LEN);
+    nvs_handle_t nvs_handle;
+    if (nvs_open(PERSONALIZATION_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK)
+        return false;
+    size_t len = PERSONALIZATION_MAX_PROFILES * PERSONALIZATION_NAME_LEN;
+    esp_err_t err = nvs_get_blob(nvs_handle, PERSONALIZATION_NVS_NAMES, names, &len);
+    nvs_close(nvs_handle);
+    for (int i = 0; i < PERSONALIZATION_MAX_PROFILES; i++)
+    {
+        names[i][PERSONALIZATION_NAME_LEN - 1] = '\0';
+    }
+    return err == ESP_OK;
+}
+
+SpellPersonalization::SpellPersonalization()
+    : profileSlot(-1), modelId(0), classCount(0), active(false),
+      currentModelId(0), lastModelId(0), hasLast(false), stats{}
+{
+    profileName[0] = '\0';
+    memset(bias, 0, sizeof(bias));
+    memset(current, 0, sizeof(current));
+    memset(last, 0, sizeof(last));
+    mutex = xSemaphoreCreateMutex();
+}
+
+void SpellPersonalization::updateActive()
+{
+    bool any = classCount > 0;
+    for (int i = 0; !any && i < SPELL_OUTPUT_SIZE; i++)
+    {
+        any = bias[i] != 0;
+    }
+    active = any;
+}
+
+bool SpellPersonalization::loadSlot(int slot)
+{
+    // Caller holds mutex; a missing blob is an empty profile
+    modelId = 0;
+    classCount = 0;
+    memset(bias, 0, sizeof(bias));
+    profileSlot = slot;
+
+    PersonalizationBlob *blob = (PersonalizationBlob *)malloc(sizeof(PersonalizationBlob));
+    if (!blob)
+        return false;
+
+    char key[8];
+    snprintf(key, sizeof(key), "pz%d", slot);
+    nvs_handle_t nvs_handle;
+    size_t len = sizeof(PersonalizationBlob);
+    bool ok = nvs_open(PERSONALIZATION_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) == ESP_OK;
+    if (ok)
+    {
+        ok = nvs_get_blob(nvs_handle, key, blob, &len) == ESP_OK;
+        nvs_close(nvs_handle);
+    }
+
+    if (ok && len == sizeof(PersonalizationBlob) && blob->version == PERSONALIZATION_VERSION &&
+        blob->count == SPELL_OUTPUT_SIZE && blob->class_count <= PERSONALIZATION_MAX_CLASSES)
+    {
+        modelId = blob->model_id;
+        classCount = blob->class_count;
+        memcpy(bias, blob->bias, sizeof(bias));
+        memcpy(classes, blob->classes, sizeof(classes));
+    }
+    else if (ok)
+    {
+        ESP_LOGW(TAG, "Stored profile %s doesn't match this firmware - starting empty", key);
+    }
+    free(blob);
+    updateActive();
+    return true;
+}
+
+bool SpellPersonalization::saveProfile()
+{
+    if (profileSlot < 0)
+        return false;
+
+    PersonalizationBlob *blob = (PersonalizationBlob *)calloc(1, sizeof(PersonalizationBlob));
+    if (!blob)
+        return false;
+
+    // Snapshot under the mutex, write flash without holding it
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    int slot = profileSlot;
+    blob->version = PERSONALIZATION_VERSION;
+    blob->count = SPELL_OUTPUT_SIZE;
+    blob->model_id = modelId;
+    blob->class_count = (uint8_t)classCount;
+    memcpy(blob->bias, bias, sizeof(bias));
+    memcpy(blob->classes, classes, sizeof(classes));
+    xSemaphoreGive(mutex);
+
+    char key[8];
+    snprintf(key, sizeof(key), "pz%d", slot);
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(PERSONALIZATION_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(nvs_handle, key, blob, sizeof(PersonalizationBlob));
+        if (err == ESP_OK)
+            err = nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+    free(blob);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save profile '%s': %s", profileName, esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+bool SpellPersonalization::load()
+{
+    char names[PERSONALIZATION_MAX_PROFILES][PERSONALIZATION_NAME_LEN];
+    loadNames(names);
+
+    uint8_t slot = 0xFF;
+    nvs_handle_t nvs_handle;
+    if (nvs_open(PERSONALIZATION_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) == ESP_OK)
+    {
+        nvs_get_u8(nvs_handle, PERSONALIZATION_NVS_ACTIVE, &slot);
+        nvs_close(nvs_handle);
+    }
+
+    if (slot >= PERSONALIZATION_MAX_PROFILES || names[slot][0] == '\0')
+    {
+        return selectProfile("default");
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    strncpy(profileName, names[slot], sizeof(profileName) - 1);
+    profileName[sizeof(profileName) - 1] = '\0';
+    loadSlot(slot);
+    xSemaphoreGive(mutex);
+
+    ESP_LOGI(TAG, "Profile '%s': %zu adapted spells", profileName, classCount);
+    return true;
+}
+
+bool SpellPersonalization::selectProfile(const char *name)
+{
+    if (!name || name[0] == '\0' || strlen(name) >= PERSONALIZATION_NAME_LEN)
+        return false;
+
+    char names[PERSONALIZATION_MAX_PROFILES][PERSONALIZATION_NAME_LEN];
+    loadNames(names);
+
+    int slot = -1;
+    int free_slot = -1;
+    for (int i = 0; i < PERSONALIZATION_MAX_PROFILES; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+        {
+            slot = i;
+            break;
+        }
+        if (free_slot < 0 && names[i][0] == '\0')
+            free_slot = i;
+    }
+
+    bool created = slot < 0;
+    if (created)
+    {
+        if (free_slot < 0)
+        {
+            ESP_LOGW(TAG, "No free profile slot for '%s' (max %d)", name, PERSONALIZATION_MAX_PROFILES);
+            return false;
+        }
+        slot = free_slot;
+        strncpy(names[slot], name, PERSONALIZATION_NAME_LEN - 1);
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    strncpy(profileName, name, sizeof(profileName) - 1);
+    profileName[sizeof(profileName) - 1] = '\0';
+    if (created)
+    {
+        // Slot may hold a deleted profile's blob - start clean
+        profileSlot = slot;
+        modelId = 0;
+        classCount = 0;
+        memset(bias, 0, sizeof(bias));
+        updateActive();
+    }
+    else
+    {
+        loadSlot(slot);
+    }
+    hasLast = false;
+    xSemaphoreGive(mutex);
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(PERSONALIZATION_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        if (created)
+            err = nvs_set_blob(nvs_handle, PERSONALIZATION_NVS_NAMES, names, sizeof(names));
+        if (err == ESP_OK)
+            err = nvs_set_u8(nvs_handle, PERSONALIZATION_NVS_ACTIVE, (uint8_t)slot);
+        if (err == ESP_OK)
+            err = nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to store profile selection: %s", esp_err_to_name(err));
+        return false;
+    }
+
+    ESP_LOGI(TAG, "%s profile '%s' (%zu adapted spells)", created ? "Created" : "Selected", profileName, classCount);
+    return created ? saveProfile() : true;
+}
+
+size_t SpellPersonalization::listProfiles(char (*names)[PERSONALIZATION_NAME_LEN], size_t max)
+{
+    char stored[PERSONALIZATION_MAX_PROFILES][PERSONALIZATION_NAME_LEN];
+    loadNames(stored);
+
+    size_t n = 0;
+    for (int i = 0; i < PERSONALIZATION_MAX_PROFILES && n < max; i++)
+    {
+        if (stored[i][0] != '\0')
+            memcpy(names[n++], stored[i], PERSONALIZATION_NAME_LEN);
+    }
+    return n;
+}
+
+bool SpellPersonalization::resetProfile()
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    classCount = 0;
+    memset(bias, 0, sizeof(bias));
+    hasLast = false;
+    updateActive();
+    xSemaphoreGive(mutex);
+
+    ESP_LOGI(TAG, "Profile '%s' reset", profileName);
+    return saveProfile();
+}
+
+void SpellPersonalization::adjustedLogits(const float *embedding, uint32_t model_id, float *logits) const
+{
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        logits[i] = embedding[i] + bias[i] * (1.0f / PERSONALIZATION_BIAS_SCALE);
+    }
+
+    // Class means are only meaningful for the model they were collected with
+    if (model_id != modelId)
+        return;
+
+    const float inv_scale = 1.0f / PERSONALIZATION_EMBED_SCALE;
+    for (size_t k = 0; k < classCount; k++)
+    {
+        const PersonalizationClass &cls = classes[k];
+        float sum_sq = 0.0f;
+        for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+        {
+            float d = embedding[i] - cls.mean[i] * inv_scale;
+            sum_sq += d * d;
+        }
+        float distance = sqrtf(sum_sq);
+        float boost = PERSONALIZATION_NCM_WEIGHT * (PERSONALIZATION_NCM_RADIUS - distance);
+        logits[cls.spell] += fmaxf(-PERSONALIZATION_MAX_BOOST, fminf(PERSONALIZATION_MAX_BOOST, boost));
+    }
+}
+
+void SpellPersonalization::apply(float *probabilities, uint32_t model_id)
+{
+    // Raw row is kept even when nothing is learned yet so the cast can still be corrected
+    memcpy(current, probabilities, sizeof(current));
+    currentModelId = model_id;
+    if (!active)
+    {
+        stats.last_us = 0; // Per-cast log reads this; don't leave the previous cast's time
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    int before = 0;
+    for (int i = 1; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        if (probabilities[i] > probabilities[before])
+            before = i;
+    }
+
+    float embedding[SPELL_OUTPUT_SIZE];
+    embed(probabilities, embedding);
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    adjustedLogits(embedding, model_id, probabilities);
+    xSemaphoreGive(mutex);
+    int after = softmax(probabilities);
+
+    stats.applied++;
+    if (after != before)
+        stats.changed++;
+    stats.last_us = (uint32_t)(esp_timer_get_time() - start);
+    stats.total_us += stats.last_us;
+}
+
+void SpellPersonalization::keepLast()
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    memcpy(last, current, sizeof(last));
+    lastModelId = currentModelId;
+    hasLast = true;
+    xSemaphoreGive(mutex);
+}
+
+bool SpellPersonalization::correct(int spell_id)
+{
+    if (spell_id < 0 || spell_id >= SPELL_OUTPUT_SIZE)
+        return false;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (!hasLast)
+    {
+        xSemaphoreGive(mutex);
+        ESP_LOGW(TAG, "No cast to correct");
+        return false;
+    }
+
+    float embedding[SPELL_OUTPUT_SIZE];
+    embed(last, embedding);
+
+    // Means from another model live in a different embedding space
+    if (lastModelId != modelId)
+    {
+        classCount = 0;
+        modelId = lastModelId;
+    }
+
+    // One cross-entropy step on the bias, using the scores the cast actually got
+    float probs[SPELL_OUTPUT_SIZE];
+    adjustedLogits(embedding, modelId, probs);
+    int predicted = softmax(probs);
+    bias[spell_id] = quantize(bias[spell_id] / PERSONALIZATION_BIAS_SCALE +
+                                  PERSONALIZATION_BIAS_RATE * (1.0f - probs[spell_id]),
+                              PERSONALIZATION_BIAS_SCALE);
+    if (predicted != spell_id)
+    {
+        bias[predicted] = quantize(bias[predicted] / PERSONALIZATION_BIAS_SCALE -
+                                       PERSONALIZATION_BIAS_RATE * probs[predicted],
+                                   PERSONALIZATION_BIAS_SCALE);
+    }
+
+    // Fold the cast into the spell's mean; a full table gives up its least-seen spell
+    size_t slot = classCount;
+    for (size_t k = 0; k < classCount; k++)
+    {
+        if (classes[k].spell == spell_id)
+        {
+            slot = k;
+            break;
+        }
+    }
+    if (slot == classCount)
+    {
+        if (classCount < PERSONALIZATION_MAX_CLASSES)
+        {
+            classCount++;
+        }
+        else
+        {
+            slot = 0;
+            for (size_t k = 1; k < classCount; k++)
+            {
+                if (classes[k].count < classes[slot].count)
+                    slot = k;
+            }
+        }
+        classes[slot].spell = (uint8_t)spell_id;
+        classes[slot].count = 0;
+        memset(classes[slot].mean, 0, sizeof(classes[slot].mean));
+    }
+
+    PersonalizationClass &cls = classes[slot];
+    if (cls.count < PERSONALIZATION_MAX_EXAMPLES)
+        cls.count++;
+    float rate = 1.0f / cls.count;
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        float mean = cls.mean[i] / PERSONALIZATION_EMBED_SCALE;
+        cls.mean[i] = quantize(mean + (embedding[i] - mean) * rate, PERSONALIZATION_EMBED_SCALE);
+    }
+
+    unsigned examples = cls.count;
+    hasLast = false; // One correction per cast
+    stats.corrections++;
+    updateActive();
+    xSemaphoreGive(mutex);
+
+    ESP_LOGI(TAG, "Correction: %s (predicted %s), %u examples, profile '%s'",
+             SPELL_NAMES[spell_id], SPELL_NAMES[predicted], examples, profileName);
+    return saveProfile();
+}
+
+size_t SpellPersonalization::getClasses(PersonalizationClass *out, size_t max)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    size_t n = classCount < max ? classCount : max;
+    memcpy(out, classes, n * sizeof(PersonalizationClass));
+    xSemaphoreGive(mutex);
+    return n;
+}
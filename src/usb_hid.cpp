@@ -1225,6 +1225,18 @@ void USBHIDManager::setSpellGamepadButton(const char *spell_name, uint8_t button
     ESP_LOGW(TAG, "Spell '%s' not found in spell list", spell_name);
 }
 
+void USBHIDManager::setSpellKeycodeAt(int index, uint8_t keycode)
+{
+    if (index >= 0 && index < 73)
+        settings.spell_keycodes[index] = keycode;
+}
+
+void USBHIDManager::setSpellGamepadButtonAt(int index, uint8_t button)
+{
+    if (index >= 0 && index < 73)
+        settings.spell_gamepad_buttons[index] = button > 10 ? 0 : button;
+}
+
 uint8_t USBHIDManager::getSpellGamepadButton(const char *spell_name) const
 {
     if (!spell_name)
@@ -1283,5 +1295,7 @@ void USBHIDManager::setGamepadSensitivityValue(float sensitivity) {}
 void USBHIDManager::setGamepadDeadzoneValue(float deadzone) {}
 void USBHIDManager::setSpellGamepadButton(const char *spell_name, uint8_t button) {}
 uint8_t USBHIDManager::getSpellGamepadButton(const char *spell_name) const { return 0; }
+void USBHIDManager::setSpellKeycodeAt(int index, uint8_t keycode) {}
+void USBHIDManager::setSpellGamepadButtonAt(int index, uint8_t button) {}
 void USBHIDManager::sendSpellGamepadForSpell(const char *spell_name) {}
 #endif // USE_USB_HID_DEVICE
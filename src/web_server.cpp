@@ -7,10 +7,18 @@
 #include "nvs.h"
 #include "esp_wifi.h"
 #include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "ws_protocol.h"
+#include "image_cache.h"
+#include "gesture_atlas.h"
+#include "json_writer.h"
+#include "json_reader.h"
+#include "esp_heap_caps.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
-#include <dirent.h>
+#include <sys/stat.h>
 
 // Forward declaration from main.cpp
 #if USE_USB_HID_DEVICE
@@ -19,1997 +27,155 @@ extern USBHIDManager usbHID;
 
 static const char *TAG = "web_server";
 
-// Helper to sanitize strings for JSON output (removes non-printable and non-UTF-8 chars)
-static void sanitize_for_json(char *dest, const char *src, size_t max_len)
+// Gesture images: the flash-mapped atlas when flashed, otherwise SPIFFS through an LRU
+// cache of the PNG bytes; files too large for the cache stream in chunks
+#define GESTURE_IMAGE_CHUNK_SIZE 8192
+static GestureAtlas gesture_atlas;
+static ImageCache image_cache;
+
+// Per-request logging of gesture image serving (DEBUG_WEB_REQUESTS in config.h)
+#define REQUEST_LOGI(...)                \
+    do                                   \
+    {                                    \
+        if (DEBUG_WEB_REQUESTS)          \
+            ESP_LOGI(TAG, __VA_ARGS__);  \
+    } while (0)
+
+// Set the ETag and answer 304 if the client already has this version
+static bool send_not_modified(httpd_req_t *req, const char *etag)
 {
-    if (!src || !dest || max_len == 0)
-    {
-        if (dest && max_len > 0)
-            dest[0] = '\0';
-        return;
-    }
+    httpd_resp_set_hdr(req, "ETag", etag);
 
-    size_t j = 0;
-    for (size_t i = 0; src[i] != '\0' && j < max_len - 1; i++)
+    char if_none_match[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, etag) != NULL)
     {
-        unsigned char c = src[i];
-        // Allow printable ASCII and basic UTF-8 continuation bytes
-        // Skip control characters, NULL, and invalid UTF-8
-        if (c >= 32 && c < 127) // Printable ASCII
-        {
-            // Escape JSON special characters
-            if (c == '"' || c == '\\' || c == '/')
-            {
-                if (j + 1 < max_len - 1)
-                {
-                    dest[j++] = '\\';
-                    dest[j++] = c;
-                }
-            }
-            else
-            {
-                dest[j++] = c;
-            }
-        }
-        else if (c >= 128) // Potential UTF-8 multi-byte character
-        {
-            // Simple UTF-8 validation: just accept bytes >= 128 as-is
-            // for proper UTF-8 sequences (conservative approach)
-            dest[j++] = c;
-        }
-        // Skip control characters (0-31, 127)
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return true;
     }
-    dest[j] = '\0';
+    return false;
+}
+
+const char *const WS_TOPIC_NAMES[WS_TOPIC_COUNT] = {
+    "status", "spell", "gesture", "gesture_point", "imu", "battery", "button", "scan"};
+
+// JSON responses: a JsonWriter on a JSON_CHUNK_SIZE stack buffer, flushed as HTTP chunks
+#define JSON_CHUNK_SIZE 512
+
+static bool json_chunk_sink(const char *data, size_t len, void *ctx)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len) == ESP_OK;
 }
 
-// Helper for broadcasting WebSocket messages with auto-disconnect detection
-static void broadcast_to_clients(httpd_handle_t server, int *clients, int *count,
-                                 SemaphoreHandle_t mutex, const char *data)
+// Finish a response written through json_chunk_sink: a document that fit in the buffer
+// goes out in one send (with Content-Length), a larger one as its last chunk
+static esp_err_t json_send(httpd_req_t *req, JsonWriter &json)
 {
-    if (!data || !clients || !count || !server)
+    if (!json.flushed())
     {
-        ESP_LOGW(TAG, "broadcast_to_clients called with NULL parameters");
-        return;
+        return httpd_resp_send(req, json.c_str(), json.length());
     }
-
-    if (xSemaphoreTake(mutex, pdMS_TO_TICKS(10)) == pdTRUE)
+    if (!json.flush())
     {
-        httpd_ws_frame_t ws_pkt;
-        memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
-        ws_pkt.payload = (uint8_t *)data;
-        ws_pkt.len = strlen(data);
-        ws_pkt.type = HTTPD_WS_TYPE_TEXT;
-
-        for (int i = 0; i < *count; i++)
-        {
-            esp_err_t ret = httpd_ws_send_frame_async(server, clients[i], &ws_pkt);
-            if (ret != ESP_OK)
-            {
-                ESP_LOGW(TAG, "WebSocket send failed for fd=%d (error=%s), removing client",
-                         clients[i], esp_err_to_name(ret));
-                for (int j = i; j < *count - 1; j++)
-                {
-                    clients[j] = clients[j + 1];
-                }
-                (*count)--;
-                i--;
-            }
-        }
-        xSemaphoreGive(mutex);
+        return ESP_FAIL; // Client went away mid-response
     }
+    return httpd_resp_send_chunk(req, nullptr, 0);
 }
 
-// HTML page with IMU visualization
-static const char index_html[] = R"rawliteral(
-<!DOCTYPE html>
-<html>
-<head>
-    <meta charset="UTF-8">
-    <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <title>Magic Wand Gateway</title>
-    <style>
-        body { 
-            font-family: Arial, sans-serif; 
-            margin: 0; 
-            padding: 20px; 
-            background: #1a1a1a; 
-            color: #fff; 
-        }
-        h1 { 
-            text-align: center; 
-            color: #4CAF50; 
-        }
-        .container { 
-            max-width: 1200px; 
-            margin: 0 auto; 
-        }
-        .status { 
-            padding: 10px; 
-            margin: 10px 0; 
-            border-radius: 5px; 
-            background: #333; 
-        }
-        .status.connected { 
-            background: #2d5016; 
-        }
-        .battery-box {
-            text-align: center;
-            padding: 15px;
-            margin: 10px 0;
-            background: #333;
-            border-radius: 5px;
-            font-size: 1.5em;
-        }
-        .battery-level {
-            color: #4CAF50;
-            font-weight: bold;
-        }
-        .battery-low {
-            color: #ff4444;
-        }
-        .battery-warning {
-            display: none;
-            background: rgba(255, 152, 0, 0.15);
-            border-left: 4px solid #ff9800;
-            padding: 12px 15px;
-            margin: 10px 0;
-            border-radius: 4px;
-            font-size: 0.9em;
-            line-height: 1.5;
-        }
-        .battery-warning.show {
-            display: block;
-        }
-        .battery-warning strong {
-            color: #ff9800;
-        }
-        .spell-box { 
-            font-size: 2em; 
-            text-align: center; 
-            padding: 20px; 
-            margin: 20px 0; 
-            background: #333; 
-            border-radius: 10px; 
-            min-height: 80px; 
-        }
-        .spell-name { 
-            color: #FFD700; 
-            font-weight: bold; 
-        }
-        canvas { 
-            border: 2px solid #444; 
-            border-radius: 5px; 
-            background: #000; 
-            display: block; 
-            margin: 20px auto; 
-        }
-        .data-grid { 
-            display: grid; 
-            grid-template-columns: repeat(2, 1fr); 
-            gap: 10px; 
-            margin: 20px 0; 
-        }
-        .data-item { 
-            background: #333; 
-            padding: 15px; 
-            border-radius: 5px; 
-        }
-        .data-label { 
-            color: #888; 
-            font-size: 0.9em; 
-        }
-        .data-value { 
-            font-size: 1.5em; 
-            font-weight: bold; 
-            color: #4CAF50; 
-        }
-        .ble-controls {
-            background: #333;
-            padding: 20px;
-            margin: 20px 0;
-            border-radius: 5px;
-        }
-        .ble-controls h3 {
-            margin-top: 0;
-            color: #4CAF50;
-        }
-        .button {
-            background: #4CAF50;
-            color: white;
-            border: none;
-            padding: 12px 24px;
-            margin: 5px;
-            border-radius: 5px;
-            cursor: pointer;
-            font-size: 1em;
-            transition: background 0.3s;
-        }
-        .button:hover {
-            background: #45a049;
-        }
-        .button:disabled {
-            background: #666;
-            cursor: not-allowed;
-        }
-        .button.secondary {
-            background: #666;
-        }
-        .button.secondary:hover {
-            background: #555;
-        }
-        .button.danger {
-            background: #d32f2f;
-        }
-        .button.danger:hover {
-            background: #b71c1c;
-        }
-        .scan-results {
-            margin-top: 15px;
-            max-height: 300px;
-            overflow-y: auto;
-        }
-        .scan-item {
-            background: #222;
-            padding: 10px;
-            margin: 5px 0;
-            border-radius: 3px;
-            display: flex;
-            justify-content: space-between;
-            align-items: center;
-        }
-        .scan-item:hover {
-            background: #2a2a2a;
-        }
-        .scan-info {
-            flex-grow: 1;
-        }
-        .mac-address {
-            font-family: monospace;
-            color: #4CAF50;
-        }
-        .rssi {
-            color: #888;
-            font-size: 0.9em;
-        }
-        .input-group {
-            margin: 10px 0;
-        }
-        .input-group input {
-            width: 250px;
-            padding: 10px;
-            border: 1px solid #555;
-            background: #222;
-            color: #fff;
-            border-radius: 5px;
-            font-family: monospace;
-        }
-        .settings-grid {
-            display: grid;
-            grid-template-columns: 1fr 1fr;
-            gap: 20px;
-        }
-        .spell-mappings-container {
-            background: #222;
-            padding: 10px;
-            border-radius: 5px;
-            max-height: 400px;
-            overflow-y: auto;
-        }
-        .spell-mappings-grid {
-            display: grid;
-            grid-template-columns: repeat(2, minmax(0, 1fr));
-            gap: 8px;
-        }
-        .spell-mapping-item {
-            display: flex;
-            flex-direction: column;
-            gap: 4px;
-        }
-        .spell-mapping-item select {
-            width: 100%;
-            padding: 10px;
-            background: #333;
-            color: #fff;
-            border: 1px solid #555;
-            border-radius: 5px;
-            font-size: 14px;
-        }
-        .spell-mapping-search {
-            width: 100%;
-            padding: 10px;
-            margin-bottom: 10px;
-            border: 1px solid #555;
-            background: #222;
-            color: #fff;
-            border-radius: 5px;
-        }
-        @media (max-width: 900px) {
-            .settings-grid {
-                grid-template-columns: 1fr;
-            }
-        }
-        @media (max-width: 700px) {
-            .spell-mappings-grid {
-                grid-template-columns: 1fr;
-            }
-            .button {
-                width: 100%;
-            }
-            .input-group input {
-                width: 100%;
-            }
-        }
-        /* Toast notification styles */
-        .toast {
-            position: fixed;
-            bottom: 20px;
-            right: 20px;
-            background: #333;
-            color: #fff;
-            padding: 16px 24px;
-            border-radius: 8px;
-            box-shadow: 0 4px 12px rgba(0,0,0,0.5);
-            display: flex;
-            align-items: center;
-            gap: 12px;
-            font-size: 1em;
-            z-index: 10000;
-            animation: slideIn 0.3s ease-out, slideOut 0.3s ease-in 2.7s;
-            opacity: 0;
-        }
-        .toast.success {
-            background: #2d5016;
-            border-left: 4px solid #4CAF50;
-        }
-        .toast.error {
-            background: #5a1a1a;
-            border-left: 4px solid #f44336;
-        }
-        @keyframes slideIn {
-            from {
-                transform: translateX(400px);
-                opacity: 0;
-            }
-            to {
-                transform: translateX(0);
-                opacity: 1;
-            }
-        }
-        @keyframes slideOut {
-            from {
-                transform: translateX(0);
-                opacity: 1;
-            }
-            to {
-                transform: translateX(400px);
-                opacity: 0;
-            }
-        }
-        /* Spell Learning Controls */
-        .spell-learning-controls {
-            background: #333;
-            padding: 20px;
-            margin: 20px 0;
-            border-radius: 5px;
-            display: flex;
-            gap: 15px;
-            align-items: center;
-            flex-wrap: wrap;
-        }
-        .spell-learning-controls select {
-            flex: 1;
-            min-width: 250px;
-            padding: 12px;
-            background: #222;
-            color: #fff;
-            border: 1px solid #555;
-            border-radius: 5px;
-            font-size: 1em;
-        }
-        /* Desktop scaling - reduce everything by 30% for better overview */
-        @media (min-width: 901px) {
-            body {
-                zoom: 0.7;
-            }
-        }
-    </style>
-</head>
-<body>
-    <div class="container">
-        <h1>🪄 Magic Wand Gateway</h1>
-        
-        <div id="status" class="status">
-            WebSocket: <span id="status-text">Connecting...</span><br>
-            Wand: <span id="wand-status">Unknown</span>
-        </div>
-        
-        <div class="ble-controls">
-            <h3>🔵 BLE Wand Management</h3>
-            <div>
-                <button class="button" id="scanBtn" onclick="startScan()">🔍 Scan for Wands</button>
-                <button class="button secondary" id="connectBtn" onclick="connectWand()" disabled>🔗 Connect</button>
-                <button class="button danger" id="disconnectBtn" onclick="disconnectWand()">✖ Disconnect</button>
-            </div>
-            <div class="input-group">
-                <label>Stored MAC: </label>
-                <input type="text" id="storedMac" placeholder="XX:XX:XX:XX:XX:XX" readonly>
-                <button class="button secondary" onclick="loadStoredMac()">🔄 Refresh</button>
-            </div>
-            <div id="scanStatus" style="margin-top: 10px; color: #888;"></div>
-            <div id="scanResults" class="scan-results"></div>
-            
-            <div id="battery-warning" class="battery-warning">
-                <strong>⚠️ Low Battery Warning</strong><br>
-                Wand battery is critically low (&lt;40%). The wand is in power-saving mode with limited functionality:
-                <ul style="margin: 8px 0 0 20px; padding: 0;">
-                    <li>Battery monitoring: ✓ Active</li>
-                    <li>Wand control &amp; spells: ✗ Disabled</li>
-                    <li>IMU &amp; gesture tracking: ✗ Disabled</li>
-                </ul>
-                <strong>Please charge the wand to restore full functionality.</strong>
-            </div>
-        </div>
-        
-        <div class="ble-controls">
-            <h3>⚙️ Spell & Mouse Settings</h3>
-            <div class="settings-grid">
-                <div>
-                    <div style="font-size: 0.9em; color: #4CAF50; margin-bottom: 15px; padding: 10px; background: rgba(76, 175, 80, 0.1); border-left: 3px solid #4CAF50; border-radius: 4px;">
-                        <strong>📝 How Spell-to-Key Mapping Works:</strong><br>
-                        1. Perform a gesture/spell with your wand<br>
-                        2. The device detects which spell you cast<br>
-                        3. The assigned keyboard key is sent to your computer<br>
-                        4. Works in both <strong>Mouse</strong> and <strong>Keyboard</strong> HID modes!<br>
-                        <br>
-                        💡 <strong>Example:</strong> Map "Lumos" to key "F" → Cast Lumos → "F" key pressed<br>
-                        Perfect for gaming hotkeys, productivity shortcuts, etc!
-                    </div>
-                    <h4 style="margin: 0 0 10px 0; color: #4CAF50;">Spell Mappings (Full Keyboard)</h4>
-                    <input type="text" id="spell-filter" class="spell-mapping-search" placeholder="Filter spells..." oninput="filterSpellMappings()">
-                    <div class="spell-mappings-container">
-                        <div id="spell-mappings" class="spell-mappings-grid">
-                            <!-- Spell mappings will be populated by JavaScript -->
-                        </div>
-                    </div>
-                    <h4 style="margin: 20px 0 10px 0; color: #4CAF50;">Spell Mappings (Gamepad Buttons)</h4>
-                    <input type="text" id="gamepad-spell-filter" class="spell-mapping-search" placeholder="Filter spells..." oninput="filterGamepadMappings()">
-                    <div class="spell-mappings-container">
-                        <div id="gamepad-mappings" class="spell-mappings-grid">
-                            <!-- Gamepad mappings will be populated by JavaScript -->
-                        </div>
-                    </div>
-                </div>
-                <div>
-                    <h4 style="margin: 0 0 10px 0; color: #4CAF50;">Mouse Settings</h4>
-                    <div style="background: #222; padding: 10px; border-radius: 5px;">
-                        <div style="margin: 10px 0;">
-                            <label style="display: block; margin-bottom: 5px;">Mouse Sensitivity:</label>
-                            <div style="display: flex; gap: 10px; align-items: center;">
-                                <input type="range" id="mouse-sensitivity" min="0.1" max="5.0" step="0.1" value="1.0" style="flex-grow: 1;">
-                                <span id="sens-value" style="width: 40px; text-align: right;">1.0x</span>
-                            </div>
-                            <div style="font-size: 0.8em; color: #888; margin-top: 5px;">Lower = less movement, Higher = more movement</div>
-                        </div>
-                        <div style="margin: 10px 0;">
-                            <label style="display: flex; align-items: center; gap: 8px; cursor: pointer;">
-                                <input type="checkbox" id="invert-mouse-y" style="width: 18px; height: 18px;">
-                                <span>Invert Mouse Y-Axis</span>
-                            </label>
-                            <div style="font-size: 0.8em; color: #888; margin-top: 5px;">
-                                📍 Only applies in <strong>Mouse</strong> mode<br>
-                                ⚠️ <strong>If cursor moves BACKWARDS:</strong><br>
-                                • UNCHECKED (default) = wand UP moves cursor UP (natural)<br>
-                                • CHECKED = wand UP moves cursor DOWN (inverted)<br>
-                                💡 Click "Reset Settings" below if checkbox doesn't work
-                            </div>
-                        </div>
-                        <div style="margin: 10px 0; border-top: 1px solid #444; padding-top: 10px;">
-                            <label style="display: block; margin-bottom: 5px;">HID Mode:</label>
-                            <select id="hid-mode" style="width: 100%; padding: 8px; border-radius: 4px; background: #111; color: #eee; border: 1px solid #444;">
-                                <option value="0">Mouse - Wand controls cursor + spell keys</option>
-                                <option value="1">Keyboard - Spell keys only</option>
-                                <option value="2">Gamepad - Wand controls joystick + spell buttons</option>
-                                <option value="3">Disabled - No HID output</option>
-                            </select>
-                            <div style="font-size: 0.8em; color: #4CAF50; margin-top: 8px; padding: 8px; background: rgba(76, 175, 80, 0.1); border-left: 3px solid #4CAF50; border-radius: 4px;">
-                                <strong>ℹ️ Mixed Mode Tip:</strong><br>
-                                • <strong>Mouse mode:</strong> Wand movement controls cursor AND detected spells send keyboard keys!<br>
-                                • <strong>Keyboard mode:</strong> Only spell detection sends keys (no mouse movement)<br>
-                                • <strong>Gamepad mode:</strong> Wand controls joystick AND spells trigger gamepad buttons<br>
-                                • This lets you aim with the wand while casting spells as hotkeys!
-                            </div>
-                        </div>
-                        <div style="margin: 10px 0; border-top: 1px solid #444; padding-top: 10px;">
-                            <label style="display: block; margin-bottom: 5px;">Gamepad Sensitivity:</label>
-                            <div style="display: flex; gap: 10px; align-items: center;">
-                                <input type="range" id="gamepad-sensitivity" min="0.1" max="5.0" step="0.1" value="1.0" style="flex-grow: 1;">
-                                <span id="gpad-sens-value" style="width: 40px; text-align: right;">1.0x</span>
-                            </div>
-                        </div>
-                        <div style="margin: 10px 0;">
-                            <label style="display: block; margin-bottom: 5px;">Gamepad Dead Zone:</label>
-                            <div style="display: flex; gap: 10px; align-items: center;">
-                                <input type="range" id="gamepad-deadzone" min="0.0" max="0.5" step="0.01" value="0.05" style="flex-grow: 1;">
-                                <span id="gpad-deadzone-value" style="width: 50px; text-align: right;">0.05</span>
-                            </div>
-                        </div>
-                        <div style="margin: 10px 0;">
-                            <label style="display: flex; align-items: center; gap: 8px; cursor: pointer;">
-                                <input type="checkbox" id="invert-gamepad-y" style="width: 18px; height: 18px;">
-                                <span>Invert Gamepad Y-Axis</span>
-                            </label>
-                            <div style="font-size: 0.8em; color: #888; margin-top: 5px;">
-                                🎮 Only applies in <strong>Gamepad</strong> mode<br>
-                                ⚠️ Toggle if wand movement feels backwards in-game
-                            </div>
-                        </div>
-                    </div>
-                    <div style="background: #222; padding: 10px; border-radius: 5px; margin-top: 10px;">
-                        <h4 style="margin: 0 0 10px 0; color: #4CAF50;">Home Assistant MQTT Settings</h4>
-                        <div style="margin: 10px 0;">
-                            <label style="display: flex; align-items: center; gap: 8px; cursor: pointer;">
-                                <input type="checkbox" id="ha-mqtt-enabled" style="width: 18px; height: 18px;">
-                                <span>Enable MQTT</span>
-                            </label>
-                        </div>
-                        <div style="margin: 10px 0;">
-                            <label style="display: block; margin-bottom: 5px;">MQTT Broker URI:</label>
-                            <input type="text" id="mqtt-broker" placeholder="mqtt://192.168.1.100:1883" style="width: 100%; padding: 8px; border-radius: 4px; background: #111; color: #eee; border: 1px solid #444;">
-                        </div>
-                        <div style="margin: 10px 0;">
-                            <label style="display: block; margin-bottom: 5px;">MQTT Username:</label>
-                            <input type="text" id="mqtt-username" placeholder="homeassistant" style="width: 100%; padding: 8px; border-radius: 4px; background: #111; color: #eee; border: 1px solid #444;">
-                        </div>
-                        <div style="margin: 10px 0;">
-                            <label style="display: block; margin-bottom: 5px;">MQTT Password:</label>
-                            <input type="password" id="mqtt-password" placeholder="password" style="width: 100%; padding: 8px; border-radius: 4px; background: #111; color: #eee; border: 1px solid #444;">
-                        </div>
-                        <div style="font-size: 0.8em; color: #888; margin-top: 5px;">Restart required after changing MQTT settings</div>
-                    </div>
-                </div>
-            </div>
-            <div style="margin-top: 15px;">
-                <button class="button" onclick="saveSettings()">💾 Save Settings</button>
-                <button class="button secondary" onclick="loadSettings()">🔄 Load Settings</button>
-                <button class="button danger" onclick="resetSettings()">🔁 Reset to Defaults</button>
-            </div>
-        </div>
-        
-        <div class="ble-controls">
-            <h3>📡 WiFi & Network Settings</h3>
-            <div style="background: #222; padding: 15px; border-radius: 5px; margin-bottom: 10px;">
-                <h4 style="margin: 0 0 10px 0; color: #4CAF50;">WiFi Client Mode</h4>
-                <div style="margin: 10px 0;">
-                    <button class="button" onclick="scanWifi()">🔍 Scan WiFi Networks</button>
-                    <div id="wifiScanStatus" style="margin-top: 10px; color: #888;"></div>
-                    <div id="wifiResults" class="scan-results" style="max-height: 200px;"></div>
-                </div>
-                <div style="margin: 10px 0;">
-                    <label style="display: block; margin-bottom: 5px;">WiFi SSID:</label>
-                    <input type="text" id="wifi-ssid" placeholder="Your WiFi Network" style="width: 100%; padding: 8px; border-radius: 4px; background: #111; color: #eee; border: 1px solid #444;">
-                </div>
-                <div style="margin: 10px 0;">
-                    <label style="display: block; margin-bottom: 5px;">WiFi Password:</label>
-                    <input type="password" id="wifi-password" placeholder="WiFi Password" style="width: 100%; padding: 8px; border-radius: 4px; background: #111; color: #eee; border: 1px solid #444;">
-                </div>
-                <button class="button" onclick="connectWifi()">🌐 Connect to WiFi</button>
-                <div id="wifiConnectStatus" style="margin-top: 10px; color: #888;"></div>
-            </div>
-            <div style="background: #222; padding: 15px; border-radius: 5px; margin-bottom: 10px;">
-                <h4 style="margin: 0 0 10px 0; color: #4CAF50;">📡 Hotspot / Access Point Info</h4>
-                <div style="margin: 10px 0; padding: 10px; background: #333; border-radius: 4px;">
-                    <div style="margin-bottom: 8px;">
-                        <span style="color: #888;">Default Hotspot SSID:</span>
-                        <span style="color: #4CAF50; margin-left: 8px; font-weight: bold;">HP-esp32-wand-gateway</span>
-                    </div>
-                    <div style="margin-bottom: 8px;">
-                        <span style="color: #888;">Security:</span>
-                        <span style="color: #4CAF50; margin-left: 8px;">Open (No Password)</span>
-                    </div>
-                    <div>
-                        <span style="color: #888;">IP Address:</span>
-                        <span style="color: #4CAF50; margin-left: 8px;">192.168.4.1</span>
-                    </div>
-                </div>
-                <div style="font-size: 0.85em; color: #888; margin-top: 10px; padding: 8px; background: rgba(76, 175, 80, 0.1); border-left: 3px solid #4CAF50;">
-                    💡 The device automatically creates this hotspot when no WiFi network is available.
-                </div>
-            </div>
-            <div style="background: #222; padding: 15px; border-radius: 5px;">
-                <h4 style="margin: 0 0 10px 0; color: #4CAF50;">System Control</h4>
-                <div style="margin-bottom: 15px;">
-                    <label style="display: block; margin-bottom: 5px;">WiFi Mode:</label>
-                    <select id="wifi-mode" style="width: 100%; padding: 8px; border-radius: 4px; background: #111; color: #eee; border: 1px solid #444; margin-bottom: 5px;">
-                        <option value="client">Client Mode (Connect to WiFi)</option>
-                        <option value="ap">Hotspot Mode (Access Point)</option>
-                    </select>
-                    <button class="button" onclick="switchWifiMode()">🔄 Switch WiFi Mode</button>
-                    <div style="font-size: 0.8em; color: #888; margin-top: 5px;">Device will restart to apply mode change</div>
-                </div>
-                <div style="margin-bottom: 15px; padding-top: 15px; border-top: 1px solid #444;">
-                    <button class="button danger" onclick="resetToDefaults()">⚠️ Reset to Defaults</button>
-                    <div style="font-size: 0.8em; color: #888; margin-top: 5px;">Clears all settings (WiFi, wand MAC, MQTT)</div>
-                </div>
-                <div style="margin-bottom: 15px; padding-top: 15px; border-top: 1px solid #444;">
-                    <button class="button" onclick="checkNVS()">🔍 Check Saved Settings (NVS)</button>
-                    <div style="font-size: 0.8em; color: #888; margin-top: 5px;">View what's actually stored in memory</div>
-                    <pre id="nvs-debug" style="background: #111; padding: 10px; border-radius: 4px; font-size: 11px; max-height: 200px; overflow-y: auto; display: none; margin-top: 10px;"></pre>
-                </div>
-                <div style="border-top: 1px solid #444; padding-top: 15px;">
-                    <button class="button danger" onclick="rebootDevice()">🔄 Reboot Device</button>
-                    <div style="font-size: 0.8em; color: #888; margin-top: 5px;">Device will restart in 2 seconds</div>
-                </div>
-            </div>
-        </div>
-        
-        <div class="battery-box">
-            🔋 Battery: <span id="battery" class="battery-level">--</span>%
-        </div>
-        
-        <div class="spell-box" style="background: rgba(76, 175, 80, 0.1); padding: 15px; border-radius: 8px; margin-bottom: 20px;">
-            <h3 style="margin-top: 0; color: #4CAF50;">📱 Wand Information</h3>
-            <div style="display: grid; grid-template-columns: 120px 1fr; gap: 10px; font-size: 14px;">
-                <div><strong>Wand Type:</strong></div><div id="wand-type" style="color: #4CAF50; font-weight: bold;">-</div>
-                <div><strong>Firmware:</strong></div><div id="wand-firmware">-</div>
-                <div><strong>Serial Number:</strong></div><div id="wand-serial">-</div>
-                <div><strong>SKU:</strong></div><div id="wand-sku">-</div>
-                <div><strong>Device ID:</strong></div><div id="wand-device-id">-</div>
-            </div>
-        </div>
-        
-        <div class="spell-box" style="background: rgba(33, 150, 243, 0.1); padding: 15px; border-radius: 8px; margin-bottom: 20px;">
-            <h3 style="margin-top: 0; color: #2196F3;">🔘 Button Presses</h3>
-            <div style="display: flex; gap: 30px; justify-content: center; font-size: 32px;">
-                <div style="text-align: center;">
-                    <div id="btn1" style="color: #666;">○</div>
-                    <div style="font-size: 12px; margin-top: 5px;">B1</div>
-                </div>
-                <div style="text-align: center;">
-                    <div id="btn2" style="color: #666;">○</div>
-                    <div style="font-size: 12px; margin-top: 5px;">B2</div>
-                </div>
-                <div style="text-align: center;">
-                    <div id="btn3" style="color: #666;">○</div>
-                    <div style="font-size: 12px; margin-top: 5px;">B3</div>
-                </div>
-                <div style="text-align: center;">
-                    <div id="btn4" style="color: #666;">○</div>
-                    <div style="font-size: 12px; margin-top: 5px;">B4</div>
-                </div>
-            </div>
-        </div>
-        
-        <div class="spell-box">
-            <div id="spell-display">Waiting for spell...</div>
-        </div>
-        
-        <div class="ble-controls">
-            <h3>📚 Spell Learning</h3>
-            <div class="spell-learning-controls">
-                <select id="spell-selector">
-                    <option value="">-- Select a spell to practice --</option>
-                </select>
-                <button class="button" onclick="practiceSpell()">📖 Load Reference</button>
-                <button class="button secondary" onclick="clearReferenceGesture()">🗑️ Clear</button>
-            </div>
-        </div>
-        
-        <h2 style="text-align: center; color: #4CAF50; margin-top: 30px;">Gesture Path</h2>
-        <canvas id="gesture-canvas" width="600" height="600"></canvas>
-        
-        <h2 style="text-align: center; color: #4CAF50; margin-top: 30px;">IMU Data</h2>
-        <canvas id="imu-canvas" width="800" height="400"></canvas>
-        
-        <div class="data-grid">
-            <div class="data-item">
-                <div class="data-label">Accelerometer X</div>
-                <div class="data-value" id="ax">0.00</div>
-            </div>
-            <div class="data-item">
-                <div class="data-label">Accelerometer Y</div>
-                <div class="data-value" id="ay">0.00</div>
-            </div>
-            <div class="data-item">
-                <div class="data-label">Accelerometer Z</div>
-                <div class="data-value" id="az">0.00</div>
-            </div>
-            <div class="data-item">
-                <div class="data-label">Gyroscope X</div>
-                <div class="data-value" id="gx">0.00</div>
-            </div>
-            <div class="data-item">
-                <div class="data-label">Gyroscope Y</div>
-                <div class="data-value" id="gy">0.00</div>
-            </div>
-            <div class="data-item">
-                <div class="data-label">Gyroscope Z</div>
-                <div class="data-value" id="gz">0.00</div>
-            </div>
-        </div>
-    </div>
-    
-    <script>
-        const canvas = document.getElementById('imu-canvas');
-        const ctx = canvas.getContext('2d');
-        const gestureCanvas = document.getElementById('gesture-canvas');
-        const gestureCtx = gestureCanvas.getContext('2d');
-        const statusDiv = document.getElementById('status');
-        const statusText = document.getElementById('status-text');
-        const wandStatus = document.getElementById('wand-status');
-        
-        let accelHistory = { x: [], y: [], z: [] };
-        let gyroHistory = { x: [], y: [], z: [] };
-        const maxHistory = 200;
-        
-        // Gesture tracking
-        let gesturePoints = [];
-        let rawGesturePoints = [];  // Store raw coordinates from ESP32
-        let isTracking = false;
-        
-        // Gesture reference image for spell practice
-        let referenceGestureImage = null;
-        let referenceGestureLoaded = false;
-        
-        // WebSocket connection
-        let ws = null;
-        
-        function connectWebSocket() {
-            const wsUrl = `ws://${window.location.host}/ws`;
-            ws = new WebSocket(wsUrl);
-            
-            ws.onopen = () => {
-                console.log('WebSocket connected');
-                statusText.textContent = 'Connected';
-                statusDiv.classList.add('connected');
-                // Request current wand status
-                ws.send('{"type":"request_status"}');
-            };
-            
-            ws.onclose = () => {
-                console.log('WebSocket disconnected');
-                statusText.textContent = 'Disconnected';
-                statusDiv.classList.remove('connected');
-                // Reconnect after 2 seconds
-                setTimeout(connectWebSocket, 2000);
-            };
-            
-            ws.onerror = (error) => {
-                console.error('WebSocket error:', error);
-            };
-            
-            ws.onmessage = (event) => {
-                try {
-                    const data = JSON.parse(event.data);
-                    
-                    if (data.type === 'wand_status') {
-                        wandStatus.textContent = data.connected ? '✓ Connected' : '✗ Disconnected';
-                        wandStatus.style.color = data.connected ? '#4CAF50' : '#ff4444';
-                        if (!data.connected) {
-                            clearWandInfo();
-                        }
-                    } else if (data.type === 'imu') {
-                        updateIMU(data);
-                    } else if (data.type === 'spell') {
-                        showSpell(data.spell, data.confidence);
-                    } else if (data.type === 'battery') {
-                        updateBattery(data.level);
-                    } else if (data.type === 'gesture_start') {
-                        startGesture();
-                    } else if (data.type === 'gesture_point') {
-                        addGesturePoint(data.x, data.y);
-                    } else if (data.type === 'gesture_end') {
-                        endGesture();
-                    } else if (data.type === 'scan_result') {
-                        addScanResult(data.address, data.name, data.rssi);
-                    } else if (data.type === 'scan_complete') {
-                        scanComplete();
-                    } else if (data.type === 'low_confidence') {
-                        showLowConfidence(data.spell, data.confidence);
-                    } else if (data.type === 'wand_info') {
-                        showWandInfo(data);
-                    } else if (data.type === 'button_press') {
-                        updateButtons(data.b1, data.b2, data.b3, data.b4);
-                    }
-                } catch (e) {
-                    console.error('Parse error:', e);
-                }
-            };
-        }
-        
-        // Connect on page load
-        connectWebSocket();
-        
-        function updateIMU(data) {
-            // Update text displays
-            document.getElementById('ax').textContent = data.ax.toFixed(2);
-            document.getElementById('ay').textContent = data.ay.toFixed(2);
-            document.getElementById('az').textContent = data.az.toFixed(2);
-            document.getElementById('gx').textContent = data.gx.toFixed(2);
-            document.getElementById('gy').textContent = data.gy.toFixed(2);
-            document.getElementById('gz').textContent = data.gz.toFixed(2);
-            
-            // Update history
-            accelHistory.x.push(data.ax);
-            accelHistory.y.push(data.ay);
-            accelHistory.z.push(data.az);
-            gyroHistory.x.push(data.gx);
-            gyroHistory.y.push(data.gy);
-            gyroHistory.z.push(data.gz);
-            
-            if (accelHistory.x.length > maxHistory) {
-                accelHistory.x.shift();
-                accelHistory.y.shift();
-                accelHistory.z.shift();
-                gyroHistory.x.shift();
-                gyroHistory.y.shift();
-                gyroHistory.z.shift();
-            }
-            
-            drawGraph();
-        }
-        
-        function drawGraph() {
-            ctx.fillStyle = '#000';
-            ctx.fillRect(0, 0, canvas.width, canvas.height);
-            
-            const mid = canvas.height / 2;
-            const scale = 50;
-            
-            // Draw center line
-            ctx.strokeStyle = '#333';
-            ctx.beginPath();
-            ctx.moveTo(0, mid);
-            ctx.lineTo(canvas.width, mid);
-            ctx.stroke();
-            
-            // Draw accelerometer
-            drawLine(accelHistory.x, '#ff4444', scale, mid);
-            drawLine(accelHistory.y, '#44ff44', scale, mid);
-            drawLine(accelHistory.z, '#4444ff', scale, mid);
-            
-            // Legend
-            ctx.font = '12px Arial';
-            ctx.fillStyle = '#ff4444';
-            ctx.fillText('Accel X', 10, 20);
-            ctx.fillStyle = '#44ff44';
-            ctx.fillText('Accel Y', 80, 20);
-            ctx.fillStyle = '#4444ff';
-            ctx.fillText('Accel Z', 150, 20);
-        }
-        
-        function drawLine(data, color, scale, mid) {
-            if (data.length < 2) return;
-            
-            ctx.strokeStyle = color;
-            ctx.lineWidth = 2;
-            ctx.beginPath();
-            
-            const step = canvas.width / maxHistory;
-            for (let i = 0; i < data.length; i++) {
-                const x = i * step;
-                const y = mid - (data[i] * scale);
-                
-                if (i === 0) {
-                    ctx.moveTo(x, y);
-                } else {
-                    ctx.lineTo(x, y);
-                }
-            }
-            
-            ctx.stroke();
-        }
-        
-        function showSpell(spell, confidence) {
-            const display = document.getElementById('spell-display');
-            display.innerHTML = `<span class="spell-name">${spell}</span><br>
-                                <small>${(confidence * 100).toFixed(1)}% confidence</small>`;
-            
-            // Fade out after 5 seconds
-            setTimeout(() => {
-                display.textContent = 'Waiting for spell...';
-            }, 5000);
-        }
-        
-        function updateBattery(level) {
-            const batteryElem = document.getElementById('battery');
-            const warningElem = document.getElementById('battery-warning');
-            batteryElem.textContent = level;
-            
-            // Change color based on battery level
-            if (level < 20) {
-                batteryElem.className = 'battery-level battery-low';
-            } else {
-                batteryElem.className = 'battery-level';
-            }
-            
-            // Show warning if battery is critically low (<40%)
-            if (level < 40) {
-                warningElem.classList.add('show');
-            } else {
-                warningElem.classList.remove('show');
-            }
-        }
-        
-        function startGesture() {
-            isTracking = true;
-            gesturePoints = [];
-            rawGesturePoints = [];
-            clearGestureCanvas();
-        }
-        
-        function addGesturePoint(x, y) {
-            if (!isTracking) return;
-            
-            // Store raw coordinates
-            rawGesturePoints.push({x: x, y: y});
-            
-            // Redraw entire gesture with auto-scaling
-            drawGesture();
-        }
-        
-        function endGesture() {
-            isTracking = false;
-            // Redraw final gesture with optimal scaling
-            drawGesture();
-            console.log(`Gesture complete: ${rawGesturePoints.length} raw points captured`);
-        }
-        
-        function clearGestureCanvas() {
-            gestureCtx.fillStyle = '#000';
-            gestureCtx.fillRect(0, 0, gestureCanvas.width, gestureCanvas.height);
-            
-            // Draw reference gesture image if loaded (semi-transparent)
-            if (referenceGestureLoaded && referenceGestureImage) {
-                const centerX = gestureCanvas.width / 2;
-                const centerY = gestureCanvas.height / 2;
-                
-                // Scale image to fit canvas while maintaining aspect ratio
-                const maxSize = Math.min(gestureCanvas.width, gestureCanvas.height) * 0.9;
-                const scale = Math.min(maxSize / referenceGestureImage.width, maxSize / referenceGestureImage.height);
-                const scaledWidth = referenceGestureImage.width * scale;
-                const scaledHeight = referenceGestureImage.height * scale;
-                
-                // Draw with 40% opacity as reference
-                gestureCtx.globalAlpha = 0.4;
-                gestureCtx.drawImage(
-                    referenceGestureImage,
-                    centerX - scaledWidth / 2,
-                    centerY - scaledHeight / 2,
-                    scaledWidth,
-                    scaledHeight
-                );
-                gestureCtx.globalAlpha = 1.0;
-            }
-            
-            // Draw center crosshair on top
-            gestureCtx.strokeStyle = '#444';
-            gestureCtx.lineWidth = 1;
-            gestureCtx.beginPath();
-            const centerX = gestureCanvas.width / 2;
-            const centerY = gestureCanvas.height / 2;
-            gestureCtx.moveTo(centerX - 20, centerY);
-            gestureCtx.lineTo(centerX + 20, centerY);
-            gestureCtx.moveTo(centerX, centerY - 20);
-            gestureCtx.lineTo(centerX, centerY + 20);
-            gestureCtx.stroke();
-        }
-        
-        function drawGesture() {
-            clearGestureCanvas();
-            
-            if (rawGesturePoints.length === 0) return;
-            
-            const canvasCenterX = gestureCanvas.width / 2;
-            const canvasCenterY = gestureCanvas.height / 2;
-            
-            // Offset all points so first point is at origin (0,0)
-            const firstPoint = rawGesturePoints[0];
-            const offsetPoints = rawGesturePoints.map(p => ({
-                x: p.x - firstPoint.x,
-                y: p.y - firstPoint.y
-            }));
-            
-            // Fixed scale - no auto-scaling, just offset to center
-            function toCanvas(x, y) {
-                return {
-                    x: canvasCenterX + x,
-                    y: canvasCenterY - y  // Flip Y for screen coords
-                };
-            }
-            
-            // Draw starting point (green dot) at center
-            const start = toCanvas(offsetPoints[0].x, offsetPoints[0].y);
-            gestureCtx.fillStyle = '#00ff00';
-            gestureCtx.beginPath();
-            gestureCtx.arc(start.x, start.y, 5, 0, 2 * Math.PI);
-            gestureCtx.fill();
-            
-            if (offsetPoints.length < 2) return;
-            
-            // Draw the gesture path
-            gestureCtx.strokeStyle = '#00ffff';
-            gestureCtx.lineWidth = 3;
-            gestureCtx.lineCap = 'round';
-            gestureCtx.lineJoin = 'round';
-            gestureCtx.beginPath();
-            gestureCtx.moveTo(start.x, start.y);
-            
-            for (let i = 1; i < offsetPoints.length; i++) {
-                const p = toCanvas(offsetPoints[i].x, offsetPoints[i].y);
-                gestureCtx.lineTo(p.x, p.y);
-            }
-            gestureCtx.stroke();
-            
-            // Draw ending point (red dot)
-            const end = toCanvas(
-                offsetPoints[offsetPoints.length - 1].x,
-                offsetPoints[offsetPoints.length - 1].y
-            );
-            gestureCtx.fillStyle = '#ff0000';
-            gestureCtx.beginPath();
-            gestureCtx.arc(end.x, end.y, 5, 0, 2 * Math.PI);
-            gestureCtx.fill();
-            
-            // Draw current endpoint (yellow) if tracking
-            if (isTracking) {
-                gestureCtx.fillStyle = '#ffff00';
-                gestureCtx.beginPath();
-                gestureCtx.arc(end.x, end.y, 8, 0, 2 * Math.PI);
-                gestureCtx.fill();
-            }
-        }
-        
-        // Initialize gesture canvas
-        clearGestureCanvas();
-        
-        // Spell Learning Functions
-        const SPELL_NAMES = [
-            "The_Force_Spell", "Colloportus", "Colloshoo", "The_Hour_Reversal_Reversal_Charm",
-            "Evanesco", "Herbivicus", "Orchideous", "Brachiabindo", "Meteolojinx", "Riddikulus",
-            "Silencio", "Immobulus", "Confringo", "Petrificus_Totalus", "Flipendo",
-            "The_Cheering_Charm", "Salvio_Hexia", "Pestis_Incendium", "Alohomora", "Protego",
-            "Langlock", "Mucus_Ad_Nauseum", "Flagrate", "Glacius", "Finite", "Anteoculatia",
-            "Expelliarmus", "Expecto_Patronum", "Descendo", "Depulso", "Reducto", "Colovaria",
-            "Aberto", "Confundo", "Densaugeo", "The_Stretching_Jinx", "Entomorphis",
-            "The_Hair_Thickening_Growing_Charm", "Bombarda", "Finestra", "The_Sleeping_Charm",
-            "Rictusempra", "Piertotum_Locomotor", "Expulso", "Impedimenta", "Ascendio",
-            "Incarcerous", "Ventus", "Revelio", "Accio", "Melefors", "Scourgify",
-            "Wingardium_Leviosa", "Nox", "Stupefy", "Spongify", "Lumos", "Appare_Vestigium",
-            "Verdimillious", "Fulgari", "Reparo", "Locomotor", "Quietus", "Everte_Statum",
-            "Incendio", "Aguamenti", "Sonorus", "Cantis", "Arania_Exumai", "Calvorio",
-            "The_Hour_Reversal_Charm", "Vermillious", "The_Pepper-Breath_Hex"
-        ];
-        
-        // Map spell names to SPIFFS filenames (32 char limit including .png)
-        // Some names are shortened to fit SPIFFS filename restrictions
-        const SPELL_FILENAME_MAP = {
-            "The_Hair_Thickening_Growing_Charm": "hair_grow_charm.png",
-            // Default: use lowercase with underscores
-        };
-        
-        function spellNameToFilename(spellName) {
-            // Check if there's a custom mapping
-            if (SPELL_FILENAME_MAP[spellName]) {
-                const mappedFilename = SPELL_FILENAME_MAP[spellName];
-                console.log('[Filename Map] Custom mapping:', spellName, '->', mappedFilename);
-                return mappedFilename;
-            }
-            // Default: convert to lowercase
-            const filename = spellName.toLowerCase() + '.png';
-            console.log('[Filename Map] Default mapping:', spellName, '->', filename);
-            return filename;
-        }
-        
-        function populateSpellSelector() {
-            const selector = document.getElementById('spell-selector');
-            SPELL_NAMES.forEach(spell => {
-                const option = document.createElement('option');
-                option.value = spell;
-                option.textContent = spell.replace(/_/g, ' ');
-                selector.appendChild(option);
-            });
-        }
-        
-        function practiceSpell() {
-            const selector = document.getElementById('spell-selector');
-            const selectedSpell = selector.value;
-            
-            console.log('[Spell Practice] Selected spell:', selectedSpell);
-            
-            if (!selectedSpell) {
-                showToast('Please select a spell to practice', 'error');
-                return;
-            }
-            
-            const filename = spellNameToFilename(selectedSpell);
-            const imageUrl = `/gesture/${filename}`;
-            
-            console.log('[Spell Practice] Loading reference:', filename);
-            
-            // Create image object
-            const img = new Image();
-            
-            img.onload = function() {
-                console.log('[Spell Practice] Reference image loaded:', imageUrl);
-                referenceGestureImage = img;
-                referenceGestureLoaded = true;
-                
-                // Redraw canvas with reference image
-                clearGestureCanvas();
-                drawGesture();
-                
-                showToast(`Reference loaded: ${selectedSpell.replace(/_/g, ' ')}`, 'success');
-            };
-            
-            img.onerror = function() {
-                console.error('[Spell Practice] Failed to load image:', imageUrl);
-                showToast('Failed to load gesture image: ' + filename, 'error');
-            };
-            
-            img.src = imageUrl;
-        }
-        
-        function clearReferenceGesture() {
-            referenceGestureImage = null;
-            referenceGestureLoaded = false;
-            clearGestureCanvas();
-            drawGesture();
-            console.log('[Spell Practice] Reference cleared');
-            showToast('Reference cleared', 'success');
-        }
-        
-        // Initialize spell selector on page load
-        populateSpellSelector();
-        
-        // Toast notification function
-        function showToast(message, type = 'success') {
-            // Remove any existing toasts
-            const existingToasts = document.querySelectorAll('.toast');
-            existingToasts.forEach(toast => toast.remove());
-            
-            // Create new toast
-            const toast = document.createElement('div');
-            toast.className = `toast ${type}`;
-            toast.textContent = message;
-            
-            // Add to document
-            document.body.appendChild(toast);
-            
-            // Trigger animation by forcing reflow
-            setTimeout(() => {
-                toast.style.opacity = '1';
-            }, 10);
-            
-            // Remove after 3 seconds
-            setTimeout(() => {
-                toast.style.opacity = '0';
-                setTimeout(() => toast.remove(), 300);
-            }, 3000);
-        }
-        
-        // BLE Management Functions
-        let scanResults = [];
-        let selectedMac = null;
-        
-        function startScan() {
-            const btn = document.getElementById('scanBtn');
-            const status = document.getElementById('scanStatus');
-            const results = document.getElementById('scanResults');
-            
-            btn.disabled = true;
-            btn.textContent = '⏳ Scanning...';
-            status.textContent = 'Scanning for BLE devices...';
-            results.innerHTML = '';
-            scanResults = [];
-            selectedMac = null;
-            
-            fetch('/scan', { method: 'POST' })
-                .then(response => response.json())
-                .then(data => {
-                    console.log('Scan started:', data);
-                    setTimeout(() => {
-                        btn.disabled = false;
-                        btn.textContent = '🔍 Scan for Wands';
-                    }, 10000); // Re-enable after 10 seconds
-                })
-                .catch(error => {
-                    console.error('Scan error:', error);
-                    status.textContent = 'Scan failed: ' + error;
-                    btn.disabled = false;
-                    btn.textContent = '🔍 Scan for Wands';
-                });
-        }
-        
-        function addScanResult(address, name, rssi) {
-            // Check if already in list
-            if (scanResults.find(r => r.address === address)) {
-                return;
-            }
-            
-            scanResults.push({ address, name, rssi });
-            
-            // Sort: MCB/MCW wands first, then by RSSI
-            scanResults.sort((a, b) => {
-                const aIsMC = (a.name && (a.name.startsWith('MCB') || a.name.startsWith('MCW')));
-                const bIsMC = (b.name && (b.name.startsWith('MCB') || b.name.startsWith('MCW')));
-                
-                if (aIsMC && !bIsMC) return -1;  // a goes first
-                if (!aIsMC && bIsMC) return 1;   // b goes first
-                
-                // Both are MC or both are not, sort by RSSI (higher is better)
-                return b.rssi - a.rssi;
-            });
-            
-            // Rebuild the display
-            const results = document.getElementById('scanResults');
-            results.innerHTML = '';
-            
-            scanResults.forEach(device => {
-                const item = document.createElement('div');
-                item.className = 'scan-item';
-                const isMCWand = device.name && (device.name.startsWith('MCB') || device.name.startsWith('MCW'));
-                const nameStyle = isMCWand ? 'style="color: #4CAF50; font-weight: bold;"' : '';
-                item.innerHTML = `
-                    <div class="scan-info">
-                        <div class="mac-address">${device.address}</div>
-                        <div ${nameStyle}>${device.name || 'Unknown Device'}</div>
-                        <div class="rssi">RSSI: ${device.rssi} dBm</div>
-                    </div>
-                    <button class="button" onclick="selectWand('${device.address}', '${device.name}')">Select</button>
-                `;
-                results.appendChild(item);
-            });
-        }
-        
-        function scanComplete() {
-            const status = document.getElementById('scanStatus');
-            status.textContent = `Scan complete. Found ${scanResults.length} device(s).`;
-        }
-        
-        function selectWand(address, name) {
-            selectedMac = address;
-            document.getElementById('storedMac').value = address;
-            document.getElementById('connectBtn').disabled = false;
-            document.getElementById('scanStatus').textContent = `Selected: ${name || 'Unknown'} (${address})`;
-            
-            // Save MAC address
-            fetch('/set_mac', {
-                method: 'POST',
-                headers: { 'Content-Type': 'application/json' },
-                body: JSON.stringify({ mac: address })
-            })
-            .then(response => response.json())
-            .then(data => {
-                console.log('MAC saved:', data);
-                showToast(`Wand selected: ${name || address}`, 'success');
-            })
-            .catch(error => {
-                console.error('Failed to save MAC:', error);
-                showToast('Failed to save MAC address', 'error');
-            });
-        }
-        
-        function loadStoredMac() {
-            fetch('/get_stored_mac')
-                .then(response => response.json())
-                .then(data => {
-                    if (data.mac) {
-                        document.getElementById('storedMac').value = data.mac;
-                        selectedMac = data.mac;
-                        document.getElementById('connectBtn').disabled = false;
-                    } else {
-                        document.getElementById('storedMac').value = '';
-                        document.getElementById('scanStatus').textContent = 'No stored MAC address';
-                    }
-                })
-                .catch(error => {
-                    console.error('Failed to load MAC:', error);
-                });
-        }
-        
-        function connectWand() {
-            if (!selectedMac) {
-                showToast('Please select a wand first', 'error');
-                return;
-            }
-            
-            const btn = document.getElementById('connectBtn');
-            btn.disabled = true;
-            btn.textContent = '⏳ Connecting...';
-            
-            fetch('/connect', { method: 'POST' })
-                .then(response => response.json())
-                .then(data => {
-                    console.log('Connect response:', data);
-                    document.getElementById('scanStatus').textContent = data.status === 'connecting' ? 
-                        'Connection initiated...' : data.message;
-                    setTimeout(() => {
-                        btn.disabled = false;
-                        btn.textContent = '🔗 Connect';
-                    }, 3000);
-                })
-                .catch(error => {
-                    console.error('Connect error:', error);
-                    document.getElementById('scanStatus').textContent = 'Connection failed';
-                    btn.disabled = false;
-                    btn.textContent = '🔗 Connect';
-                });
-        }
-        
-        function disconnectWand() {
-            fetch('/disconnect', { method: 'POST' })
-                .then(response => response.json())
-                .then(data => {
-                    console.log('Disconnect response:', data);
-                    document.getElementById('scanStatus').textContent = 'Disconnected (manual reconnect required)';
-                    // Update wand status to show disconnected
-                    const wandStatus = document.getElementById('wandStatus');
-                    wandStatus.textContent = '✗ Disconnected';
-                    wandStatus.style.color = '#ff4444';
-                })
-                .catch(error => {
-                    console.error('Disconnect error:', error);
-                });
-        }
-        
-        function showLowConfidence(spell, confidence) {
-            const display = document.getElementById('spell-display');
-            display.innerHTML = `<span style="color: #ff8800;">${spell}</span><br>
-                                <small>${(confidence * 100).toFixed(1)}% confidence (low)</small>`;
-        }
-        
-        function showWandInfo(data) {
-            console.log('Wand Info:', data);
-            document.getElementById('wand-type').textContent = data.wand_type || '-';
-            document.getElementById('wand-firmware').textContent = data.firmware || '-';
-            document.getElementById('wand-serial').textContent = data.serial || '-';
-            document.getElementById('wand-sku').textContent = data.sku || '-';
-            document.getElementById('wand-device-id').textContent = data.device_id || '-';
-            
-            if (data.wand_type && data.firmware) {
-                document.getElementById('scanStatus').textContent = 
-                    `Connected: ${data.wand_type} Wand (FW: ${data.firmware})`;
-            }
-        }
-        
-        function clearWandInfo() {
-            console.log('Clearing wand info (disconnected)');
-            document.getElementById('wand-type').textContent = '-';
-            document.getElementById('wand-firmware').textContent = '-';
-            document.getElementById('wand-serial').textContent = '-';
-            document.getElementById('wand-sku').textContent = '-';
-            document.getElementById('wand-device-id').textContent = '-';
-            document.getElementById('battery').textContent = '--';
-            document.getElementById('battery').className = 'battery-level';
-            document.getElementById('battery-warning').classList.remove('show');
-            // Clear button states
-            updateButtons(false, false, false, false);
-        }
-        
-        function updateButtons(b1, b2, b3, b4) {
-            document.getElementById('btn1').textContent = b1 ? '●' : '○';
-            document.getElementById('btn2').textContent = b2 ? '●' : '○';
-            document.getElementById('btn3').textContent = b3 ? '●' : '○';
-            document.getElementById('btn4').textContent = b4 ? '●' : '○';
-            document.getElementById('btn1').style.color = b1 ? '#4CAF50' : '#666';
-            document.getElementById('btn2').style.color = b2 ? '#4CAF50' : '#666';
-            document.getElementById('btn3').style.color = b3 ? '#4CAF50' : '#666';
-            document.getElementById('btn4').style.color = b4 ? '#4CAF50' : '#666';
-        }
-        
-        // SPELL_NAMES already declared above in Spell Learning section (line ~1033)
-
-        const KEY_OPTIONS = [
-            { group: 'Common', label: 'None', value: 0 },
-            { group: 'Letters', label: 'A', value: 0x04 },
-            { group: 'Letters', label: 'B', value: 0x05 },
-            { group: 'Letters', label: 'C', value: 0x06 },
-            { group: 'Letters', label: 'D', value: 0x07 },
-            { group: 'Letters', label: 'E', value: 0x08 },
-            { group: 'Letters', label: 'F', value: 0x09 },
-            { group: 'Letters', label: 'G', value: 0x0A },
-            { group: 'Letters', label: 'H', value: 0x0B },
-            { group: 'Letters', label: 'I', value: 0x0C },
-            { group: 'Letters', label: 'J', value: 0x0D },
-            { group: 'Letters', label: 'K', value: 0x0E },
-            { group: 'Letters', label: 'L', value: 0x0F },
-            { group: 'Letters', label: 'M', value: 0x10 },
-            { group: 'Letters', label: 'N', value: 0x11 },
-            { group: 'Letters', label: 'O', value: 0x12 },
-            { group: 'Letters', label: 'P', value: 0x13 },
-            { group: 'Letters', label: 'Q', value: 0x14 },
-            { group: 'Letters', label: 'R', value: 0x15 },
-            { group: 'Letters', label: 'S', value: 0x16 },
-            { group: 'Letters', label: 'T', value: 0x17 },
-            { group: 'Letters', label: 'U', value: 0x18 },
-            { group: 'Letters', label: 'V', value: 0x19 },
-            { group: 'Letters', label: 'W', value: 0x1A },
-            { group: 'Letters', label: 'X', value: 0x1B },
-            { group: 'Letters', label: 'Y', value: 0x1C },
-            { group: 'Letters', label: 'Z', value: 0x1D },
-            { group: 'Numbers', label: '1', value: 0x1E },
-            { group: 'Numbers', label: '2', value: 0x1F },
-            { group: 'Numbers', label: '3', value: 0x20 },
-            { group: 'Numbers', label: '4', value: 0x21 },
-            { group: 'Numbers', label: '5', value: 0x22 },
-            { group: 'Numbers', label: '6', value: 0x23 },
-            { group: 'Numbers', label: '7', value: 0x24 },
-            { group: 'Numbers', label: '8', value: 0x25 },
-            { group: 'Numbers', label: '9', value: 0x26 },
-            { group: 'Numbers', label: '0', value: 0x27 },
-            { group: 'Controls', label: 'Enter', value: 0x28 },
-            { group: 'Controls', label: 'Esc', value: 0x29 },
-            { group: 'Controls', label: 'Backspace', value: 0x2A },
-            { group: 'Controls', label: 'Tab', value: 0x2B },
-            { group: 'Controls', label: 'Space', value: 0x2C },
-            { group: 'Punctuation', label: '-', value: 0x2D },
-            { group: 'Punctuation', label: '=', value: 0x2E },
-            { group: 'Punctuation', label: '[', value: 0x2F },
-            { group: 'Punctuation', label: ']', value: 0x30 },
-            { group: 'Punctuation', label: '\\', value: 0x31 },
-            { group: 'Punctuation', label: '#', value: 0x32 },
-            { group: 'Punctuation', label: ';', value: 0x33 },
-            { group: 'Punctuation', label: '\'', value: 0x34 },
-            { group: 'Punctuation', label: '`', value: 0x35 },
-            { group: 'Punctuation', label: ',', value: 0x36 },
-            { group: 'Punctuation', label: '.', value: 0x37 },
-            { group: 'Punctuation', label: '/', value: 0x38 },
-            { group: 'Controls', label: 'Caps Lock', value: 0x39 },
-            { group: 'Function', label: 'F1', value: 0x3A },
-            { group: 'Function', label: 'F2', value: 0x3B },
-            { group: 'Function', label: 'F3', value: 0x3C },
-            { group: 'Function', label: 'F4', value: 0x3D },
-            { group: 'Function', label: 'F5', value: 0x3E },
-            { group: 'Function', label: 'F6', value: 0x3F },
-            { group: 'Function', label: 'F7', value: 0x40 },
-            { group: 'Function', label: 'F8', value: 0x41 },
-            { group: 'Function', label: 'F9', value: 0x42 },
-            { group: 'Function', label: 'F10', value: 0x43 },
-            { group: 'Function', label: 'F11', value: 0x44 },
-            { group: 'Function', label: 'F12', value: 0x45 },
-            { group: 'System', label: 'Print Screen', value: 0x46 },
-            { group: 'System', label: 'Scroll Lock', value: 0x47 },
-            { group: 'System', label: 'Pause', value: 0x48 },
-            { group: 'Navigation', label: 'Insert', value: 0x49 },
-            { group: 'Navigation', label: 'Home', value: 0x4A },
-            { group: 'Navigation', label: 'Page Up', value: 0x4B },
-            { group: 'Navigation', label: 'Delete', value: 0x4C },
-            { group: 'Navigation', label: 'End', value: 0x4D },
-            { group: 'Navigation', label: 'Page Down', value: 0x4E },
-            { group: 'Navigation', label: 'Arrow Right', value: 0x4F },
-            { group: 'Navigation', label: 'Arrow Left', value: 0x50 },
-            { group: 'Navigation', label: 'Arrow Down', value: 0x51 },
-            { group: 'Navigation', label: 'Arrow Up', value: 0x52 },
-            { group: 'Numpad', label: 'Num Lock', value: 0x53 },
-            { group: 'Numpad', label: 'Numpad /', value: 0x54 },
-            { group: 'Numpad', label: 'Numpad *', value: 0x55 },
-            { group: 'Numpad', label: 'Numpad -', value: 0x56 },
-            { group: 'Numpad', label: 'Numpad +', value: 0x57 },
-            { group: 'Numpad', label: 'Numpad Enter', value: 0x58 },
-            { group: 'Numpad', label: 'Numpad 1', value: 0x59 },
-            { group: 'Numpad', label: 'Numpad 2', value: 0x5A },
-            { group: 'Numpad', label: 'Numpad 3', value: 0x5B },
-            { group: 'Numpad', label: 'Numpad 4', value: 0x5C },
-            { group: 'Numpad', label: 'Numpad 5', value: 0x5D },
-            { group: 'Numpad', label: 'Numpad 6', value: 0x5E },
-            { group: 'Numpad', label: 'Numpad 7', value: 0x5F },
-            { group: 'Numpad', label: 'Numpad 8', value: 0x60 },
-            { group: 'Numpad', label: 'Numpad 9', value: 0x61 },
-            { group: 'Numpad', label: 'Numpad 0', value: 0x62 },
-            { group: 'Numpad', label: 'Numpad .', value: 0x63 },
-            { group: 'Function', label: 'F13', value: 0x68 },
-            { group: 'Function', label: 'F14', value: 0x69 },
-            { group: 'Function', label: 'F15', value: 0x6A },
-            { group: 'Function', label: 'F16', value: 0x6B },
-            { group: 'Function', label: 'F17', value: 0x6C },
-            { group: 'Function', label: 'F18', value: 0x6D },
-            { group: 'Function', label: 'F19', value: 0x6E },
-            { group: 'Function', label: 'F20', value: 0x6F },
-            { group: 'Function', label: 'F21', value: 0x70 },
-            { group: 'Function', label: 'F22', value: 0x71 },
-            { group: 'Function', label: 'F23', value: 0x72 },
-            { group: 'Function', label: 'F24', value: 0x73 }
-        ];
-
-        const GAMEPAD_BUTTON_OPTIONS = [
-            { label: 'Disabled', value: 0 },
-            { label: 'Button 1', value: 1 },
-            { label: 'Button 2', value: 2 },
-            { label: 'Button 3', value: 3 },
-            { label: 'Button 4', value: 4 },
-            { label: 'Button 5', value: 5 },
-            { label: 'Button 6', value: 6 },
-            { label: 'Button 7', value: 7 },
-            { label: 'Button 8', value: 8 },
-            { label: 'Button 9', value: 9 },
-            { label: 'Button 10', value: 10 }
-        ];
-
-        function buildKeySelectOptions(select) {
-            const groups = new Map();
-            KEY_OPTIONS.forEach((opt) => {
-                if (!groups.has(opt.group)) {
-                    const optgroup = document.createElement('optgroup');
-                    optgroup.label = opt.group;
-                    groups.set(opt.group, optgroup);
-                }
-                const option = document.createElement('option');
-                option.value = opt.value;
-                option.textContent = opt.label;
-                groups.get(opt.group).appendChild(option);
-            });
-            groups.forEach((optgroup) => select.appendChild(optgroup));
-        }
-
-        function buildGamepadSelectOptions(select) {
-            GAMEPAD_BUTTON_OPTIONS.forEach((opt) => {
-                const option = document.createElement('option');
-                option.value = opt.value;
-                option.textContent = opt.label;
-                select.appendChild(option);
-            });
-        }
+#define JSON_BODY_CHUNK 128
 
-        // Populate spell mapping dropdowns
-        function populateSpellMappings() {
-            const container = document.getElementById('spell-mappings');
-            container.innerHTML = '';
-
-            for (let i = 0; i < SPELL_NAMES.length; i++) {
-                const spell = SPELL_NAMES[i];
-                const select = document.createElement('select');
-                select.id = `spell_${i}`;
-                buildKeySelectOptions(select);
-
-                const label = document.createElement('label');
-                label.style.cssText = 'font-size: 12px; word-break: break-word;';
-                label.textContent = spell.replace(/_/g, ' ');
-
-                const wrapper = document.createElement('div');
-                wrapper.className = 'spell-mapping-item';
-                wrapper.dataset.spellName = spell.toLowerCase().replace(/_/g, ' ');
-                wrapper.appendChild(label);
-                wrapper.appendChild(select);
-                container.appendChild(wrapper);
-            }
+// Feed the whole request body to reader, however it is split across receives.
+// On failure a 400 has been sent and the handler should return ESP_FAIL.
+static bool read_json_body(httpd_req_t *req, JsonReader &reader)
+{
+    char chunk[JSON_BODY_CHUNK];
+    size_t remaining = req->content_len;
+    while (remaining > 0 && reader.ok())
+    {
+        int received = httpd_req_recv(req, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+        if (received == HTTPD_SOCK_ERR_TIMEOUT)
+        {
+            continue;
         }
-
-        function populateGamepadMappings() {
-            const container = document.getElementById('gamepad-mappings');
-            container.innerHTML = '';
-
-            for (let i = 0; i < SPELL_NAMES.length; i++) {
-                const spell = SPELL_NAMES[i];
-                const select = document.createElement('select');
-                select.id = `gpad_spell_${i}`;
-                buildGamepadSelectOptions(select);
-
-                const label = document.createElement('label');
-                label.style.cssText = 'font-size: 12px; word-break: break-word;';
-                label.textContent = spell.replace(/_/g, ' ');
-
-                const wrapper = document.createElement('div');
-                wrapper.className = 'spell-mapping-item';
-                wrapper.dataset.spellName = spell.toLowerCase().replace(/_/g, ' ');
-                wrapper.appendChild(label);
-                wrapper.appendChild(select);
-                container.appendChild(wrapper);
-            }
+        if (received <= 0)
+        {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to read request body");
+            return false;
         }
+        remaining -= received;
+        reader.feed(chunk, received);
+    }
+    if (!reader.finish())
+    {
+        ESP_LOGW(TAG, "Rejected %s: invalid JSON at byte %u", req->uri, (unsigned)reader.offset());
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return false;
+    }
+    return true;
+}
 
-        function filterSpellMappings() {
-            const input = document.getElementById('spell-filter');
-            const filter = input.value.trim().toLowerCase();
-            const items = document.querySelectorAll('#spell-mappings .spell-mapping-item');
-            items.forEach((item) => {
-                const name = item.dataset.spellName || '';
-                item.style.display = name.includes(filter) ? 'flex' : 'none';
-            });
-        }
+static void write_wand_info(JsonWriter &json, const char *firmware, const char *serial, const char *sku,
+                            const char *device_id, const char *wand_type)
+{
+    json.beginObject();
+    json.field("type", "wand_info");
+    json.field("firmware", firmware);
+    json.field("serial", serial);
+    json.field("sku", sku);
+    json.field("device_id", device_id);
+    json.field("wand_type", wand_type);
+    json.endObject();
+}
 
-        function filterGamepadMappings() {
-            const input = document.getElementById('gamepad-spell-filter');
-            const filter = input.value.trim().toLowerCase();
-            const items = document.querySelectorAll('#gamepad-mappings .spell-mapping-item');
-            items.forEach((item) => {
-                const name = item.dataset.spellName || '';
-                item.style.display = name.includes(filter) ? 'flex' : 'none';
-            });
-        }
-        
-        // Mouse sensitivity slider handler
-        document.getElementById('mouse-sensitivity').addEventListener('input', (e) => {
-            const value = parseFloat(e.target.value);
-            document.getElementById('sens-value').textContent = value.toFixed(1) + 'x';
-        });
-
-        // Gamepad sensitivity slider handler
-        document.getElementById('gamepad-sensitivity').addEventListener('input', (e) => {
-            const value = parseFloat(e.target.value);
-            document.getElementById('gpad-sens-value').textContent = value.toFixed(1) + 'x';
-        });
-
-        // Gamepad deadzone slider handler
-        document.getElementById('gamepad-deadzone').addEventListener('input', (e) => {
-            const value = parseFloat(e.target.value);
-            document.getElementById('gpad-deadzone-value').textContent = value.toFixed(2);
-        });
-        
-        // Load and save settings with spell mappings
-        function saveSettings() {
-            const invertMouseY = document.getElementById('invert-mouse-y').checked;
-            console.log('💾 Saving settings - invert_mouse_y checkbox state:', invertMouseY);
-            
-            const invertGamepadY = document.getElementById('invert-gamepad-y').checked;
-            console.log('💾 Saving settings - gamepad_invert_y checkbox state:', invertGamepadY);
-            
-            const settings = {
-                mouse_sensitivity: parseFloat(document.getElementById('mouse-sensitivity').value),
-                invert_mouse_y: invertMouseY,
-                hid_mode: parseInt(document.getElementById('hid-mode').value),
-                gamepad_sensitivity: parseFloat(document.getElementById('gamepad-sensitivity').value),
-                gamepad_deadzone: parseFloat(document.getElementById('gamepad-deadzone').value),
-                gamepad_invert_y: invertGamepadY,
-                ha_mqtt_enabled: document.getElementById('ha-mqtt-enabled').checked,
-                mqtt_broker: document.getElementById('mqtt-broker').value,
-                mqtt_username: document.getElementById('mqtt-username').value,
-                mqtt_password: document.getElementById('mqtt-password').value,
-                spells: [],
-                gamepad_spells: []
-            };
-            
-            // Collect all spell keycode mappings
-            for (let i = 0; i < SPELL_NAMES.length; i++) {
-                const select = document.getElementById(`spell_${i}`);
-                const keycode = parseInt(select.value);
-                settings.spells.push(keycode);
-                if (keycode !== 0) {
-                    console.log(`Spell[${i}] '${SPELL_NAMES[i]}': keycode=${keycode} (0x${keycode.toString(16).toUpperCase()})`);
-                }
-            }
+// Web UI (web/), gzipped at build time and embedded by src/CMakeLists.txt
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
+extern const uint8_t app_js_gz_start[] asm("_binary_app_js_gz_start");
+extern const uint8_t app_js_gz_end[] asm("_binary_app_js_gz_end");
+extern const uint8_t app_css_gz_start[] asm("_binary_app_css_gz_start");
+extern const uint8_t app_css_gz_end[] asm("_binary_app_css_gz_end");
 
-            // Collect all spell gamepad button mappings
-            for (let i = 0; i < SPELL_NAMES.length; i++) {
-                const select = document.getElementById(`gpad_spell_${i}`);
-                settings.gamepad_spells.push(parseInt(select.value));
-            }
-            
-            fetch('/settings/save', {
-                method: 'POST',
-                headers: { 'Content-Type': 'application/json' },
-                body: JSON.stringify(settings)
-            })
-            .then(response => response.json())
-            .then(data => {
-                showToast('Settings saved successfully!', 'success');
-                console.log('Settings saved:', data);
-            })
-            .catch(error => {
-                showToast('Failed to save settings', 'error');
-                console.error('Save error:', error);
-            });
-        }
-        
-        function loadSettings() {
-            fetch('/settings/get')
-                .then(response => response.json())
-                .then(data => {
-                    console.log('Settings loaded:', data);
-                    console.log('🔍 Received invert_mouse_y from backend:', data.invert_mouse_y);
-                    console.log('🔍 Received gamepad_invert_y from backend:', data.gamepad_invert_y);
-                    
-                    document.getElementById('mouse-sensitivity').value = data.mouse_sensitivity || 1.0;
-                    document.getElementById('sens-value').textContent = (data.mouse_sensitivity || 1.0).toFixed(1) + 'x';
-                    document.getElementById('invert-mouse-y').checked = (data.invert_mouse_y === true);
-                    
-                    console.log('✅ Set invert-mouse-y checkbox to:', document.getElementById('invert-mouse-y').checked);
-                    
-                    document.getElementById('hid-mode').value = (data.hid_mode !== undefined) ? data.hid_mode : 0;
-                    document.getElementById('gamepad-sensitivity').value = data.gamepad_sensitivity || 1.0;
-                    document.getElementById('gpad-sens-value').textContent = (data.gamepad_sensitivity || 1.0).toFixed(1) + 'x';
-                    document.getElementById('gamepad-deadzone').value = (data.gamepad_deadzone !== undefined) ? data.gamepad_deadzone : 0.05;
-                    document.getElementById('gpad-deadzone-value').textContent = ((data.gamepad_deadzone !== undefined) ? data.gamepad_deadzone : 0.05).toFixed(2);
-                    document.getElementById('invert-gamepad-y').checked = (data.gamepad_invert_y === true);
-                    
-                    console.log('✅ Set invert-gamepad-y checkbox to:', document.getElementById('invert-gamepad-y').checked);
-                    document.getElementById('ha-mqtt-enabled').checked = data.ha_mqtt_enabled !== false;
-                    document.getElementById('mqtt-broker').value = data.mqtt_broker || '';
-                    document.getElementById('mqtt-username').value = data.mqtt_username || '';
-                    document.getElementById('mqtt-password').value = data.mqtt_password || '';
-                    
-                    // Load spell keycodes
-                    if (data.spells && data.spells.length === SPELL_NAMES.length) {
-                        let loaded_count = 0;
-                        for (let i = 0; i < data.spells.length; i++) {
-                            const select = document.getElementById(`spell_${i}`);
-                            if (select) {
-                                select.value = data.spells[i];
-                                if (data.spells[i] !== 0) {
-                                    loaded_count++;
-                                    console.log(`Loading spell[${i}] '${SPELL_NAMES[i]}': keycode=${data.spells[i]} (0x${data.spells[i].toString(16).toUpperCase().padStart(2, '0')})`);
-                                }
-                            }
-                        }
-                        console.log(`✓ Loaded ${loaded_count} spell-to-key mappings`);
-                    }
-                    if (data.gamepad_spells && data.gamepad_spells.length === SPELL_NAMES.length) {
-                        for (let i = 0; i < data.gamepad_spells.length; i++) {
-                            const select = document.getElementById(`gpad_spell_${i}`);
-                            if (select) {
-                                select.value = data.gamepad_spells[i];
-                            }
-                        }
-                    }
-                    showToast('Settings loaded from device', 'success');
-                })
-                .catch(error => {
-                    showToast('Failed to load settings', 'error');
-                    console.error('Load error:', error);
-                });
-        }
-        
-        function resetSettings() {
-            if (confirm('⚠️ Reset all settings to defaults?')) {
-                fetch('/settings/reset', { method: 'POST' })
-                    .then(response => response.json())
-                    .then(data => {
-                        console.log('Settings reset:', data);
-                        showToast('Settings reset to defaults! Reloading...', 'success');
-                        // Reload settings from backend to ensure UI is synced
-                        setTimeout(() => {
-                            loadSettings();
-                        }, 500);
-                    })
-                    .catch(error => {
-                        showToast('Failed to reset settings', 'error');
-                        console.error('Reset error:', error);
-                    });
-            }
-        }
-        
-        // Initialize UI
-        populateSpellMappings();
-        populateGamepadMappings();
-        
-        // Load settings on page load
-        setTimeout(loadSettings, 2000);
-        
-        // Load stored MAC on page load
-        setTimeout(loadStoredMac, 1000);
-        
-        // WiFi Management Functions
-        function scanWifi() {
-            const btn = event.target;
-            const status = document.getElementById('wifiScanStatus');
-            const results = document.getElementById('wifiResults');
-            
-            btn.disabled = true;
-            btn.textContent = '⏳ Scanning...';
-            status.textContent = 'Scanning for WiFi networks...';
-            results.innerHTML = '';
-            
-            fetch('/wifi/scan', { method: 'POST' })
-                .then(response => response.json())
-                .then(data => {
-                    if (data.networks && data.networks.length > 0) {
-                        status.textContent = `Found ${data.networks.length} network(s)`;
-                        data.networks.forEach(network => {
-                            const item = document.createElement('div');
-                            item.className = 'scan-item';
-                            item.innerHTML = `
-                                <div class="scan-info">
-                                    <div style="font-weight: bold;">${network.ssid}</div>
-                                    <div class="rssi">RSSI: ${network.rssi} dBm | Security: ${network.auth}</div>
-                                </div>
-                                <button class="button" onclick="selectWifiNetwork('${network.ssid}')">Select</button>
-                            `;
-                            results.appendChild(item);
-                        });
-                    } else {
-                        status.textContent = 'No networks found';
-                    }
-                    btn.disabled = false;
-                    btn.textContent = '🔍 Scan WiFi Networks';
-                })
-                .catch(error => {
-                    status.textContent = 'Scan failed: ' + error;
-                    btn.disabled = false;
-                    btn.textContent = '🔍 Scan WiFi Networks';
-                    showToast('WiFi scan failed', 'error');
-                });
-        }
-        
-        function selectWifiNetwork(ssid) {
-            document.getElementById('wifi-ssid').value = ssid;
-            showToast(`Selected: ${ssid}`, 'success');
-        }
-        
-        function connectWifi() {
-            const ssid = document.getElementById('wifi-ssid').value;
-            const password = document.getElementById('wifi-password').value;
-            const status = document.getElementById('wifiConnectStatus');
-            
-            if (!ssid) {
-                showToast('Please enter WiFi SSID', 'error');
-                return;
-            }
-            
-            if (!confirm(`⚠️ Connecting to ${ssid} will reboot the device. Continue?`)) {
-                return;
-            }
-            
-            status.textContent = 'Saving WiFi settings and rebooting...';
-            
-            fetch('/wifi/connect', {
-                method: 'POST',
-                headers: { 'Content-Type': 'application/json' },
-                body: JSON.stringify({ ssid: ssid, password: password })
-            })
-            .then(response => response.json())
-            .then(data => {
-                if (data.success) {
-                    status.textContent = 'Device rebooting to apply WiFi settings...';
-                    showToast('Rebooting to connect to WiFi...', 'success');
-                    setTimeout(() => {
-                        window.location.reload();
-                    }, 5000);
-                } else {
-                    status.textContent = 'Connection failed: ' + (data.message || 'Unknown error');
-                    showToast('WiFi connection failed', 'error');
-                }
-            })
-            .catch(error => {
-                status.textContent = 'Device rebooting...';
-                showToast('Device rebooting...', 'success');
-                setTimeout(() => {
-                    window.location.reload();
-                }, 5000);
-            });
-        }
-        
-        function rebootDevice() {
-            if (!confirm('⚠️ Are you sure you want to reboot the device?')) {
-                return;
-            }
-            
-            showToast('Rebooting device...', 'success');
-            
-            fetch('/system/reboot', { method: 'POST' })
-                .then(response => response.json())
-                .then(data => {
-                    showToast('Device rebooting...', 'success');
-                    setTimeout(() => {
-                        window.location.reload();
-                    }, 5000);
-                })
-                .catch(error => {
-                    showToast('Reboot command sent', 'success');
-                    setTimeout(() => {
-                        window.location.reload();
-                    }, 5000);
-                });
-        }
-        
-        function switchWifiMode() {
-            const mode = document.getElementById('wifi-mode').value;
-            
-            if (!confirm(`⚠️ Switch to ${mode === 'ap' ? 'Hotspot' : 'Client'} mode? Device will reboot.`)) {
-                return;
-            }
-            
-            showToast('Switching WiFi mode...', 'success');
-            
-            fetch('/system/wifi_mode', {
-                method: 'POST',
-                headers: { 'Content-Type': 'application/json' },
-                body: JSON.stringify({ mode: mode })
-            })
-            .then(response => response.json())
-            .then(data => {
-                showToast('Device rebooting to apply mode change...', 'success');
-                setTimeout(() => {
-                    window.location.reload();
-                }, 5000);
-            })
-            .catch(error => {
-                showToast('Mode change command sent, device rebooting...', 'success');
-                setTimeout(() => {
-                    window.location.reload();
-                }, 5000);
-            });
-        }
-        
-        function resetToDefaults() {
-            if (!confirm('⚠️ WARNING: This will erase ALL settings including WiFi credentials, wand MAC, and MQTT settings. Continue?')) {
-                return;
-            }
-            
-            if (!confirm('⚠️ FINAL CONFIRMATION: Are you absolutely sure? This cannot be undone!')) {
-                return;
-            }
-            
-            showToast('Resetting to defaults...', 'success');
-            
-            fetch('/system/reset_nvs', { method: 'POST' })
-                .then(response => response.json())
-                .then(data => {
-                    showToast('Settings cleared! Device rebooting...', 'success');
-                    setTimeout(() => {
-                        window.location.href = 'http://192.168.4.1/';
-                    }, 5000);
-                })
-                .catch(error => {
-                    showToast('Reset command sent, device rebooting...', 'success');
-                    setTimeout(() => {
-                        window.location.href = 'http://192.168.4.1/';
-                    }, 5000);
-                });
-        }
-        
-        // Load current WiFi mode and set dropdown
-        function loadWifiMode() {
-            fetch('/system/get_wifi_mode')
-                .then(response => response.json())
-                .then(data => {
-                    if (data.success && data.mode) {
-                        const dropdown = document.getElementById('wifi-mode');
-                        if (dropdown) {
-                            dropdown.value = data.mode;
-                            console.log('Current WiFi mode:', data.mode, 'Force AP:', data.force_ap);
-                        }
-                    }
-                })
-                .catch(error => {
-                    console.error('Failed to load WiFi mode:', error);
-                });
-        }
-        
-        // Check NVS stored values
-        function checkNVS() {
-            const debugDiv = document.getElementById('nvs-debug');
-            fetch('/debug/nvs')
-                .then(response => response.json())
-                .then(data => {
-                    if (data.success && data.nvs) {
-                        debugDiv.style.display = 'block';
-                        debugDiv.textContent = JSON.stringify(data.nvs, null, 2);
-                        showToast('NVS values retrieved', 'success');
-                    } else {
-                        showToast('Failed to get NVS values', 'error');
-                    }
-                })
-                .catch(error => {
-                    showToast('Error reading NVS: ' + error, 'error');
-                });
-        }
-        
-        // Load WiFi mode when page loads
-        loadWifiMode();
-        
-        // Load settings (including MQTT) when page loads
-        loadSettings();
-    </script>
-</body>
-</html>
-)rawliteral";
+struct WebAsset
+{
+    const char *uri;
+    const char *type;
+    const uint8_t *start;
+    const uint8_t *end;
+    char etag[20]; // Quoted hex hash, filled on first request
+};
+
+static WebAsset web_assets[] = {
+    {"/", "text/html", index_html_gz_start, index_html_gz_end, ""},
+    {"/app.js", "application/javascript", app_js_gz_start, app_js_gz_end, ""},
+    {"/app.css", "text/css", app_css_gz_start, app_css_gz_end, ""},
+};
 
 WebServer::WebServer()
-    : server(nullptr), running(false), ws_client_count(0)
+    : server(nullptr), running(false), ws_client_count(0), ws_binary_client_count(0),
+      sender_task(nullptr), stats_since_us(0), data_wait_task(nullptr), data_wait_queue(nullptr),
+      data_waiter_count(0)
 {
     memset(ws_clients, 0, sizeof(ws_clients));
-    memset(&cached_data, 0, sizeof(cached_data));
-    cached_data.wand_connected = false;
-
+    memset(&gesture_batch, 0, sizeof(gesture_batch));
+    gesture_batch.type = WS_MSG_GESTURE_POINTS;
+    gesture_batch.stride = 2;
+    memset(&imu_batch, 0, sizeof(imu_batch));
+    imu_batch.type = WS_MSG_IMU;
+    imu_batch.stride = 6;
+    memset(&gesture_stats, 0, sizeof(gesture_stats));
+    memset(&imu_stats, 0, sizeof(imu_stats));
+    memset(topic_stats, 0, sizeof(topic_stats));
     client_mutex = xSemaphoreCreateMutex();
     if (!client_mutex)
     {
         ESP_LOGE(TAG, "FATAL: Failed to create client_mutex");
     }
 
-    data_mutex = xSemaphoreCreateMutex();
-    if (!data_mutex)
+    batch_mutex = xSemaphoreCreateMutex();
+    if (!batch_mutex)
     {
-        ESP_LOGE(TAG, "FATAL: Failed to create data_mutex");
+        ESP_LOGE(TAG, "FATAL: Failed to create batch_mutex");
     }
 }
 
@@ -2020,9 +186,9 @@ WebServer::~WebServer()
     {
         vSemaphoreDelete(client_mutex);
     }
-    if (data_mutex)
+    if (batch_mutex)
     {
-        vSemaphoreDelete(data_mutex);
+        vSemaphoreDelete(batch_mutex);
     }
 }
 
@@ -2044,8 +210,11 @@ bool WebServer::begin(uint16_t port)
         return true;
     }
 
-    // Initialize SPIFFS for gesture images
-    ESP_LOGI(TAG, "Initializing SPIFFS for gesture images...");
+    // Gesture images: packed atlas in the "gestures" partition, mapped from flash
+    bool atlas = gesture_atlas.begin();
+
+    // SPIFFS holds custom gestures and dataset captures (and gesture images without an atlas)
+    ESP_LOGI(TAG, "Initializing SPIFFS...");
     esp_vfs_spiffs_conf_t spiffs_conf = {
         .base_path = "/spiffs",
         .partition_label = "spiffs",
@@ -2058,17 +227,15 @@ bool WebServer::begin(uint16_t port)
     {
         if (ret == ESP_FAIL)
         {
-            ESP_LOGW(TAG, "SPIFFS mount failed - partition may be corrupted or not flashed");
-            ESP_LOGW(TAG, "Run './upload_gestures.sh' to flash gesture images");
+            ESP_LOGW(TAG, "SPIFFS mount failed - partition may be corrupted");
         }
         else if (ret == ESP_ERR_NOT_FOUND)
         {
             ESP_LOGW(TAG, "SPIFFS partition not found - check partition table");
-            ESP_LOGW(TAG, "Expected: offset=0x490000, size=0x370000 (3.6MB)");
         }
         else
         {
-            ESP_LOGW(TAG, "SPIFFS init failed (%s) - gesture images unavailable", esp_err_to_name(ret));
+            ESP_LOGW(TAG, "SPIFFS init failed (%s)", esp_err_to_name(ret));
         }
     }
     else
@@ -2078,42 +245,17 @@ bool WebServer::begin(uint16_t port)
         if (ret == ESP_OK)
         {
             ESP_LOGI(TAG, "SPIFFS: %d KB total, %d KB used", total / 1024, used / 1024);
-            if (used == 0)
-            {
-                ESP_LOGI(TAG, "SPIFFS is empty - run './upload_gestures.sh' to upload gesture images");
-            }
-            else
-            {
-                // List SPIFFS contents for debugging
-                ESP_LOGI(TAG, "Listing SPIFFS contents:");
-                DIR *dir = opendir("/spiffs");
-                if (dir)
-                {
-                    struct dirent *entry;
-                    int file_count = 0;
-                    while ((entry = readdir(dir)) != NULL && file_count < 10)
-                    {
-                        ESP_LOGI(TAG, "  - %s", entry->d_name);
-                        file_count++;
-                    }
-                    if (file_count == 10)
-                    {
-                        ESP_LOGI(TAG, "  ... (showing first 10 files)");
-                    }
-                    closedir(dir);
-                }
-                else
-                {
-                    ESP_LOGW(TAG, "Failed to open SPIFFS directory for listing");
-                }
-            }
         }
     }
+    if (!atlas)
+    {
+        ESP_LOGW(TAG, "No gesture atlas - 'idf.py flash' writes it (or tools/pack_gestures.py + esptool.py)");
+    }
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = port;
     config.max_open_sockets = 7;
-    config.max_uri_handlers = 25; // Support all handlers + buffer for future endpoints
+    config.max_uri_handlers = WEB_URI_HANDLER_SLOTS;
     config.lru_purge_enable = true;
 
     if (httpd_start(&server, &config) != ESP_OK)
@@ -2122,18 +264,24 @@ bool WebServer::begin(uint16_t port)
         return false;
     }
 
-    // Register handlers
-    httpd_uri_t root = {
-        .uri = "/",
-        .method = HTTP_GET,
-        .handler = root_handler,
-        .user_ctx = nullptr,
-        .is_websocket = false,
-        .handle_ws_control_frames = false,
-        .supported_subprotocol = nullptr};
-    if (httpd_register_uri_handler(server, &root) != ESP_OK)
-    {
-        ESP_LOGW(TAG, "Root handler registration FAILED");
+    // Register handlers (a failure here usually means WEB_URI_HANDLER_COUNT fell behind)
+    int failed_handlers = 0;
+    // Web UI: /, /app.js, /app.css
+    for (size_t i = 0; i < sizeof(web_assets) / sizeof(web_assets[0]); i++)
+    {
+        httpd_uri_t asset = {
+            .uri = web_assets[i].uri,
+            .method = HTTP_GET,
+            .handler = asset_handler,
+            .user_ctx = &web_assets[i],
+            .is_websocket = false,
+            .handle_ws_control_frames = false,
+            .supported_subprotocol = nullptr};
+        if (httpd_register_uri_handler(server, &asset) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "UI asset handler registration FAILED: %s", web_assets[i].uri);
+            failed_handlers++;
+        }
     }
 
     httpd_uri_t ws = {
@@ -2147,6 +295,50 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &ws) != ESP_OK)
     {
         ESP_LOGW(TAG, "WebSocket handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Polling alternatives to the WebSocket: snapshot, long-poll, server-sent events
+    httpd_uri_t data = {
+        .uri = "/data",
+        .method = HTTP_GET,
+        .handler = data_handler,
+        .user_ctx = this,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &data) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Data handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t data_poll = {
+        .uri = "/data/poll",
+        .method = HTTP_GET,
+        .handler = data_poll_handler,
+        .user_ctx = this,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &data_poll) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Data long-poll handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t data_events = {
+        .uri = "/data/events",
+        .method = HTTP_GET,
+        .handler = data_events_handler,
+        .user_ctx = this,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &data_events) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Data events handler registration FAILED");
+        failed_handlers++;
     }
 
     // Captive portal handlers for Android/iOS detection
@@ -2161,6 +353,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &captive_generate_204) != ESP_OK)
     {
         ESP_LOGW(TAG, "Captive portal /generate_204 handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t captive_hotspot = {
@@ -2174,6 +367,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &captive_hotspot) != ESP_OK)
     {
         ESP_LOGW(TAG, "Captive portal /hotspot-detect.html handler registration FAILED");
+        failed_handlers++;
     }
 
     // BLE scan and MAC management handlers
@@ -2188,6 +382,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &scan) != ESP_OK)
     {
         ESP_LOGW(TAG, "Scan handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t set_mac = {
@@ -2201,6 +396,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &set_mac) != ESP_OK)
     {
         ESP_LOGW(TAG, "Set MAC handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t get_stored_mac = {
@@ -2214,6 +410,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &get_stored_mac) != ESP_OK)
     {
         ESP_LOGW(TAG, "Get stored MAC handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t connect = {
@@ -2227,6 +424,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &connect) != ESP_OK)
     {
         ESP_LOGW(TAG, "Connect handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t disconnect = {
@@ -2240,6 +438,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &disconnect) != ESP_OK)
     {
         ESP_LOGW(TAG, "Disconnect handler registration FAILED");
+        failed_handlers++;
     }
 
     // Settings endpoints
@@ -2254,6 +453,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &settings_get) != ESP_OK)
     {
         ESP_LOGW(TAG, "Settings GET handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t settings_save = {
@@ -2267,6 +467,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &settings_save) != ESP_OK)
     {
         ESP_LOGW(TAG, "Settings SAVE handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t settings_reset = {
@@ -2280,6 +481,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &settings_reset) != ESP_OK)
     {
         ESP_LOGW(TAG, "Settings RESET handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t wifi_scan = {
@@ -2293,6 +495,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &wifi_scan) != ESP_OK)
     {
         ESP_LOGW(TAG, "WiFi scan handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t wifi_connect = {
@@ -2306,6 +509,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &wifi_connect) != ESP_OK)
     {
         ESP_LOGW(TAG, "WiFi connect handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t hotspot_settings = {
@@ -2319,6 +523,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &hotspot_settings) != ESP_OK)
     {
         ESP_LOGW(TAG, "Hotspot settings handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t hotspot_get = {
@@ -2332,6 +537,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &hotspot_get) != ESP_OK)
     {
         ESP_LOGW(TAG, "Hotspot get handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t system_reboot = {
@@ -2345,6 +551,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &system_reboot) != ESP_OK)
     {
         ESP_LOGW(TAG, "System reboot handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t system_wifi_mode = {
@@ -2358,6 +565,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &system_wifi_mode) != ESP_OK)
     {
         ESP_LOGW(TAG, "System wifi_mode handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t system_reset_nvs = {
@@ -2371,6 +579,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &system_reset_nvs) != ESP_OK)
     {
         ESP_LOGW(TAG, "System reset_nvs handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t system_get_wifi_mode = {
@@ -2384,6 +593,7 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &system_get_wifi_mode) != ESP_OK)
     {
         ESP_LOGW(TAG, "System get_wifi_mode handler registration FAILED");
+        failed_handlers++;
     }
 
     httpd_uri_t debug_nvs = {
@@ -2397,33 +607,454 @@ bool WebServer::begin(uint16_t port)
     if (httpd_register_uri_handler(server, &debug_nvs) != ESP_OK)
     {
         ESP_LOGW(TAG, "Debug NVS handler registration FAILED");
+        failed_handlers++;
     }
 
-    // Register 404 error handler to intercept gesture image requests
-    // ESP-IDF httpd wildcards don't work well, so use error handler approach
-    ESP_LOGI(TAG, "Registering 404 handler for gesture images");
-    httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, gesture_404_handler);
-
-    running = true;
-    ESP_LOGI(TAG, "Web server started on port %d", port);
-    ESP_LOGI(TAG, "Registered endpoints: /, /ws, /generate_204, /hotspot-detect.html, /scan, /set_mac, /get_stored_mac, /connect, /disconnect, /settings/get, /settings/save, /settings/reset, /wifi/scan, /wifi/connect, /hotspot/settings, /hotspot/get, /system/reboot, [404:gesture/*]");
-    return true;
-}
-
-void WebServer::stop()
-{
-    if (server)
+    // Model registry endpoints (runtime model switching)
+    httpd_uri_t models_get = {
+        .uri = "/models",
+        .method = HTTP_GET,
+        .handler = models_get_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &models_get) != ESP_OK)
     {
-        httpd_stop(server);
-        server = nullptr;
-        running = false;
+        ESP_LOGW(TAG, "Models list handler registration FAILED");
+        failed_handlers++;
     }
-}
 
-esp_err_t WebServer::root_handler(httpd_req_t *req)
-{
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, index_html, strlen(index_html));
+    httpd_uri_t models_select = {
+        .uri = "/models/select",
+        .method = HTTP_POST,
+        .handler = models_select_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &models_select) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Model select handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Shadow-model evaluation endpoints
+    httpd_uri_t shadow_status = {
+        .uri = "/shadow",
+        .method = HTTP_GET,
+        .handler = shadow_status_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &shadow_status) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Shadow status handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t shadow_log = {
+        .uri = "/shadow/log",
+        .method = HTTP_GET,
+        .handler = shadow_log_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &shadow_log) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Shadow log handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t shadow_select = {
+        .uri = "/shadow/select",
+        .method = HTTP_POST,
+        .handler = shadow_select_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &shadow_select) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Shadow select handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Custom gesture endpoints (record/list/delete user templates)
+    httpd_uri_t custom_list = {
+        .uri = "/custom",
+        .method = HTTP_GET,
+        .handler = custom_list_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &custom_list) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Custom gesture list handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t custom_record = {
+        .uri = "/custom/record",
+        .method = HTTP_POST,
+        .handler = custom_record_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &custom_record) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Custom gesture record handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t custom_delete = {
+        .uri = "/custom/delete",
+        .method = HTTP_POST,
+        .handler = custom_delete_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &custom_delete) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Custom gesture delete handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Cascade endpoints (stage-1 model, escalation threshold, statistics)
+    httpd_uri_t cascade_get = {
+        .uri = "/cascade",
+        .method = HTTP_GET,
+        .handler = cascade_get_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &cascade_get) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Cascade get handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t cascade_set = {
+        .uri = "/cascade",
+        .method = HTTP_POST,
+        .handler = cascade_set_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &cascade_set) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Cascade set handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Multi-window trimming statistics
+    httpd_uri_t windows_get = {
+        .uri = "/windows",
+        .method = HTTP_GET,
+        .handler = windows_get_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &windows_get) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Windows stats handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Per-spell confidence thresholds and temperature
+    httpd_uri_t calibration_get = {
+        .uri = "/calibration",
+        .method = HTTP_GET,
+        .handler = calibration_get_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &calibration_get) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Calibration get handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t calibration_set = {
+        .uri = "/calibration",
+        .method = HTTP_POST,
+        .handler = calibration_set_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &calibration_set) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Calibration set handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Button-free segmentation counters
+    httpd_uri_t segmenter_get = {
+        .uri = "/segmenter",
+        .method = HTTP_GET,
+        .handler = segmenter_get_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &segmenter_get) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Segmenter stats handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Labelled dataset capture (status/toggle/label, binary download)
+    httpd_uri_t dataset_get = {
+        .uri = "/dataset",
+        .method = HTTP_GET,
+        .handler = dataset_get_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &dataset_get) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Dataset status handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t dataset_set = {
+        .uri = "/dataset",
+        .method = HTTP_POST,
+        .handler = dataset_set_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &dataset_set) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Dataset set handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t dataset_download = {
+        .uri = "/dataset/download",
+        .method = HTTP_GET,
+        .handler = dataset_download_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &dataset_download) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Dataset download handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Recent casts in PSRAM: summary, binary download, replay through the active model
+    httpd_uri_t history_get = {
+        .uri = "/history",
+        .method = HTTP_GET,
+        .handler = history_get_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &history_get) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "History handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t history_download = {
+        .uri = "/history/download",
+        .method = HTTP_GET,
+        .handler = history_download_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &history_download) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "History download handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t history_replay = {
+        .uri = "/history/replay",
+        .method = HTTP_POST,
+        .handler = history_replay_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &history_replay) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "History replay handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Per-user personalization (profiles, corrections)
+    httpd_uri_t personalize_get = {
+        .uri = "/personalize",
+        .method = HTTP_GET,
+        .handler = personalize_get_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &personalize_get) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Personalize status handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t personalize_set = {
+        .uri = "/personalize",
+        .method = HTTP_POST,
+        .handler = personalize_set_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &personalize_set) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Personalize set handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // WebSocket stream cost (JSON vs binary frames)
+    httpd_uri_t ws_stats = {
+        .uri = "/ws/stats",
+        .method = HTTP_GET,
+        .handler = ws_stats_handler,
+        .user_ctx = this,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &ws_stats) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "WebSocket stats handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t gestures_index = {
+        .uri = "/gestures/index",
+        .method = HTTP_GET,
+        .handler = gesture_index_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &gestures_index) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Gesture index handler registration FAILED");
+        failed_handlers++;
+    }
+
+    httpd_uri_t gestures_atlas = {
+        .uri = "/gestures/atlas",
+        .method = HTTP_GET,
+        .handler = gesture_atlas_handler,
+        .user_ctx = nullptr,
+        .is_websocket = false,
+        .handle_ws_control_frames = false,
+        .supported_subprotocol = nullptr};
+    if (httpd_register_uri_handler(server, &gestures_atlas) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Gesture atlas handler registration FAILED");
+        failed_handlers++;
+    }
+
+    // Register 404 error handler to intercept gesture image requests
+    // ESP-IDF httpd wildcards don't work well, so use error handler approach
+    ESP_LOGI(TAG, "Registering 404 handler for gesture images");
+    httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, gesture_404_handler);
+
+    if (!sender_task &&
+        xTaskCreate(senderTaskFunc, "ws_sender", WS_SENDER_TASK_STACK, this, WS_SENDER_TASK_PRIORITY,
+                    &sender_task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create WebSocket sender task");
+        sender_task = nullptr;
+    }
+
+    if (!data_wait_queue)
+    {
+        data_wait_queue = xQueueCreate(DATA_WAIT_MAX_CLIENTS, sizeof(DataWaiter));
+    }
+    if (data_wait_queue && !data_wait_task &&
+        xTaskCreate(dataWaitTaskFunc, "data_wait", DATA_WAIT_TASK_STACK, this, DATA_WAIT_TASK_PRIORITY,
+                    &data_wait_task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create long-poll task");
+        data_wait_task = nullptr;
+    }
+
+    if (failed_handlers > 0)
+    {
+        ESP_LOGE(TAG, "%d URI handler(s) not registered - raise WEB_URI_HANDLER_COUNT (%d)",
+                 failed_handlers, WEB_URI_HANDLER_COUNT);
+    }
+
+    stats_since_us = esp_timer_get_time();
+    running = true;
+    ESP_LOGI(TAG, "Web server started on port %d", port);
+    ESP_LOGI(TAG, "Registered endpoints: /, /app.js, /app.css, /ws, /data, /data/poll, /data/events, /generate_204, /hotspot-detect.html, /scan, /set_mac, /get_stored_mac, /connect, /disconnect, /settings/get, /settings/save, /settings/reset, /wifi/scan, /wifi/connect, /hotspot/settings, /hotspot/get, /system/reboot, /models, /models/select, /shadow, /shadow/log, /shadow/select, /custom, /custom/record, /custom/delete, /cascade, /windows, /calibration, /segmenter, /dataset, /dataset/download, /history, /history/download, /history/replay, /personalize, /ws/stats, /gestures/index, /gestures/atlas, [404:gesture/*]");
+    return true;
+}
+
+void WebServer::stop()
+{
+    if (server)
+    {
+        // The wait task completes held requests once it sees running == false
+        running = false;
+        if (data_wait_task)
+        {
+            xTaskNotifyGive(data_wait_task);
+            for (int i = 0; i < 20 && data_waiter_count.load() > 0; i++)
+            {
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+        }
+        httpd_stop(server);
+        server = nullptr;
+        running = false;
+    }
+}
+
+esp_err_t WebServer::asset_handler(httpd_req_t *req)
+{
+    WebAsset *asset = (WebAsset *)req->user_ctx;
+    size_t size = asset->end - asset->start;
+
+    // Strong ETag from the compressed bytes, computed on first use (FNV-1a 64)
+    if (asset->etag[0] == '\0')
+    {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ asset->start[i]) * 0x100000001b3ULL;
+        }
+        snprintf(asset->etag, sizeof(asset->etag), "\"%016llx\"", (unsigned long long)hash);
+    }
+
+    // no-cache: the browser revalidates on every load and gets an empty 304 while unchanged
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (send_not_modified(req, asset->etag))
+    {
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, asset->type);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_send(req, (const char *)asset->start, size);
     return ESP_OK;
 }
 
@@ -2469,49 +1100,55 @@ esp_err_t WebServer::ws_handler(httpd_req_t *req)
             {
                 buf[ws_pkt.len] = 0; // Null terminate
 
+                // Topic subscription: {"type":"subscribe","topics":"spell,gesture_point,imu:10"}
+                char *topics = strstr((char *)buf, "\"topics\":\"");
+                if (strstr((char *)buf, "\"subscribe\"") != NULL && topics)
+                {
+                    WebServer *server = (WebServer *)req->user_ctx;
+                    server->setWebSocketClientTopics(httpd_req_to_sockfd(req), topics + 10);
+                }
+                // Stream format negotiation: {"type":"format","format":"binary"|"json"}
+                else if (strstr((char *)buf, "\"format\"") != NULL)
+                {
+                    WebServer *server = (WebServer *)req->user_ctx;
+                    server->setWebSocketClientBinary(httpd_req_to_sockfd(req),
+                                                     strstr((char *)buf, "\"binary\"") != NULL);
+                }
                 // Check if client is requesting status
-                if (strstr((char *)buf, "request_status") != NULL)
+                else if (strstr((char *)buf, "request_status") != NULL)
                 {
                     WebServer *server = (WebServer *)req->user_ctx;
-                    bool wand_connected = false;
-                    char firmware[32], serial[32], sku[32], device_id[32], wand_type[32];
-
-                    if (xSemaphoreTake(server->data_mutex, pdMS_TO_TICKS(10)) == pdTRUE)
-                    {
-                        wand_connected = server->cached_data.wand_connected;
-                        strncpy(firmware, server->cached_data.firmware_version, sizeof(firmware));
-                        strncpy(serial, server->cached_data.serial_number, sizeof(serial));
-                        strncpy(sku, server->cached_data.sku, sizeof(sku));
-                        strncpy(device_id, server->cached_data.device_id, sizeof(device_id));
-                        strncpy(wand_type, server->cached_data.wand_type, sizeof(wand_type));
-                        xSemaphoreGive(server->data_mutex);
-                    }
+                    CachedData data;
+                    server->cached_data.read(data);
 
                     // Send wand status response
                     char response[100];
-                    snprintf(response, sizeof(response), "{\"type\":\"wand_status\",\"connected\":%s}",
-                             wand_connected ? "true" : "false");
+                    JsonWriter status(response, sizeof(response));
+                    status.beginObject();
+                    status.field("type", "wand_status");
+                    status.field("connected", data.wand_connected);
+                    status.endObject();
 
                     httpd_ws_frame_t resp_pkt;
                     memset(&resp_pkt, 0, sizeof(httpd_ws_frame_t));
-                    resp_pkt.payload = (uint8_t *)response;
-                    resp_pkt.len = strlen(response);
+                    resp_pkt.payload = (uint8_t *)status.c_str();
+                    resp_pkt.len = status.length();
                     resp_pkt.type = HTTPD_WS_TYPE_TEXT;
                     httpd_ws_send_frame(req, &resp_pkt);
 
                     // Also send cached wand info if available
-                    if (wand_connected && serial[0] != '\0')
+                    if (data.wand_connected && data.serial_number[0] != '\0')
                     {
                         char wand_info[512];
-                        snprintf(wand_info, sizeof(wand_info),
-                                 "{\"type\":\"wand_info\",\"firmware\":\"%s\",\"serial\":\"%s\",\"sku\":\"%s\",\"device_id\":\"%s\",\"wand_type\":\"%s\"}",
-                                 firmware, serial, sku, device_id, wand_type);
+                        JsonWriter info(wand_info, sizeof(wand_info));
+                        write_wand_info(info, data.firmware_version, data.serial_number, data.sku, data.device_id,
+                                        data.wand_type);
 
                         vTaskDelay(pdMS_TO_TICKS(10)); // Small delay between frames
 
                         memset(&resp_pkt, 0, sizeof(httpd_ws_frame_t));
-                        resp_pkt.payload = (uint8_t *)wand_info;
-                        resp_pkt.len = strlen(wand_info);
+                        resp_pkt.payload = (uint8_t *)info.c_str();
+                        resp_pkt.len = info.length();
                         resp_pkt.type = HTTPD_WS_TYPE_TEXT;
                         httpd_ws_send_frame(req, &resp_pkt);
                     }
@@ -2524,1231 +1161,1956 @@ esp_err_t WebServer::ws_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+// Truncating copy for cached_data writes (no printf inside the seqlock's critical section)
+static void copy_cached_string(char *dst, size_t size, const char *src)
+{
+    size_t len = strnlen(src, size - 1);
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
 esp_err_t WebServer::data_handler(httpd_req_t *req)
 {
     WebServer *server = (WebServer *)req->user_ctx;
 
-    httpd_resp_set_type(req, "application/json");
+    // Lock-free snapshot: never waits on the BLE path
+    CachedData data;
+    uint32_t version = server->cached_data.read(data);
+
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
     httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
 
-    char json[512];
-
-    if (xSemaphoreTake(server->data_mutex, pdMS_TO_TICKS(10)) == pdTRUE)
+    // Pollers hand back the version they have (If-None-Match or ?since=) and get an
+    // empty 304 while nothing changed
+    char etag[16];
+    snprintf(etag, sizeof(etag), "\"%lu\"", (unsigned long)version);
+    if (send_not_modified(req, etag))
     {
-        if (server->cached_data.has_spell)
-        {
-            snprintf(json, sizeof(json),
-                     "{\"ax\":%.3f,\"ay\":%.3f,\"az\":%.3f,\"gx\":%.3f,\"gy\":%.3f,\"gz\":%.3f,"
-                     "\"spell\":\"%s\",\"confidence\":%.3f,\"battery\":%d}",
-                     server->cached_data.ax, server->cached_data.ay, server->cached_data.az,
-                     server->cached_data.gx, server->cached_data.gy, server->cached_data.gz,
-                     server->cached_data.spell, server->cached_data.confidence,
-                     server->cached_data.battery);
-            server->cached_data.has_spell = false; // Clear after sending
-        }
-        else
+        return ESP_OK;
+    }
+    unsigned long since = 0;
+    char query[32];
+    char value[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK)
+    {
+        since = strtoul(value, nullptr, 10);
+        if (since == version)
         {
-            snprintf(json, sizeof(json),
-                     "{\"ax\":%.3f,\"ay\":%.3f,\"az\":%.3f,\"gx\":%.3f,\"gy\":%.3f,\"gz\":%.3f,"
-                     "\"battery\":%d}",
-                     server->cached_data.ax, server->cached_data.ay, server->cached_data.az,
-                     server->cached_data.gx, server->cached_data.gy, server->cached_data.gz,
-                     server->cached_data.battery);
+            httpd_resp_set_status(req, "304 Not Modified");
+            httpd_resp_send(req, NULL, 0);
+            return ESP_OK;
         }
-        xSemaphoreGive(server->data_mutex);
     }
-    else
+
+    char buf[256];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("version", (unsigned long)version);
+    json.field("ax", data.ax);
+    json.field("ay", data.ay);
+    json.field("az", data.az);
+    json.field("gx", data.gx);
+    json.field("gy", data.gy);
+    json.field("gz", data.gz);
+    // The last spell, unless the client's previous snapshot already had it. This replaces the
+    // old read-and-clear: a seqlock reader can't clear shared state, and clearing handed each
+    // spell to whichever poller came first, so other clients never saw it. Without since,
+    // every poll repeats the last spell; spell_version tells a repeat from a new cast.
+    if (data.spell_version > since)
     {
-        snprintf(json, sizeof(json), "{\"error\":\"timeout\"}");
+        json.field("spell", data.spell);
+        json.field("confidence", data.confidence);
+        json.field("spell_version", (unsigned long)data.spell_version);
     }
+    json.field("battery", data.battery);
+    json.field("connected", data.wand_connected);
+    json.endObject();
 
-    httpd_resp_send(req, json, strlen(json));
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json.c_str(), json.length());
     return ESP_OK;
 }
 
-void WebServer::broadcastIMU(float ax, float ay, float az, float gx, float gy, float gz)
-{
-    if (!running)
-        return;
-
-    char json[300];
-    snprintf(json, sizeof(json),
-             "{\"type\":\"imu\",\"ax\":%.3f,\"ay\":%.3f,\"az\":%.3f,\"gx\":%.3f,\"gy\":%.3f,\"gz\":%.3f}",
-             ax, ay, az, gx, gy, gz);
+// Names of the DATA_GROUP_* bits, in bit order
+static const char *const DATA_GROUP_NAMES[] = {"imu", "spell", "battery", "status"};
+#define DATA_GROUP_COUNT (sizeof(DATA_GROUP_NAMES) / sizeof(DATA_GROUP_NAMES[0]))
+#define DATA_EVENT_SIZE 576
 
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+// "imu,spell" -> DATA_GROUP_* bits; every group when nothing known is listed
+static uint8_t parse_data_groups(const char *list)
+{
+    uint8_t groups = 0;
+    const char *name = list;
+    while (*name)
+    {
+        const char *end = strchr(name, ',');
+        size_t len = end ? (size_t)(end - name) : strlen(name);
+        for (size_t g = 0; g < DATA_GROUP_COUNT; g++)
+        {
+            if (strlen(DATA_GROUP_NAMES[g]) == len && strncmp(DATA_GROUP_NAMES[g], name, len) == 0)
+            {
+                groups |= 1u << g;
+            }
+        }
+        if (!end)
+            break;
+        name = end + 1;
+    }
+    return groups ? groups : DATA_GROUPS_ALL;
 }
 
-void WebServer::broadcastSpell(const char *spell_name, float confidence)
+// ?since=<version>&fields=<groups>&timeout=<ms>
+static void parse_data_query(httpd_req_t *req, uint32_t *since, uint8_t *groups, uint32_t *timeout_ms)
 {
-    if (!running || !spell_name)
+    char query[96];
+    char value[48];
+    *groups = DATA_GROUPS_ALL;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK)
+    {
         return;
+    }
+    if (httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK)
+    {
+        *since = strtoul(value, nullptr, 10);
+    }
+    if (httpd_query_key_value(query, "fields", value, sizeof(value)) == ESP_OK)
+    {
+        *groups = parse_data_groups(value);
+    }
+    if (timeout_ms && httpd_query_key_value(query, "timeout", value, sizeof(value)) == ESP_OK)
+    {
+        *timeout_ms = strtoul(value, nullptr, 10);
+        if (*timeout_ms > DATA_POLL_MAX_TIMEOUT_MS)
+        {
+            *timeout_ms = DATA_POLL_MAX_TIMEOUT_MS;
+        }
+    }
+}
 
-    char json[300];
-    snprintf(json, sizeof(json),
-             "{\"type\":\"spell\",\"spell\":\"%s\",\"confidence\":%.3f}",
-             spell_name, confidence);
-
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+// Groups among `groups` written after version `since`
+static uint8_t changed_data_groups(const CachedData &data, uint32_t since, uint8_t groups)
+{
+    uint8_t changed = 0;
+    if (data.imu_version > since)
+        changed |= DATA_GROUP_IMU;
+    if (data.spell_version > since)
+        changed |= DATA_GROUP_SPELL;
+    if (data.battery_version > since)
+        changed |= DATA_GROUP_BATTERY;
+    if (data.status_version > since)
+        changed |= DATA_GROUP_STATUS;
+    return changed & groups;
 }
 
-void WebServer::broadcastBattery(uint8_t level)
+// The version plus only the fields of the changed groups
+static void write_data_fields(JsonWriter &json, const CachedData &data, uint32_t version, uint8_t changed)
 {
-    if (!running)
-        return;
+    json.beginObject();
+    json.field("version", (unsigned long)version);
+    if (changed & DATA_GROUP_IMU)
+    {
+        json.field("ax", data.ax);
+        json.field("ay", data.ay);
+        json.field("az", data.az);
+        json.field("gx", data.gx);
+        json.field("gy", data.gy);
+        json.field("gz", data.gz);
+    }
+    if (changed & DATA_GROUP_SPELL)
+    {
+        json.field("spell", data.spell);
+        json.field("confidence", data.confidence);
+        json.field("spell_version", (unsigned long)data.spell_version);
+    }
+    if (changed & DATA_GROUP_BATTERY)
+    {
+        json.field("battery", data.battery);
+    }
+    if (changed & DATA_GROUP_STATUS)
+    {
+        json.field("connected", data.wand_connected);
+        json.field("firmware", data.firmware_version);
+        json.field("serial", data.serial_number);
+        json.field("sku", data.sku);
+        json.field("device_id", data.device_id);
+        json.field("wand_type", data.wand_type);
+    }
+    json.endObject();
+}
 
-    char json[150];
-    snprintf(json, sizeof(json),
-             "{\"type\":\"battery\",\"level\":%d}",
-             level);
+static esp_err_t send_data_fields(httpd_req_t *req, const CachedData &data, uint32_t version, uint8_t changed)
+{
+    char buf[DATA_EVENT_SIZE];
+    JsonWriter json(buf, sizeof(buf));
+    write_data_fields(json, data, version, changed);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    return httpd_resp_send(req, json.c_str(), json.length());
+}
 
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+static void send_too_many_held(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    httpd_resp_sendstr(req, "Too many held connections");
 }
 
-void WebServer::broadcastWandStatus(bool connected)
+esp_err_t WebServer::data_poll_handler(httpd_req_t *req)
 {
-    if (!running)
-        return;
+    WebServer *server = (WebServer *)req->user_ctx;
+    uint32_t since = 0;
+    uint8_t groups;
+    uint32_t timeout_ms = DATA_POLL_TIMEOUT_MS;
+    parse_data_query(req, &since, &groups, &timeout_ms);
 
-    // Update cached status
-    if (xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10)) == pdTRUE)
+    CachedData data;
+    uint32_t version = server->cached_data.read(data);
+    if (since > version)
     {
-        cached_data.wand_connected = connected;
-        xSemaphoreGive(data_mutex);
+        since = 0; // Version from before a reboot
     }
 
-    char json[150];
-    snprintf(json, sizeof(json),
-             "{\"type\":\"wand_status\",\"connected\":%s}",
-             connected ? "true" : "false");
-
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+    // Something newer already: answer right away, otherwise wait for it off the httpd task
+    uint8_t changed = changed_data_groups(data, since, groups);
+    if (changed)
+    {
+        return send_data_fields(req, data, version, changed);
+    }
+    if (!server->holdDataRequest(req, false, groups, since, esp_timer_get_time() + timeout_ms * 1000LL))
+    {
+        send_too_many_held(req);
+    }
+    return ESP_OK;
 }
 
-void WebServer::broadcastGestureStart()
+esp_err_t WebServer::data_events_handler(httpd_req_t *req)
 {
-    if (!running)
-        return;
+    WebServer *server = (WebServer *)req->user_ctx;
+    uint32_t since = 0;
+    uint8_t groups;
+    parse_data_query(req, &since, &groups, nullptr);
 
-    ESP_LOGI(TAG, "Broadcasting gesture_start to %d clients", ws_client_count);
-    const char *json = "{\"type\":\"gesture_start\"}";
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+    // EventSource resumes from the last id it saw
+    char last_id[12];
+    if (httpd_req_get_hdr_value_str(req, "Last-Event-ID", last_id, sizeof(last_id)) == ESP_OK)
+    {
+        since = strtoul(last_id, nullptr, 10);
+    }
+    if (since > server->cached_data.version())
+    {
+        since = 0;
+    }
+
+    if (!server->holdDataRequest(req, true, groups, since, esp_timer_get_time()))
+    {
+        send_too_many_held(req);
+    }
+    return ESP_OK;
 }
 
-void WebServer::broadcastGesturePoint(float x, float y)
+// Hand a request to the wait task; false when DATA_WAIT_MAX_CLIENTS are already held
+bool WebServer::holdDataRequest(httpd_req_t *req, bool events, uint8_t groups, uint32_t since, int64_t deadline_us)
 {
-    if (!running)
+    if (!data_wait_task)
     {
-        return;
+        return false;
+    }
+    if (data_waiter_count.fetch_add(1) >= DATA_WAIT_MAX_CLIENTS)
+    {
+        data_waiter_count.fetch_sub(1);
+        return false;
     }
 
-    char json[200];
-    // Flip both axes to match wand movement direction with screen display
-    // (wand right = screen right, wand down = screen down)
-    snprintf(json, sizeof(json),
-             "{\"type\":\"gesture_point\",\"x\":%.4f,\"y\":%.4f}",
-             x, -y);
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+    DataWaiter waiter;
+    memset(&waiter, 0, sizeof(waiter));
+    waiter.events = events;
+    waiter.groups = groups;
+    waiter.since = since;
+    waiter.deadline_us = deadline_us;
+    if (httpd_req_async_handler_begin(req, &waiter.req) != ESP_OK)
+    {
+        data_waiter_count.fetch_sub(1);
+        return false;
+    }
+    // The count keeps the queue from ever being full
+    xQueueSend(data_wait_queue, &waiter, 0);
+    xTaskNotifyGive(data_wait_task);
+    return true;
 }
 
-void WebServer::broadcastGestureEnd()
+void WebServer::notifyDataWaiters()
 {
-    if (!running)
-        return;
+    if (data_wait_task && data_waiter_count.load(std::memory_order_relaxed) > 0)
+    {
+        xTaskNotifyGive(data_wait_task);
+    }
+}
 
-    ESP_LOGI(TAG, "Broadcasting gesture_end to %d clients", ws_client_count);
-    const char *json = "{\"type\":\"gesture_end\"}";
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+void WebServer::dataWaitTaskFunc(void *arg)
+{
+    WebServer *self = (WebServer *)arg;
+    DataWaiter waiters[DATA_WAIT_MAX_CLIENTS];
+    memset(waiters, 0, sizeof(waiters));
+    TickType_t wait = portMAX_DELAY;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, wait);
+        wait = self->serviceDataWaiters(waiters);
+    }
 }
 
-void WebServer::addWebSocketClient(int fd)
+// One event-stream client; false once its connection is gone
+static bool service_data_stream(DataWaiter &waiter, const CachedData &data, uint32_t version, int64_t now,
+                                int64_t *wake_us)
 {
-    if (xSemaphoreTake(client_mutex, pdMS_TO_TICKS(100)) == pdTRUE)
+    if (!waiter.started)
     {
-        if (ws_client_count >= 10)
+        httpd_resp_set_type(waiter.req, "text/event-stream");
+        httpd_resp_set_hdr(waiter.req, "Access-Control-Allow-Origin", "*");
+        httpd_resp_set_hdr(waiter.req, "Cache-Control", "no-cache");
+        if (httpd_resp_sendstr_chunk(waiter.req, "retry: 3000\n\n") != ESP_OK)
         {
-            ESP_LOGW(TAG, "Max WebSocket clients reached, rejecting connection");
-            xSemaphoreGive(client_mutex);
-            return;
+            return false;
         }
+        waiter.started = true;
+    }
 
-        ws_clients[ws_client_count++] = fd;
-        ESP_LOGI(TAG, "WebSocket client added (total: %d)", ws_client_count);
-        xSemaphoreGive(client_mutex);
+    uint8_t changed = changed_data_groups(data, waiter.since, waiter.groups);
+    if (changed && now >= waiter.next_send_us)
+    {
+        char buf[DATA_EVENT_SIZE + 32];
+        int n = snprintf(buf, sizeof(buf), "id: %lu\ndata: ", (unsigned long)version);
+        JsonWriter json(buf + n, sizeof(buf) - n - 2);
+        write_data_fields(json, data, version, changed);
+        if (!json.ok())
+        {
+            return false;
+        }
+        size_t len = n + json.length();
+        memcpy(buf + len, "\n\n", 2);
+        if (httpd_resp_send_chunk(waiter.req, buf, len + 2) != ESP_OK)
+        {
+            return false;
+        }
+        waiter.since = version;
+        waiter.next_send_us = now + DATA_EVENTS_MIN_INTERVAL_MS * 1000LL;
+        waiter.deadline_us = now + DATA_EVENTS_KEEPALIVE_MS * 1000LL;
+        changed = 0;
+    }
+    else if (now >= waiter.deadline_us)
+    {
+        // Keeps proxies from timing out an idle stream, and finds dead sockets
+        if (httpd_resp_sendstr_chunk(waiter.req, ": keep-alive\n\n") != ESP_OK)
+        {
+            return false;
+        }
+        waiter.deadline_us = now + DATA_EVENTS_KEEPALIVE_MS * 1000LL;
+    }
+
+    *wake_us = waiter.deadline_us;
+    if (changed && waiter.next_send_us < *wake_us)
+    {
+        *wake_us = waiter.next_send_us; // Coalesced changes go out when the interval ends
     }
+    return true;
 }
 
-void WebServer::removeWebSocketClient(int fd)
+// Answer what is due; returns how long the task may sleep
+TickType_t WebServer::serviceDataWaiters(DataWaiter *waiters)
 {
-    if (xSemaphoreTake(client_mutex, pdMS_TO_TICKS(100)) == pdTRUE)
+    DataWaiter incoming;
+    while (xQueueReceive(data_wait_queue, &incoming, 0) == pdTRUE)
     {
-        for (int i = 0; i < ws_client_count; i++)
+        for (int i = 0; i < DATA_WAIT_MAX_CLIENTS; i++)
         {
-            if (ws_clients[i] == fd)
+            if (!waiters[i].req)
             {
-                for (int j = i; j < ws_client_count - 1; j++)
-                {
-                    ws_clients[j] = ws_clients[j + 1];
-                }
-                ws_client_count--;
-                ESP_LOGI(TAG, "WebSocket client removed (total: %d)", ws_client_count);
+                waiters[i] = incoming;
                 break;
             }
         }
-        xSemaphoreGive(client_mutex);
     }
-}
-
-void WebServer::broadcastLowConfidence(const char *spell_name, float confidence)
-{
-    if (!running || !spell_name)
-        return;
 
-    char json[256];
-    snprintf(json, sizeof(json),
-             "{\"type\":\"low_confidence\",\"spell\":\"%s\",\"confidence\":%.4f}",
-             spell_name, confidence);
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+    CachedData data;
+    uint32_t version = cached_data.read(data);
+    int64_t now = esp_timer_get_time();
+    int64_t next_us = INT64_MAX;
+    for (int i = 0; i < DATA_WAIT_MAX_CLIENTS; i++)
+    {
+        DataWaiter &waiter = waiters[i];
+        if (!waiter.req)
+        {
+            continue;
+        }
 
-    ESP_LOGI(TAG, "Low confidence prediction: %s (%.2f%%)", spell_name, confidence * 100.0f);
-}
+        bool done = !running;
+        int64_t wake_us = INT64_MAX;
+        if (done)
+        {
+            // Server stopping: just release the request
+        }
+        else if (waiter.events)
+        {
+            done = !service_data_stream(waiter, data, version, now, &wake_us);
+        }
+        else
+        {
+            uint8_t changed = changed_data_groups(data, waiter.since, waiter.groups);
+            if (changed)
+            {
+                send_data_fields(waiter.req, data, version, changed);
+                done = true;
+            }
+            else if (now >= waiter.deadline_us)
+            {
+                char etag[16];
+                snprintf(etag, sizeof(etag), "\"%lu\"", (unsigned long)version);
+                httpd_resp_set_hdr(waiter.req, "ETag", etag);
+                httpd_resp_set_status(waiter.req, "304 Not Modified");
+                httpd_resp_send(waiter.req, NULL, 0);
+                done = true;
+            }
+            wake_us = waiter.deadline_us;
+        }
 
-void WebServer::broadcastWandInfo(const char *firmware_version, const char *serial_number,
-                                  const char *sku, const char *device_id, const char *wand_type)
-{
-    // Sanitize all input strings
-    char safe_fw[32], safe_serial[32], safe_sku[32], safe_devid[32], safe_type[32];
-    sanitize_for_json(safe_fw, firmware_version, sizeof(safe_fw));
-    sanitize_for_json(safe_serial, serial_number, sizeof(safe_serial));
-    sanitize_for_json(safe_sku, sku, sizeof(safe_sku));
-    sanitize_for_json(safe_devid, device_id, sizeof(safe_devid));
-    sanitize_for_json(safe_type, wand_type, sizeof(safe_type));
+        if (done)
+        {
+            httpd_req_async_handler_complete(waiter.req);
+            waiter.req = nullptr;
+            data_waiter_count.fetch_sub(1);
+        }
+        else if (wake_us < next_us)
+        {
+            next_us = wake_us;
+        }
+    }
 
-    // Cache the wand info for new clients
-    if (xSemaphoreTake(data_mutex, pdMS_TO_TICKS(10)) == pdTRUE)
+    if (next_us == INT64_MAX)
     {
-        snprintf(cached_data.firmware_version, sizeof(cached_data.firmware_version), "%s", safe_fw);
-        snprintf(cached_data.serial_number, sizeof(cached_data.serial_number), "%s", safe_serial);
-        snprintf(cached_data.sku, sizeof(cached_data.sku), "%s", safe_sku);
-        snprintf(cached_data.device_id, sizeof(cached_data.device_id), "%s", safe_devid);
-        snprintf(cached_data.wand_type, sizeof(cached_data.wand_type), "%s", safe_type);
-        xSemaphoreGive(data_mutex);
+        return portMAX_DELAY;
     }
+    int64_t wait_ms = next_us > now ? (next_us - now + 999) / 1000 : 1;
+    return pdMS_TO_TICKS(wait_ms) > 0 ? pdMS_TO_TICKS(wait_ms) : 1;
+}
 
+void WebServer::broadcastIMU(float ax, float ay, float az, float gx, float gy, float gz)
+{
     if (!running)
         return;
 
-    char json[1024];
-    snprintf(json, sizeof(json),
-             "{\"type\":\"wand_info\",\"firmware\":\"%s\",\"serial\":\"%s\",\"sku\":\"%s\",\"device_id\":\"%s\",\"wand_type\":\"%s\"}",
-             safe_fw, safe_serial, safe_sku, safe_devid, safe_type);
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
-
-    ESP_LOGI(TAG, "Wand info broadcast: FW=%s, Serial=%s, SKU=%s, DevID=%s, Type=%s",
-             safe_fw, safe_serial, safe_sku, safe_devid, safe_type);
+    CachedData &data = cached_data.beginWrite();
+    data.ax = ax;
+    data.ay = ay;
+    data.az = az;
+    data.gx = gx;
+    data.gy = gy;
+    data.gz = gz;
+    data.imu_version = cached_data.version() + 1; // This write
+    cached_data.endWrite();
+    notifyDataWaiters();
+
+    // Only format what subscribed clients need now
+    uint8_t want = wantedFormats(WS_TOPIC_IMU);
+    if (want & WS_WANT_JSON)
+    {
+        char buf[160];
+        int64_t t0 = esp_timer_get_time();
+        JsonWriter json(buf, sizeof(buf));
+        json.beginObject();
+        json.field("type", "imu");
+        json.field("ax", ax);
+        json.field("ay", ay);
+        json.field("az", az);
+        json.field("gx", gx);
+        json.field("gy", gy);
+        json.field("gz", gz);
+        json.endObject();
+        imu_stats.json.encode_us += esp_timer_get_time() - t0;
+        imu_stats.json.messages++;
+        sendToClients(WS_TOPIC_IMU, json.c_str(), nullptr, 0, &imu_stats);
+    }
+    if (want & WS_WANT_BINARY)
+    {
+        const float sample[6] = {ax, ay, az, gx, gy, gz};
+        batchSample(imu_batch, sample, imu_stats);
+    }
 }
 
-void WebServer::broadcastButtonPress(bool b1, bool b2, bool b3, bool b4)
+void WebServer::broadcastSpell(const char *spell_name, float confidence)
 {
-    if (!running)
+    if (!running || !spell_name)
         return;
 
-    char json[128];
-    snprintf(json, sizeof(json),
-             "{\"type\":\"button_press\",\"b1\":%s,\"b2\":%s,\"b3\":%s,\"b4\":%s}",
-             b1 ? "true" : "false",
-             b2 ? "true" : "false",
-             b3 ? "true" : "false",
-             b4 ? "true" : "false");
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+    CachedData &data = cached_data.beginWrite();
+    copy_cached_string(data.spell, sizeof(data.spell), spell_name);
+    data.confidence = confidence;
+    data.spell_version = cached_data.version() + 1; // This write
+    cached_data.endWrite();
+    notifyDataWaiters();
+
+    if (!wantedFormats(WS_TOPIC_SPELL))
+        return; // No subscriber
+
+    char buf[160];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("type", "spell");
+    json.field("spell", spell_name);
+    json.field("confidence", confidence);
+    json.endObject();
+
+    sendToClients(WS_TOPIC_SPELL, json.c_str());
 }
 
-void WebServer::broadcastScanResult(const char *address, const char *name, int rssi)
+void WebServer::broadcastBattery(uint8_t level)
 {
-    if (!running || !address || !name)
+    if (!running)
+        return;
+
+    CachedData &data = cached_data.beginWrite();
+    data.battery = level;
+    data.battery_version = cached_data.version() + 1;
+    cached_data.endWrite();
+    notifyDataWaiters();
+
+    if (!wantedFormats(WS_TOPIC_BATTERY))
         return;
 
-    char sanitized_name[64];
-    char sanitized_address[24];
-    sanitize_for_json(sanitized_name, name, sizeof(sanitized_name));
-    sanitize_for_json(sanitized_address, address, sizeof(sanitized_address));
+    char buf[64];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("type", "battery");
+    json.field("level", level);
+    json.endObject();
 
-    char json[256];
-    snprintf(json, sizeof(json),
-             "{\"type\":\"scan_result\",\"address\":\"%s\",\"name\":\"%s\",\"rssi\":%d}",
-             sanitized_address, sanitized_name, rssi);
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
+    sendToClients(WS_TOPIC_BATTERY, json.c_str());
 }
 
-void WebServer::broadcastScanComplete()
+void WebServer::broadcastWandStatus(bool connected)
 {
     if (!running)
         return;
 
-    const char *json = "{\"type\":\"scan_complete\"}";
-    broadcast_to_clients(server, ws_clients, &ws_client_count, client_mutex, json);
-    ESP_LOGI(TAG, "Scan complete broadcast");
-}
+    // Update cached status
+    CachedData &data = cached_data.beginWrite();
+    data.wand_connected = connected;
+    data.status_version = cached_data.version() + 1;
+    cached_data.endWrite();
+    notifyDataWaiters();
 
-// Global pointer to access BLE client from HTTP handlers
-static class WandBLEClient *g_wand_client = nullptr;
+    char buf[64];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("type", "wand_status");
+    json.field("connected", connected);
+    json.endObject();
 
-void WebServer::setWandClient(WandBLEClient *client)
+    if (!connected)
+    {
+        flushBatch(imu_batch, imu_stats); // Stream stopped; don't leave samples waiting
+    }
+    sendToClients(WS_TOPIC_STATUS, json.c_str());
+}
+
+void WebServer::broadcastGestureStart()
 {
-    g_wand_client = client;
+    if (!running)
+        return;
+
+    ESP_LOGI(TAG, "Broadcasting gesture_start to %d clients", ws_client_count);
+    flushBatch(gesture_batch, gesture_stats);
+    const char *json = "{\"type\":\"gesture_start\"}";
+    sendToClients(WS_TOPIC_GESTURE, json);
+
+    // First point of the gesture goes out without waiting for the window
+    if (xSemaphoreTake(batch_mutex, pdMS_TO_TICKS(10)) == pdTRUE)
+    {
+        gesture_batch.flush_next = true;
+        xSemaphoreGive(batch_mutex);
+    }
 }
 
-esp_err_t WebServer::scan_handler(httpd_req_t *req)
+void WebServer::broadcastGesturePoint(float x, float y)
 {
-    if (!g_wand_client)
+    if (!running)
     {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
-        return ESP_FAIL;
+        return;
     }
 
-    // Stop any ongoing scan first
-    g_wand_client->stopScan();
+    uint8_t want = wantedFormats(WS_TOPIC_GESTURE_POINTS);
+    if (want & WS_WANT_JSON)
+    {
+        char buf[96];
+        int64_t t0 = esp_timer_get_time();
+        // Flip both axes to match wand movement direction with screen display
+        // (wand right = screen right, wand down = screen down)
+        JsonWriter json(buf, sizeof(buf));
+        json.beginObject();
+        json.field("type", "gesture_point");
+        json.field("x", x, 4);
+        json.field("y", -y, 4);
+        json.endObject();
+        gesture_stats.json.encode_us += esp_timer_get_time() - t0;
+        gesture_stats.json.messages++;
+        sendToClients(WS_TOPIC_GESTURE_POINTS, json.c_str(), nullptr, 0, &gesture_stats);
+    }
+    if (want & WS_WANT_BINARY)
+    {
+        const float point[2] = {x, y};
+        batchSample(gesture_batch, point, gesture_stats);
+    }
+}
 
-    // Disconnect wand before scanning (if connected)
-    if (g_wand_client->isConnected())
+void WebServer::batchSample(StreamBatch &batch, const float *sample, WsStreamStats &stats)
+{
+    if (xSemaphoreTake(batch_mutex, pdMS_TO_TICKS(10)) != pdTRUE)
     {
-        ESP_LOGI(TAG, "Disconnecting wand before scan");
-        g_wand_client->setUserDisconnectRequested(true);
-        g_wand_client->disconnect();
-        // Give BLE stack time to process disconnect
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        stats.batch_dropped++;
+        return;
     }
 
-    // Start BLE scan for 10 seconds
-    bool success = g_wand_client->startScan(10);
+    // Still full when the last flush couldn't take batch_mutex: drop this sample and retry the flush
+    bool full = batch.count >= WS_BATCH_MAX_SAMPLES;
+    if (full)
+    {
+        batch.skipped++;
+        stats.batch_dropped++;
+    }
+    else
+    {
+        int64_t now = esp_timer_get_time();
+        if (batch.count == 0)
+        {
+            batch.first_us = now;
+        }
+        memcpy(&batch.samples[batch.count * batch.stride], sample, batch.stride * sizeof(float));
+        batch.count++;
+        batch.arrival_sum_us += now;
+        stats.binary.messages++;
 
-    const char *response = success ? "{\"status\":\"scanning\",\"duration\":10}" : "{\"status\":\"error\",\"message\":\"Cannot scan (already connected or scanning)\"}";
+        // Window measured from the oldest sample; the newest one waits at most one sample period
+        full = batch.flush_next || batch.count >= WS_BATCH_MAX_SAMPLES ||
+               now - batch.first_us >= (int64_t)WS_BATCH_WINDOW_MS * 1000;
+        batch.flush_next = false;
+    }
+    xSemaphoreGive(batch_mutex);
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, response);
-    return ESP_OK;
+    if (full)
+    {
+        flushBatch(batch, stats);
+    }
 }
 
-esp_err_t WebServer::set_mac_handler(httpd_req_t *req)
+void WebServer::flushBatch(StreamBatch &batch, WsStreamStats &stats)
 {
-    char content[128];
-    int ret = httpd_req_recv(req, content, sizeof(content) - 1);
-    if (ret <= 0)
+    uint8_t frame[sizeof(WsFrameHeader) + WS_BATCH_MAX_SAMPLES * WS_IMU_SAMPLE_SIZE];
+    size_t frame_len = 0;
+
+    if (xSemaphoreTake(batch_mutex, pdMS_TO_TICKS(10)) != pdTRUE)
     {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
-        return ESP_FAIL;
+        return;
     }
-    content[ret] = '\0';
-
-    // Parse JSON: {"mac":"XX:XX:XX:XX:XX:XX"}
-    char mac[18] = {0};
-    char *mac_start = strstr(content, "\"mac\":\"");
-    if (mac_start)
+    if (batch.count > 0)
     {
-        mac_start += 7; // Skip "mac":"
-        char *mac_end = strchr(mac_start, '"');
-        if (mac_end && (mac_end - mac_start) == 17) // MAC address is 17 chars
+        int64_t now = esp_timer_get_time();
+        frame_len = batch.type == WS_MSG_IMU
+                        ? ws_encode_imu(frame, sizeof(frame), batch.next_sequence, batch.samples, batch.count)
+                        : ws_encode_gesture_points(frame, sizeof(frame), batch.next_sequence, batch.samples, batch.count);
+        int64_t done = esp_timer_get_time();
+        stats.binary.encode_us += done - now;
+        stats.batch_wait_us += (uint64_t)(now * (int64_t)batch.count - batch.arrival_sum_us);
+        if (now - batch.first_us > (int64_t)stats.batch_wait_max_us)
         {
-            strncpy(mac, mac_start, 17);
-            mac[17] = '\0';
+            stats.batch_wait_max_us = (uint32_t)(now - batch.first_us);
+        }
+        batch.next_sequence += (uint16_t)(batch.count + batch.skipped);
+        batch.count = 0;
+        batch.skipped = 0;
+        batch.arrival_sum_us = 0;
+    }
+    xSemaphoreGive(batch_mutex);
 
-            // Check if MAC changed
-            char old_mac[18] = {0};
-            bool mac_changed = false;
+    if (frame_len > 0)
+    {
+        sendToClients(batch.type == WS_MSG_IMU ? WS_TOPIC_IMU : WS_TOPIC_GESTURE_POINTS,
+                      nullptr, frame, frame_len, &stats);
+    }
+}
 
-            nvs_handle_t nvs_handle_read;
-            esp_err_t err_read = nvs_open("storage", NVS_READONLY, &nvs_handle_read);
-            if (err_read == ESP_OK)
+void WebServer::broadcastGestureEnd()
+{
+    if (!running)
+        return;
+
+    ESP_LOGI(TAG, "Broadcasting gesture_end to %d clients", ws_client_count);
+    flushBatch(gesture_batch, gesture_stats); // Last points before the end marker
+    const char *json = "{\"type\":\"gesture_end\"}";
+    sendToClients(WS_TOPIC_GESTURE, json);
+}
+
+// Shared frame: header and payload in one allocation
+static WsMessage *create_message(WsTopic topic, bool binary, const void *data, size_t len, WsStreamStats *stats)
+{
+    WsMessage *msg = (WsMessage *)malloc(sizeof(WsMessage) + len);
+    if (!msg)
+    {
+        return nullptr;
+    }
+    msg->refs = 0;
+    msg->topic = topic;
+    msg->binary = binary;
+    msg->stats = stats;
+    msg->queued_us = esp_timer_get_time();
+    msg->len = len;
+    msg->data = (uint8_t *)(msg + 1);
+    memcpy(msg->data, data, len);
+    return msg;
+}
+
+// Stream data that a full queue may lose; events (spells, gesture start/end, status) never are
+static bool is_droppable(WsTopic topic)
+{
+    return topic == WS_TOPIC_IMU || topic == WS_TOPIC_GESTURE_POINTS || topic == WS_TOPIC_BUTTON;
+}
+
+void WebServer::releaseMessage(WsMessage *msg)
+{
+    if (msg && --msg->refs == 0)
+    {
+        free(msg);
+    }
+}
+
+void WebServer::sendToClients(WsTopic topic, const char *json, const uint8_t *frame, size_t frame_len,
+                              WsStreamStats *stats)
+{
+    if (!server)
+    {
+        return;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    WsMessage *text_msg = nullptr;
+    WsMessage *binary_msg = nullptr;
+    int json_frames = 0;
+    int binary_frames = 0;
+
+    if (xSemaphoreTake(client_mutex, pdMS_TO_TICKS(10)) == pdTRUE)
+    {
+        for (int i = 0; i < ws_client_count; i++)
+        {
+            WsClient &client = ws_clients[i];
+            bool binary = client.binary && frame;
+            if (!binary && !json)
             {
-                size_t old_mac_len = sizeof(old_mac);
-                if (nvs_get_str(nvs_handle_read, "wand_mac", old_mac, &old_mac_len) == ESP_OK)
-                {
-                    mac_changed = (strcmp(old_mac, mac) != 0);
-                    ESP_LOGI(TAG, "MAC change detected: old=%s, new=%s", old_mac, mac);
-                }
-                else
-                {
-                    ESP_LOGI(TAG, "No previous MAC stored, first time setup");
-                }
-                nvs_close(nvs_handle_read);
+                continue; // Switched format after the payloads were built
             }
-
-            // Store in NVS
-            nvs_handle_t nvs_handle;
-            esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-            if (err == ESP_OK)
+            if (!(client.topics & (1u << topic)))
             {
-                err = nvs_set_str(nvs_handle, "wand_mac", mac);
-                if (err == ESP_OK)
-                {
-                    nvs_commit(nvs_handle);
-                    ESP_LOGI(TAG, "Stored wand MAC: %s", mac);
-
-                    // If MAC changed, disconnect current wand and wait longer
-                    if (mac_changed && g_wand_client && g_wand_client->isConnected())
-                    {
-                        ESP_LOGI(TAG, "MAC changed, disconnecting current wand");
-                        g_wand_client->setUserDisconnectRequested(true);
-                        g_wand_client->disconnect();
-                        // Wait longer to ensure clean disconnect before connecting to new wand
-                        vTaskDelay(pdMS_TO_TICKS(2000));
-                    }
+                continue;
+            }
+            if (client.max_hz[topic] && t0 - client.last_us[topic] < 1000000 / client.max_hz[topic])
+            {
+                client.stats.decimated++;
+                continue;
+            }
 
-                    httpd_resp_set_type(req, "application/json");
-                    httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"MAC address saved\"}");
-                }
-                else
+            // Formatted once, shared by every client of that format
+            WsMessage *&msg = binary ? binary_msg : text_msg;
+            if (!msg)
+            {
+                msg = binary ? create_message(topic, true, frame, frame_len, stats)
+                             : create_message(topic, false, json, strlen(json), stats);
+                if (!msg)
                 {
-                    ESP_LOGE(TAG, "Failed to save MAC: %d", err);
-                    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save");
+                    ESP_LOGW(TAG, "WebSocket message allocation failed");
+                    break;
                 }
-                nvs_close(nvs_handle);
+                msg->refs = 1; // Held by this function until every client has it
             }
-            else
+
+            if (enqueue(client, msg))
             {
-                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "NVS error");
+                (binary ? binary_frames : json_frames)++;
+                client.last_us[topic] = t0;
+            }
+            else if (!is_droppable(topic))
+            {
+                // Queue full of messages that can't be dropped either: the client is stalled
+                ESP_LOGW(TAG, "WebSocket client fd=%d stalled (%d queued), closing", client.fd, client.depth);
+                httpd_sess_trigger_close(server, client.fd);
+                removeClientAt(i);
+                i--;
             }
-            return err == ESP_OK ? ESP_OK : ESP_FAIL;
         }
+        releaseMessage(text_msg);
+        releaseMessage(binary_msg);
+        xSemaphoreGive(client_mutex);
     }
 
-    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid MAC format");
-    return ESP_FAIL;
+    if (stats)
+    {
+        int64_t elapsed = esp_timer_get_time() - t0;
+        if (json_frames)
+        {
+            stats->json.frames += json_frames;
+            stats->json.bytes += (uint64_t)json_frames * strlen(json);
+            stats->json.queue_us += binary_frames ? elapsed / 2 : elapsed;
+        }
+        if (binary_frames)
+        {
+            stats->binary.frames += binary_frames;
+            stats->binary.bytes += (uint64_t)binary_frames * frame_len;
+            stats->binary.queue_us += json_frames ? elapsed / 2 : elapsed;
+        }
+    }
+    if (json_frames || binary_frames)
+    {
+        if (sender_task)
+        {
+            xTaskNotifyGive(sender_task);
+        }
+        else
+        {
+            drainQueues(); // No sender task: send on the caller's thread as before
+        }
+    }
 }
 
-esp_err_t WebServer::get_stored_mac_handler(httpd_req_t *req)
+// Queue a message for one client (client_mutex held). Full queue:
+//  - IMU: replaces the newest queued IMU message (latest wins)
+//  - gesture points, buttons: dropped
+//  - everything else evicts the oldest droppable message; false if there is none
+bool WebServer::enqueue(WsClient &client, WsMessage *msg)
 {
-    char mac[18] = {0};
-    nvs_handle_t nvs_handle;
-
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
-    if (err == ESP_OK)
+    if (client.depth >= WS_CLIENT_QUEUE_LEN)
     {
-        size_t mac_len = sizeof(mac);
-        err = nvs_get_str(nvs_handle, "wand_mac", mac, &mac_len);
-        nvs_close(nvs_handle);
+        // Only when full: each IMU message is a whole batch, so replacing one that merely
+        // waits its turn would lose a frame
+        for (int k = client.depth - 1; k >= 0 && msg->topic == WS_TOPIC_IMU; k--)
+        {
+            WsMessage *&queued = client.queue[(client.head + k) % WS_CLIENT_QUEUE_LEN];
+            if (queued->topic == WS_TOPIC_IMU)
+            {
+                releaseMessage(queued);
+                queued = msg;
+                msg->refs++;
+                client.stats.replaced++;
+                return true;
+            }
+        }
 
-        if (err == ESP_OK && mac[0] != '\0')
+        if (is_droppable(msg->topic))
         {
-            char response[128];
-            snprintf(response, sizeof(response), "{\"status\":\"success\",\"mac\":\"%s\"}", mac);
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_sendstr(req, response);
-            return ESP_OK;
+            client.stats.dropped++;
+            return false;
+        }
+
+        int victim = -1;
+        for (int k = 0; k < client.depth && victim < 0; k++)
+        {
+            if (is_droppable(client.queue[(client.head + k) % WS_CLIENT_QUEUE_LEN]->topic))
+            {
+                victim = k;
+            }
+        }
+        if (victim < 0)
+        {
+            return false;
         }
+        releaseMessage(client.queue[(client.head + victim) % WS_CLIENT_QUEUE_LEN]);
+        for (int k = victim; k < client.depth - 1; k++)
+        {
+            client.queue[(client.head + k) % WS_CLIENT_QUEUE_LEN] = client.queue[(client.head + k + 1) % WS_CLIENT_QUEUE_LEN];
+        }
+        client.depth--;
+        client.stats.dropped++;
     }
 
-    // No MAC stored
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"status\":\"not_found\",\"mac\":\"\"}");
-    return ESP_OK;
+    client.queue[(client.head + client.depth) % WS_CLIENT_QUEUE_LEN] = msg;
+    client.depth++;
+    msg->refs++;
+    client.stats.queued++;
+    if (client.depth > client.stats.max_depth)
+    {
+        client.stats.max_depth = client.depth;
+    }
+    return true;
 }
 
-esp_err_t WebServer::connect_handler(httpd_req_t *req)
+void WebServer::senderTaskFunc(void *arg)
 {
-    if (!g_wand_client)
+    WebServer *self = (WebServer *)arg;
+    for (;;)
     {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
-        return ESP_FAIL;
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        self->drainQueues();
     }
+}
 
-    // Read stored MAC from NVS
-    char mac[18] = {0};
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
-    if (err == ESP_OK)
+// Send one message per client per pass until every queue is empty
+void WebServer::drainQueues()
+{
+    bool pending = true;
+    while (pending)
     {
-        size_t mac_len = sizeof(mac);
-        err = nvs_get_str(nvs_handle, "wand_mac", mac, &mac_len);
-        nvs_close(nvs_handle);
-
-        if (err == ESP_OK && mac[0] != '\0')
+        pending = false;
+        int fds[WS_MAX_CLIENTS];
+        int count = 0;
+        if (xSemaphoreTake(client_mutex, portMAX_DELAY) == pdTRUE)
         {
-            ESP_LOGI(TAG, "Attempting connection to stored MAC: %s", mac);
-
-            // Disconnect if already connected
-            if (g_wand_client->isConnected())
+            for (int i = 0; i < ws_client_count; i++)
             {
-                g_wand_client->disconnect();
-                vTaskDelay(pdMS_TO_TICKS(1000));
+                fds[count++] = ws_clients[i].fd;
             }
+            xSemaphoreGive(client_mutex);
+        }
 
-            // Reset user disconnect flag - user is explicitly requesting connection
-            g_wand_client->setUserDisconnectRequested(false);
+        for (int n = 0; n < count; n++)
+        {
+            WsMessage *msg = nullptr;
+            if (xSemaphoreTake(client_mutex, portMAX_DELAY) == pdTRUE)
+            {
+                int i = findClient(fds[n]);
+                if (i >= 0 && ws_clients[i].depth > 0)
+                {
+                    // The popped reference is held while the frame is in flight
+                    WsClient &client = ws_clients[i];
+                    msg = client.queue[client.head];
+                    client.head = (client.head + 1) % WS_CLIENT_QUEUE_LEN;
+                    client.depth--;
+                }
+                xSemaphoreGive(client_mutex);
+            }
+            if (!msg)
+            {
+                continue;
+            }
 
-            // Mark that initialization is needed after this connection
-            g_wand_client->setNeedsInitialization(true);
+            httpd_ws_frame_t ws_pkt;
+            memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+            ws_pkt.payload = msg->data;
+            ws_pkt.len = msg->len;
+            ws_pkt.type = msg->binary ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT;
 
-            // Try to connect
-            bool success = g_wand_client->connect(mac);
+            int64_t t0 = esp_timer_get_time();
+            esp_err_t ret = server ? httpd_ws_send_frame_async(server, fds[n], &ws_pkt) : ESP_FAIL;
+            int64_t done = esp_timer_get_time();
 
-            if (success)
-            {
-                httpd_resp_set_type(req, "application/json");
-                httpd_resp_sendstr(req, "{\"status\":\"connecting\",\"message\":\"Connection initiated\"}");
-                return ESP_OK;
-            }
-            else
+            if (xSemaphoreTake(client_mutex, portMAX_DELAY) == pdTRUE)
             {
-                httpd_resp_set_type(req, "application/json");
-                httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Connection failed\"}");
-                return ESP_FAIL;
+                if (msg->stats)
+                {
+                    (msg->binary ? msg->stats->binary : msg->stats->json).send_us += done - t0;
+                }
+                int i = findClient(fds[n]);
+                if (i >= 0 && ret != ESP_OK)
+                {
+                    ESP_LOGW(TAG, "WebSocket send failed for fd=%d (error=%s), removing client",
+                             fds[n], esp_err_to_name(ret));
+                    removeClientAt(i);
+                }
+                else if (i >= 0)
+                {
+                    WsClientStats &stats = ws_clients[i].stats;
+                    uint32_t send_us = (uint32_t)(done - t0);
+                    uint32_t latency_us = (uint32_t)(done - msg->queued_us);
+                    stats.sent++;
+                    stats.send_us += send_us;
+                    stats.latency_us += latency_us;
+                    if (send_us > stats.send_max_us)
+                        stats.send_max_us = send_us;
+                    if (latency_us > stats.latency_max_us)
+                        stats.latency_max_us = latency_us;
+                    pending = pending || ws_clients[i].depth > 0;
+                }
+                releaseMessage(msg);
+                xSemaphoreGive(client_mutex);
             }
         }
     }
-
-    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No stored MAC address");
-    return ESP_FAIL;
 }
 
-esp_err_t WebServer::disconnect_handler(httpd_req_t *req)
+uint8_t WebServer::wantedFormats(WsTopic topic)
 {
-    ESP_LOGI(TAG, "disconnect_handler called!");
+    uint8_t want = 0;
+    bool stream = topic == WS_TOPIC_IMU || topic == WS_TOPIC_GESTURE_POINTS;
+    int64_t now = esp_timer_get_time();
 
-    if (!g_wand_client)
+    if (xSemaphoreTake(client_mutex, pdMS_TO_TICKS(10)) == pdTRUE)
     {
-        ESP_LOGE(TAG, "BLE client not initialized (g_wand_client is NULL)");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
-        return ESP_FAIL;
+        for (int i = 0; i < ws_client_count; i++)
+        {
+            const WsClient &client = ws_clients[i];
+            if (!(client.topics & (1u << topic)))
+            {
+                continue;
+            }
+            if (stream && client.binary)
+            {
+                want |= WS_WANT_BINARY;
+            }
+            else if (!client.max_hz[topic] || now - client.last_us[topic] >= 1000000 / client.max_hz[topic])
+            {
+                want |= WS_WANT_JSON; // Events are JSON for every client
+            }
+        }
+        xSemaphoreGive(client_mutex);
     }
 
-    ESP_LOGI(TAG, "Wand connected status: %d", g_wand_client->isConnected());
-
-    if (g_wand_client->isConnected())
+    if (want)
     {
-        g_wand_client->setUserDisconnectRequested(true);
-        g_wand_client->disconnect();
-        ESP_LOGI(TAG, "User-initiated disconnect via web interface - auto-reconnect disabled");
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"status\":\"disconnected\"}");
+        topic_stats[topic].formatted++;
     }
     else
     {
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"status\":\"not_connected\"}");
+        topic_stats[topic].skipped++;
     }
-
-    return ESP_OK;
+    return want;
 }
 
-esp_err_t WebServer::settings_get_handler(httpd_req_t *req)
+int WebServer::findClient(int fd) const
 {
-    ESP_LOGI(TAG, "settings_get_handler called!");
-
-    // Return mouse sensitivity and all 73 spell keycodes
-#if USE_USB_HID_DEVICE
-    // Allocate buffer on heap to avoid stack overflow
-    char *buffer = (char *)malloc(4096);
-    if (!buffer)
+    for (int i = 0; i < ws_client_count; i++)
     {
-        ESP_LOGE(TAG, "Failed to allocate buffer for settings response");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Memory allocation failed");
-        return ESP_FAIL;
+        if (ws_clients[i].fd == fd)
+        {
+            return i;
+        }
     }
+    return -1;
+}
 
-    int offset = 0;
-    size_t buffer_size = 4096;
-
-    float mouse_sens = usbHID.getMouseSensitivity();
-    bool mouse_invert = usbHID.getInvertMouseY();
-    HIDMode hid_mode = usbHID.getHidMode();
-    float gamepad_sens = usbHID.getGamepadSensitivity();
-    float gamepad_deadzone = usbHID.getGamepadDeadzone();
-    bool gamepad_invert = usbHID.getGamepadInvertY();
-
-    ESP_LOGI(TAG, "📤 Sending settings to UI:");
-    ESP_LOGI(TAG, "   mouse_sensitivity=%.2f, invert_mouse_y=%s", mouse_sens, mouse_invert ? "true" : "false");
-    ESP_LOGI(TAG, "   hid_mode=%u", static_cast<unsigned>(hid_mode));
-    ESP_LOGI(TAG, "   gamepad_sensitivity=%.2f, gamepad_deadzone=%.2f, gamepad_invert_y=%s",
-             gamepad_sens, gamepad_deadzone, gamepad_invert ? "true" : "false");
-
-    offset += snprintf(buffer + offset, buffer_size - offset,
-                       "{\"mouse_sensitivity\": %.2f, \"invert_mouse_y\": %s, \"hid_mode\": %u, \"gamepad_sensitivity\": %.2f, \"gamepad_deadzone\": %.2f, \"gamepad_invert_y\": %s, \"spells\": [",
-                       mouse_sens,
-                       mouse_invert ? "true" : "false",
-                       static_cast<unsigned>(hid_mode),
-                       gamepad_sens,
-                       gamepad_deadzone,
-                       gamepad_invert ? "true" : "false");
-
-    const uint8_t *spell_keycodes = usbHID.getSpellKeycodes();
-    for (int i = 0; i < 73; i++)
+// client_mutex held
+void WebServer::removeClientAt(int index)
+{
+    WsClient &client = ws_clients[index];
+    if (client.binary)
     {
-        offset += snprintf(buffer + offset, buffer_size - offset, "%d%s",
-                           spell_keycodes[i],
-                           i < 72 ? "," : "");
+        ws_binary_client_count--;
     }
+    for (int k = 0; k < client.depth; k++)
+    {
+        releaseMessage(client.queue[(client.head + k) % WS_CLIENT_QUEUE_LEN]);
+    }
+    for (int j = index; j < ws_client_count - 1; j++)
+    {
+        ws_clients[j] = ws_clients[j + 1];
+    }
+    ws_client_count--;
+}
 
-    // Add HA MQTT setting
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
-    bool ha_mqtt_enabled = true; // Default: enabled
-    char mqtt_broker[128] = {0};
-    char mqtt_username[64] = {0};
-    char mqtt_password[64] = {0};
-
-    if (err == ESP_OK)
+void WebServer::addWebSocketClient(int fd)
+{
+    if (xSemaphoreTake(client_mutex, pdMS_TO_TICKS(100)) == pdTRUE)
     {
-        uint8_t ha_mqtt_u8 = 1;
-        nvs_get_u8(nvs_handle, "ha_mqtt_enabled", &ha_mqtt_u8);
-        ha_mqtt_enabled = (ha_mqtt_u8 != 0);
-
-        size_t required_size;
-        err = nvs_get_str(nvs_handle, "mqtt_broker", NULL, &required_size);
-        if (err == ESP_OK && required_size <= sizeof(mqtt_broker))
-        {
-            nvs_get_str(nvs_handle, "mqtt_broker", mqtt_broker, &required_size);
-        }
-
-        err = nvs_get_str(nvs_handle, "mqtt_username", NULL, &required_size);
-        if (err == ESP_OK && required_size <= sizeof(mqtt_username))
+        // A socket number reused by a new connection replaces the stale entry
+        int stale = findClient(fd);
+        if (stale >= 0)
         {
-            nvs_get_str(nvs_handle, "mqtt_username", mqtt_username, &required_size);
+            removeClientAt(stale);
         }
 
-        err = nvs_get_str(nvs_handle, "mqtt_password", NULL, &required_size);
-        if (err == ESP_OK && required_size <= sizeof(mqtt_password))
+        if (ws_client_count >= WS_MAX_CLIENTS)
         {
-            nvs_get_str(nvs_handle, "mqtt_password", mqtt_password, &required_size);
+            ESP_LOGW(TAG, "Max WebSocket clients reached, rejecting connection");
+            xSemaphoreGive(client_mutex);
+            return;
         }
 
-        nvs_close(nvs_handle);
+        // New connections start on JSON until they ask for binary frames
+        WsClient &client = ws_clients[ws_client_count++];
+        memset(&client, 0, sizeof(client));
+        client.fd = fd;
+        client.topics = WS_TOPICS_ALL; // Clients that never subscribe get everything
+        ESP_LOGI(TAG, "WebSocket client added (total: %d)", ws_client_count);
+        xSemaphoreGive(client_mutex);
     }
+}
 
-    // Fall back to config.h defaults if NVS is empty (same logic as main.cpp)
-    if (strlen(mqtt_broker) == 0)
-    {
-        snprintf(mqtt_broker, sizeof(mqtt_broker), "mqtt://%s:%d", MQTT_SERVER, MQTT_PORT);
-        ESP_LOGI(TAG, "MQTT broker not in NVS, using config.h default: %s", mqtt_broker);
-    }
-    else
+void WebServer::removeWebSocketClient(int fd)
+{
+    if (xSemaphoreTake(client_mutex, pdMS_TO_TICKS(100)) == pdTRUE)
     {
-        ESP_LOGI(TAG, "MQTT broker loaded from NVS: %s", mqtt_broker);
+        int i = findClient(fd);
+        if (i >= 0)
+        {
+            removeClientAt(i);
+            ESP_LOGI(TAG, "WebSocket client removed (total: %d)", ws_client_count);
+        }
+        xSemaphoreGive(client_mutex);
     }
+}
 
-    if (strlen(mqtt_username) == 0)
-    {
-        strncpy(mqtt_username, MQTT_USER, sizeof(mqtt_username) - 1);
-        ESP_LOGI(TAG, "MQTT username not in NVS, using config.h default: %s", mqtt_username);
-    }
-    else
-    {
-        ESP_LOGI(TAG, "MQTT username loaded from NVS: %s", mqtt_username);
-    }
+// topics: comma-separated names, each optionally ":<max messages/s>" ("spell,gesture,imu:10")
+void WebServer::setWebSocketClientTopics(int fd, const char *topics)
+{
+    uint16_t mask = 0;
+    uint16_t max_hz[WS_TOPIC_COUNT] = {0};
 
-    if (strlen(mqtt_password) == 0)
+    const char *p = topics;
+    while (*p && *p != '"')
     {
-        strncpy(mqtt_password, MQTT_PASSWORD, sizeof(mqtt_password) - 1);
-        ESP_LOGI(TAG, "MQTT password not in NVS, using config.h default");
+        size_t len = strcspn(p, ":,\"");
+        for (int t = 0; t < WS_TOPIC_COUNT; t++)
+        {
+            if (strlen(WS_TOPIC_NAMES[t]) == len && strncmp(p, WS_TOPIC_NAMES[t], len) == 0)
+            {
+                mask |= 1u << t;
+                max_hz[t] = p[len] == ':' ? (uint16_t)atoi(p + len + 1) : 0;
+                break;
+            }
+        }
+        p += strcspn(p, ",\"");
+        if (*p == ',')
+        {
+            p++;
+        }
     }
-    else
+
+    if (xSemaphoreTake(client_mutex, pdMS_TO_TICKS(100)) == pdTRUE)
     {
-        ESP_LOGI(TAG, "MQTT password loaded from NVS");
+        int i = findClient(fd);
+        if (i >= 0)
+        {
+            ws_clients[i].topics = mask;
+            memcpy(ws_clients[i].max_hz, max_hz, sizeof(max_hz));
+            ESP_LOGI(TAG, "WebSocket client fd=%d subscribed to 0x%02x", fd, mask);
+        }
+        xSemaphoreGive(client_mutex);
     }
+}
 
-    const uint8_t *gamepad_buttons = usbHID.getSpellGamepadButtons();
-    offset += snprintf(buffer + offset, buffer_size - offset, "], \"gamepad_spells\": [");
-    for (int i = 0; i < 73; i++)
+void WebServer::setWebSocketClientBinary(int fd, bool binary)
+{
+    if (xSemaphoreTake(client_mutex, pdMS_TO_TICKS(100)) == pdTRUE)
     {
-        offset += snprintf(buffer + offset, buffer_size - offset, "%d%s",
-                           gamepad_buttons[i],
-                           i < 72 ? "," : "");
+        int i = findClient(fd);
+        if (i >= 0 && ws_clients[i].binary != binary)
+        {
+            ws_clients[i].binary = binary;
+            ws_binary_client_count += binary ? 1 : -1;
+            ESP_LOGI(TAG, "WebSocket client fd=%d uses %s stream frames", fd, binary ? "binary" : "JSON");
+        }
+        xSemaphoreGive(client_mutex);
     }
+}
 
-    offset += snprintf(buffer + offset, buffer_size - offset,
-                       "], \"ha_mqtt_enabled\": %s, \"mqtt_broker\": \"%s\", \"mqtt_username\": \"%s\", \"mqtt_password\": \"%s\"}",
-                       ha_mqtt_enabled ? "true" : "false",
-                       mqtt_broker,
-                       mqtt_username,
-                       mqtt_password);
+void WebServer::broadcastLowConfidence(const char *spell_name, float confidence)
+{
+    if (!running || !spell_name)
+        return;
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, buffer);
-    free(buffer);
-#else
-    // USB HID disabled, but still return MQTT settings
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
-    bool ha_mqtt_enabled = true;
-    char mqtt_broker[128] = {0};
-    char mqtt_username[64] = {0};
-    char mqtt_password[64] = {0};
+    char buf[160];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("type", "low_confidence");
+    json.field("spell", spell_name);
+    json.field("confidence", confidence, 4);
+    json.endObject();
+    sendToClients(WS_TOPIC_SPELL, json.c_str());
 
-    if (err == ESP_OK)
-    {
-        uint8_t ha_mqtt_u8 = 1;
-        nvs_get_u8(nvs_handle, "ha_mqtt_enabled", &ha_mqtt_u8);
-        ha_mqtt_enabled = (ha_mqtt_u8 != 0);
+    ESP_LOGI(TAG, "Low confidence prediction: %s (%.2f%%)", spell_name, confidence * 100.0f);
+}
 
-        size_t required_size;
-        err = nvs_get_str(nvs_handle, "mqtt_broker", NULL, &required_size);
-        if (err == ESP_OK && required_size <= sizeof(mqtt_broker))
-        {
-            nvs_get_str(nvs_handle, "mqtt_broker", mqtt_broker, &required_size);
-        }
+void WebServer::broadcastWandInfo(const char *firmware_version, const char *serial_number,
+                                  const char *sku, const char *device_id, const char *wand_type)
+{
+    firmware_version = firmware_version ? firmware_version : "";
+    serial_number = serial_number ? serial_number : "";
+    sku = sku ? sku : "";
+    device_id = device_id ? device_id : "";
+    wand_type = wand_type ? wand_type : "";
+
+    // Cache the wand info for new clients (escaped when written out)
+    CachedData &data = cached_data.beginWrite();
+    copy_cached_string(data.firmware_version, sizeof(data.firmware_version), firmware_version);
+    copy_cached_string(data.serial_number, sizeof(data.serial_number), serial_number);
+    copy_cached_string(data.sku, sizeof(data.sku), sku);
+    copy_cached_string(data.device_id, sizeof(data.device_id), device_id);
+    copy_cached_string(data.wand_type, sizeof(data.wand_type), wand_type);
+    data.status_version = cached_data.version() + 1;
+    cached_data.endWrite();
+    notifyDataWaiters();
 
-        err = nvs_get_str(nvs_handle, "mqtt_username", NULL, &required_size);
-        if (err == ESP_OK && required_size <= sizeof(mqtt_username))
-        {
-            nvs_get_str(nvs_handle, "mqtt_username", mqtt_username, &required_size);
-        }
+    if (!running)
+        return;
 
-        err = nvs_get_str(nvs_handle, "mqtt_password", NULL, &required_size);
-        if (err == ESP_OK && required_size <= sizeof(mqtt_password))
-        {
-            nvs_get_str(nvs_handle, "mqtt_password", mqtt_password, &required_size);
-        }
+    char buf[512];
+    JsonWriter json(buf, sizeof(buf));
+    write_wand_info(json, firmware_version, serial_number, sku, device_id, wand_type);
+    sendToClients(WS_TOPIC_STATUS, json.c_str());
 
-        nvs_close(nvs_handle);
-    }
+    ESP_LOGI(TAG, "Wand info broadcast: FW=%s, Serial=%s, SKU=%s, DevID=%s, Type=%s",
+             firmware_version, serial_number, sku, device_id, wand_type);
+}
 
-    // Fall back to config.h defaults if NVS is empty
-    if (strlen(mqtt_broker) == 0)
-    {
-        snprintf(mqtt_broker, sizeof(mqtt_broker), "mqtt://%s:%d", MQTT_SERVER, MQTT_PORT);
-        ESP_LOGI(TAG, "MQTT broker not in NVS, using config.h default: %s", mqtt_broker);
-    }
-    else
-    {
-        ESP_LOGI(TAG, "MQTT broker loaded from NVS: %s", mqtt_broker);
-    }
+void WebServer::broadcastButtonPress(bool b1, bool b2, bool b3, bool b4)
+{
+    if (!running || !wantedFormats(WS_TOPIC_BUTTON))
+        return;
 
-    if (strlen(mqtt_username) == 0)
-    {
-        strncpy(mqtt_username, MQTT_USER, sizeof(mqtt_username) - 1);
-        ESP_LOGI(TAG, "MQTT username not in NVS, using config.h default: %s", mqtt_username);
-    }
-    else
-    {
-        ESP_LOGI(TAG, "MQTT username loaded from NVS: %s", mqtt_username);
-    }
+    char buf[96];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("type", "button_press");
+    json.field("b1", b1);
+    json.field("b2", b2);
+    json.field("b3", b3);
+    json.field("b4", b4);
+    json.endObject();
+    sendToClients(WS_TOPIC_BUTTON, json.c_str());
+}
 
-    if (strlen(mqtt_password) == 0)
-    {
-        strncpy(mqtt_password, MQTT_PASSWORD, sizeof(mqtt_password) - 1);
-        ESP_LOGI(TAG, "MQTT password not in NVS, using config.h default");
-    }
-    else
-    {
-        ESP_LOGI(TAG, "MQTT password loaded from NVS");
-    }
+void WebServer::broadcastScanResult(const char *address, const char *name, int rssi)
+{
+    if (!running || !address || !name)
+        return;
+    if (!wantedFormats(WS_TOPIC_SCAN))
+        return; // No subscriber
+
+    char buf[256];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("type", "scan_result");
+    json.field("address", address);
+    json.field("name", name, strnlen(name, 63)); // Advertised names are untrusted
+    json.field("rssi", rssi);
+    json.endObject();
+    sendToClients(WS_TOPIC_SCAN, json.c_str());
+}
 
-    char response[512];
-    snprintf(response, sizeof(response),
-             "{\"status\":\"usb_hid_disabled\","
-             "\"ha_mqtt_enabled\":%s,"
-             "\"mqtt_broker\":\"%s\","
-             "\"mqtt_username\":\"%s\","
-             "\"mqtt_password\":\"%s\"}",
-             ha_mqtt_enabled ? "true" : "false",
-             mqtt_broker,
-             mqtt_username,
-             mqtt_password);
+void WebServer::broadcastScanComplete()
+{
+    if (!running)
+        return;
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, response);
-#endif
-    return ESP_OK;
+    const char *json = "{\"type\":\"scan_complete\"}";
+    sendToClients(WS_TOPIC_SCAN, json);
+    ESP_LOGI(TAG, "Scan complete broadcast");
 }
 
-esp_err_t WebServer::settings_save_handler(httpd_req_t *req)
+void WebServer::broadcastCustomGestureRecorded(const char *name, bool stored)
 {
-    ESP_LOGI(TAG, "settings_save_handler called!");
+    if (!running || !wantedFormats(WS_TOPIC_SPELL))
+        return;
 
-    // Read the POST body
-    int content_len = req->content_len;
-    char *buffer = (char *)malloc(content_len + 1);
-    if (!buffer)
-    {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Allocation failed");
-        return ESP_FAIL;
-    }
+    char buf[128];
+    JsonWriter json(buf, sizeof(buf));
+    json.beginObject();
+    json.field("type", "custom_recorded");
+    json.field("name", name);
+    json.field("stored", stored);
+    json.endObject();
+    sendToClients(WS_TOPIC_SPELL, json.c_str());
+}
 
-    int read_len = httpd_req_recv(req, buffer, content_len);
-    if (read_len != content_len)
+// Global pointer to access BLE client from HTTP handlers
+static class WandBLEClient *g_wand_client = nullptr;
+
+void WebServer::setWandClient(WandBLEClient *client)
+{
+    g_wand_client = client;
+}
+
+esp_err_t WebServer::scan_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
     {
-        free(buffer);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to read request body");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
         return ESP_FAIL;
     }
 
-    buffer[content_len] = 0;
-    ESP_LOGI(TAG, "Received settings: %s", buffer);
+    // Stop any ongoing scan first
+    g_wand_client->stopScan();
 
-    // Parse JSON - expect format: {"mouse_sensitivity": 1.5, "spells": [0, 58, 0, ...]}
-#if USE_USB_HID_DEVICE
-    float mouse_sens = 1.0f;
-    char *mouse_ptr = strstr(buffer, "\"mouse_sensitivity\"");
-    if (mouse_ptr)
+    // Disconnect wand before scanning (if connected)
+    if (g_wand_client->isConnected())
     {
-        sscanf(mouse_ptr, "\"mouse_sensitivity\" : %f", &mouse_sens);
-        usbHID.setMouseSensitivityValue(mouse_sens);
+        ESP_LOGI(TAG, "Disconnecting wand before scan");
+        g_wand_client->setUserDisconnectRequested(true);
+        g_wand_client->disconnect();
+        // Give BLE stack time to process disconnect
+        vTaskDelay(pdMS_TO_TICKS(1000));
     }
 
-    // Parse invert_mouse_y
-    char *invert_ptr = strstr(buffer, "\"invert_mouse_y\"");
-    if (invert_ptr)
-    {
-        // Find the colon after the key, then check the value
-        char *value_ptr = strchr(invert_ptr, ':');
-        if (value_ptr)
-        {
-            value_ptr++; // Skip colon
-            while (*value_ptr == ' ' || *value_ptr == '\t')
-                value_ptr++; // Skip whitespace
-            bool invert = (strncmp(value_ptr, "true", 4) == 0);
-            ESP_LOGI(TAG, "🔍 Parsing invert_mouse_y: JSON substring='%.50s...', parsed_value=%s",
-                     invert_ptr, invert ? "true" : "false");
-            usbHID.setInvertMouseY(invert);
-            ESP_LOGI(TAG, "✅ Called setInvertMouseY(%s)", invert ? "true" : "false");
-        }
-    }
-    else
-    {
-        ESP_LOGW(TAG, "⚠️ invert_mouse_y not found in JSON!");
-    }
+    // Start BLE scan for 10 seconds
+    bool success = g_wand_client->startScan(10);
 
-    // Parse HID mode
-    char *hid_mode_ptr = strstr(buffer, "\"hid_mode\"");
-    if (hid_mode_ptr)
-    {
-        int hid_mode = HID_MODE_MOUSE;
-        sscanf(hid_mode_ptr, "\"hid_mode\" : %d", &hid_mode);
-        usbHID.setHidMode(static_cast<HIDMode>(hid_mode));
-    }
+    const char *response = success ? "{\"status\":\"scanning\",\"duration\":10}" : "{\"status\":\"error\",\"message\":\"Cannot scan (already connected or scanning)\"}";
 
-    // Parse gamepad sensitivity
-    char *gpad_sens_ptr = strstr(buffer, "\"gamepad_sensitivity\"");
-    if (gpad_sens_ptr)
-    {
-        float gpad_sens = 1.0f;
-        sscanf(gpad_sens_ptr, "\"gamepad_sensitivity\" : %f", &gpad_sens);
-        ESP_LOGI(TAG, "📝 Parsed gamepad_sensitivity: %.2f", gpad_sens);
-        usbHID.setGamepadSensitivityValue(gpad_sens);
-    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
 
-    // Parse gamepad deadzone
-    char *gpad_deadzone_ptr = strstr(buffer, "\"gamepad_deadzone\"");
-    if (gpad_deadzone_ptr)
+esp_err_t WebServer::set_mac_handler(httpd_req_t *req)
+{
+    char content[128];
+    int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+    if (ret <= 0)
     {
-        float gpad_deadzone = 0.05f;
-        sscanf(gpad_deadzone_ptr, "\"gamepad_deadzone\" : %f", &gpad_deadzone);
-        ESP_LOGI(TAG, "📝 Parsed gamepad_deadzone: %.2f", gpad_deadzone);
-        usbHID.setGamepadDeadzoneValue(gpad_deadzone);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
     }
+    content[ret] = '\0';
 
-    // Parse gamepad invert_y
-    char *gpad_invert_ptr = strstr(buffer, "\"gamepad_invert_y\"");
-    if (gpad_invert_ptr)
+    // Parse JSON: {"mac":"XX:XX:XX:XX:XX:XX"}
+    char mac[18] = {0};
+    char *mac_start = strstr(content, "\"mac\":\"");
+    if (mac_start)
     {
-        // Find the colon after the key, then check the value
-        char *value_ptr = strchr(gpad_invert_ptr, ':');
-        bool invert = false;
-        if (value_ptr)
+        mac_start += 7; // Skip "mac":"
+        char *mac_end = strchr(mac_start, '"');
+        if (mac_end && (mac_end - mac_start) == 17) // MAC address is 17 chars
         {
-            value_ptr++; // Skip colon
-            while (*value_ptr == ' ' || *value_ptr == '\t')
-                value_ptr++; // Skip whitespace
-            invert = (strncmp(value_ptr, "true", 4) == 0);
+            strncpy(mac, mac_start, 17);
+            mac[17] = '\0';
 
-            ESP_LOGI(TAG, "🔍 Parsing gamepad_invert_y: JSON substring='%.50s...', parsed_value=%s",
-                     gpad_invert_ptr, invert ? "true" : "false");
-        }
-        usbHID.setGamepadInvertY(invert);
-        ESP_LOGI(TAG, "✅ Called setGamepadInvertY(%s)", invert ? "true" : "false");
-    }
+            // Check if MAC changed
+            char old_mac[18] = {0};
+            bool mac_changed = false;
 
-    // Parse HA MQTT enabled
-    char *ha_mqtt_ptr = strstr(buffer, "\"ha_mqtt_enabled\"");
-    if (ha_mqtt_ptr)
-    {
-        // Find the colon after the key, then check the value
-        char *value_ptr = strchr(ha_mqtt_ptr, ':');
-        bool enabled = false;
-        if (value_ptr)
-        {
-            value_ptr++; // Skip colon
-            while (*value_ptr == ' ' || *value_ptr == '\t')
-                value_ptr++; // Skip whitespace
-            enabled = (strncmp(value_ptr, "true", 4) == 0);
-        }
-        nvs_handle_t nvs_handle;
-        esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-        if (err == ESP_OK)
-        {
-            nvs_set_u8(nvs_handle, "ha_mqtt_enabled", enabled ? 1 : 0);
-            nvs_commit(nvs_handle);
-            nvs_close(nvs_handle);
-            ESP_LOGI(TAG, "HA MQTT enabled setting saved: %d (restart required)", enabled);
-        }
-    }
-
-    // Parse MQTT broker URI
-    char *mqtt_broker_ptr = strstr(buffer, "\"mqtt_broker\":");
-    if (mqtt_broker_ptr)
-    {
-        mqtt_broker_ptr += strlen("\"mqtt_broker\":");
-        while (*mqtt_broker_ptr == ' ')
-            mqtt_broker_ptr++;
-        if (*mqtt_broker_ptr == '\"')
-        {
-            mqtt_broker_ptr++;
-            char *end_quote = strchr(mqtt_broker_ptr, '\"');
-            if (end_quote)
+            nvs_handle_t nvs_handle_read;
+            esp_err_t err_read = nvs_open("storage", NVS_READONLY, &nvs_handle_read);
+            if (err_read == ESP_OK)
             {
-                size_t len = end_quote - mqtt_broker_ptr;
-                char mqtt_broker[128] = {0};
-                if (len < sizeof(mqtt_broker))
+                size_t old_mac_len = sizeof(old_mac);
+                if (nvs_get_str(nvs_handle_read, "wand_mac", old_mac, &old_mac_len) == ESP_OK)
                 {
-                    strncpy(mqtt_broker, mqtt_broker_ptr, len);
-                    nvs_handle_t nvs_handle;
-                    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-                    if (err == ESP_OK)
-                    {
-                        nvs_set_str(nvs_handle, "mqtt_broker", mqtt_broker);
-                        nvs_commit(nvs_handle);
-                        nvs_close(nvs_handle);
-                        ESP_LOGI(TAG, "MQTT broker saved: %s", mqtt_broker);
-                    }
+                    mac_changed = (strcmp(old_mac, mac) != 0);
+                    ESP_LOGI(TAG, "MAC change detected: old=%s, new=%s", old_mac, mac);
                 }
-            }
-        }
-    }
-
-    // Parse MQTT username
-    char *mqtt_username_ptr = strstr(buffer, "\"mqtt_username\":");
-    if (mqtt_username_ptr)
-    {
-        mqtt_username_ptr += strlen("\"mqtt_username\":");
-        while (*mqtt_username_ptr == ' ')
-            mqtt_username_ptr++;
-        if (*mqtt_username_ptr == '\"')
-        {
-            mqtt_username_ptr++;
-            char *end_quote = strchr(mqtt_username_ptr, '\"');
-            if (end_quote)
-            {
-                size_t len = end_quote - mqtt_username_ptr;
-                char mqtt_username[64] = {0};
-                if (len < sizeof(mqtt_username))
+                else
                 {
-                    strncpy(mqtt_username, mqtt_username_ptr, len);
-                    nvs_handle_t nvs_handle;
-                    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-                    if (err == ESP_OK)
-                    {
-                        nvs_set_str(nvs_handle, "mqtt_username", mqtt_username);
-                        nvs_commit(nvs_handle);
-                        nvs_close(nvs_handle);
-                        ESP_LOGI(TAG, "MQTT username saved");
-                    }
+                    ESP_LOGI(TAG, "No previous MAC stored, first time setup");
                 }
+                nvs_close(nvs_handle_read);
             }
-        }
-    }
 
-    // Parse MQTT password
-    char *mqtt_password_ptr = strstr(buffer, "\"mqtt_password\":");
-    if (mqtt_password_ptr)
-    {
-        mqtt_password_ptr += strlen("\"mqtt_password\":");
-        while (*mqtt_password_ptr == ' ')
-            mqtt_password_ptr++;
-        if (*mqtt_password_ptr == '\"')
-        {
-            mqtt_password_ptr++;
-            char *end_quote = strchr(mqtt_password_ptr, '\"');
-            if (end_quote)
+            // Store in NVS
+            nvs_handle_t nvs_handle;
+            esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+            if (err == ESP_OK)
             {
-                size_t len = end_quote - mqtt_password_ptr;
-                char mqtt_password[64] = {0};
-                if (len < sizeof(mqtt_password))
+                err = nvs_set_str(nvs_handle, "wand_mac", mac);
+                if (err == ESP_OK)
                 {
-                    strncpy(mqtt_password, mqtt_password_ptr, len);
-                    nvs_handle_t nvs_handle;
-                    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-                    if (err == ESP_OK)
+                    nvs_commit(nvs_handle);
+                    ESP_LOGI(TAG, "Stored wand MAC: %s", mac);
+
+                    // If MAC changed, disconnect current wand and wait longer
+                    if (mac_changed && g_wand_client && g_wand_client->isConnected())
                     {
-                        nvs_set_str(nvs_handle, "mqtt_password", mqtt_password);
-                        nvs_commit(nvs_handle);
-                        nvs_close(nvs_handle);
-                        ESP_LOGI(TAG, "MQTT password saved");
+                        ESP_LOGI(TAG, "MAC changed, disconnecting current wand");
+                        g_wand_client->setUserDisconnectRequested(true);
+                        g_wand_client->disconnect();
+                        // Wait longer to ensure clean disconnect before connecting to new wand
+                        vTaskDelay(pdMS_TO_TICKS(2000));
                     }
-                }
-            }
-        }
-    }
 
-    // Parse spell keycodes array
-    char *spells_ptr = strstr(buffer, "\"spells\":");
-    if (spells_ptr)
-    {
-        // Skip to the opening bracket
-        spells_ptr = strchr(spells_ptr, '[');
-        if (spells_ptr)
-        {
-            extern const char *SPELL_NAMES[73];
-            char *end_bracket = strchr(spells_ptr, ']');
-            if (end_bracket)
-            {
-                int spell_idx = 0;
-                const char *parse_ptr = spells_ptr + 1;
-
-                while (spell_idx < 73 && parse_ptr < end_bracket)
+                    httpd_resp_set_type(req, "application/json");
+                    httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"MAC address saved\"}");
+                }
+                else
                 {
-                    int keycode = 0;
-                    int matched = sscanf(parse_ptr, "%d", &keycode);
-                    if (matched == 1)
-                    {
-                        ESP_LOGI(TAG, "Setting spell[%d]='%s' to keycode=0x%02X (%d)",
-                                 spell_idx, SPELL_NAMES[spell_idx], keycode, keycode);
-                        usbHID.setSpellKeycode(SPELL_NAMES[spell_idx], (uint8_t)keycode);
-                        spell_idx++;
-                        // Skip to next comma or bracket
-                        parse_ptr = strchr(parse_ptr, ',');
-                        if (parse_ptr)
-                            parse_ptr++;
-                        else
-                            parse_ptr = end_bracket;
-                    }
-                    else
-                    {
-                        break;
-                    }
+                    ESP_LOGE(TAG, "Failed to save MAC: %d", err);
+                    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to save");
                 }
-                ESP_LOGI(TAG, "Parsed %d spell keycodes", spell_idx);
+                nvs_close(nvs_handle);
+            }
+            else
+            {
+                httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "NVS error");
             }
+            return err == ESP_OK ? ESP_OK : ESP_FAIL;
         }
     }
 
-    // Parse gamepad spell button array
-    char *gpad_ptr = strstr(buffer, "\"gamepad_spells\":");
-    if (gpad_ptr)
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid MAC format");
+    return ESP_FAIL;
+}
+
+esp_err_t WebServer::get_stored_mac_handler(httpd_req_t *req)
+{
+    char mac[18] = {0};
+    nvs_handle_t nvs_handle;
+
+    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK)
     {
-        gpad_ptr = strchr(gpad_ptr, '[');
-        if (gpad_ptr)
-        {
-            extern const char *SPELL_NAMES[73];
-            char *end_bracket = strchr(gpad_ptr, ']');
-            if (end_bracket)
-            {
-                int spell_idx = 0;
-                const char *parse_ptr = gpad_ptr + 1;
+        size_t mac_len = sizeof(mac);
+        err = nvs_get_str(nvs_handle, "wand_mac", mac, &mac_len);
+        nvs_close(nvs_handle);
 
-                while (spell_idx < 73 && parse_ptr < end_bracket)
-                {
-                    int button = 0;
-                    int matched = sscanf(parse_ptr, "%d", &button);
-                    if (matched == 1)
-                    {
-                        usbHID.setSpellGamepadButton(SPELL_NAMES[spell_idx], (uint8_t)button);
-                        spell_idx++;
-                        parse_ptr = strchr(parse_ptr, ',');
-                        if (parse_ptr)
-                            parse_ptr++;
-                        else
-                            parse_ptr = end_bracket;
-                    }
-                    else
-                    {
-                        break;
-                    }
-                }
-                ESP_LOGI(TAG, "Parsed %d gamepad spell mappings", spell_idx);
-            }
+        if (err == ESP_OK && mac[0] != '\0')
+        {
+            char buf[64];
+            JsonWriter json(buf, sizeof(buf));
+            json.beginObject();
+            json.field("status", "success");
+            json.field("mac", mac);
+            json.endObject();
+            httpd_resp_set_type(req, "application/json");
+            httpd_resp_send(req, json.c_str(), json.length());
+            return ESP_OK;
         }
     }
-#endif
 
-    ESP_LOGI(TAG, "Settings save complete. MQTT settings saved to NVS (reboot required to apply)");
+    // No MAC stored
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"status\":\"not_found\",\"mac\":\"\"}");
+    return ESP_OK;
+}
 
-    // Save to NVS
-#if USE_USB_HID_DEVICE
-    if (usbHID.saveSettings())
-    {
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"Settings saved\"}");
-        free(buffer);
-        return ESP_OK;
-    }
-    else
+esp_err_t WebServer::connect_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
     {
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Failed to save to NVS\"}");
-        free(buffer);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
         return ESP_FAIL;
     }
-#else
-    // USB HID disabled, but still parse and save MQTT settings
-    // Parse HA MQTT enabled
-    char *ha_mqtt_ptr = strstr(buffer, "\"ha_mqtt_enabled\"");
-    if (ha_mqtt_ptr)
-    {
-        // Find the colon after the key, then check the value
-        char *value_ptr = strchr(ha_mqtt_ptr, ':');
-        bool enabled = false;
-        if (value_ptr)
-        {
-            value_ptr++; // Skip colon
-            while (*value_ptr == ' ' || *value_ptr == '\t')
-                value_ptr++; // Skip whitespace
-            enabled = (strncmp(value_ptr, "true", 4) == 0);
-        }
-        nvs_handle_t nvs_handle;
-        esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-        if (err == ESP_OK)
-        {
-            nvs_set_u8(nvs_handle, "ha_mqtt_enabled", enabled ? 1 : 0);
-            nvs_commit(nvs_handle);
-            nvs_close(nvs_handle);
-            ESP_LOGI(TAG, "HA MQTT enabled setting saved: %d (restart required)", enabled);
-        }
-    }
 
-    // Parse MQTT broker URI
-    char *mqtt_broker_ptr = strstr(buffer, "\"mqtt_broker\":");
-    if (mqtt_broker_ptr)
+    // Read stored MAC from NVS
+    char mac[18] = {0};
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK)
     {
-        mqtt_broker_ptr += strlen("\"mqtt_broker\":");
-        while (*mqtt_broker_ptr == ' ')
-            mqtt_broker_ptr++;
-        if (*mqtt_broker_ptr == '\"')
+        size_t mac_len = sizeof(mac);
+        err = nvs_get_str(nvs_handle, "wand_mac", mac, &mac_len);
+        nvs_close(nvs_handle);
+
+        if (err == ESP_OK && mac[0] != '\0')
         {
-            mqtt_broker_ptr++;
-            char *end_quote = strchr(mqtt_broker_ptr, '\"');
-            if (end_quote)
+            ESP_LOGI(TAG, "Attempting connection to stored MAC: %s", mac);
+
+            // Disconnect if already connected
+            if (g_wand_client->isConnected())
             {
-                size_t len = end_quote - mqtt_broker_ptr;
-                char mqtt_broker[128] = {0};
-                if (len < sizeof(mqtt_broker))
-                {
-                    strncpy(mqtt_broker, mqtt_broker_ptr, len);
-                    nvs_handle_t nvs_handle;
-                    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-                    if (err == ESP_OK)
-                    {
-                        nvs_set_str(nvs_handle, "mqtt_broker", mqtt_broker);
-                        nvs_commit(nvs_handle);
-                        nvs_close(nvs_handle);
-                        ESP_LOGI(TAG, "MQTT broker saved: %s", mqtt_broker);
-                    }
-                }
+                g_wand_client->disconnect();
+                vTaskDelay(pdMS_TO_TICKS(1000));
             }
-        }
-    }
 
-    // Parse MQTT username
-    char *mqtt_username_ptr = strstr(buffer, "\"mqtt_username\":");
-    if (mqtt_username_ptr)
-    {
-        mqtt_username_ptr += strlen("\"mqtt_username\":");
-        while (*mqtt_username_ptr == ' ')
-            mqtt_username_ptr++;
-        if (*mqtt_username_ptr == '\"')
-        {
-            mqtt_username_ptr++;
-            char *end_quote = strchr(mqtt_username_ptr, '\"');
-            if (end_quote)
+            // Reset user disconnect flag - user is explicitly requesting connection
+            g_wand_client->setUserDisconnectRequested(false);
+
+            // Mark that initialization is needed after this connection
+            g_wand_client->setNeedsInitialization(true);
+
+            // Try to connect
+            bool success = g_wand_client->connect(mac);
+
+            if (success)
             {
-                size_t len = end_quote - mqtt_username_ptr;
-                char mqtt_username[64] = {0};
-                if (len < sizeof(mqtt_username))
-                {
-                    strncpy(mqtt_username, mqtt_username_ptr, len);
-                    nvs_handle_t nvs_handle;
-                    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-                    if (err == ESP_OK)
-                    {
-                        nvs_set_str(nvs_handle, "mqtt_username", mqtt_username);
-                        nvs_commit(nvs_handle);
-                        nvs_close(nvs_handle);
-                        ESP_LOGI(TAG, "MQTT username saved");
-                    }
-                }
+                httpd_resp_set_type(req, "application/json");
+                httpd_resp_sendstr(req, "{\"status\":\"connecting\",\"message\":\"Connection initiated\"}");
+                return ESP_OK;
             }
-        }
-    }
-
-    // Parse MQTT password
-    char *mqtt_password_ptr = strstr(buffer, "\"mqtt_password\":");
-    if (mqtt_password_ptr)
-    {
-        mqtt_password_ptr += strlen("\"mqtt_password\":");
-        while (*mqtt_password_ptr == ' ')
-            mqtt_password_ptr++;
-        if (*mqtt_password_ptr == '\"')
-        {
-            mqtt_password_ptr++;
-            char *end_quote = strchr(mqtt_password_ptr, '\"');
-            if (end_quote)
+            else
             {
-                size_t len = end_quote - mqtt_password_ptr;
-                char mqtt_password[64] = {0};
-                if (len < sizeof(mqtt_password))
-                {
-                    strncpy(mqtt_password, mqtt_password_ptr, len);
-                    nvs_handle_t nvs_handle;
-                    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-                    if (err == ESP_OK)
-                    {
-                        nvs_set_str(nvs_handle, "mqtt_password", mqtt_password);
-                        nvs_commit(nvs_handle);
-                        nvs_close(nvs_handle);
-                        ESP_LOGI(TAG, "MQTT password saved");
-                    }
-                }
+                httpd_resp_set_type(req, "application/json");
+                httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Connection failed\"}");
+                return ESP_FAIL;
             }
         }
     }
 
-    ESP_LOGI(TAG, "MQTT settings saved to NVS (USB HID disabled, restart required to apply)");
-
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"MQTT settings saved (restart required)\"}");
-    free(buffer);
-    return ESP_OK;
-#endif
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No stored MAC address");
+    return ESP_FAIL;
 }
 
-esp_err_t WebServer::settings_reset_handler(httpd_req_t *req)
+esp_err_t WebServer::disconnect_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "settings_reset_handler called!");
+    ESP_LOGI(TAG, "disconnect_handler called!");
 
-#if USE_USB_HID_DEVICE
-    if (usbHID.resetSettings())
+    if (!g_wand_client)
+    {
+        ESP_LOGE(TAG, "BLE client not initialized (g_wand_client is NULL)");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Wand connected status: %d", g_wand_client->isConnected());
+
+    if (g_wand_client->isConnected())
     {
+        g_wand_client->setUserDisconnectRequested(true);
+        g_wand_client->disconnect();
+        ESP_LOGI(TAG, "User-initiated disconnect via web interface - auto-reconnect disabled");
         httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"Settings reset to defaults\"}");
-        return ESP_OK;
+        httpd_resp_sendstr(req, "{\"status\":\"disconnected\"}");
     }
     else
     {
         httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Failed to reset settings\"}");
-        return ESP_FAIL;
+        httpd_resp_sendstr(req, "{\"status\":\"not_connected\"}");
     }
-#else
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"status\":\"disabled\",\"message\":\"USB HID not enabled\"}");
+
     return ESP_OK;
-#endif
 }
 
-esp_err_t WebServer::wifi_scan_handler(httpd_req_t *req)
+esp_err_t WebServer::settings_get_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "wifi_scan_handler called!");
-
-    // Get current WiFi mode
-    wifi_mode_t current_mode;
-    esp_err_t err = esp_wifi_get_mode(&current_mode);
-    if (err != ESP_OK)
-    {
-        ESP_LOGE(TAG, "Failed to get WiFi mode: %s", esp_err_to_name(err));
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"success\":false,\"message\":\"Failed to get WiFi mode\",\"networks\":[]}");
-        return ESP_OK;
-    }
+    ESP_LOGI(TAG, "settings_get_handler called!");
+
+    // MQTT settings from NVS, falling back to config.h defaults (same logic as main.cpp)
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
+    bool ha_mqtt_enabled = true; // Default: enabled
+    char mqtt_broker[128] = {0};
+    char mqtt_username[64] = {0};
+    char mqtt_password[64] = {0};
+
+    if (err == ESP_OK)
+    {
+        uint8_t ha_mqtt_u8 = 1;
+        nvs_get_u8(nvs_handle, "ha_mqtt_enabled", &ha_mqtt_u8);
+        ha_mqtt_enabled = (ha_mqtt_u8 != 0);
+
+        size_t required_size;
+        err = nvs_get_str(nvs_handle, "mqtt_broker", NULL, &required_size);
+        if (err == ESP_OK && required_size <= sizeof(mqtt_broker))
+        {
+            nvs_get_str(nvs_handle, "mqtt_broker", mqtt_broker, &required_size);
+        }
+
+        err = nvs_get_str(nvs_handle, "mqtt_username", NULL, &required_size);
+        if (err == ESP_OK && required_size <= sizeof(mqtt_username))
+        {
+            nvs_get_str(nvs_handle, "mqtt_username", mqtt_username, &required_size);
+        }
+
+        err = nvs_get_str(nvs_handle, "mqtt_password", NULL, &required_size);
+        if (err == ESP_OK && required_size <= sizeof(mqtt_password))
+        {
+            nvs_get_str(nvs_handle, "mqtt_password", mqtt_password, &required_size);
+        }
+
+        nvs_close(nvs_handle);
+    }
+
+    if (strlen(mqtt_broker) == 0)
+    {
+        snprintf(mqtt_broker, sizeof(mqtt_broker), "mqtt://%s:%d", MQTT_SERVER, MQTT_PORT);
+        ESP_LOGI(TAG, "MQTT broker not in NVS, using config.h default: %s", mqtt_broker);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "MQTT broker loaded from NVS: %s", mqtt_broker);
+    }
+
+    if (strlen(mqtt_username) == 0)
+    {
+        strncpy(mqtt_username, MQTT_USER, sizeof(mqtt_username) - 1);
+        ESP_LOGI(TAG, "MQTT username not in NVS, using config.h default: %s", mqtt_username);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "MQTT username loaded from NVS: %s", mqtt_username);
+    }
+
+    if (strlen(mqtt_password) == 0)
+    {
+        strncpy(mqtt_password, MQTT_PASSWORD, sizeof(mqtt_password) - 1);
+        ESP_LOGI(TAG, "MQTT password not in NVS, using config.h default");
+    }
+    else
+    {
+        ESP_LOGI(TAG, "MQTT password loaded from NVS");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+
+#if USE_USB_HID_DEVICE
+    // Mouse/gamepad settings and all 73 spell keycodes / gamepad buttons
+    float mouse_sens = usbHID.getMouseSensitivity();
+    bool mouse_invert = usbHID.getInvertMouseY();
+    HIDMode hid_mode = usbHID.getHidMode();
+    float gamepad_sens = usbHID.getGamepadSensitivity();
+    float gamepad_deadzone = usbHID.getGamepadDeadzone();
+    bool gamepad_invert = usbHID.getGamepadInvertY();
+
+    ESP_LOGI(TAG, "📤 Sending settings to UI:");
+    ESP_LOGI(TAG, "   mouse_sensitivity=%.2f, invert_mouse_y=%s", mouse_sens, mouse_invert ? "true" : "false");
+    ESP_LOGI(TAG, "   hid_mode=%u", static_cast<unsigned>(hid_mode));
+    ESP_LOGI(TAG, "   gamepad_sensitivity=%.2f, gamepad_deadzone=%.2f, gamepad_invert_y=%s",
+             gamepad_sens, gamepad_deadzone, gamepad_invert ? "true" : "false");
+
+    json.field("mouse_sensitivity", mouse_sens, 2);
+    json.field("invert_mouse_y", mouse_invert);
+    json.field("hid_mode", static_cast<unsigned>(hid_mode));
+    json.field("gamepad_sensitivity", gamepad_sens, 2);
+    json.field("gamepad_deadzone", gamepad_deadzone, 2);
+    json.field("gamepad_invert_y", gamepad_invert);
+
+    const uint8_t *spell_keycodes = usbHID.getSpellKeycodes();
+    json.beginArray("spells");
+    for (int i = 0; i < 73; i++)
+    {
+        json.item(spell_keycodes[i]);
+    }
+    json.endArray();
+
+    const uint8_t *gamepad_buttons = usbHID.getSpellGamepadButtons();
+    json.beginArray("gamepad_spells");
+    for (int i = 0; i < 73; i++)
+    {
+        json.item(gamepad_buttons[i]);
+    }
+    json.endArray();
+#else
+    // USB HID disabled, but still return MQTT settings
+    json.field("status", "usb_hid_disabled");
+#endif
+
+    json.field("ha_mqtt_enabled", ha_mqtt_enabled);
+    json.field("mqtt_broker", mqtt_broker);
+    json.field("mqtt_username", mqtt_username);
+    json.field("mqtt_password", mqtt_password);
+    json.endObject();
+    return json_send(req, json);
+}
+
+// /settings/save body, parsed by JsonReader as it arrives. Values are staged here and
+// only applied once the whole body parsed, so a bad request changes nothing.
+enum SettingsField : uint8_t
+{
+    SETTING_MOUSE_SENSITIVITY,
+    SETTING_INVERT_MOUSE_Y,
+    SETTING_HID_MODE,
+    SETTING_GAMEPAD_SENSITIVITY,
+    SETTING_GAMEPAD_DEADZONE,
+    SETTING_GAMEPAD_INVERT_Y,
+    SETTING_HA_MQTT_ENABLED,
+    SETTING_MQTT_BROKER,
+    SETTING_MQTT_USERNAME,
+    SETTING_MQTT_PASSWORD,
+    SETTING_SPELLS,
+    SETTING_GAMEPAD_SPELLS,
+    SETTING_COUNT
+};
+
+struct SettingsKey
+{
+    const char *name;
+    SettingsField field;
+};
+
+// Perfect hash: FNV-1a of each key modulo SETTINGS_KEY_SLOTS lands in its own slot.
+// Adding a key means re-checking that it doesn't collide (or growing the table).
+#define SETTINGS_KEY_SLOTS 22
+static const SettingsKey SETTINGS_KEYS[SETTINGS_KEY_SLOTS] = {
+    {"gamepad_spells", SETTING_GAMEPAD_SPELLS},          // 0
+    {nullptr, SETTING_COUNT},                            // 1
+    {nullptr, SETTING_COUNT},                            // 2
+    {"gamepad_deadzone", SETTING_GAMEPAD_DEADZONE},       // 3
+    {"gamepad_sensitivity", SETTING_GAMEPAD_SENSITIVITY}, // 4
+    {"mqtt_broker", SETTING_MQTT_BROKER},                // 5
+    {"mouse_sensitivity", SETTING_MOUSE_SENSITIVITY},    // 6
+    {"gamepad_invert_y", SETTING_GAMEPAD_INVERT_Y},      // 7
+    {nullptr, SETTING_COUNT},                            // 8
+    {"invert_mouse_y", SETTING_INVERT_MOUSE_Y},          // 9
+    {"hid_mode", SETTING_HID_MODE},                      // 10
+    {nullptr, SETTING_COUNT},                            // 11
+    {"mqtt_username", SETTING_MQTT_USERNAME},            // 12
+    {nullptr, SETTING_COUNT},                            // 13
+    {"spells", SETTING_SPELLS},                          // 14
+    {"mqtt_password", SETTING_MQTT_PASSWORD},            // 15
+    {nullptr, SETTING_COUNT},                            // 16
+    {nullptr, SETTING_COUNT},                            // 17
+    {nullptr, SETTING_COUNT},                            // 18
+    {nullptr, SETTING_COUNT},                            // 19
+    {nullptr, SETTING_COUNT},                            // 20
+    {"ha_mqtt_enabled", SETTING_HA_MQTT_ENABLED},        // 21
+};
+
+static const SettingsKey *find_settings_key(const char *key)
+{
+    uint32_t hash = 2166136261u;
+    for (const char *c = key; *c; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    const SettingsKey *slot = &SETTINGS_KEYS[hash % SETTINGS_KEY_SLOTS];
+    return slot->name && strcmp(slot->name, key) == 0 ? slot : nullptr;
+}
+
+struct SettingsUpdate
+{
+    uint16_t present; // Bit per SettingsField
+    float mouse_sensitivity;
+    bool invert_mouse_y;
+    uint8_t hid_mode;
+    float gamepad_sensitivity;
+    float gamepad_deadzone;
+    bool gamepad_invert_y;
+    bool ha_mqtt_enabled;
+    char mqtt_broker[128];
+    char mqtt_username[64];
+    char mqtt_password[64];
+    uint8_t spell_keycodes[SPELL_OUTPUT_SIZE];
+    uint8_t spell_gamepad_buttons[SPELL_OUTPUT_SIZE];
+    uint8_t spell_count; // Leading entries of the arrays that were sent
+    uint8_t gamepad_count;
+    const SettingsKey *current; // Key of the array being read (looked up once per array)
+    uint16_t ignored;
+};
+
+static bool copy_setting_string(char *dst, size_t size, const char *value, size_t len)
+{
+    if (len >= size)
+    {
+        return false;
+    }
+    memcpy(dst, value, len + 1);
+    return true;
+}
+
+// JsonReader callback: stage one value
+static void stage_setting(const char *key, int index, JsonValueType type, const char *value, size_t len,
+                          void *ctx)
+{
+    SettingsUpdate *update = (SettingsUpdate *)ctx;
+    if (index <= 0)
+    {
+        update->current = find_settings_key(key);
+    }
+    const SettingsKey *setting = update->current;
+    if (!setting || (index >= 0) != (setting->field == SETTING_SPELLS || setting->field == SETTING_GAMEPAD_SPELLS))
+    {
+        update->ignored++;
+        return;
+    }
+
+    bool number = type == JSON_VALUE_NUMBER;
+    bool valid = true;
+    switch (setting->field)
+    {
+    case SETTING_MOUSE_SENSITIVITY:
+        valid = number;
+        update->mouse_sensitivity = strtof(value, nullptr);
+        break;
+    case SETTING_GAMEPAD_SENSITIVITY:
+        valid = number;
+        update->gamepad_sensitivity = strtof(value, nullptr);
+        break;
+    case SETTING_GAMEPAD_DEADZONE:
+        valid = number;
+        update->gamepad_deadzone = strtof(value, nullptr);
+        break;
+    case SETTING_HID_MODE:
+        valid = number && atoi(value) >= HID_MODE_MOUSE && atoi(value) <= HID_MODE_DISABLED;
+        update->hid_mode = (uint8_t)atoi(value);
+        break;
+    // Anything but true turns a flag off, as before
+    case SETTING_INVERT_MOUSE_Y:
+        update->invert_mouse_y = type == JSON_VALUE_TRUE;
+        break;
+    case SETTING_GAMEPAD_INVERT_Y:
+        update->gamepad_invert_y = type == JSON_VALUE_TRUE;
+        break;
+    case SETTING_HA_MQTT_ENABLED:
+        update->ha_mqtt_enabled = type == JSON_VALUE_TRUE;
+        break;
+    case SETTING_MQTT_BROKER:
+        valid = type == JSON_VALUE_STRING &&
+                copy_setting_string(update->mqtt_broker, sizeof(update->mqtt_broker), value, len);
+        break;
+    case SETTING_MQTT_USERNAME:
+        valid = type == JSON_VALUE_STRING &&
+                copy_setting_string(update->mqtt_username, sizeof(update->mqtt_username), value, len);
+        break;
+    case SETTING_MQTT_PASSWORD:
+        valid = type == JSON_VALUE_STRING &&
+                copy_setting_string(update->mqtt_password, sizeof(update->mqtt_password), value, len);
+        break;
+    // Arrays are positional (SPELL_NAMES order); the first non-number ends them, as before
+    case SETTING_SPELLS:
+        valid = number && index < SPELL_OUTPUT_SIZE && index == update->spell_count;
+        if (valid)
+        {
+            update->spell_keycodes[update->spell_count++] = (uint8_t)atoi(value);
+        }
+        break;
+    case SETTING_GAMEPAD_SPELLS:
+        valid = number && index < SPELL_OUTPUT_SIZE && index == update->gamepad_count;
+        if (valid)
+        {
+            update->spell_gamepad_buttons[update->gamepad_count++] = (uint8_t)atoi(value);
+        }
+        break;
+    case SETTING_COUNT:
+        valid = false;
+        break;
+    }
+
+    if (valid)
+    {
+        update->present |= 1u << setting->field;
+    }
+    else
+    {
+        update->ignored++;
+    }
+}
+
+static bool has_setting(const SettingsUpdate &update, SettingsField field)
+{
+    return update.present & (1u << field);
+}
+
+// MQTT settings go to NVS for the next boot, all in one open/commit
+static void save_mqtt_settings(const SettingsUpdate &update)
+{
+    const uint16_t mqtt_fields = (1u << SETTING_HA_MQTT_ENABLED) | (1u << SETTING_MQTT_BROKER) |
+                                 (1u << SETTING_MQTT_USERNAME) | (1u << SETTING_MQTT_PASSWORD);
+    if (!(update.present & mqtt_fields))
+    {
+        return;
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open NVS for MQTT settings (%s)", esp_err_to_name(err));
+        return;
+    }
+    if (has_setting(update, SETTING_HA_MQTT_ENABLED))
+    {
+        nvs_set_u8(nvs_handle, "ha_mqtt_enabled", update.ha_mqtt_enabled ? 1 : 0);
+        ESP_LOGI(TAG, "HA MQTT enabled setting saved: %d (restart required)", update.ha_mqtt_enabled);
+    }
+    if (has_setting(update, SETTING_MQTT_BROKER))
+    {
+        nvs_set_str(nvs_handle, "mqtt_broker", update.mqtt_broker);
+        ESP_LOGI(TAG, "MQTT broker saved: %s", update.mqtt_broker);
+    }
+    if (has_setting(update, SETTING_MQTT_USERNAME))
+    {
+        nvs_set_str(nvs_handle, "mqtt_username", update.mqtt_username);
+        ESP_LOGI(TAG, "MQTT username saved");
+    }
+    if (has_setting(update, SETTING_MQTT_PASSWORD))
+    {
+        nvs_set_str(nvs_handle, "mqtt_password", update.mqtt_password);
+        ESP_LOGI(TAG, "MQTT password saved");
+    }
+    nvs_commit(nvs_handle);
+    nvs_close(nvs_handle);
+}
+
+#if USE_USB_HID_DEVICE
+static void apply_hid_settings(const SettingsUpdate &update)
+{
+    if (has_setting(update, SETTING_MOUSE_SENSITIVITY))
+        usbHID.setMouseSensitivityValue(update.mouse_sensitivity);
+    if (has_setting(update, SETTING_INVERT_MOUSE_Y))
+        usbHID.setInvertMouseY(update.invert_mouse_y);
+    if (has_setting(update, SETTING_HID_MODE))
+        usbHID.setHidMode(static_cast<HIDMode>(update.hid_mode));
+    if (has_setting(update, SETTING_GAMEPAD_SENSITIVITY))
+        usbHID.setGamepadSensitivityValue(update.gamepad_sensitivity);
+    if (has_setting(update, SETTING_GAMEPAD_DEADZONE))
+        usbHID.setGamepadDeadzoneValue(update.gamepad_deadzone);
+    if (has_setting(update, SETTING_GAMEPAD_INVERT_Y))
+        usbHID.setGamepadInvertY(update.gamepad_invert_y);
+    for (int i = 0; i < update.spell_count; i++)
+        usbHID.setSpellKeycodeAt(i, update.spell_keycodes[i]);
+    for (int i = 0; i < update.gamepad_count; i++)
+        usbHID.setSpellGamepadButtonAt(i, update.spell_gamepad_buttons[i]);
+}
+#endif
+
+esp_err_t WebServer::settings_save_handler(httpd_req_t *req)
+{
+    int64_t start_us = esp_timer_get_time();
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    // Parse the POST body chunk by chunk as it is received - it is never held in full
+    SettingsUpdate update;
+    memset(&update, 0, sizeof(update));
+    JsonReader reader(stage_setting, &update);
+    if (!read_json_body(req, reader))
+    {
+        return ESP_FAIL;
+    }
+    int64_t parsed_us = esp_timer_get_time();
+
+    // Expected format: {"mouse_sensitivity": 1.5, "spells": [0, 58, 0, ...], "mqtt_broker": "...", ...}
+    save_mqtt_settings(update);
+#if USE_USB_HID_DEVICE
+    apply_hid_settings(update);
+    bool saved = usbHID.saveSettings();
+#endif
+
+    ESP_LOGI(TAG, "Settings save: %u bytes, %d keycodes, %d gamepad buttons, %u ignored; "
+                  "parse %lld us, total %lld us, free heap %u -> %u",
+             (unsigned)req->content_len, update.spell_count, update.gamepad_count,
+             update.ignored + (unsigned)reader.skipped(), (long long)(parsed_us - start_us),
+             (long long)(esp_timer_get_time() - start_us), (unsigned)heap_before,
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT));
+
+    httpd_resp_set_type(req, "application/json");
+#if USE_USB_HID_DEVICE
+    if (saved)
+    {
+        httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"Settings saved\"}");
+        return ESP_OK;
+    }
+    httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Failed to save to NVS\"}");
+    return ESP_FAIL;
+#else
+    // USB HID disabled, only the MQTT settings apply
+    httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"MQTT settings saved (restart required)\"}");
+    return ESP_OK;
+#endif
+}
+
+esp_err_t WebServer::settings_reset_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "settings_reset_handler called!");
+
+#if USE_USB_HID_DEVICE
+    if (usbHID.resetSettings())
+    {
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"status\":\"success\",\"message\":\"Settings reset to defaults\"}");
+        return ESP_OK;
+    }
+    else
+    {
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"status\":\"error\",\"message\":\"Failed to reset settings\"}");
+        return ESP_FAIL;
+    }
+#else
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"status\":\"disabled\",\"message\":\"USB HID not enabled\"}");
+    return ESP_OK;
+#endif
+}
+
+esp_err_t WebServer::wifi_scan_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "wifi_scan_handler called!");
+
+    // Get current WiFi mode
+    wifi_mode_t current_mode;
+    esp_err_t err = esp_wifi_get_mode(&current_mode);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to get WiFi mode: %s", esp_err_to_name(err));
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"success\":false,\"message\":\"Failed to get WiFi mode\",\"networks\":[]}");
+        return ESP_OK;
+    }
 
     // If in AP-only mode, switch to APSTA mode temporarily
     bool mode_changed = false;
@@ -3794,688 +3156,1770 @@ esp_err_t WebServer::wifi_scan_handler(httpd_req_t *req)
         return ESP_OK;
     }
 
-    // Get number of APs found
-    uint16_t ap_count = 0;
-    esp_wifi_scan_get_ap_num(&ap_count);
+    // Get number of APs found
+    uint16_t ap_count = 0;
+    esp_wifi_scan_get_ap_num(&ap_count);
+
+    ESP_LOGI(TAG, "Found %d access points", ap_count);
+
+    if (ap_count == 0)
+    {
+        // Restore original mode if we changed it
+        if (mode_changed)
+        {
+            ESP_LOGI(TAG, "Restoring AP mode");
+            esp_wifi_set_mode(WIFI_MODE_AP);
+        }
+
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"success\":true,\"networks\":[]}");
+        return ESP_OK;
+    }
+
+    // Limit to max 20 networks to avoid memory issues
+    if (ap_count > 20)
+    {
+        ap_count = 20;
+    }
+
+    // Allocate memory for AP records
+    wifi_ap_record_t *ap_records = (wifi_ap_record_t *)malloc(sizeof(wifi_ap_record_t) * ap_count);
+    if (!ap_records)
+    {
+        ESP_LOGE(TAG, "Failed to allocate memory for AP records");
+
+        // Restore original mode if we changed it
+        if (mode_changed)
+        {
+            esp_wifi_set_mode(WIFI_MODE_AP);
+        }
+
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"success\":false,\"message\":\"Memory allocation failed\",\"networks\":[]}");
+        return ESP_OK;
+    }
+
+    // Get AP records BEFORE restoring mode (mode change clears scan results!)
+    err = esp_wifi_scan_get_ap_records(&ap_count, ap_records);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to get AP records: %s", esp_err_to_name(err));
+        free(ap_records);
+
+        // Restore original mode if we changed it
+        if (mode_changed)
+        {
+            esp_wifi_set_mode(WIFI_MODE_AP);
+        }
+
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"success\":false,\"message\":\"Failed to get records\",\"networks\":[]}");
+        return ESP_OK;
+    }
+
+    // Now restore original mode after getting records
+    if (mode_changed)
+    {
+        ESP_LOGI(TAG, "Restoring AP mode");
+        esp_wifi_set_mode(WIFI_MODE_AP);
+    }
+
+    // Stream the JSON response (SSIDs escaped inline)
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("success", true);
+    json.beginArray("networks");
+
+    for (int i = 0; i < ap_count; i++)
+    {
+        const char *auth_mode = "OPEN";
+        switch (ap_records[i].authmode)
+        {
+        case WIFI_AUTH_OPEN:
+            auth_mode = "OPEN";
+            break;
+        case WIFI_AUTH_WEP:
+            auth_mode = "WEP";
+            break;
+        case WIFI_AUTH_WPA_PSK:
+            auth_mode = "WPA";
+            break;
+        case WIFI_AUTH_WPA2_PSK:
+            auth_mode = "WPA2";
+            break;
+        case WIFI_AUTH_WPA_WPA2_PSK:
+            auth_mode = "WPA/WPA2";
+            break;
+        case WIFI_AUTH_WPA3_PSK:
+            auth_mode = "WPA3";
+            break;
+        case WIFI_AUTH_WPA2_WPA3_PSK:
+            auth_mode = "WPA2/WPA3";
+            break;
+        default:
+            auth_mode = "UNKNOWN";
+            break;
+        }
+
+        const char *ssid = (const char *)ap_records[i].ssid;
+        json.beginObject();
+        json.field("ssid", ssid, strnlen(ssid, sizeof(ap_records[i].ssid)));
+        json.field("rssi", ap_records[i].rssi);
+        json.field("auth", auth_mode);
+        json.field("channel", ap_records[i].primary);
+        json.endObject();
+    }
+
+    json.endArray();
+    json.endObject();
+    json_send(req, json);
+    free(ap_records);
+
+    ESP_LOGI(TAG, "WiFi scan completed successfully with %d networks", ap_count);
+    return ESP_OK;
+}
+
+esp_err_t WebServer::wifi_connect_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "wifi_connect_handler called!");
+
+    // Read the POST body
+    int content_len = req->content_len;
+    char *buffer = (char *)malloc(content_len + 1);
+    if (!buffer)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Allocation failed");
+        return ESP_FAIL;
+    }
+
+    int read_len = httpd_req_recv(req, buffer, content_len);
+    if (read_len != content_len)
+    {
+        free(buffer);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to read request body");
+        return ESP_FAIL;
+    }
+
+    buffer[content_len] = 0;
+    ESP_LOGI(TAG, "Received WiFi connect request: %s", buffer);
+
+    // Parse SSID and password
+    char ssid[32] = {0};
+    char password[64] = {0};
+
+    char *ssid_ptr = strstr(buffer, "\"ssid\":");
+    if (ssid_ptr)
+    {
+        ssid_ptr += strlen("\"ssid\":");
+        while (*ssid_ptr == ' ')
+            ssid_ptr++;
+        if (*ssid_ptr == '\"')
+        {
+            ssid_ptr++;
+            char *end_quote = strchr(ssid_ptr, '\"');
+            if (end_quote)
+            {
+                size_t len = end_quote - ssid_ptr;
+                if (len < sizeof(ssid))
+                {
+                    strncpy(ssid, ssid_ptr, len);
+                }
+            }
+        }
+    }
+
+    char *password_ptr = strstr(buffer, "\"password\":");
+    if (password_ptr)
+    {
+        password_ptr += strlen("\"password\":");
+        while (*password_ptr == ' ')
+            password_ptr++;
+        if (*password_ptr == '\"')
+        {
+            password_ptr++;
+            char *end_quote = strchr(password_ptr, '\"');
+            if (end_quote)
+            {
+                size_t len = end_quote - password_ptr;
+                if (len < sizeof(password))
+                {
+                    strncpy(password, password_ptr, len);
+                }
+            }
+        }
+    }
+
+    // Save WiFi credentials to NVS
+    if (strlen(ssid) > 0)
+    {
+        nvs_handle_t nvs_handle;
+        esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+        if (err == ESP_OK)
+        {
+            nvs_set_str(nvs_handle, "wifi_ssid", ssid);
+            nvs_set_str(nvs_handle, "wifi_password", password);
+            nvs_commit(nvs_handle);
+            nvs_close(nvs_handle);
+            ESP_LOGI(TAG, "WiFi credentials saved to NVS: SSID=%s", ssid);
+        }
+    }
+
+    // Send response indicating reboot will occur
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"WiFi credentials saved. Rebooting to apply changes...\"}");
+
+    free(buffer);
+
+    // Schedule reboot to apply WiFi changes
+    ESP_LOGI(TAG, "WiFi configuration updated. Rebooting in 2 seconds...");
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    esp_restart();
+
+    return ESP_OK;
+}
+
+esp_err_t WebServer::hotspot_settings_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "hotspot_settings_handler called!");
+
+    // Read the POST body
+    int content_len = req->content_len;
+    char *buffer = (char *)malloc(content_len + 1);
+    if (!buffer)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Allocation failed");
+        return ESP_FAIL;
+    }
+
+    int read_len = httpd_req_recv(req, buffer, content_len);
+    if (read_len != content_len)
+    {
+        free(buffer);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to read request body");
+        return ESP_FAIL;
+    }
+
+    buffer[content_len] = 0;
+    ESP_LOGI(TAG, "Received hotspot settings: %s", buffer);
+
+    // Parse settings
+    char *enabled_ptr = strstr(buffer, "\"enabled\"");
+    bool enabled = false;
+    if (enabled_ptr)
+    {
+        char *value_ptr = strchr(enabled_ptr, ':');
+        if (value_ptr)
+        {
+            value_ptr++;
+            while (*value_ptr == ' ' || *value_ptr == '\t')
+                value_ptr++;
+            enabled = (strncmp(value_ptr, "true", 4) == 0);
+        }
+    }
+
+    char ssid[32] = {0};
+    char password[64] = {0};
+    int channel = 1;
+
+    char *ssid_ptr = strstr(buffer, "\"ssid\":");
+    if (ssid_ptr)
+    {
+        ssid_ptr += strlen("\"ssid\":");
+        while (*ssid_ptr == ' ')
+            ssid_ptr++;
+        if (*ssid_ptr == '\"')
+        {
+            ssid_ptr++;
+            char *end_quote = strchr(ssid_ptr, '\"');
+            if (end_quote)
+            {
+                size_t len = end_quote - ssid_ptr;
+                if (len < sizeof(ssid))
+                {
+                    strncpy(ssid, ssid_ptr, len);
+                }
+            }
+        }
+    }
+
+    char *password_ptr = strstr(buffer, "\"password\":");
+    if (password_ptr)
+    {
+        password_ptr += strlen("\"password\":");
+        while (*password_ptr == ' ')
+            password_ptr++;
+        if (*password_ptr == '\"')
+        {
+            password_ptr++;
+            char *end_quote = strchr(password_ptr, '\"');
+            if (end_quote)
+            {
+                size_t len = end_quote - password_ptr;
+                if (len < sizeof(password))
+                {
+                    strncpy(password, password_ptr, len);
+                }
+            }
+        }
+    }
+
+    char *channel_ptr = strstr(buffer, "\"channel\":");
+    if (channel_ptr)
+    {
+        sscanf(channel_ptr, "\"channel\" : %d", &channel);
+    }
+
+    // Save hotspot settings to NVS
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        nvs_set_u8(nvs_handle, "hotspot_enabled", enabled ? 1 : 0);
+        if (strlen(ssid) > 0)
+        {
+            nvs_set_str(nvs_handle, "hotspot_ssid", ssid);
+        }
+        if (strlen(password) > 0)
+        {
+            nvs_set_str(nvs_handle, "hotspot_password", password);
+        }
+        nvs_set_u8(nvs_handle, "hotspot_channel", (uint8_t)channel);
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+        ESP_LOGI(TAG, "Hotspot settings saved: enabled=%d, SSID=%s, channel=%d", enabled, ssid, channel);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"Hotspot settings saved. Rebooting to apply changes...\"}");
+
+    free(buffer);
+
+    // Schedule reboot to apply hotspot changes
+    ESP_LOGI(TAG, "Hotspot configuration updated. Rebooting in 2 seconds...");
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    esp_restart();
+
+    return ESP_OK;
+}
+
+esp_err_t WebServer::hotspot_get_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "hotspot_get_handler called!");
+
+    // Load hotspot settings from NVS
+    char hotspot_ssid[32] = {0};
+    char hotspot_password[64] = {0};
+    uint8_t hotspot_channel = 6;
+    bool hotspot_enabled = false;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        uint8_t enabled = 0;
+        nvs_get_u8(nvs_handle, "hotspot_enabled", &enabled);
+        hotspot_enabled = (enabled != 0);
+
+        size_t required_size;
+        err = nvs_get_str(nvs_handle, "hotspot_ssid", NULL, &required_size);
+        if (err == ESP_OK && required_size > 0 && required_size <= sizeof(hotspot_ssid))
+        {
+            nvs_get_str(nvs_handle, "hotspot_ssid", hotspot_ssid, &required_size);
+        }
+
+        err = nvs_get_str(nvs_handle, "hotspot_password", NULL, &required_size);
+        if (err == ESP_OK && required_size > 0 && required_size <= sizeof(hotspot_password))
+        {
+            nvs_get_str(nvs_handle, "hotspot_password", hotspot_password, &required_size);
+        }
+
+        uint8_t channel = 6;
+        nvs_get_u8(nvs_handle, "hotspot_channel", &channel);
+        if (channel >= 1 && channel <= 13)
+        {
+            hotspot_channel = channel;
+        }
+
+        nvs_close(nvs_handle);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("success", true);
+    json.field("enabled", hotspot_enabled);
+    json.field("ssid", hotspot_ssid);
+    json.field("password", hotspot_password);
+    json.field("channel", hotspot_channel);
+    json.endObject();
+    return json_send(req, json);
+}
+
+esp_err_t WebServer::system_reboot_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "system_reboot_handler called! Rebooting in 2 seconds...");
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"Rebooting device...\"}");
+
+    // Schedule reboot after a short delay to allow response to be sent
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    esp_restart();
+
+    return ESP_OK;
+}
+
+esp_err_t WebServer::system_wifi_mode_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "system_wifi_mode_handler called!");
+
+    // Read request body
+    char buf[100];
+    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (ret <= 0)
+    {
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "{\"success\":false,\"message\":\"No data received\"}");
+        return ESP_FAIL;
+    }
+    buf[ret] = '\0';
+
+    // Parse JSON to extract mode
+    // Expected: {"mode":"client"} or {"mode":"ap"}
+    bool force_ap = false;
+    char *mode_ptr = strstr(buf, "\"mode\"");
+    if (mode_ptr)
+    {
+        char *value_ptr = strchr(mode_ptr, ':');
+        if (value_ptr)
+        {
+            value_ptr++;
+            while (*value_ptr == ' ' || *value_ptr == '\t')
+                value_ptr++;
+            if (*value_ptr == '\"')
+            {
+                value_ptr++;
+                if (strncmp(value_ptr, "ap", 2) == 0)
+                {
+                    force_ap = true;
+                }
+            }
+        }
+    }
+
+    ESP_LOGI(TAG, "Setting force_ap_mode to %d", force_ap ? 1 : 0);
+
+    // Save to NVS
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_u8(nvs_handle, "force_ap_mode", force_ap ? 1 : 0);
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Failed to save force_ap_mode to NVS");
+        }
+        nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Failed to open NVS for force_ap_mode");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"WiFi mode will change after reboot\"}");
+
+    // Schedule reboot after a short delay to allow response to be sent
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    esp_restart();
+
+    return ESP_OK;
+}
+
+esp_err_t WebServer::system_reset_nvs_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "system_reset_nvs_handler called! Clearing ALL NVS settings...");
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"Resetting to defaults...\"}");
+
+    // Allow response to be sent
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    // Erase NVS partition
+    esp_err_t err = nvs_flash_erase();
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "NVS erased successfully");
+        // Reinitialize NVS
+        err = nvs_flash_init();
+        if (err == ESP_OK)
+        {
+            ESP_LOGI(TAG, "NVS reinitialized successfully");
+        }
+        else
+        {
+            ESP_LOGW(TAG, "NVS reinit failed: %s", esp_err_to_name(err));
+        }
+    }
+    else
+    {
+        ESP_LOGW(TAG, "NVS erase failed: %s", esp_err_to_name(err));
+    }
+
+    // Reboot after delay
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    esp_restart();
+
+    return ESP_OK;
+}
+
+esp_err_t WebServer::system_get_wifi_mode_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "system_get_wifi_mode_handler called");
+
+    // Check force_ap_mode flag from NVS
+    bool force_ap = false;
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        uint8_t ap_mode = 0;
+        err = nvs_get_u8(nvs_handle, "force_ap_mode", &ap_mode);
+        if (err == ESP_OK && ap_mode == 1)
+        {
+            force_ap = true;
+        }
+        nvs_close(nvs_handle);
+    }
+
+    // Also check current WiFi mode
+    wifi_mode_t current_mode;
+    esp_wifi_get_mode(&current_mode);
+
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("success", true);
+    json.field("mode", force_ap ? "ap" : "client");
+    json.field("current_wifi_mode", current_mode == WIFI_MODE_AP ? "AP" : (current_mode == WIFI_MODE_STA ? "STA" : "APSTA"));
+    json.field("force_ap", force_ap);
+    json.endObject();
+    return json_send(req, json);
+}
+
+esp_err_t WebServer::debug_nvs_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "debug_nvs_handler called - showing stored NVS values");
+
+    char wifi_ssid[32] = {0};
+    char wifi_password[64] = {0};
+    char wand_mac[18] = {0};
+    char mqtt_broker[128] = {0};
+    char mqtt_username[64] = {0};
+    char mqtt_password[64] = {0};
+    bool ha_mqtt_enabled = false;
+    bool force_ap_mode = false;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK)
+    {
+        size_t required_size;
+
+        // WiFi credentials
+        required_size = sizeof(wifi_ssid);
+        nvs_get_str(nvs_handle, "wifi_ssid", wifi_ssid, &required_size);
+
+        required_size = sizeof(wifi_password);
+        nvs_get_str(nvs_handle, "wifi_password", wifi_password, &required_size);
+
+        // Wand MAC
+        required_size = sizeof(wand_mac);
+        nvs_get_str(nvs_handle, "wand_mac", wand_mac, &required_size);
+
+        // MQTT settings
+        uint8_t mqtt_enabled = 0;
+        nvs_get_u8(nvs_handle, "ha_mqtt_enabled", &mqtt_enabled);
+        ha_mqtt_enabled = (mqtt_enabled != 0);
+
+        required_size = sizeof(mqtt_broker);
+        nvs_get_str(nvs_handle, "mqtt_broker", mqtt_broker, &required_size);
+
+        required_size = sizeof(mqtt_username);
+        nvs_get_str(nvs_handle, "mqtt_username", mqtt_username, &required_size);
+
+        required_size = sizeof(mqtt_password);
+        nvs_get_str(nvs_handle, "mqtt_password", mqtt_password, &required_size);
+
+        // WiFi mode
+        uint8_t ap_mode = 0;
+        nvs_get_u8(nvs_handle, "force_ap_mode", &ap_mode);
+        force_ap_mode = (ap_mode != 0);
+
+        nvs_close(nvs_handle);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("success", true);
+    json.beginObject("nvs");
+    json.field("wifi_ssid", wifi_ssid);
+    json.field("wifi_password", strlen(wifi_password) > 0 ? "***" : "");
+    json.field("wand_mac", wand_mac);
+    json.field("mqtt_broker", mqtt_broker);
+    json.field("mqtt_username", mqtt_username);
+    json.field("mqtt_password", strlen(mqtt_password) > 0 ? "***" : "");
+    json.field("ha_mqtt_enabled", ha_mqtt_enabled);
+    json.field("force_ap_mode", force_ap_mode);
+    json.endObject();
+    json.endObject();
+    json_send(req, json);
+
+    ESP_LOGI(TAG, "NVS Debug: mqtt_broker='%s', mqtt_username='%s', ha_mqtt_enabled=%d",
+             mqtt_broker, mqtt_username, ha_mqtt_enabled);
+
+    return ESP_OK;
+}
+
+esp_err_t WebServer::models_get_handler(httpd_req_t *req)
+{
+    ModelRegistry *registry = g_wand_client ? g_wand_client->getModelRegistry() : nullptr;
+    if (!registry)
+    {
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_sendstr(req, "{\"active\":\"\",\"ready\":false,\"models\":[]}");
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("active", g_wand_client->getActiveModelName());
+    json.field("ready", g_wand_client->isDetectorReady()); // False: a switch failed and the old model didn't come back
+    json.beginArray("models");
+    for (size_t i = 0; i < registry->getCount(); i++)
+    {
+        const ModelInfo *info = registry->get(i);
+        char crc[9];
+        snprintf(crc, sizeof(crc), "%08lx", (unsigned long)info->crc32);
+        json.beginObject();
+        json.field("name", info->name);
+        json.field("size", (unsigned)info->size);
+        json.beginArray("input");
+        json.item(info->input_samples);
+        json.item(info->input_channels);
+        json.endArray();
+        json.field("classes", info->output_classes);
+        json.field("crc", crc);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return json_send(req, json);
+}
+
+// JsonReader callback: copy a top-level "name" string into ctx (MODEL_NAME_LEN bytes)
+static void read_name_field(const char *key, int index, JsonValueType type, const char *value, size_t len,
+                            void *ctx)
+{
+    if (index == -1 && type == JSON_VALUE_STRING && strcmp(key, "name") == 0 && len < MODEL_NAME_LEN)
+    {
+        memcpy(ctx, value, len + 1);
+    }
+}
+
+esp_err_t WebServer::models_select_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
+
+    // {"name":"model_name"} - decoded, so names with quotes or backslashes round-trip from /models
+    char name[MODEL_NAME_LEN] = {0};
+    JsonReader reader(read_name_field, name);
+    if (!read_json_body(req, reader))
+    {
+        return ESP_FAIL;
+    }
+    if (name[0] == '\0')
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing model name");
+        return ESP_FAIL;
+    }
+
+    bool success = g_wand_client->selectModel(name);
 
-    ESP_LOGI(TAG, "Found %d access points", ap_count);
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("success", success);
+    json.field("active", g_wand_client->getActiveModelName());
+    json.endObject();
+    return json_send(req, json);
+}
 
-    if (ap_count == 0)
+esp_err_t WebServer::shadow_status_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
     {
-        // Restore original mode if we changed it
-        if (mode_changed)
-        {
-            ESP_LOGI(TAG, "Restoring AP mode");
-            esp_wifi_set_mode(WIFI_MODE_AP);
-        }
-
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"success\":true,\"networks\":[]}");
-        return ESP_OK;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
     }
 
-    // Limit to max 20 networks to avoid memory issues
-    if (ap_count > 20)
+    ShadowEvaluator &shadow = g_wand_client->getShadowEvaluator();
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("enabled", shadow.isEnabled());
+    json.field("model", shadow.getModelName());
+    json.field("production", g_wand_client->getActiveModelName());
+    json.field("total", (unsigned long)shadow.getTotal());
+    json.field("disagreements", (unsigned long)shadow.getDisagreements());
+    json.field("dropped", (unsigned long)shadow.getDropped());
+    json.endObject();
+    return json_send(req, json);
+}
+
+esp_err_t WebServer::shadow_log_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
     {
-        ap_count = 20;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
     }
 
-    // Allocate memory for AP records
-    wifi_ap_record_t *ap_records = (wifi_ap_record_t *)malloc(sizeof(wifi_ap_record_t) * ap_count);
-    if (!ap_records)
+    // Snapshot first so the evaluator isn't held while we send
+    ShadowRecord *records = (ShadowRecord *)malloc(sizeof(ShadowRecord) * SHADOW_LOG_SIZE);
+    if (!records)
     {
-        ESP_LOGE(TAG, "Failed to allocate memory for AP records");
-
-        // Restore original mode if we changed it
-        if (mode_changed)
-        {
-            esp_wifi_set_mode(WIFI_MODE_AP);
-        }
-
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"success\":false,\"message\":\"Memory allocation failed\",\"networks\":[]}");
-        return ESP_OK;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
     }
+    size_t count = g_wand_client->getShadowEvaluator().snapshot(records, SHADOW_LOG_SIZE);
 
-    // Get AP records BEFORE restoring mode (mode change clears scan results!)
-    err = esp_wifi_scan_get_ap_records(&ap_count, ap_records);
-    if (err != ESP_OK)
-    {
-        ESP_LOGE(TAG, "Failed to get AP records: %s", esp_err_to_name(err));
-        free(ap_records);
+    httpd_resp_set_type(req, "text/csv");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"shadow_log.csv\"");
+    httpd_resp_sendstr_chunk(req, "timestamp_ms,prod_spell,prod_conf,shadow_spell,shadow_conf,"
+                                  "shadow_conf_for_prod,agree,prod_us,shadow_us\n");
 
-        // Restore original mode if we changed it
-        if (mode_changed)
+    char line[192];
+    for (size_t i = 0; i < count; i++)
+    {
+        const ShadowRecord &r = records[i];
+        snprintf(line, sizeof(line), "%lu,%s,%.4f,%s,%.4f,%.4f,%d,%lu,%lu\n",
+                 (unsigned long)r.timestamp_ms,
+                 SPELL_NAMES[r.prod_index], r.prod_confidence,
+                 SPELL_NAMES[r.shadow_index], r.shadow_confidence,
+                 r.shadow_prod_confidence, r.prod_index == r.shadow_index ? 1 : 0,
+                 (unsigned long)r.prod_us, (unsigned long)r.shadow_us);
+        if (httpd_resp_sendstr_chunk(req, line) != ESP_OK)
         {
-            esp_wifi_set_mode(WIFI_MODE_AP);
+            break;
         }
-
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"success\":false,\"message\":\"Failed to get records\",\"networks\":[]}");
-        return ESP_OK;
     }
+    free(records);
 
-    // Now restore original mode after getting records
-    if (mode_changed)
+    httpd_resp_sendstr_chunk(req, nullptr);
+    return ESP_OK;
+}
+
+esp_err_t WebServer::shadow_select_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
     {
-        ESP_LOGI(TAG, "Restoring AP mode");
-        esp_wifi_set_mode(WIFI_MODE_AP);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
     }
 
-    // Build JSON response
-    char *response = (char *)malloc(8192);
-    if (!response)
+    char content[128];
+    int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+    if (ret <= 0)
     {
-        free(ap_records);
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_sendstr(req, "{\"success\":false,\"message\":\"Memory allocation failed\",\"networks\":[]}");
-        return ESP_OK;
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
     }
+    content[ret] = '\0';
 
-    int offset = snprintf(response, 8192, "{\"success\":true,\"networks\":[");
-
-    for (int i = 0; i < ap_count; i++)
+    // Parse JSON: {"name":"model_name"} - empty name disables shadow mode
+    char name[MODEL_NAME_LEN] = {0};
+    char *name_start = strstr(content, "\"name\":\"");
+    if (name_start)
     {
-        const char *auth_mode = "OPEN";
-        switch (ap_records[i].authmode)
+        name_start += 8; // Skip "name":"
+        char *name_end = strchr(name_start, '"');
+        if (name_end && name_end - name_start < (int)sizeof(name))
         {
-        case WIFI_AUTH_OPEN:
-            auth_mode = "OPEN";
-            break;
-        case WIFI_AUTH_WEP:
-            auth_mode = "WEP";
-            break;
-        case WIFI_AUTH_WPA_PSK:
-            auth_mode = "WPA";
-            break;
-        case WIFI_AUTH_WPA2_PSK:
-            auth_mode = "WPA2";
-            break;
-        case WIFI_AUTH_WPA_WPA2_PSK:
-            auth_mode = "WPA/WPA2";
-            break;
-        case WIFI_AUTH_WPA3_PSK:
-            auth_mode = "WPA3";
-            break;
-        case WIFI_AUTH_WPA2_WPA3_PSK:
-            auth_mode = "WPA2/WPA3";
-            break;
-        default:
-            auth_mode = "UNKNOWN";
-            break;
+            strncpy(name, name_start, name_end - name_start);
         }
+    }
+
+    bool success = g_wand_client->selectShadowModel(name);
 
-        // Escape any special characters in SSID
-        char escaped_ssid[64];
-        const char *src = (const char *)ap_records[i].ssid;
-        char *dst = escaped_ssid;
-        int max_len = sizeof(escaped_ssid) - 1;
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("success", success);
+    json.field("shadow", g_wand_client->getShadowEvaluator().getModelName());
+    json.endObject();
+    return json_send(req, json);
+}
 
-        while (*src && max_len > 1)
+// Extract "name" from a small JSON body ({"name":"..."}); empty string if absent
+static void parse_name_field(const char *content, char *name, size_t name_len)
+{
+    name[0] = '\0';
+    const char *name_start = strstr(content, "\"name\":\"");
+    if (name_start)
+    {
+        name_start += 8; // Skip "name":"
+        const char *name_end = strchr(name_start, '"');
+        if (name_end && (size_t)(name_end - name_start) < name_len)
         {
-            if (*src == '"' || *src == '\\')
-            {
-                if (max_len > 2)
-                {
-                    *dst++ = '\\';
-                    max_len--;
-                }
-            }
-            *dst++ = *src++;
-            max_len--;
+            memcpy(name, name_start, name_end - name_start);
+            name[name_end - name_start] = '\0';
         }
-        *dst = '\0';
+    }
+}
 
-        offset += snprintf(response + offset, 8192 - offset,
-                           "%s{\"ssid\":\"%s\",\"rssi\":%d,\"auth\":\"%s\",\"channel\":%d}",
-                           i > 0 ? "," : "",
-                           escaped_ssid,
-                           ap_records[i].rssi,
-                           auth_mode,
-                           ap_records[i].primary);
+// Index into SPELL_NAMES of a name that isn't NUL-terminated; -1 if unknown
+static int find_spell_index(const char *name, size_t len)
+{
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        if (strlen(SPELL_NAMES[i]) == len && strncmp(SPELL_NAMES[i], name, len) == 0)
+            return i;
+    }
+    return -1;
+}
 
-        if (offset >= 8000)
-            break;
+esp_err_t WebServer::custom_list_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
     }
 
-    offset += snprintf(response + offset, 8192 - offset, "]}");
+    CustomGestureEngine &custom = g_wand_client->getCustomGestures();
+    static char names[CUSTOM_GESTURE_MAX_TEMPLATES][CUSTOM_GESTURE_NAME_LEN];
+    static uint8_t counts[CUSTOM_GESTURE_MAX_TEMPLATES];
+    size_t n = custom.list(names, counts, CUSTOM_GESTURE_MAX_TEMPLATES);
 
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, response);
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("recording", custom.getRecordingName());
+    json.field("examples", (unsigned)custom.getTemplateCount());
+    json.field("max_examples", CUSTOM_GESTURE_MAX_TEMPLATES);
+    json.field("match_us", (unsigned long)custom.getLastMatchUs());
+    json.beginArray("gestures");
+    for (size_t i = 0; i < n; i++)
+    {
+        json.beginObject();
+        json.field("name", names[i], strnlen(names[i], CUSTOM_GESTURE_NAME_LEN));
+        json.field("count", counts[i]);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return json_send(req, json);
+}
 
-    free(response);
-    free(ap_records);
+esp_err_t WebServer::custom_record_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
 
-    ESP_LOGI(TAG, "WiFi scan completed successfully with %d networks", ap_count);
+    char content[128];
+    int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+    if (ret <= 0)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    content[ret] = '\0';
+
+    // Empty name cancels a pending recording
+    char name[CUSTOM_GESTURE_NAME_LEN];
+    parse_name_field(content, name, sizeof(name));
+    g_wand_client->getCustomGestures().armRecording(name);
+    ESP_LOGI(TAG, "Custom gesture recording %s%s", name[0] ? "armed for " : "cancelled", name);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, name[0] ? "{\"status\":\"armed\"}" : "{\"status\":\"cancelled\"}");
     return ESP_OK;
 }
 
-esp_err_t WebServer::wifi_connect_handler(httpd_req_t *req)
+esp_err_t WebServer::custom_delete_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "wifi_connect_handler called!");
-
-    // Read the POST body
-    int content_len = req->content_len;
-    char *buffer = (char *)malloc(content_len + 1);
-    if (!buffer)
+    if (!g_wand_client)
     {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Allocation failed");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
         return ESP_FAIL;
     }
 
-    int read_len = httpd_req_recv(req, buffer, content_len);
-    if (read_len != content_len)
+    char content[128];
+    int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+    if (ret <= 0)
     {
-        free(buffer);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to read request body");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
         return ESP_FAIL;
     }
+    content[ret] = '\0';
 
-    buffer[content_len] = 0;
-    ESP_LOGI(TAG, "Received WiFi connect request: %s", buffer);
+    char name[CUSTOM_GESTURE_NAME_LEN];
+    parse_name_field(content, name, sizeof(name));
+    bool removed = name[0] && g_wand_client->getCustomGestures().removeGesture(name);
 
-    // Parse SSID and password
-    char ssid[32] = {0};
-    char password[64] = {0};
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, removed ? "{\"success\":true}" : "{\"success\":false}");
+    return ESP_OK;
+}
 
-    char *ssid_ptr = strstr(buffer, "\"ssid\":");
-    if (ssid_ptr)
+esp_err_t WebServer::cascade_get_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
     {
-        ssid_ptr += strlen("\"ssid\":");
-        while (*ssid_ptr == ' ')
-            ssid_ptr++;
-        if (*ssid_ptr == '\"')
-        {
-            ssid_ptr++;
-            char *end_quote = strchr(ssid_ptr, '\"');
-            if (end_quote)
-            {
-                size_t len = end_quote - ssid_ptr;
-                if (len < sizeof(ssid))
-                {
-                    strncpy(ssid, ssid_ptr, len);
-                }
-            }
-        }
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
     }
 
-    char *password_ptr = strstr(buffer, "\"password\":");
-    if (password_ptr)
+    CascadeRecognizer &cascade = g_wand_client->getCascade();
+    const CascadeStats &stats = cascade.getStats();
+    uint32_t stage1_casts = cascade.isEnabled() ? stats.casts - stats.shape_skips : 0;
+    uint32_t stage2_casts = cascade.isEnabled() ? stats.escalations + stats.shape_skips : stats.casts;
+
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("enabled", cascade.isEnabled());
+    json.field("stage1", cascade.getStage1Name());
+    json.field("full", g_wand_client->getActiveModelName());
+    json.field("threshold", cascade.getAcceptThreshold());
+    json.field("casts", (unsigned long)stats.casts);
+    json.field("escalations", (unsigned long)stats.escalations);
+    json.field("shape_skips", (unsigned long)stats.shape_skips);
+    json.field("stage1_rejects", (unsigned long)stats.stage1_rejects);
+    json.field("escalation_rate", stage1_casts ? (float)stats.escalations / stage1_casts : 1.0f);
+    json.field("avg_us", (unsigned long)(stats.casts ? stats.total_us / stats.casts : 0));
+    json.field("avg_stage1_us", (unsigned long)(stage1_casts ? stats.stage1_us / stage1_casts : 0));
+    json.field("avg_full_us", (unsigned long)(stage2_casts ? stats.stage2_us / stage2_casts : 0));
+    json.endObject();
+    return json_send(req, json);
+}
+
+esp_err_t WebServer::cascade_set_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
     {
-        password_ptr += strlen("\"password\":");
-        while (*password_ptr == ' ')
-            password_ptr++;
-        if (*password_ptr == '\"')
-        {
-            password_ptr++;
-            char *end_quote = strchr(password_ptr, '\"');
-            if (end_quote)
-            {
-                size_t len = end_quote - password_ptr;
-                if (len < sizeof(password))
-                {
-                    strncpy(password, password_ptr, len);
-                }
-            }
-        }
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
     }
 
-    // Save WiFi credentials to NVS
-    if (strlen(ssid) > 0)
+    char content[160];
+    int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+    if (ret <= 0)
     {
-        nvs_handle_t nvs_handle;
-        esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-        if (err == ESP_OK)
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    content[ret] = '\0';
+
+    // Parse JSON: {"model":"tiny","threshold":0.95} - empty model disables the cascade
+    CascadeRecognizer &cascade = g_wand_client->getCascade();
+    char model[MODEL_NAME_LEN] = {0};
+    strncpy(model, cascade.getStage1Name(), sizeof(model) - 1);
+    char *model_start = strstr(content, "\"model\":\"");
+    if (model_start)
+    {
+        model_start += 9; // Skip "model":"
+        char *model_end = strchr(model_start, '"');
+        memset(model, 0, sizeof(model));
+        if (model_end && model_end - model_start < (int)sizeof(model))
         {
-            nvs_set_str(nvs_handle, "wifi_ssid", ssid);
-            nvs_set_str(nvs_handle, "wifi_password", password);
-            nvs_commit(nvs_handle);
-            nvs_close(nvs_handle);
-            ESP_LOGI(TAG, "WiFi credentials saved to NVS: SSID=%s", ssid);
+            strncpy(model, model_start, model_end - model_start);
         }
     }
 
-    // Send response indicating reboot will occur
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"WiFi credentials saved. Rebooting to apply changes...\"}");
-
-    free(buffer);
+    float threshold = cascade.getAcceptThreshold();
+    char *threshold_start = strstr(content, "\"threshold\":");
+    if (threshold_start)
+    {
+        sscanf(threshold_start + 12, "%f", &threshold);
+    }
 
-    // Schedule reboot to apply WiFi changes
-    ESP_LOGI(TAG, "WiFi configuration updated. Rebooting in 2 seconds...");
-    vTaskDelay(pdMS_TO_TICKS(2000));
-    esp_restart();
+    bool success = g_wand_client->configureCascade(model, threshold);
 
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, success ? "{\"success\":true}" : "{\"success\":false}");
     return ESP_OK;
 }
 
-esp_err_t WebServer::hotspot_settings_handler(httpd_req_t *req)
+esp_err_t WebServer::windows_get_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "hotspot_settings_handler called!");
-
-    // Read the POST body
-    int content_len = req->content_len;
-    char *buffer = (char *)malloc(content_len + 1);
-    if (!buffer)
+    if (!g_wand_client)
     {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Allocation failed");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
         return ESP_FAIL;
     }
 
-    int read_len = httpd_req_recv(req, buffer, content_len);
-    if (read_len != content_len)
+    const WindowStats &stats = g_wand_client->getWindowStats();
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("casts", (unsigned long)stats.casts);
+    json.field("rescued", (unsigned long)stats.rescued);
+    json.beginArray("windows");
+    for (int w = 0; w < PREPROCESS_MAX_WINDOWS; w++)
+    {
+        json.beginObject();
+        json.field("name", PREPROCESS_WINDOW_NAMES[w]);
+        json.field("evaluated", (unsigned long)stats.evaluated[w]);
+        json.field("hits", (unsigned long)stats.hits[w]);
+        json.field("avg_us", (unsigned long)(stats.evaluated[w] ? stats.total_us[w] / stats.evaluated[w] : 0));
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return json_send(req, json);
+}
+
+esp_err_t WebServer::calibration_get_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
     {
-        free(buffer);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to read request body");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
         return ESP_FAIL;
     }
 
-    buffer[content_len] = 0;
-    ESP_LOGI(TAG, "Received hotspot settings: %s", buffer);
+    SpellCalibration &calibration = g_wand_client->getCalibration();
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("temperature", calibration.getTemperature());
+    json.field("default", SPELL_CONFIDENCE_THRESHOLD);
+    json.beginObject("thresholds");
+    for (int i = 0; i < SPELL_OUTPUT_SIZE; i++)
+    {
+        json.field(SPELL_NAMES[i], calibration.getThreshold(i));
+    }
+    json.endObject();
+    json.endObject();
+    return json_send(req, json);
+}
 
-    // Parse settings
-    char *enabled_ptr = strstr(buffer, "\"enabled\"");
-    bool enabled = false;
-    if (enabled_ptr)
+// POST /calibration body, staged so nothing is applied unless every value is valid
+struct CalibrationUpdate
+{
+    bool reset;
+    bool has_temperature;
+    float temperature;
+    int spell_id; // -1: no "spell" (or an unknown one, then invalid is set)
+    bool has_threshold;
+    float threshold;
+    float table[SPELL_OUTPUT_SIZE];
+    int table_count; // Entries of "thresholds" received, -1 if absent
+    bool invalid;
+};
+
+// JsonReader callback: stage one calibration value
+static void stage_calibration(const char *key, int index, JsonValueType type, const char *value, size_t len,
+                              void *ctx)
+{
+    CalibrationUpdate *update = (CalibrationUpdate *)ctx;
+    bool number = type == JSON_VALUE_NUMBER;
+    if (index >= 0)
     {
-        char *value_ptr = strchr(enabled_ptr, ':');
-        if (value_ptr)
+        if (strcmp(key, "thresholds") != 0)
+            return;
+        if (!number || index >= SPELL_OUTPUT_SIZE)
         {
-            value_ptr++;
-            while (*value_ptr == ' ' || *value_ptr == '\t')
-                value_ptr++;
-            enabled = (strncmp(value_ptr, "true", 4) == 0);
+            update->invalid = true;
+            return;
         }
+        update->table[index] = strtof(value, nullptr);
+        update->table_count = index + 1;
+    }
+    else if (strcmp(key, "reset") == 0)
+    {
+        update->reset = type == JSON_VALUE_TRUE;
+    }
+    else if (strcmp(key, "temperature") == 0)
+    {
+        update->invalid |= !number;
+        update->has_temperature = true;
+        update->temperature = strtof(value, nullptr);
+    }
+    else if (strcmp(key, "spell") == 0)
+    {
+        update->spell_id = type == JSON_VALUE_STRING ? find_spell_index(value, len) : -1;
+        update->invalid |= update->spell_id < 0;
+    }
+    else if (strcmp(key, "threshold") == 0)
+    {
+        update->invalid |= !number;
+        update->has_threshold = true;
+        update->threshold = strtof(value, nullptr);
     }
+}
 
-    char ssid[32] = {0};
-    char password[64] = {0};
-    int channel = 1;
+esp_err_t WebServer::calibration_set_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
 
-    char *ssid_ptr = strstr(buffer, "\"ssid\":");
-    if (ssid_ptr)
+    // Any combination of:
+    //   {"reset":true}                         - every spell back to the default threshold
+    //   {"temperature":1.4}                    - temperature scaling of the model output
+    //   {"spell":"Incendio","threshold":0.9}   - one spell
+    //   {"thresholds":[0.99,0.9,...]}          - all spells in SPELL_NAMES order (calibrate_thresholds.py)
+    CalibrationUpdate update = {};
+    update.spell_id = -1;
+    update.table_count = -1;
+    JsonReader reader(stage_calibration, &update);
+    if (!read_json_body(req, reader))
     {
-        ssid_ptr += strlen("\"ssid\":");
-        while (*ssid_ptr == ' ')
-            ssid_ptr++;
-        if (*ssid_ptr == '\"')
-        {
-            ssid_ptr++;
-            char *end_quote = strchr(ssid_ptr, '\"');
-            if (end_quote)
-            {
-                size_t len = end_quote - ssid_ptr;
-                if (len < sizeof(ssid))
-                {
-                    strncpy(ssid, ssid_ptr, len);
-                }
-            }
-        }
+        return ESP_FAIL;
     }
 
-    char *password_ptr = strstr(buffer, "\"password\":");
-    if (password_ptr)
+    // Applied to a copy first: one bad value leaves the live calibration untouched
+    SpellCalibration &calibration = g_wand_client->getCalibration();
+    SpellCalibration staged = calibration;
+    bool ok = !update.invalid && update.has_threshold == (update.spell_id >= 0);
+    if (ok && update.reset)
     {
-        password_ptr += strlen("\"password\":");
-        while (*password_ptr == ' ')
-            password_ptr++;
-        if (*password_ptr == '\"')
+        staged.reset();
+    }
+    if (ok && update.has_temperature)
+    {
+        ok = staged.setTemperature(update.temperature);
+    }
+    if (ok && update.has_threshold)
+    {
+        ok = staged.setThreshold(update.spell_id, update.threshold);
+    }
+    if (ok && update.table_count >= 0)
+    {
+        ok = update.table_count == SPELL_OUTPUT_SIZE;
+        for (int i = 0; ok && i < SPELL_OUTPUT_SIZE; i++)
         {
-            password_ptr++;
-            char *end_quote = strchr(password_ptr, '\"');
-            if (end_quote)
-            {
-                size_t len = end_quote - password_ptr;
-                if (len < sizeof(password))
-                {
-                    strncpy(password, password_ptr, len);
-                }
-            }
+            ok = staged.setThreshold(i, update.table[i]);
         }
     }
 
-    char *channel_ptr = strstr(buffer, "\"channel\":");
-    if (channel_ptr)
+    bool saved = false;
+    if (ok)
     {
-        sscanf(channel_ptr, "\"channel\" : %d", &channel);
+        calibration = staged;
+        saved = calibration.save();
     }
-
-    // Save hotspot settings to NVS
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (err == ESP_OK)
+    else
     {
-        nvs_set_u8(nvs_handle, "hotspot_enabled", enabled ? 1 : 0);
-        if (strlen(ssid) > 0)
-        {
-            nvs_set_str(nvs_handle, "hotspot_ssid", ssid);
-        }
-        if (strlen(password) > 0)
-        {
-            nvs_set_str(nvs_handle, "hotspot_password", password);
-        }
-        nvs_set_u8(nvs_handle, "hotspot_channel", (uint8_t)channel);
-        nvs_commit(nvs_handle);
-        nvs_close(nvs_handle);
-        ESP_LOGI(TAG, "Hotspot settings saved: enabled=%d, SSID=%s, channel=%d", enabled, ssid, channel);
+        ESP_LOGW(TAG, "Calibration update rejected, nothing applied");
     }
 
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"Hotspot settings saved. Rebooting to apply changes...\"}");
-
-    free(buffer);
-
-    // Schedule reboot to apply hotspot changes
-    ESP_LOGI(TAG, "Hotspot configuration updated. Rebooting in 2 seconds...");
-    vTaskDelay(pdMS_TO_TICKS(2000));
-    esp_restart();
-
+    httpd_resp_sendstr(req, ok && saved ? "{\"success\":true}" : "{\"success\":false}");
     return ESP_OK;
 }
 
-esp_err_t WebServer::hotspot_get_handler(httpd_req_t *req)
+esp_err_t WebServer::segmenter_get_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "hotspot_get_handler called!");
-
-    // Load hotspot settings from NVS
-    char hotspot_ssid[32] = {0};
-    char hotspot_password[64] = {0};
-    uint8_t hotspot_channel = 6;
-    bool hotspot_enabled = false;
-
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
-    if (err == ESP_OK)
+    if (!g_wand_client)
     {
-        uint8_t enabled = 0;
-        nvs_get_u8(nvs_handle, "hotspot_enabled", &enabled);
-        hotspot_enabled = (enabled != 0);
-
-        size_t required_size;
-        err = nvs_get_str(nvs_handle, "hotspot_ssid", NULL, &required_size);
-        if (err == ESP_OK && required_size > 0 && required_size <= sizeof(hotspot_ssid))
-        {
-            nvs_get_str(nvs_handle, "hotspot_ssid", hotspot_ssid, &required_size);
-        }
-
-        err = nvs_get_str(nvs_handle, "hotspot_password", NULL, &required_size);
-        if (err == ESP_OK && required_size > 0 && required_size <= sizeof(hotspot_password))
-        {
-            nvs_get_str(nvs_handle, "hotspot_password", hotspot_password, &required_size);
-        }
-
-        uint8_t channel = 6;
-        nvs_get_u8(nvs_handle, "hotspot_channel", &channel);
-        if (channel >= 1 && channel <= 13)
-        {
-            hotspot_channel = channel;
-        }
-
-        nvs_close(nvs_handle);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
     }
 
-    // Build JSON response
-    char response[512];
-    snprintf(response, sizeof(response),
-             "{\"success\":true,\"enabled\":%s,\"ssid\":\"%s\",\"password\":\"%s\",\"channel\":%d}",
-             hotspot_enabled ? "true" : "false",
-             hotspot_ssid,
-             hotspot_password,
-             hotspot_channel);
-
+    const SegmenterStats &stats = g_wand_client->getSegmenterStats();
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, response);
-
-    return ESP_OK;
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("enabled", (bool)CONTINUOUS_SEGMENTATION);
+    json.field("started", (unsigned long)stats.started);
+    json.field("evaluated", (unsigned long)stats.evaluated);
+    json.field("rejected", (unsigned long)stats.rejected);
+    json.field("aborted", (unsigned long)stats.aborted);
+    json.field("recognized", (unsigned long)stats.recognized);
+    json.endObject();
+    return json_send(req, json);
 }
 
-esp_err_t WebServer::system_reboot_handler(httpd_req_t *req)
+esp_err_t WebServer::dataset_get_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "system_reboot_handler called! Rebooting in 2 seconds...");
+    if (!g_wand_client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
 
+    DatasetCapture &dataset = g_wand_client->getDatasetCapture();
+    const DatasetStats &stats = dataset.getStats();
+    uint8_t label = dataset.getLabel();
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"Rebooting device...\"}");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("enabled", dataset.isEnabled());
+    json.field("label", label < SPELL_OUTPUT_SIZE ? SPELL_NAMES[label] : "");
+    json.field("captured", (unsigned long)stats.captured);
+    json.field("written", (unsigned long)stats.written);
+    json.field("dropped", (unsigned long)stats.dropped);
+    json.field("evicted", (unsigned long)stats.evicted);
+    json.field("write_errors", (unsigned long)stats.write_errors);
+    json.field("segments", (unsigned)dataset.getSegmentCount());
+    json.field("max_segments", DATASET_MAX_SEGMENTS);
+    json.field("bytes", (unsigned)dataset.getStoredBytes());
+    json.endObject();
+    return json_send(req, json);
+}
 
-    // Schedule reboot after a short delay to allow response to be sent
-    vTaskDelay(pdMS_TO_TICKS(2000));
-    esp_restart();
+// POST /dataset body, staged so an unknown label changes nothing
+struct DatasetUpdate
+{
+    int enabled; // -1: not sent
+    bool clear;
+    int label;   // -1: not sent, else spell index or DATASET_LABEL_NONE
+    bool invalid;
+};
+
+// JsonReader callback: stage one dataset value
+static void stage_dataset(const char *key, int index, JsonValueType type, const char *value, size_t len,
+                          void *ctx)
+{
+    DatasetUpdate *update = (DatasetUpdate *)ctx;
+    if (index != -1)
+        return;
 
-    return ESP_OK;
+    if (strcmp(key, "clear") == 0)
+    {
+        update->clear = type == JSON_VALUE_TRUE;
+    }
+    else if (strcmp(key, "enabled") == 0)
+    {
+        update->enabled = type == JSON_VALUE_TRUE ? 1 : 0;
+        update->invalid |= type != JSON_VALUE_TRUE && type != JSON_VALUE_FALSE;
+    }
+    else if (strcmp(key, "label") == 0)
+    {
+        int spell_id = type == JSON_VALUE_STRING ? find_spell_index(value, len) : -1;
+        update->label = type == JSON_VALUE_STRING && len == 0 ? DATASET_LABEL_NONE : spell_id;
+        update->invalid |= update->label < 0;
+    }
 }
 
-esp_err_t WebServer::system_wifi_mode_handler(httpd_req_t *req)
+esp_err_t WebServer::dataset_set_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "system_wifi_mode_handler called!");
+    if (!g_wand_client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
 
-    // Read request body
-    char buf[100];
-    int ret = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (ret <= 0)
+    // Any combination of:
+    //   {"enabled":true}      - start/stop capturing casts
+    //   {"label":"Incendio"}  - label for following casts ("" = unlabelled)
+    //   {"clear":true}        - delete every captured segment
+    DatasetUpdate update = {-1, false, -1, false};
+    JsonReader reader(stage_dataset, &update);
+    if (!read_json_body(req, reader))
     {
-        httpd_resp_set_status(req, "400 Bad Request");
-        httpd_resp_sendstr(req, "{\"success\":false,\"message\":\"No data received\"}");
         return ESP_FAIL;
     }
-    buf[ret] = '\0';
 
-    // Parse JSON to extract mode
-    // Expected: {"mode":"client"} or {"mode":"ap"}
-    bool force_ap = false;
-    char *mode_ptr = strstr(buf, "\"mode\"");
-    if (mode_ptr)
+    DatasetCapture &dataset = g_wand_client->getDatasetCapture();
+    bool ok = !update.invalid;
+    if (ok && update.clear)
     {
-        char *value_ptr = strchr(mode_ptr, ':');
-        if (value_ptr)
-        {
-            value_ptr++;
-            while (*value_ptr == ' ' || *value_ptr == '\t')
-                value_ptr++;
-            if (*value_ptr == '\"')
-            {
-                value_ptr++;
-                if (strncmp(value_ptr, "ap", 2) == 0)
-                {
-                    force_ap = true;
-                }
-            }
-        }
+        ok = dataset.clear();
+    }
+    if (ok && update.label >= 0)
+    {
+        dataset.setLabel((uint8_t)update.label);
+    }
+    if (ok && update.enabled == 1)
+    {
+        ok = dataset.setEnabled(true);
+    }
+    else if (ok && update.enabled == 0)
+    {
+        dataset.setEnabled(false);
+        dataset.flush();
     }
 
-    ESP_LOGI(TAG, "Setting force_ap_mode to %d", force_ap ? 1 : 0);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, ok ? "{\"success\":true}" : "{\"success\":false}");
+    return ESP_OK;
+}
 
-    // Save to NVS
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (err == ESP_OK)
+static bool dataset_send_chunk(const uint8_t *data, size_t len, void *ctx)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, (const char *)data, len) == ESP_OK;
+}
+
+esp_err_t WebServer::dataset_download_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
+
+    // Segment files concatenated oldest-first (decode with dataset_decode.py)
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"wand_dataset.bin\"");
+    bool ok = g_wand_client->getDatasetCapture().download(dataset_send_chunk, req);
+    httpd_resp_send_chunk(req, nullptr, 0);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+static void write_top_k(JsonWriter &json, const uint8_t *top_index, const float *top_score)
+{
+    json.beginArray("top");
+    for (int k = 0; k < GESTURE_HISTORY_TOP_K && top_index[k] < SPELL_OUTPUT_SIZE; k++)
     {
-        err = nvs_set_u8(nvs_handle, "force_ap_mode", force_ap ? 1 : 0);
-        if (err != ESP_OK)
-        {
-            ESP_LOGW(TAG, "Failed to save force_ap_mode to NVS");
-        }
-        nvs_commit(nvs_handle);
-        nvs_close(nvs_handle);
+        json.beginObject();
+        json.field("spell", SPELL_NAMES[top_index[k]]);
+        json.field("score", top_score[k], 4);
+        json.endObject();
     }
-    else
+    json.endArray();
+}
+
+esp_err_t WebServer::history_get_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
     {
-        ESP_LOGW(TAG, "Failed to open NVS for force_ap_mode");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
     }
 
+    GestureHistory &history = g_wand_client->getGestureHistory();
+    const GestureHistoryStats &stats = history.getStats();
+
+    // Summary only (no positions/tensors), newest first
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"WiFi mode will change after reboot\"}");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("depth", (unsigned)history.getDepth());
+    json.field("recorded", (unsigned long)stats.recorded);
+    json.field("dropped", (unsigned long)stats.dropped);
+    json.beginArray("entries");
+    uint32_t first = history.firstId();
+    for (uint32_t id = history.lastId(); id >= first && id > 0; id--)
+    {
+        GestureHistoryRecord record;
+        if (!history.getRecord(id, &record))
+        {
+            continue;
+        }
+        uint8_t top_index[GESTURE_HISTORY_TOP_K];
+        float top_score[GESTURE_HISTORY_TOP_K];
+        memcpy(top_index, record.top_index, sizeof(top_index));
+        memcpy(top_score, record.top_score, sizeof(top_score));
+
+        json.beginObject();
+        json.field("id", (unsigned long)record.id);
+        json.field("timestamp_ms", (unsigned long)record.timestamp_ms);
+        json.field("duration_ms", (unsigned long)record.duration_ms);
+        json.field("positions", (unsigned)record.position_count);
+        json.field("flags", (unsigned)record.flags);
+        json.field("recognized", (record.flags & GESTURE_HISTORY_FLAG_RECOGNIZED) != 0);
+        json.field("windows", (unsigned)record.window_count);
+        json.field("preprocess_us", (unsigned long)record.preprocess_us);
+        json.field("detect_us", (unsigned long)record.detect_us);
+        json.field("custom_us", (unsigned long)record.custom_us);
+        write_top_k(json, top_index, top_score);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return json_send(req, json);
+}
 
-    // Schedule reboot after a short delay to allow response to be sent
-    vTaskDelay(pdMS_TO_TICKS(2000));
-    esp_restart();
+esp_err_t WebServer::history_download_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
 
-    return ESP_OK;
+    // Layout documented in gesture_history.h
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"wand_history.bin\"");
+    bool ok = g_wand_client->getGestureHistory().download(dataset_send_chunk, req);
+    httpd_resp_send_chunk(req, nullptr, 0);
+    return ok ? ESP_OK : ESP_FAIL;
 }
 
-esp_err_t WebServer::system_reset_nvs_handler(httpd_req_t *req)
+// POST /history/replay body
+struct ReplayRequest
 {
-    ESP_LOGI(TAG, "system_reset_nvs_handler called! Clearing ALL NVS settings...");
+    long id; // 0: newest cast
+    long runs;
+    bool invalid;
+};
+
+// JsonReader callback: "id" and "runs" must be positive integers
+static void read_replay_field(const char *key, int index, JsonValueType type, const char *value, size_t len,
+                              void *ctx)
+{
+    ReplayRequest *request = (ReplayRequest *)ctx;
+    long *target = strcmp(key, "id") == 0 ? &request->id : strcmp(key, "runs") == 0 ? &request->runs : nullptr;
+    if (index != -1 || !target)
+        return;
 
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, "{\"success\":true,\"message\":\"Resetting to defaults...\"}");
+    char *end = nullptr;
+    *target = type == JSON_VALUE_NUMBER ? strtol(value, &end, 10) : 0;
+    request->invalid |= type != JSON_VALUE_NUMBER || end != value + len || *target < 1;
+}
 
-    // Allow response to be sent
-    vTaskDelay(pdMS_TO_TICKS(1000));
+esp_err_t WebServer::history_replay_handler(httpd_req_t *req)
+{
+    if (!g_wand_client)
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
 
-    // Erase NVS partition
-    esp_err_t err = nvs_flash_erase();
-    if (err == ESP_OK)
+    // {"id":12,"runs":20} - id defaults to the newest cast, runs to 1; an empty body replays the newest once
+    ReplayRequest request = {0, 1, false};
+    JsonReader reader(read_replay_field, &request);
+    if (req->content_len > 0 && !read_json_body(req, reader))
     {
-        ESP_LOGI(TAG, "NVS erased successfully");
-        // Reinitialize NVS
-        err = nvs_flash_init();
-        if (err == ESP_OK)
-        {
-            ESP_LOGI(TAG, "NVS reinitialized successfully");
-        }
-        else
-        {
-            ESP_LOGW(TAG, "NVS reinit failed: %s", esp_err_to_name(err));
-        }
+        return ESP_FAIL;
     }
-    else
+    if (request.invalid)
     {
-        ESP_LOGW(TAG, "NVS erase failed: %s", esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "id and runs must be positive integers");
+        return ESP_FAIL;
     }
 
-    // Reboot after delay
-    vTaskDelay(pdMS_TO_TICKS(1000));
-    esp_restart();
+    GestureHistory &history = g_wand_client->getGestureHistory();
+    uint32_t id = request.id > 0 ? (uint32_t)request.id : history.lastId();
+    int runs = request.runs < GESTURE_REPLAY_MAX_RUNS ? (int)request.runs : GESTURE_REPLAY_MAX_RUNS;
+    if (id == 0 || id < history.firstId() || id > history.lastId())
+    {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Cast not in history");
+        return ESP_FAIL;
+    }
 
-    return ESP_OK;
+    GestureReplayResult result;
+    if (!g_wand_client->replayGesture(id, runs, &result))
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Replay failed");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("id", (unsigned long)result.id);
+    json.field("model", g_wand_client->getActiveModelName());
+    json.field("runs", (unsigned)result.runs);
+    json.field("spell", result.spell);
+    json.field("predicted", result.predicted >= 0 && result.predicted < SPELL_OUTPUT_SIZE ? SPELL_NAMES[result.predicted] : nullptr);
+    json.field("confidence", result.confidence, 4);
+    write_top_k(json, result.top_index, result.top_score);
+    if (result.tensor_max_diff >= 0.0f)
+    {
+        json.field("tensor_max_diff", result.tensor_max_diff, 6);
+    }
+    else
+    {
+        json.fieldNull("tensor_max_diff");
+    }
+    json.beginObject("preprocess_us");
+    json.field("min", (unsigned long)result.preprocess_us_min);
+    json.field("avg", (unsigned long)result.preprocess_us_avg);
+    json.field("max", (unsigned long)result.preprocess_us_max);
+    json.endObject();
+    json.beginObject("detect_us");
+    json.field("min", (unsigned long)result.detect_us_min);
+    json.field("avg", (unsigned long)result.detect_us_avg);
+    json.field("max", (unsigned long)result.detect_us_max);
+    json.endObject();
+    json.endObject();
+    return json_send(req, json);
 }
 
-esp_err_t WebServer::system_get_wifi_mode_handler(httpd_req_t *req)
+esp_err_t WebServer::personalize_get_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "system_get_wifi_mode_handler called");
-
-    // Check force_ap_mode flag from NVS
-    bool force_ap = false;
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
-    if (err == ESP_OK)
+    if (!g_wand_client)
     {
-        uint8_t ap_mode = 0;
-        err = nvs_get_u8(nvs_handle, "force_ap_mode", &ap_mode);
-        if (err == ESP_OK && ap_mode == 1)
-        {
-            force_ap = true;
-        }
-        nvs_close(nvs_handle);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
     }
 
-    // Also check current WiFi mode
-    wifi_mode_t current_mode;
-    esp_wifi_get_mode(&current_mode);
-
-    char response[200];
-    snprintf(response, sizeof(response),
-             "{\"success\":true,\"mode\":\"%s\",\"current_wifi_mode\":\"%s\",\"force_ap\":%s}",
-             force_ap ? "ap" : "client",
-             current_mode == WIFI_MODE_AP ? "AP" : (current_mode == WIFI_MODE_STA ? "STA" : "APSTA"),
-             force_ap ? "true" : "false");
+    SpellPersonalization &personalization = g_wand_client->getPersonalization();
+    const PersonalizationStats &stats = personalization.getStats();
+    char names[PERSONALIZATION_MAX_PROFILES][PERSONALIZATION_NAME_LEN];
+    size_t profile_count = personalization.listProfiles(names, PERSONALIZATION_MAX_PROFILES);
+    PersonalizationClass classes[PERSONALIZATION_MAX_CLASSES];
+    size_t class_count = personalization.getClasses(classes, PERSONALIZATION_MAX_CLASSES);
 
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, response);
-
-    return ESP_OK;
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("enabled", (bool)SPELL_PERSONALIZATION);
+    json.field("profile", personalization.getProfileName());
+    json.field("applied", (unsigned long)stats.applied);
+    json.field("changed", (unsigned long)stats.changed);
+    json.field("corrections", (unsigned long)stats.corrections);
+    json.field("last_us", (unsigned long)stats.last_us);
+    json.field("avg_us", (unsigned long)(stats.applied ? stats.total_us / stats.applied : 0));
+    json.field("max_profiles", PERSONALIZATION_MAX_PROFILES);
+    json.field("max_classes", PERSONALIZATION_MAX_CLASSES);
+    json.beginArray("profiles");
+    for (size_t i = 0; i < profile_count; i++)
+    {
+        json.item(names[i]);
+    }
+    json.endArray();
+    json.beginArray("classes");
+    for (size_t i = 0; i < class_count; i++)
+    {
+        json.beginObject();
+        json.field("spell", classes[i].spell < SPELL_OUTPUT_SIZE ? SPELL_NAMES[classes[i].spell] : "?");
+        json.field("examples", classes[i].count);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return json_send(req, json);
 }
 
-esp_err_t WebServer::debug_nvs_handler(httpd_req_t *req)
+esp_err_t WebServer::personalize_set_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "debug_nvs_handler called - showing stored NVS values");
-
-    char response[1024];
-    char wifi_ssid[32] = {0};
-    char wifi_password[64] = {0};
-    char wand_mac[18] = {0};
-    char mqtt_broker[128] = {0};
-    char mqtt_username[64] = {0};
-    char mqtt_password[64] = {0};
-    bool ha_mqtt_enabled = false;
-    bool force_ap_mode = false;
-
-    nvs_handle_t nvs_handle;
-    esp_err_t err = nvs_open("storage", NVS_READONLY, &nvs_handle);
-    if (err == ESP_OK)
+    if (!g_wand_client)
     {
-        size_t required_size;
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "BLE client not initialized");
+        return ESP_FAIL;
+    }
 
-        // WiFi credentials
-        required_size = sizeof(wifi_ssid);
-        nvs_get_str(nvs_handle, "wifi_ssid", wifi_ssid, &required_size);
+    char content[128];
+    int ret = httpd_req_recv(req, content, sizeof(content) - 1);
+    if (ret <= 0)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
+        return ESP_FAIL;
+    }
+    content[ret] = '\0';
 
-        required_size = sizeof(wifi_password);
-        nvs_get_str(nvs_handle, "wifi_password", wifi_password, &required_size);
+    // Parse JSON, one of:
+    //   {"profile":"alice"}      - switch to (or create) a user profile
+    //   {"correct":"Incendio"}   - the last cast was this spell
+    //   {"reset":true}           - forget the active profile's corrections
+    SpellPersonalization &personalization = g_wand_client->getPersonalization();
+    bool ok = false;
+
+    char *profile_start = strstr(content, "\"profile\":\"");
+    char *correct_start = strstr(content, "\"correct\":\"");
+    if (profile_start)
+    {
+        profile_start += 11; // Skip "profile":"
+        char *profile_end = strchr(profile_start, '"');
+        char name[PERSONALIZATION_NAME_LEN];
+        if (profile_end && (size_t)(profile_end - profile_start) < sizeof(name))
+        {
+            memcpy(name, profile_start, profile_end - profile_start);
+            name[profile_end - profile_start] = '\0';
+            ok = personalization.selectProfile(name);
+        }
+    }
+    else if (correct_start)
+    {
+        correct_start += 11; // Skip "correct":"
+        char *correct_end = strchr(correct_start, '"');
+        int spell_id = correct_end ? find_spell_index(correct_start, correct_end - correct_start) : -1;
+        ok = spell_id >= 0 && personalization.correct(spell_id);
+    }
+    else if (strstr(content, "\"reset\":true"))
+    {
+        ok = personalization.resetProfile();
+    }
 
-        // Wand MAC
-        required_size = sizeof(wand_mac);
-        nvs_get_str(nvs_handle, "wand_mac", wand_mac, &required_size);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, ok ? "{\"success\":true}" : "{\"success\":false}");
+    return ESP_OK;
+}
 
-        // MQTT settings
-        uint8_t mqtt_enabled = 0;
-        nvs_get_u8(nvs_handle, "ha_mqtt_enabled", &mqtt_enabled);
-        ha_mqtt_enabled = (mqtt_enabled != 0);
+// Custom 404 handler that intercepts gesture image requests
+// Append one format's counters and per-second rates
+static void write_ws_stats(JsonWriter &json, const char *name, const WsFormatStats &stats, double seconds)
+{
+    json.beginObject(name);
+    json.field("messages", (unsigned long)stats.messages);
+    json.field("frames", (unsigned long)stats.frames);
+    json.field("bytes", (unsigned long long)stats.bytes);
+    json.field("encode_us", (unsigned long long)stats.encode_us);
+    json.field("queue_us", (unsigned long long)stats.queue_us);
+    json.field("send_us", (unsigned long long)stats.send_us);
+    json.field("frames_per_s", seconds > 0 ? stats.frames / seconds : 0.0, 1);
+    json.field("bytes_per_s", seconds > 0 ? stats.bytes / seconds : 0.0, 0);
+    json.field("cpu_us_per_s", seconds > 0 ? (stats.encode_us + stats.queue_us + stats.send_us) / seconds : 0.0, 0);
+    json.field("encode_ns_per_msg", stats.messages ? stats.encode_us * 1000.0 / stats.messages : 0.0, 0);
+    json.endObject();
+}
 
-        required_size = sizeof(mqtt_broker);
-        nvs_get_str(nvs_handle, "mqtt_broker", mqtt_broker, &required_size);
+// Both encodings of one stream; batching latency applies to binary samples only
+static void write_ws_stream(JsonWriter &json, const char *name, const WsStreamStats &stats, double seconds)
+{
+    json.beginObject(name);
+    write_ws_stats(json, "json", stats.json, seconds);
+    write_ws_stats(json, "binary", stats.binary, seconds);
+    json.field("batch_wait_avg_us",
+               (unsigned long)(stats.binary.messages ? stats.batch_wait_us / stats.binary.messages : 0));
+    json.field("batch_wait_max_us", (unsigned long)stats.batch_wait_max_us);
+    json.field("batch_dropped", (unsigned long)stats.batch_dropped);
+    json.endObject();
+}
 
-        required_size = sizeof(mqtt_username);
-        nvs_get_str(nvs_handle, "mqtt_username", mqtt_username, &required_size);
+esp_err_t WebServer::ws_stats_handler(httpd_req_t *req)
+{
+    WebServer *server = (WebServer *)req->user_ctx;
 
-        required_size = sizeof(mqtt_password);
-        nvs_get_str(nvs_handle, "mqtt_password", mqtt_password, &required_size);
+    // GET /ws/stats?reset=1 starts a new measurement window
+    char query[32];
+    char value[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "reset", value, sizeof(value)) == ESP_OK)
+    {
+        memset(&server->gesture_stats, 0, sizeof(server->gesture_stats));
+        memset(&server->imu_stats, 0, sizeof(server->imu_stats));
+        memset(server->topic_stats, 0, sizeof(server->topic_stats));
+        if (xSemaphoreTake(server->client_mutex, pdMS_TO_TICKS(100)) == pdTRUE)
+        {
+            for (int i = 0; i < server->ws_client_count; i++)
+            {
+                memset(&server->ws_clients[i].stats, 0, sizeof(WsClientStats));
+            }
+            xSemaphoreGive(server->client_mutex);
+        }
+        server->stats_since_us = esp_timer_get_time();
+    }
 
-        // WiFi mode
-        uint8_t ap_mode = 0;
-        nvs_get_u8(nvs_handle, "force_ap_mode", &ap_mode);
-        force_ap_mode = (ap_mode != 0);
+    double seconds = (esp_timer_get_time() - server->stats_since_us) / 1e6;
+    WsStreamStats gesture = server->gesture_stats;
+    WsStreamStats imu = server->imu_stats;
 
-        nvs_close(nvs_handle);
+    // Per-client queue snapshot
+    int fds[WS_MAX_CLIENTS];
+    bool binary[WS_MAX_CLIENTS];
+    int depth[WS_MAX_CLIENTS];
+    uint16_t topics[WS_MAX_CLIENTS];
+    uint16_t max_hz[WS_MAX_CLIENTS][WS_TOPIC_COUNT];
+    WsClientStats client_stats[WS_MAX_CLIENTS];
+    int client_count = 0;
+    if (xSemaphoreTake(server->client_mutex, pdMS_TO_TICKS(100)) == pdTRUE)
+    {
+        for (int i = 0; i < server->ws_client_count; i++)
+        {
+            fds[client_count] = server->ws_clients[i].fd;
+            binary[client_count] = server->ws_clients[i].binary;
+            depth[client_count] = server->ws_clients[i].depth;
+            topics[client_count] = server->ws_clients[i].topics;
+            memcpy(max_hz[client_count], server->ws_clients[i].max_hz, sizeof(max_hz[0]));
+            client_stats[client_count++] = server->ws_clients[i].stats;
+        }
+        xSemaphoreGive(server->client_mutex);
     }
 
-    snprintf(response, sizeof(response),
-             "{\"success\":true,"
-             "\"nvs\":{"
-             "\"wifi_ssid\":\"%s\","
-             "\"wifi_password\":\"%s\","
-             "\"wand_mac\":\"%s\","
-             "\"mqtt_broker\":\"%s\","
-             "\"mqtt_username\":\"%s\","
-             "\"mqtt_password\":\"%s\","
-             "\"ha_mqtt_enabled\":%s,"
-             "\"force_ap_mode\":%s"
-             "}}",
-             wifi_ssid,
-             strlen(wifi_password) > 0 ? "***" : "",
-             wand_mac,
-             mqtt_broker,
-             mqtt_username,
-             strlen(mqtt_password) > 0 ? "***" : "",
-             ha_mqtt_enabled ? "true" : "false",
-             force_ap_mode ? "true" : "false");
-
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, response);
-
-    ESP_LOGI(TAG, "NVS Debug: mqtt_broker='%s', mqtt_username='%s', ha_mqtt_enabled=%d",
-             mqtt_broker, mqtt_username, ha_mqtt_enabled);
-
-    return ESP_OK;
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    char buf[JSON_CHUNK_SIZE];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("clients", server->ws_client_count);
+    json.field("binary_clients", server->ws_binary_client_count);
+    json.field("seconds", seconds, 1);
+    json.field("batch_window_ms", WS_BATCH_WINDOW_MS);
+    write_ws_stream(json, "gesture_point", gesture, seconds);
+    write_ws_stream(json, "imu", imu, seconds);
+
+    // Formatting done vs avoided per topic (no subscriber / every subscriber over its rate)
+    json.beginObject("topics");
+    for (int t = 0; t < WS_TOPIC_COUNT; t++)
+    {
+        json.beginObject(WS_TOPIC_NAMES[t]);
+        json.field("formatted", (unsigned long)server->topic_stats[t].formatted);
+        json.field("skipped", (unsigned long)server->topic_stats[t].skipped);
+        json.endObject();
+    }
+    json.endObject();
+
+    json.beginArray("queues");
+    for (int i = 0; i < client_count; i++)
+    {
+        const WsClientStats &q = client_stats[i];
+        char subscribed[128];
+        size_t used = 0;
+        subscribed[0] = '\0';
+        for (int t = 0; t < WS_TOPIC_COUNT && used < sizeof(subscribed); t++)
+        {
+            if (topics[i] & (1u << t))
+            {
+                used += snprintf(subscribed + used, sizeof(subscribed) - used, max_hz[i][t] ? "%s%s:%u" : "%s%s",
+                                 used ? "," : "", WS_TOPIC_NAMES[t], max_hz[i][t]);
+            }
+        }
+        json.beginObject();
+        json.field("fd", fds[i]);
+        json.field("binary", binary[i]);
+        json.field("topics", subscribed);
+        json.field("depth", depth[i]);
+        json.field("max_depth", (unsigned long)q.max_depth);
+        json.field("queued", (unsigned long)q.queued);
+        json.field("sent", (unsigned long)q.sent);
+        json.field("dropped", (unsigned long)q.dropped);
+        json.field("replaced", (unsigned long)q.replaced);
+        json.field("decimated", (unsigned long)q.decimated);
+        json.field("latency_avg_us", (unsigned long)(q.sent ? q.latency_us / q.sent : 0));
+        json.field("latency_max_us", (unsigned long)q.latency_max_us);
+        json.field("send_avg_us", (unsigned long)(q.sent ? q.send_us / q.sent : 0));
+        json.field("send_max_us", (unsigned long)q.send_max_us);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return json_send(req, json);
 }
 
-// Custom 404 handler that intercepts gesture image requests
 esp_err_t WebServer::gesture_404_handler(httpd_req_t *req, httpd_err_code_t error)
 {
     // Check if this is a gesture image request
     const char *uri = req->uri;
     if (strncmp(uri, "/gesture/", 9) == 0)
     {
-        ESP_LOGI(TAG, "404 handler intercepted gesture request: %s", uri);
         // This is a gesture request - serve the image
         return gesture_image_handler(req);
     }
@@ -4488,12 +4932,11 @@ esp_err_t WebServer::gesture_404_handler(httpd_req_t *req, httpd_err_code_t erro
 
 esp_err_t WebServer::gesture_image_handler(httpd_req_t *req)
 {
-    // Extract spell name from URI: /gesture/<spell_name>.png
+    // Extract file name from URI: /gesture/<spell_name>.png[?query]
     const char *uri = req->uri;
     const char *prefix = "/gesture/";
     size_t prefix_len = strlen(prefix);
-
-    ESP_LOGI(TAG, "Gesture request received: %s", uri);
+    int64_t start_us = esp_timer_get_time();
 
     if (strncmp(uri, prefix, prefix_len) != 0)
     {
@@ -4502,65 +4945,174 @@ esp_err_t WebServer::gesture_image_handler(httpd_req_t *req)
         return ESP_FAIL;
     }
 
-    // Get filename (spell_name.png)
-    const char *filename_start = uri + prefix_len;
-    char filepath[128];
-    snprintf(filepath, sizeof(filepath), "/spiffs/%s", filename_start);
+    char name[IMAGE_CACHE_NAME_LEN];
+    size_t name_len = strcspn(uri + prefix_len, "?#");
+    if (name_len == 0 || name_len >= sizeof(name))
+    {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+    memcpy(name, uri + prefix_len, name_len);
+    name[name_len] = '\0';
+    if (strchr(name, '/') || strstr(name, ".."))
+    {
+        ESP_LOGW(TAG, "Rejected gesture image name: %s", name);
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    // Atlas images are sent straight from mapped flash
+    const GestureAtlasEntry *image = gesture_atlas.find(name);
+    if (image)
+    {
+        httpd_resp_set_type(req, "image/png");
+        httpd_resp_set_hdr(req, "Cache-Control", "public, max-age=86400"); // Cache for 1 day, then revalidate
+        char etag[20];
+        snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long)image->hash);
+        httpd_resp_set_hdr(req, "X-Cache", "atlas");
+        bool modified = !send_not_modified(req, etag);
+        if (modified)
+        {
+            httpd_resp_send(req, (const char *)gesture_atlas.data(image), image->size);
+        }
+        REQUEST_LOGI("Gesture image %s: %s (atlas, %lld us)", name, modified ? "sent" : "304",
+                     (long long)(esp_timer_get_time() - start_us));
+        return ESP_OK;
+    }
 
-    ESP_LOGI(TAG, "Looking for gesture image: %s", filepath);
+    char filepath[128];
+    snprintf(filepath, sizeof(filepath), "/spiffs/%s", name);
 
-    // Open file from SPIFFS
-    FILE *file = fopen(filepath, "r");
-    if (!file)
+    // Cached images skip the SPIFFS read; the stat catches a file replaced since it was cached
+    struct stat st;
+    if (stat(filepath, &st) != 0)
     {
         ESP_LOGE(TAG, "Gesture image not found: %s (errno: %d - %s)",
                  filepath, errno, strerror(errno));
         httpd_resp_send_404(req);
         return ESP_FAIL;
     }
+    size_t file_size = (size_t)st.st_size;
+    const ImageCacheEntry *entry = image_cache.find(name, file_size, (int64_t)st.st_mtime);
+    bool hit = entry != nullptr;
+    if (!entry)
+    {
+        entry = image_cache.load(name, filepath, file_size, (int64_t)st.st_mtime);
+    }
 
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    size_t file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    httpd_resp_set_type(req, "image/png");
+    httpd_resp_set_hdr(req, "Cache-Control", "public, max-age=86400"); // Cache for 1 day, then revalidate
+    httpd_resp_set_hdr(req, "X-Cache", hit ? "hit" : "miss");
 
-    ESP_LOGI(TAG, "Serving gesture image: %s (size: %zu bytes)", filepath, file_size);
+    if (entry)
+    {
+        if (send_not_modified(req, entry->etag))
+        {
+            REQUEST_LOGI("Gesture image %s: 304 (%s, %lld us)", name, hit ? "hit" : "miss",
+                         (long long)(esp_timer_get_time() - start_us));
+            return ESP_OK;
+        }
 
-    // Set content type and headers
-    httpd_resp_set_type(req, "image/png");
-    httpd_resp_set_hdr(req, "Cache-Control", "public, max-age=86400"); // Cache for 1 day
+        httpd_resp_send(req, (const char *)entry->data, entry->size);
+        REQUEST_LOGI("Gesture image %s: %u bytes (%s, %lld us)", name, (unsigned)entry->size,
+                     hit ? "hit" : "miss", (long long)(esp_timer_get_time() - start_us));
+        return ESP_OK;
+    }
 
-    // Allocate buffer for file transfer
-    char *buffer = (char *)malloc(1024);
-    if (!buffer)
+    // Too large for the cache (or no memory): stream from SPIFFS without a validator
+    FILE *file = fopen(filepath, "rb");
+    char *buffer = (char *)malloc(GESTURE_IMAGE_CHUNK_SIZE);
+    if (!file || !buffer)
     {
-        fclose(file);
+        if (file)
+            fclose(file);
+        free(buffer);
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
 
-    // Stream file to client
     size_t bytes_remaining = file_size;
     while (bytes_remaining > 0)
     {
-        size_t chunk_size = (bytes_remaining > 1024) ? 1024 : bytes_remaining;
+        size_t chunk_size = (bytes_remaining > GESTURE_IMAGE_CHUNK_SIZE) ? GESTURE_IMAGE_CHUNK_SIZE : bytes_remaining;
         size_t bytes_read = fread(buffer, 1, chunk_size, file);
-
-        if (bytes_read > 0)
-        {
-            httpd_resp_send_chunk(req, buffer, bytes_read);
-            bytes_remaining -= bytes_read;
-        }
-        else
+        if (bytes_read == 0 || httpd_resp_send_chunk(req, buffer, bytes_read) != ESP_OK)
         {
-            break; // EOF or error
+            break; // EOF, error or client gone
         }
+        bytes_remaining -= bytes_read;
     }
-
-    // Finish response
     httpd_resp_send_chunk(req, NULL, 0);
 
     free(buffer);
     fclose(file);
+    REQUEST_LOGI("Gesture image %s: %u bytes streamed (%lld us)", name, (unsigned)file_size,
+                 (long long)(esp_timer_get_time() - start_us));
+    return ESP_OK;
+}
+
+esp_err_t WebServer::gesture_index_handler(httpd_req_t *req)
+{
+    // Offsets are into /gestures/atlas, so the page can preload every image with one request
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (!gesture_atlas.isLoaded())
+    {
+        httpd_resp_sendstr(req, "{\"source\":\"spiffs\",\"images\":[]}");
+        return ESP_OK;
+    }
+
+    char etag[20];
+    snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long)gesture_atlas.hash());
+    if (send_not_modified(req, etag))
+    {
+        return ESP_OK;
+    }
+
+    // Entries are batched into ~1 KB chunks rather than one chunk each
+    char buf[1024];
+    char hash[17];
+    JsonWriter json(buf, sizeof(buf), json_chunk_sink, req);
+    json.beginObject();
+    json.field("source", "atlas");
+    json.field("size", (unsigned)gesture_atlas.size());
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)gesture_atlas.hash());
+    json.field("hash", hash);
+    json.beginArray("images");
+    for (size_t i = 0; i < gesture_atlas.count(); i++)
+    {
+        const GestureAtlasEntry *image = gesture_atlas.entry(i);
+        json.beginObject();
+        json.field("name", image->name);
+        json.field("offset", (unsigned long)image->offset);
+        json.field("size", (unsigned long)image->size);
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)image->hash);
+        json.field("hash", hash);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    return json_send(req, json);
+}
+
+esp_err_t WebServer::gesture_atlas_handler(httpd_req_t *req)
+{
+    if (!gesture_atlas.isLoaded())
+    {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No gesture atlas flashed");
+        return ESP_FAIL;
+    }
+
+    char etag[20];
+    snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long)gesture_atlas.hash());
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (send_not_modified(req, etag))
+    {
+        return ESP_OK;
+    }
+
+    // Whole mapped extent in one send - lwIP copies straight out of flash
+    httpd_resp_send(req, (const char *)gesture_atlas.image(), gesture_atlas.size());
     return ESP_OK;
 }
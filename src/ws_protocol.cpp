@@ -0,0 +1,106 @@
+#include "ws_protocol.h"
+#include <string.h>
+#include <math.h>
+
+uint16_t ws_float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF)
+    {
+        // Inf / NaN
+        return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+    }
+    if (exponent >= 31)
+    {
+        return sign | 0x7C00; // Overflow
+    }
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+        {
+            return sign; // Underflow to zero
+        }
+        // Subnormal: shift the implicit 1 in, round to nearest
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1)
+        {
+            half++;
+        }
+        return sign | (uint16_t)half;
+    }
+
+    uint16_t half = sign | (uint16_t)(exponent << 10) | (uint16_t)(mantissa >> 13);
+    if (mantissa & 0x1000)
+    {
+        half++; // Round to nearest (carries into the exponent correctly)
+    }
+    return half;
+}
+
+static int16_t to_position(float mm)
+{
+    float scaled = roundf(mm * WS_POSITION_SCALE);
+    if (scaled > 32767.0f)
+        return 32767;
+    if (scaled < -32768.0f)
+        return -32768;
+    return (int16_t)scaled;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+size_t ws_encode_gesture_points(uint8_t *buf, size_t len, uint16_t sequence,
+                                const float *xy, size_t count)
+{
+    size_t size = sizeof(WsFrameHeader) + count * WS_GESTURE_POINT_SIZE;
+    if (!buf || count == 0 || count > 255 || size > len)
+    {
+        return 0;
+    }
+
+    buf[0] = WS_MSG_GESTURE_POINTS;
+    buf[1] = (uint8_t)count;
+    put_u16(buf + 2, sequence);
+    uint8_t *p = buf + sizeof(WsFrameHeader);
+    for (size_t i = 0; i < count; i++)
+    {
+        // Same flip as the JSON gesture_point (wand down = screen down)
+        put_u16(p, (uint16_t)to_position(xy[2 * i]));
+        put_u16(p + 2, (uint16_t)to_position(-xy[2 * i + 1]));
+        p += WS_GESTURE_POINT_SIZE;
+    }
+    return size;
+}
+
+size_t ws_encode_imu(uint8_t *buf, size_t len, uint16_t sequence,
+                     const float *samples, size_t count)
+{
+    size_t size = sizeof(WsFrameHeader) + count * WS_IMU_SAMPLE_SIZE;
+    if (!buf || count == 0 || count > 255 || size > len)
+    {
+        return 0;
+    }
+
+    buf[0] = WS_MSG_IMU;
+    buf[1] = (uint8_t)count;
+    put_u16(buf + 2, sequence);
+    uint8_t *p = buf + sizeof(WsFrameHeader);
+    for (size_t i = 0; i < count * 6; i++)
+    {
+        put_u16(p, ws_float_to_half(samples[i]));
+        p += 2;
+    }
+    return size;
+}
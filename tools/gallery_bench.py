@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Time a full gesture gallery load against the wand's web server.
+
+Fetches every /gesture/<name>.png (names from the local gestures/ directory) with a
+browser-like number of parallel connections, three passes:
+  cold        first load after boot (atlas, or SPIFFS cache misses)
+  warm        same requests again (atlas, or served from the image cache)
+  revalidate  with If-None-Match from the warm pass (expect 304s, no body)
+and, when the gesture atlas is flashed, the one-request preload the page uses
+(/gestures/index + /gestures/atlas).
+
+Usage:
+  tools/gallery_bench.py [--host 192.168.4.1] [--connections 6] [--gestures gestures]
+"""
+import argparse
+import http.client
+import json
+import os
+import statistics
+import sys
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+
+def fetch(host, name, etag):
+    conn = http.client.HTTPConnection(host, timeout=10)
+    headers = {"If-None-Match": etag} if etag else {}
+    start = time.perf_counter()
+    conn.request("GET", "/gesture/" + name, headers=headers)
+    resp = conn.getresponse()
+    body = resp.read()
+    elapsed = time.perf_counter() - start
+    result = (name, resp.status, len(body), elapsed, resp.getheader("ETag"), resp.getheader("X-Cache"))
+    conn.close()
+    return result
+
+
+def run_pass(label, host, names, connections, etags):
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=connections) as pool:
+        results = list(pool.map(lambda n: fetch(host, n, etags.get(n)), names))
+    total = time.perf_counter() - start
+
+    latencies = sorted(r[3] * 1000 for r in results)
+    statuses = {}
+    for r in results:
+        statuses[r[1]] = statuses.get(r[1], 0) + 1
+    sources = {}
+    for r in results:
+        sources[r[5]] = sources.get(r[5], 0) + 1
+    print("%-10s total %7.1f ms  median %6.1f ms  p95 %6.1f ms  bytes %8d  source %s  status %s" % (
+        label, total * 1000, statistics.median(latencies), latencies[int(len(latencies) * 0.95) - 1],
+        sum(r[2] for r in results), ", ".join("%s x%d" % (k, c) for k, c in sorted(sources.items(), key=str)),
+        ", ".join("%d x%d" % (s, c) for s, c in sorted(statuses.items()))))
+    return {r[0]: r[4] for r in results if r[4]}
+
+
+def atlas_preload(host):
+    start = time.perf_counter()
+    conn = http.client.HTTPConnection(host, timeout=30)
+    conn.request("GET", "/gestures/index")
+    index = json.loads(conn.getresponse().read())
+    if index.get("source") != "atlas":
+        conn.close()
+        print("atlas      not flashed (images served from SPIFFS)")
+        return
+    conn.request("GET", "/gestures/atlas")
+    size = len(conn.getresponse().read())
+    conn.close()
+    print("atlas      total %7.1f ms  bytes %8d  images %d" % (
+        (time.perf_counter() - start) * 1000, size, len(index["images"])))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Gesture gallery load benchmark")
+    parser.add_argument("--host", default="192.168.4.1")
+    parser.add_argument("--connections", type=int, default=6, help="parallel connections (browsers use 6)")
+    parser.add_argument("--gestures", default=os.path.join(os.path.dirname(__file__), "..", "gestures"))
+    args = parser.parse_args()
+
+    names = sorted(n for n in os.listdir(args.gestures) if n.endswith(".png"))
+    if not names:
+        sys.exit("No .png files in " + args.gestures)
+
+    print("%d images from %s, %d connections" % (len(names), args.host, args.connections))
+    run_pass("cold", args.host, names, args.connections, {})
+    etags = run_pass("warm", args.host, names, args.connections, {})
+    run_pass("revalidate", args.host, names, args.connections, etags)
+    atlas_preload(args.host)
+
+
+if __name__ == "__main__":
+    main()
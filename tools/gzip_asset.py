@@ -0,0 +1,25 @@
+#!/usr/bin/env python3
+"""Gzip one web UI asset for embedding into the firmware (called from src/CMakeLists.txt).
+
+The output is reproducible (no file name or timestamp in the gzip header), so the
+ETag the web server derives from the compressed bytes only changes with the content.
+
+Usage:
+  tools/gzip_asset.py web/app.js build/app.js.gz
+"""
+import gzip
+import sys
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    compressed = gzip.compress(data, compresslevel=9, mtime=0)
+    with open(sys.argv[2], "wb") as f:
+        f.write(compressed)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""Pack the gesture PNGs into one image for the 'gestures' partition.
+
+Layout (little-endian, see include/gesture_atlas.h):
+  header  : magic 'WGAT' (u32), version (u16), count (u16), total_size (u32),
+            reserved (u32), hash (u64, FNV-1a 64 of everything after the header)
+  entries : name[32], offset (u32), size (u32), hash (u64, FNV-1a 64 of the PNG),
+            sorted by name
+  images  : PNG bytes, each 4-byte aligned
+
+Called from src/CMakeLists.txt, so 'idf.py flash' writes the atlas with the app.
+Standalone:
+  tools/pack_gestures.py gestures build/gestures.bin
+  esptool.py --chip esp32s3 write_flash 0x490000 build/gestures.bin
+"""
+import os
+import struct
+import sys
+
+MAGIC = 0x54414757
+VERSION = 1
+MAX_IMAGES = 128
+NAME_LEN = 32
+HEADER = struct.Struct("<IHHIIQ")
+ENTRY = struct.Struct("<%dsIIQ" % NAME_LEN)
+ALIGN = 4
+PARTITION_SIZE = 0x200000  # partitions-s3.csv and partitions.csv
+
+
+def fnv1a64(data):
+    h = 0xcbf29ce484222325
+    for b in data:
+        h = ((h ^ b) * 0x100000001b3) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    src_dir, out_path = sys.argv[1], sys.argv[2]
+
+    names = sorted(n for n in os.listdir(src_dir) if n.endswith(".png"))
+    if not names:
+        sys.exit("no .png files in %s" % src_dir)
+    if len(names) > MAX_IMAGES:
+        sys.exit("at most %d images" % MAX_IMAGES)
+
+    offset = HEADER.size + ENTRY.size * len(names)
+    entries = []
+    blobs = []
+    for name in names:
+        if len(name.encode()) >= NAME_LEN:
+            sys.exit("file name %r longer than %d bytes" % (name, NAME_LEN - 1))
+        with open(os.path.join(src_dir, name), "rb") as f:
+            data = f.read()
+        entries.append(ENTRY.pack(name.encode(), offset, len(data), fnv1a64(data)))
+        pad = (-len(data)) % ALIGN
+        blobs.append(data + b"\0" * pad)
+        offset += len(data) + pad
+
+    body = b"".join(entries) + b"".join(blobs)
+    total = HEADER.size + len(body)
+    image = HEADER.pack(MAGIC, VERSION, len(names), total, 0, fnv1a64(body)) + body
+
+    if len(image) > PARTITION_SIZE:
+        # Drop a previous atlas too, so the build does not treat it as up to date
+        if os.path.exists(out_path):
+            os.remove(out_path)
+        sys.exit("atlas (%d bytes) exceeds the 0x%x byte gestures partition" % (len(image), PARTITION_SIZE))
+
+    out_dir = os.path.dirname(out_path)
+    if out_dir:
+        os.makedirs(out_dir, exist_ok=True)
+    with open(out_path, "wb") as f:
+        f.write(image)
+
+    print("Wrote %s: %d bytes (%d images)" % (out_path, len(image), len(names)))
+
+
+if __name__ == "__main__":
+    main()
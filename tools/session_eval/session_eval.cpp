@@ -0,0 +1,519 @@
+// Offline evaluation of dataset captures (GET /dataset/download, include/dataset_format.h) on the host.
+//
+// Every recorded cast path is replayed through the firmware's own preprocessor and SpellDetector,
+// spread over all cores by a work-stealing pool (one detector per worker). The captures hold
+// tracked positions, so the AHRS stage is not replayed.
+//
+// Usage:
+//   session_eval -m model.tflite [-j threads] [-t threshold] [-o outdir] [-v] captures_dir
+//
+// Writes to outdir (default "."):
+//   eval_summary.json   per-spell precision/recall/F1, accuracy, per-stage timing
+//   eval_confusion.csv  label x prediction counts (last column: below threshold / no prediction)
+//   eval_sweep.csv      accepted/precision/recall for thresholds 0.50 .. 0.99
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spell_detector.h"
+#include "gesture_preprocessor.h"
+#include "dataset_format.h"
+#include "esp_timer.h"
+
+int host_log_level = 0;
+
+static const int SWEEP_STEPS = 50; // 0.50, 0.51, ... 0.99
+static const int NO_PREDICTION = SPELL_OUTPUT_SIZE; // Confusion column for rejected casts
+
+// One recorded cast, pointing into a memory-mapped capture file
+struct Cast
+{
+    const DatasetRecordHeader *header;
+    const uint8_t *path;     // Position varints
+    const uint8_t *path_end; // End of the record
+    uint16_t position_scale; // From the segment header the record belongs to
+    uint16_t file;           // Index into the capture file list
+};
+
+// Replay result of one cast
+struct CastResult
+{
+    int label;        // SPELL_NAMES index or -1 (unlabelled)
+    int predicted;    // Top-1 class, -1 if the path was rejected or could not be decoded
+    float confidence; // Top-1 probability
+    uint32_t decode_us;
+    uint32_t preprocess_us;
+    uint32_t inference_us;
+};
+
+struct MappedFile
+{
+    std::string path;
+    const uint8_t *data;
+    size_t size;
+};
+
+// ---------------------------------------------------------------------------
+// Work-stealing pool: each worker pops its own deque from the back, idle workers
+// steal from the front of the others. Casts vary a lot in length, so static
+// partitioning leaves cores idle at the end.
+// ---------------------------------------------------------------------------
+class WorkStealingPool
+{
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+    std::vector<Queue> queues;
+
+public:
+    explicit WorkStealingPool(size_t workers) : queues(workers) {}
+
+    void push(size_t worker, size_t item)
+    {
+        queues[worker].items.push_back(item);
+    }
+
+    bool next(size_t worker, size_t &item)
+    {
+        {
+            Queue &own = queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.items.empty())
+            {
+                item = own.items.back();
+                own.items.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            Queue &victim = queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.items.empty())
+            {
+                item = victim.items.front();
+                victim.items.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static bool mapFile(const std::string &path, MappedFile &out)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(DatasetSegmentHeader))
+    {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    out.path = path;
+    out.data = (const uint8_t *)data;
+    out.size = st.st_size;
+    return true;
+}
+
+// Index every record of a mapped capture file (no copies). A download is several
+// segments back to back, each starting with its own header.
+static size_t indexCasts(const MappedFile &file, uint16_t file_index, std::vector<Cast> &casts)
+{
+    const DatasetSegmentHeader *first = (const DatasetSegmentHeader *)file.data;
+    if (first->magic != DATASET_MAGIC)
+    {
+        fprintf(stderr, "%s: not a dataset capture (magic)\n", file.path.c_str());
+        return 0;
+    }
+
+    size_t offset = 0;
+    size_t found = 0;
+    uint16_t scale = DATASET_POSITION_SCALE;
+    while (offset + sizeof(uint32_t) <= file.size)
+    {
+        uint32_t magic;
+        memcpy(&magic, file.data + offset, sizeof(magic));
+        if (magic == DATASET_MAGIC && offset + sizeof(DatasetSegmentHeader) <= file.size)
+        {
+            const DatasetSegmentHeader *segment = (const DatasetSegmentHeader *)(file.data + offset);
+            if (segment->version != DATASET_VERSION || segment->position_scale == 0)
+            {
+                fprintf(stderr, "%s: unsupported segment %u (version %u)\n", file.path.c_str(),
+                        (unsigned)segment->sequence, (unsigned)segment->version);
+                break;
+            }
+            scale = segment->position_scale;
+            offset += sizeof(DatasetSegmentHeader);
+            continue;
+        }
+
+        if (offset + sizeof(DatasetRecordHeader) > file.size)
+            break;
+        const DatasetRecordHeader *record = (const DatasetRecordHeader *)(file.data + offset);
+        size_t body = offset + sizeof(DatasetRecordHeader);
+        size_t tensor_bytes = (size_t)record->tensor_size * sizeof(uint16_t);
+        if (body + record->size > file.size || tensor_bytes > record->size)
+        {
+            fprintf(stderr, "%s: truncated record %zu\n", file.path.c_str(), found);
+            break;
+        }
+        casts.push_back({record, file.data + body + tensor_bytes, file.data + body + record->size, scale, file_index});
+        offset = body + record->size;
+        found++;
+    }
+    if (offset < file.size)
+        fprintf(stderr, "%s: ignoring %zu trailing bytes\n", file.path.c_str(), file.size - offset);
+    return found;
+}
+
+static bool getVarint(const uint8_t *&p, const uint8_t *end, int32_t &value)
+{
+    uint32_t zigzag = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7)
+    {
+        uint8_t byte = *p++;
+        zigzag |= (uint32_t)(byte & 0x7F) << shift;
+        if (byte < 0x80)
+        {
+            value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Rebuild the tracked path: first point absolute, then deltas of the quantized path
+static bool decodePath(const Cast &cast, Position2D *positions)
+{
+    const uint8_t *p = cast.path;
+    int32_t x = 0, y = 0;
+    float inv_scale = 1.0f / cast.position_scale;
+    for (uint16_t i = 0; i < cast.header->position_count; i++)
+    {
+        int32_t dx, dy;
+        if (!getVarint(p, cast.path_end, dx) || !getVarint(p, cast.path_end, dy))
+            return false;
+        x += dx;
+        y += dy;
+        positions[i].x = x * inv_scale;
+        positions[i].y = y * inv_scale;
+    }
+    return true;
+}
+
+static CastResult replay(const Cast &cast, Position2D *positions, SpellDetector &detector, float *input)
+{
+    CastResult result = {};
+    result.label = cast.header->label < SPELL_OUTPUT_SIZE ? cast.header->label : -1;
+    result.predicted = -1;
+
+    int64_t start = esp_timer_get_time();
+    bool decoded = decodePath(cast, positions);
+    int64_t decode_end = esp_timer_get_time();
+    result.decode_us = (uint32_t)(decode_end - start);
+    if (!decoded || cast.header->position_count == 0)
+        return result;
+
+    // Same entry point as the firmware after tracking stops
+    bool preprocessed = detector.preprocessWindows(positions, cast.header->position_count, input, nullptr, 1) == 1;
+    int64_t preprocess_end = esp_timer_get_time();
+    result.preprocess_us = (uint32_t)(preprocess_end - decode_end);
+    if (!preprocessed)
+        return result;
+
+    // Threshold 0: keep the top-1 so thresholds can be swept afterwards
+    detector.detect(input, 0.0f);
+    result.inference_us = (uint32_t)(esp_timer_get_time() - preprocess_end);
+    result.predicted = detector.getLastPredictionIndex();
+    result.confidence = detector.getConfidence();
+    return result;
+}
+
+// JSON string body for a path (quotes, backslashes and control characters escaped)
+static void writeJsonString(FILE *f, const char *s)
+{
+    for (; *s; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+}
+
+static std::vector<unsigned char> readFile(const char *path)
+{
+    std::vector<unsigned char> data;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return data;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data.resize(size > 0 ? size : 0);
+    if (size > 0 && fread(data.data(), 1, size, f) != (size_t)size)
+        data.clear();
+    fclose(f);
+    return data;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: session_eval -m model.tflite [-j threads] [-t threshold] [-o outdir] [-v] captures_dir\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *model_path = nullptr;
+    const char *out_dir = ".";
+    const char *captures_dir = nullptr;
+    float threshold = SPELL_CONFIDENCE_THRESHOLD;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            model_path = argv[++i];
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            threads = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            threshold = strtof(argv[++i], nullptr);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            out_dir = argv[++i];
+        else if (!strcmp(argv[i], "-v"))
+            host_log_level++;
+        else if (argv[i][0] != '-' && !captures_dir)
+            captures_dir = argv[i];
+        else
+            usage();
+    }
+    if (!model_path || !captures_dir)
+        usage();
+
+    // Map every capture file and index its casts
+    std::vector<MappedFile> files;
+    std::vector<Cast> casts;
+    DIR *dir = opendir(captures_dir);
+    if (!dir)
+    {
+        fprintf(stderr, "cannot open %s\n", captures_dir);
+        return 1;
+    }
+    std::vector<std::string> names;
+    while (struct dirent *entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.')
+            names.push_back(entry->d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (const std::string &name : names)
+    {
+        MappedFile file;
+        if (mapFile(std::string(captures_dir) + "/" + name, file))
+        {
+            if (indexCasts(file, (uint16_t)files.size(), casts) > 0)
+                files.push_back(file);
+            else
+                munmap((void *)file.data, file.size);
+        }
+    }
+    if (casts.empty())
+    {
+        fprintf(stderr, "no casts found in %s\n", captures_dir);
+        return 1;
+    }
+
+    std::vector<unsigned char> model = readFile(model_path);
+    if (model.empty())
+    {
+        fprintf(stderr, "cannot read %s\n", model_path);
+        return 1;
+    }
+
+    // One path buffer + detector per worker; built serially (shared op resolver registers once)
+    threads = std::min(threads, casts.size());
+    std::vector<std::vector<Position2D>> paths(threads, std::vector<Position2D>(UINT16_MAX));
+    std::vector<SpellDetector> detectors(threads);
+    for (size_t w = 0; w < threads; w++)
+    {
+        if (!detectors[w].begin(model.data(), model.size()) || !detectors[w].isReady())
+        {
+            fprintf(stderr, "failed to load %s\n", model_path);
+            return 1;
+        }
+    }
+
+    // Deal casts round-robin; stealing evens out the long ones
+    WorkStealingPool pool(threads);
+    for (size_t i = 0; i < casts.size(); i++)
+        pool.push(i % threads, i);
+
+    std::vector<CastResult> results(casts.size());
+    int64_t wall_start = esp_timer_get_time();
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < threads; w++)
+    {
+        workers.emplace_back([&, w]()
+        {
+            float input[SPELL_INPUT_MAX_SIZE];
+            size_t item;
+            while (pool.next(w, item))
+                results[item] = replay(casts[item], paths[w].data(), detectors[w], input);
+        });
+    }
+    for (std::thread &t : workers)
+        t.join();
+    double wall_s = (esp_timer_get_time() - wall_start) / 1e6;
+
+    // Confusion matrix at the chosen threshold (rows: labels, last column: rejected)
+    std::vector<std::vector<uint32_t>> confusion(SPELL_OUTPUT_SIZE, std::vector<uint32_t>(SPELL_OUTPUT_SIZE + 1, 0));
+    std::vector<uint32_t> false_accepts(SPELL_OUTPUT_SIZE, 0); // Unlabelled casts accepted as spell
+    uint64_t decode_us = 0, preprocess_us = 0, inference_us = 0;
+    size_t labelled = 0, correct = 0, unlabelled = 0, unlabelled_accepted = 0, inferred = 0;
+    for (const CastResult &r : results)
+    {
+        decode_us += r.decode_us;
+        preprocess_us += r.preprocess_us;
+        inference_us += r.inference_us;
+        inferred += r.predicted >= 0;
+        bool accepted = r.predicted >= 0 && r.confidence >= threshold;
+        if (r.label < 0)
+        {
+            unlabelled++;
+            if (accepted)
+            {
+                unlabelled_accepted++;
+                false_accepts[r.predicted]++;
+            }
+            continue;
+        }
+        labelled++;
+        confusion[r.label][accepted ? r.predicted : NO_PREDICTION]++;
+        correct += accepted && r.predicted == r.label;
+    }
+
+    std::string prefix = std::string(out_dir) + "/";
+    FILE *f = fopen((prefix + "eval_confusion.csv").c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "cannot write to %s\n", out_dir);
+        return 1;
+    }
+    fprintf(f, "label");
+    for (int p = 0; p < SPELL_OUTPUT_SIZE; p++)
+        fprintf(f, ",%s", SPELL_NAMES[p]);
+    fprintf(f, ",none\n");
+    for (int l = 0; l < SPELL_OUTPUT_SIZE; l++)
+    {
+        fprintf(f, "%s", SPELL_NAMES[l]);
+        for (int p = 0; p <= SPELL_OUTPUT_SIZE; p++)
+            fprintf(f, ",%u", confusion[l][p]);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+
+    // Threshold sweep over labelled casts
+    f = fopen((prefix + "eval_sweep.csv").c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "cannot write to %s\n", out_dir);
+        return 1;
+    }
+    fprintf(f, "threshold,accepted,correct,precision,recall,unlabelled_accepted\n");
+    for (int step = 0; step < SWEEP_STEPS; step++)
+    {
+        float t = 0.5f + step * 0.01f;
+        size_t accepted = 0, hits = 0, noise = 0;
+        for (const CastResult &r : results)
+        {
+            if (r.predicted < 0 || r.confidence < t)
+                continue;
+            if (r.label < 0)
+            {
+                noise++;
+                continue;
+            }
+            accepted++;
+            hits += r.predicted == r.label;
+        }
+        fprintf(f, "%.2f,%zu,%zu,%.4f,%.4f,%zu\n", t, accepted, hits,
+                accepted ? (double)hits / accepted : 0.0, labelled ? (double)hits / labelled : 0.0, noise);
+    }
+    fclose(f);
+
+    f = fopen((prefix + "eval_summary.json").c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "cannot write to %s\n", out_dir);
+        return 1;
+    }
+    fprintf(f, "{\n  \"model\": \"");
+    writeJsonString(f, model_path);
+    fprintf(f, "\",\n  \"casts\": %zu,\n  \"files\": %zu,\n  \"threads\": %zu,\n",
+            casts.size(), files.size(), threads);
+    fprintf(f, "  \"threshold\": %.3f,\n  \"accuracy\": %.4f,\n  \"unlabelled\": %zu,\n  \"unlabelled_accepted\": %zu,\n",
+            threshold, labelled ? (double)correct / labelled : 0.0, unlabelled, unlabelled_accepted);
+    fprintf(f, "  \"wall_s\": %.3f,\n  \"timing_us\": {\"decode\": %.1f, \"preprocess\": %.1f, \"inference\": %.1f},\n",
+            wall_s, (double)decode_us / casts.size(), (double)preprocess_us / casts.size(),
+            inferred ? (double)inference_us / inferred : 0.0);
+    fprintf(f, "  \"spells\": {");
+    bool first = true;
+    for (int s = 0; s < SPELL_OUTPUT_SIZE; s++)
+    {
+        uint32_t support = 0, tp = confusion[s][s], predicted = false_accepts[s];
+        for (int p = 0; p <= SPELL_OUTPUT_SIZE; p++)
+            support += confusion[s][p];
+        for (int l = 0; l < SPELL_OUTPUT_SIZE; l++)
+            predicted += confusion[l][s];
+        if (support == 0 && predicted == 0)
+            continue;
+        double precision = predicted ? (double)tp / predicted : 0.0;
+        double recall = support ? (double)tp / support : 0.0;
+        double f1 = precision + recall > 0 ? 2 * precision * recall / (precision + recall) : 0.0;
+        fprintf(f, "%s\n    \"%s\": {\"support\": %u, \"predicted\": %u, \"precision\": %.4f, \"recall\": %.4f, \"f1\": %.4f}",
+                first ? "" : ",", SPELL_NAMES[s], support, predicted, precision, recall, f1);
+        first = false;
+    }
+    fprintf(f, "\n  }\n}\n");
+    fclose(f);
+
+    printf("%zu casts from %zu files on %zu threads in %.2f s (%.0f casts/s)\n",
+           casts.size(), files.size(), threads, wall_s, casts.size() / (wall_s > 0 ? wall_s : 1e-9));
+    printf("accuracy %.2f%% at threshold %.2f, %zu/%zu unlabelled casts accepted\n",
+           labelled ? 100.0 * correct / labelled : 0.0, threshold, unlabelled_accepted, unlabelled);
+    printf("avg per cast: decode %.0f us, preprocess %.0f us, inference %.0f us\n",
+           (double)decode_us / casts.size(), (double)preprocess_us / casts.size(),
+           inferred ? (double)inference_us / inferred : 0.0);
+
+    for (const MappedFile &file : files)
+        munmap((void *)file.data, file.size);
+    return 0;
+}
@@ -0,0 +1,19 @@
+// Host stand-in for ESP-IDF esp_log.h (session_eval only)
+#pragma once
+#include <stdio.h>
+
+// 0 = errors only, 1 = +warnings, 2 = +info, 3 = +debug (session_eval -v raises it)
+extern int host_log_level;
+
+#define HOST_LOG(level, letter, tag, format, ...)                                     \
+    do                                                                                \
+    {                                                                                 \
+        if (host_log_level >= (level))                                                \
+            fprintf(stderr, letter " (%s) " format "\n", (const char *)(tag), ##__VA_ARGS__); \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(0, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(1, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(2, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(3, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_LOG(3, "V", tag, format, ##__VA_ARGS__)
@@ -0,0 +1,22 @@
+// Host stand-in for the FreeRTOS mutex API (session_eval only)
+#pragma once
+#include <stdint.h>
+#include <mutex>
+
+typedef void *SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+#define portMAX_DELAY 0xffffffffu
+#define pdTRUE 1
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void) { return new std::mutex(); }
+static inline int xSemaphoreTake(SemaphoreHandle_t m, TickType_t ticks)
+{
+    (void)ticks;
+    ((std::mutex *)m)->lock();
+    return pdTRUE;
+}
+static inline int xSemaphoreGive(SemaphoreHandle_t m)
+{
+    ((std::mutex *)m)->unlock();
+    return pdTRUE;
+}
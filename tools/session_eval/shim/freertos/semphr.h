@@ -0,0 +1,3 @@
+// Host stand-in for freertos/semphr.h (session_eval only) - see FreeRTOS.h
+#pragma once
+#include "freertos/FreeRTOS.h"
@@ -0,0 +1,30 @@
+// Host stand-in for ESP-IDF nvs.h (session_eval only): no storage, every open fails
+// so SpellDetector measures the arena and calibration keeps its defaults.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+static inline esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    (void)name;
+    (void)mode;
+    (void)out;
+    return ESP_ERR_NOT_FOUND;
+}
+
+static inline void nvs_close(nvs_handle_t handle) { (void)handle; }
+static inline esp_err_t nvs_commit(nvs_handle_t handle) { (void)handle; return ESP_FAIL; }
+static inline esp_err_t nvs_get_u8(nvs_handle_t h, const char *k, uint8_t *v) { (void)h; (void)k; (void)v; return ESP_ERR_NOT_FOUND; }
+static inline esp_err_t nvs_set_u8(nvs_handle_t h, const char *k, uint8_t v) { (void)h; (void)k; (void)v; return ESP_FAIL; }
+static inline esp_err_t nvs_get_u32(nvs_handle_t h, const char *k, uint32_t *v) { (void)h; (void)k; (void)v; return ESP_ERR_NOT_FOUND; }
+static inline esp_err_t nvs_set_u32(nvs_handle_t h, const char *k, uint32_t v) { (void)h; (void)k; (void)v; return ESP_FAIL; }
+static inline esp_err_t nvs_get_blob(nvs_handle_t h, const char *k, void *v, size_t *len) { (void)h; (void)k; (void)v; (void)len; return ESP_ERR_NOT_FOUND; }
+static inline esp_err_t nvs_set_blob(nvs_handle_t h, const char *k, const void *v, size_t len) { (void)h; (void)k; (void)v; (void)len; return ESP_FAIL; }
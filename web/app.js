@@ -0,0 +1,1525 @@
+const canvas = document.getElementById('imu-canvas');
+const ctx = canvas.getContext('2d');
+const gestureCanvas = document.getElementById('gesture-canvas');
+const gestureCtx = gestureCanvas.getContext('2d');
+const statusDiv = document.getElementById('status');
+const statusText = document.getElementById('status-text');
+const wandStatus = document.getElementById('wand-status');
+
+let accelHistory = { x: [], y: [], z: [] };
+let gyroHistory = { x: [], y: [], z: [] };
+const maxHistory = 200;
+
+// Gesture tracking
+let gesturePoints = [];
+let rawGesturePoints = [];  // Store raw coordinates from ESP32
+let isTracking = false;
+
+// Gesture reference image for spell practice
+let referenceGestureImage = null;
+let referenceGestureLoaded = false;
+
+// WebSocket connection
+let ws = null;
+// Gesture/IMU streams as binary frames (open the page with ?ws=json to compare)
+const wsBinary = new URLSearchParams(window.location.search).get('ws') !== 'json';
+// Topics this page wants, e.g. ?topics=spell,gesture,gesture_point,imu:10 (default: everything)
+const wsTopics = new URLSearchParams(window.location.search).get('topics');
+const WS_MSG_GESTURE_POINTS = 1, WS_MSG_IMU = 2, WS_POSITION_SCALE = 10;
+let wsExpectedSeq = {};
+let wsLostSamples = 0;
+
+function connectWebSocket() {
+    const wsUrl = `ws://${window.location.host}/ws`;
+    ws = new WebSocket(wsUrl);
+    ws.binaryType = 'arraybuffer';
+    
+    ws.onopen = () => {
+        console.log('WebSocket connected');
+        statusText.textContent = 'Connected';
+        statusDiv.classList.add('connected');
+        wsExpectedSeq = {};
+        ws.send(`{"type":"format","format":"${wsBinary ? 'binary' : 'json'}"}`);
+        if (wsTopics) {
+            ws.send(JSON.stringify({type: 'subscribe', topics: wsTopics}));
+        }
+        // Request current wand status
+        ws.send('{"type":"request_status"}');
+    };
+    
+    ws.onclose = () => {
+        console.log('WebSocket disconnected');
+        statusText.textContent = 'Disconnected';
+        statusDiv.classList.remove('connected');
+        // Reconnect after 2 seconds
+        setTimeout(connectWebSocket, 2000);
+    };
+    
+    ws.onerror = (error) => {
+        console.error('WebSocket error:', error);
+    };
+    
+    ws.onmessage = (event) => {
+        if (event.data instanceof ArrayBuffer) {
+            decodeBinaryFrame(event.data);
+            return;
+        }
+        try {
+            const data = JSON.parse(event.data);
+            
+            if (data.type === 'wand_status') {
+                wandStatus.textContent = data.connected ? '✓ Connected' : '✗ Disconnected';
+                wandStatus.style.color = data.connected ? '#4CAF50' : '#ff4444';
+                if (!data.connected) {
+                    clearWandInfo();
+                }
+            } else if (data.type === 'imu') {
+                updateIMU(data);
+            } else if (data.type === 'spell') {
+                showSpell(data.spell, data.confidence);
+            } else if (data.type === 'battery') {
+                updateBattery(data.level);
+            } else if (data.type === 'gesture_start') {
+                startGesture();
+            } else if (data.type === 'gesture_point') {
+                addGesturePoint(data.x, data.y);
+            } else if (data.type === 'gesture_end') {
+                endGesture();
+            } else if (data.type === 'scan_result') {
+                addScanResult(data.address, data.name, data.rssi);
+            } else if (data.type === 'scan_complete') {
+                scanComplete();
+            } else if (data.type === 'low_confidence') {
+                showLowConfidence(data.spell, data.confidence);
+            } else if (data.type === 'wand_info') {
+                showWandInfo(data);
+            } else if (data.type === 'custom_recorded') {
+                showToast(data.stored ? `Example stored for ${data.name}` : 'Failed to store example', data.stored ? 'success' : 'error');
+                loadCustomGestures();
+            } else if (data.type === 'button_press') {
+                updateButtons(data.b1, data.b2, data.b3, data.b4);
+            }
+        } catch (e) {
+            console.error('Parse error:', e);
+        }
+    };
+}
+
+function halfToFloat(h) {
+    const exponent = (h >> 10) & 0x1F;
+    const mantissa = h & 0x3FF;
+    const sign = (h & 0x8000) ? -1 : 1;
+    if (exponent === 0) return sign * mantissa * Math.pow(2, -24);
+    if (exponent === 31) return mantissa ? NaN : sign * Infinity;
+    return sign * (1 + mantissa / 1024) * Math.pow(2, exponent - 15);
+}
+
+// Binary stream frame: u8 type, u8 count, u16 sequence, then count samples (ws_protocol.h)
+function decodeBinaryFrame(buffer) {
+    const view = new DataView(buffer);
+    if (view.byteLength < 4) return;
+    const type = view.getUint8(0);
+    const count = view.getUint8(1);
+    const seq = view.getUint16(2, true);
+    if (wsExpectedSeq[type] !== undefined && seq !== wsExpectedSeq[type]) {
+        wsLostSamples += (seq - wsExpectedSeq[type] + 65536) % 65536;
+    }
+    wsExpectedSeq[type] = (seq + count) % 65536;
+    
+    let offset = 4;
+    // Frames may carry a batch of samples: redraw once, after the last one
+    if (type === WS_MSG_GESTURE_POINTS) {
+        for (let i = 0; i < count && offset + 4 <= view.byteLength; i++, offset += 4) {
+            addGesturePoint(view.getInt16(offset, true) / WS_POSITION_SCALE,
+                            view.getInt16(offset + 2, true) / WS_POSITION_SCALE, i === count - 1);
+        }
+    } else if (type === WS_MSG_IMU) {
+        for (let i = 0; i < count && offset + 12 <= view.byteLength; i++, offset += 12) {
+            const v = [];
+            for (let k = 0; k < 6; k++) v.push(halfToFloat(view.getUint16(offset + 2 * k, true)));
+            updateIMU({ax: v[0], ay: v[1], az: v[2], gx: v[3], gy: v[4], gz: v[5]}, i === count - 1);
+        }
+    }
+}
+
+// Connect on page load
+connectWebSocket();
+
+function updateIMU(data, redraw = true) {
+    // Update text displays
+    document.getElementById('ax').textContent = data.ax.toFixed(2);
+    document.getElementById('ay').textContent = data.ay.toFixed(2);
+    document.getElementById('az').textContent = data.az.toFixed(2);
+    document.getElementById('gx').textContent = data.gx.toFixed(2);
+    document.getElementById('gy').textContent = data.gy.toFixed(2);
+    document.getElementById('gz').textContent = data.gz.toFixed(2);
+    
+    // Update history
+    accelHistory.x.push(data.ax);
+    accelHistory.y.push(data.ay);
+    accelHistory.z.push(data.az);
+    gyroHistory.x.push(data.gx);
+    gyroHistory.y.push(data.gy);
+    gyroHistory.z.push(data.gz);
+    
+    if (accelHistory.x.length > maxHistory) {
+        accelHistory.x.shift();
+        accelHistory.y.shift();
+        accelHistory.z.shift();
+        gyroHistory.x.shift();
+        gyroHistory.y.shift();
+        gyroHistory.z.shift();
+    }
+    
+    if (redraw) drawGraph();
+}
+
+function drawGraph() {
+    ctx.fillStyle = '#000';
+    ctx.fillRect(0, 0, canvas.width, canvas.height);
+    
+    const mid = canvas.height / 2;
+    const scale = 50;
+    
+    // Draw center line
+    ctx.strokeStyle = '#333';
+    ctx.beginPath();
+    ctx.moveTo(0, mid);
+    ctx.lineTo(canvas.width, mid);
+    ctx.stroke();
+    
+    // Draw accelerometer
+    drawLine(accelHistory.x, '#ff4444', scale, mid);
+    drawLine(accelHistory.y, '#44ff44', scale, mid);
+    drawLine(accelHistory.z, '#4444ff', scale, mid);
+    
+    // Legend
+    ctx.font = '12px Arial';
+    ctx.fillStyle = '#ff4444';
+    ctx.fillText('Accel X', 10, 20);
+    ctx.fillStyle = '#44ff44';
+    ctx.fillText('Accel Y', 80, 20);
+    ctx.fillStyle = '#4444ff';
+    ctx.fillText('Accel Z', 150, 20);
+}
+
+function drawLine(data, color, scale, mid) {
+    if (data.length < 2) return;
+    
+    ctx.strokeStyle = color;
+    ctx.lineWidth = 2;
+    ctx.beginPath();
+    
+    const step = canvas.width / maxHistory;
+    for (let i = 0; i < data.length; i++) {
+        const x = i * step;
+        const y = mid - (data[i] * scale);
+        
+        if (i === 0) {
+            ctx.moveTo(x, y);
+        } else {
+            ctx.lineTo(x, y);
+        }
+    }
+    
+    ctx.stroke();
+}
+
+function showSpell(spell, confidence) {
+    const display = document.getElementById('spell-display');
+    display.innerHTML = `<span class="spell-name">${spell}</span><br>
+                        <small>${(confidence * 100).toFixed(1)}% confidence</small>`;
+    
+    // Fade out after 5 seconds
+    setTimeout(() => {
+        display.textContent = 'Waiting for spell...';
+    }, 5000);
+}
+
+function updateBattery(level) {
+    const batteryElem = document.getElementById('battery');
+    const warningElem = document.getElementById('battery-warning');
+    batteryElem.textContent = level;
+    
+    // Change color based on battery level
+    if (level < 20) {
+        batteryElem.className = 'battery-level battery-low';
+    } else {
+        batteryElem.className = 'battery-level';
+    }
+    
+    // Show warning if battery is critically low (<40%)
+    if (level < 40) {
+        warningElem.classList.add('show');
+    } else {
+        warningElem.classList.remove('show');
+    }
+}
+
+function startGesture() {
+    isTracking = true;
+    gesturePoints = [];
+    rawGesturePoints = [];
+    clearGestureCanvas();
+}
+
+function addGesturePoint(x, y, redraw = true) {
+    if (!isTracking) return;
+    
+    // Store raw coordinates
+    rawGesturePoints.push({x: x, y: y});
+    
+    // Redraw entire gesture with auto-scaling
+    if (redraw) drawGesture();
+}
+
+function endGesture() {
+    isTracking = false;
+    // Redraw final gesture with optimal scaling
+    drawGesture();
+    console.log(`Gesture complete: ${rawGesturePoints.length} raw points captured`);
+}
+
+function clearGestureCanvas() {
+    gestureCtx.fillStyle = '#000';
+    gestureCtx.fillRect(0, 0, gestureCanvas.width, gestureCanvas.height);
+    
+    // Draw reference gesture image if loaded (semi-transparent)
+    if (referenceGestureLoaded && referenceGestureImage) {
+        const centerX = gestureCanvas.width / 2;
+        const centerY = gestureCanvas.height / 2;
+        
+        // Scale image to fit canvas while maintaining aspect ratio
+        const maxSize = Math.min(gestureCanvas.width, gestureCanvas.height) * 0.9;
+        const scale = Math.min(maxSize / referenceGestureImage.width, maxSize / referenceGestureImage.height);
+        const scaledWidth = referenceGestureImage.width * scale;
+        const scaledHeight = referenceGestureImage.height * scale;
+        
+        // Draw with 40% opacity as reference
+        gestureCtx.globalAlpha = 0.4;
+        gestureCtx.drawImage(
+            referenceGestureImage,
+            centerX - scaledWidth / 2,
+            centerY - scaledHeight / 2,
+            scaledWidth,
+            scaledHeight
+        );
+        gestureCtx.globalAlpha = 1.0;
+    }
+    
+    // Draw center crosshair on top
+    gestureCtx.strokeStyle = '#444';
+    gestureCtx.lineWidth = 1;
+    gestureCtx.beginPath();
+    const centerX = gestureCanvas.width / 2;
+    const centerY = gestureCanvas.height / 2;
+    gestureCtx.moveTo(centerX - 20, centerY);
+    gestureCtx.lineTo(centerX + 20, centerY);
+    gestureCtx.moveTo(centerX, centerY - 20);
+    gestureCtx.lineTo(centerX, centerY + 20);
+    gestureCtx.stroke();
+}
+
+function drawGesture() {
+    clearGestureCanvas();
+    
+    if (rawGesturePoints.length === 0) return;
+    
+    const canvasCenterX = gestureCanvas.width / 2;
+    const canvasCenterY = gestureCanvas.height / 2;
+    
+    // Offset all points so first point is at origin (0,0)
+    const firstPoint = rawGesturePoints[0];
+    const offsetPoints = rawGesturePoints.map(p => ({
+        x: p.x - firstPoint.x,
+        y: p.y - firstPoint.y
+    }));
+    
+    // Fixed scale - no auto-scaling, just offset to center
+    function toCanvas(x, y) {
+        return {
+            x: canvasCenterX + x,
+            y: canvasCenterY - y  // Flip Y for screen coords
+        };
+    }
+    
+    // Draw starting point (green dot) at center
+    const start = toCanvas(offsetPoints[0].x, offsetPoints[0].y);
+    gestureCtx.fillStyle = '#00ff00';
+    gestureCtx.beginPath();
+    gestureCtx.arc(start.x, start.y, 5, 0, 2 * Math.PI);
+    gestureCtx.fill();
+    
+    if (offsetPoints.length < 2) return;
+    
+    // Draw the gesture path
+    gestureCtx.strokeStyle = '#00ffff';
+    gestureCtx.lineWidth = 3;
+    gestureCtx.lineCap = 'round';
+    gestureCtx.lineJoin = 'round';
+    gestureCtx.beginPath();
+    gestureCtx.moveTo(start.x, start.y);
+    
+    for (let i = 1; i < offsetPoints.length; i++) {
+        const p = toCanvas(offsetPoints[i].x, offsetPoints[i].y);
+        gestureCtx.lineTo(p.x, p.y);
+    }
+    gestureCtx.stroke();
+    
+    // Draw ending point (red dot)
+    const end = toCanvas(
+        offsetPoints[offsetPoints.length - 1].x,
+        offsetPoints[offsetPoints.length - 1].y
+    );
+    gestureCtx.fillStyle = '#ff0000';
+    gestureCtx.beginPath();
+    gestureCtx.arc(end.x, end.y, 5, 0, 2 * Math.PI);
+    gestureCtx.fill();
+    
+    // Draw current endpoint (yellow) if tracking
+    if (isTracking) {
+        gestureCtx.fillStyle = '#ffff00';
+        gestureCtx.beginPath();
+        gestureCtx.arc(end.x, end.y, 8, 0, 2 * Math.PI);
+        gestureCtx.fill();
+    }
+}
+
+// Initialize gesture canvas
+clearGestureCanvas();
+
+// Spell Learning Functions
+const SPELL_NAMES = [
+    "The_Force_Spell", "Colloportus", "Colloshoo", "The_Hour_Reversal_Reversal_Charm",
+    "Evanesco", "Herbivicus", "Orchideous", "Brachiabindo", "Meteolojinx", "Riddikulus",
+    "Silencio", "Immobulus", "Confringo", "Petrificus_Totalus", "Flipendo",
+    "The_Cheering_Charm", "Salvio_Hexia", "Pestis_Incendium", "Alohomora", "Protego",
+    "Langlock", "Mucus_Ad_Nauseum", "Flagrate", "Glacius", "Finite", "Anteoculatia",
+    "Expelliarmus", "Expecto_Patronum", "Descendo", "Depulso", "Reducto", "Colovaria",
+    "Aberto", "Confundo", "Densaugeo", "The_Stretching_Jinx", "Entomorphis",
+    "The_Hair_Thickening_Growing_Charm", "Bombarda", "Finestra", "The_Sleeping_Charm",
+    "Rictusempra", "Piertotum_Locomotor", "Expulso", "Impedimenta", "Ascendio",
+    "Incarcerous", "Ventus", "Revelio", "Accio", "Melefors", "Scourgify",
+    "Wingardium_Leviosa", "Nox", "Stupefy", "Spongify", "Lumos", "Appare_Vestigium",
+    "Verdimillious", "Fulgari", "Reparo", "Locomotor", "Quietus", "Everte_Statum",
+    "Incendio", "Aguamenti", "Sonorus", "Cantis", "Arania_Exumai", "Calvorio",
+    "The_Hour_Reversal_Charm", "Vermillious", "The_Pepper-Breath_Hex"
+];
+
+// Map spell names to SPIFFS filenames (32 char limit including .png)
+// Some names are shortened to fit SPIFFS filename restrictions
+const SPELL_FILENAME_MAP = {
+    "The_Hair_Thickening_Growing_Charm": "hair_grow_charm.png",
+    // Default: use lowercase with underscores
+};
+
+function spellNameToFilename(spellName) {
+    // Check if there's a custom mapping
+    if (SPELL_FILENAME_MAP[spellName]) {
+        const mappedFilename = SPELL_FILENAME_MAP[spellName];
+        console.log('[Filename Map] Custom mapping:', spellName, '->', mappedFilename);
+        return mappedFilename;
+    }
+    // Default: convert to lowercase
+    const filename = spellName.toLowerCase() + '.png';
+    console.log('[Filename Map] Default mapping:', spellName, '->', filename);
+    return filename;
+}
+
+// Gesture gallery: with the atlas flashed, one request fetches every image and each
+// becomes a blob URL; otherwise images load one by one from /gesture/<file>
+const gestureImageUrls = {};
+let gesturePreload = null;
+
+function preloadGestureGallery() {
+    if (gesturePreload) return gesturePreload;
+    const start = performance.now();
+    gesturePreload = fetch('/gestures/index')
+        .then(r => r.json())
+        .then(index => {
+            if (index.source !== 'atlas') return;
+            return fetch('/gestures/atlas')
+                .then(r => r.arrayBuffer())
+                .then(atlas => {
+                    index.images.forEach(image => {
+                        const bytes = atlas.slice(image.offset, image.offset + image.size);
+                        gestureImageUrls[image.name] = URL.createObjectURL(new Blob([bytes], { type: 'image/png' }));
+                    });
+                    console.log(`[Gallery] ${index.images.length} images preloaded ` +
+                        `(${(atlas.byteLength / 1024).toFixed(0)} KB) in ${(performance.now() - start).toFixed(0)} ms`);
+                });
+        })
+        .catch(err => console.warn('[Gallery] Preload failed, loading images individually:', err));
+    return gesturePreload;
+}
+
+function populateSpellSelector() {
+    const selector = document.getElementById('spell-selector');
+    SPELL_NAMES.forEach(spell => {
+        const option = document.createElement('option');
+        option.value = spell;
+        option.textContent = spell.replace(/_/g, ' ');
+        selector.appendChild(option);
+    });
+}
+
+function practiceSpell() {
+    const selector = document.getElementById('spell-selector');
+    const selectedSpell = selector.value;
+    
+    console.log('[Spell Practice] Selected spell:', selectedSpell);
+    
+    if (!selectedSpell) {
+        showToast('Please select a spell to practice', 'error');
+        return;
+    }
+    
+    const filename = spellNameToFilename(selectedSpell);
+    preloadGestureGallery().then(() => loadReferenceImage(selectedSpell, filename));
+}
+
+function loadReferenceImage(selectedSpell, filename) {
+    const imageUrl = gestureImageUrls[filename] || `/gesture/${filename}`;
+    
+    console.log('[Spell Practice] Loading reference:', filename);
+    
+    // Create image object
+    const img = new Image();
+    
+    img.onload = function() {
+        console.log('[Spell Practice] Reference image loaded:', imageUrl);
+        referenceGestureImage = img;
+        referenceGestureLoaded = true;
+        
+        // Redraw canvas with reference image
+        clearGestureCanvas();
+        drawGesture();
+        
+        showToast(`Reference loaded: ${selectedSpell.replace(/_/g, ' ')}`, 'success');
+    };
+    
+    img.onerror = function() {
+        console.error('[Spell Practice] Failed to load image:', imageUrl);
+        showToast('Failed to load gesture image: ' + filename, 'error');
+    };
+    
+    img.src = imageUrl;
+}
+
+function clearReferenceGesture() {
+    referenceGestureImage = null;
+    referenceGestureLoaded = false;
+    clearGestureCanvas();
+    drawGesture();
+    console.log('[Spell Practice] Reference cleared');
+    showToast('Reference cleared', 'success');
+}
+
+// Initialize spell selector on page load
+populateSpellSelector();
+document.getElementById('spell-selector').addEventListener('focus', preloadGestureGallery, { once: true });
+
+// Custom gestures: record examples, list and delete
+function loadCustomGestures() {
+    fetch('/custom')
+        .then(r => r.json())
+        .then(data => {
+            document.getElementById('custom-status').textContent =
+                (data.recording ? `Recording: cast "${data.recording}" now... ` : '') +
+                `${data.examples}/${data.max_examples} examples, last match ${data.match_us} us`;
+            const list = document.getElementById('custom-list');
+            list.innerHTML = '';
+            data.gestures.forEach(g => {
+                const row = document.createElement('div');
+                row.style.cssText = 'display: flex; justify-content: space-between; align-items: center; padding: 4px 0;';
+                const label = document.createElement('span');
+                label.textContent = `${g.name} (${g.count} example${g.count === 1 ? '' : 's'})`;
+                const del = document.createElement('button');
+                del.className = 'button secondary';
+                del.textContent = '🗑️';
+                del.onclick = () => deleteCustomGesture(g.name);
+                row.appendChild(label);
+                row.appendChild(del);
+                list.appendChild(row);
+            });
+        })
+        .catch(err => console.error('[Custom] Load failed:', err));
+}
+
+function recordCustomGesture() {
+    const name = document.getElementById('custom-name').value.trim();
+    if (!name) {
+        showToast('Enter a gesture name first', 'error');
+        return;
+    }
+    fetch('/custom/record', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({ name: name })
+    })
+        .then(r => r.json())
+        .then(() => {
+            showToast(`Cast "${name}" with the wand to record an example`, 'success');
+            loadCustomGestures();
+        })
+        .catch(() => showToast('Failed to start recording', 'error'));
+}
+
+function deleteCustomGesture(name) {
+    if (!confirm(`Delete custom gesture "${name}"?`)) return;
+    fetch('/custom/delete', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({ name: name })
+    })
+        .then(r => r.json())
+        .then(() => loadCustomGestures());
+}
+
+loadCustomGestures();
+
+// Dataset capture: every cast (raw path + model input + prediction) to flash with an optional label
+function loadDataset() {
+    fetch('/dataset')
+        .then(r => r.json())
+        .then(data => {
+            document.getElementById('dataset-enabled').checked = data.enabled;
+            document.getElementById('dataset-label').value = data.label;
+            document.getElementById('dataset-status').textContent =
+                `${data.written} casts written (${data.captured} captured, ${data.dropped} dropped), ` +
+                `${(data.bytes / 1024).toFixed(1)} KB in ${data.segments}/${data.max_segments} segments`;
+        })
+        .catch(err => console.error('[Dataset] Load failed:', err));
+}
+
+function updateDataset() {
+    fetch('/dataset', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({
+            enabled: document.getElementById('dataset-enabled').checked,
+            label: document.getElementById('dataset-label').value
+        })
+    })
+        .then(r => r.json())
+        .then(data => {
+            if (!data.success) showToast('Failed to update dataset capture', 'error');
+            loadDataset();
+        });
+}
+
+function clearDataset() {
+    if (!confirm('Delete every captured cast?')) return;
+    fetch('/dataset', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({ clear: true })
+    })
+        .then(r => r.json())
+        .then(() => loadDataset());
+}
+
+SPELL_NAMES.forEach(spell => {
+    const option = document.createElement('option');
+    option.value = spell;
+    option.textContent = spell.replace(/_/g, ' ');
+    document.getElementById('dataset-label').appendChild(option);
+});
+loadDataset();
+
+// Personalization: per-user profiles adapted from corrected casts
+function loadPersonalization() {
+    fetch('/personalize')
+        .then(r => r.json())
+        .then(data => {
+            const adapted = data.classes.map(c => `${c.spell} (${c.examples})`).join(', ') || 'none';
+            document.getElementById('personalize-status').textContent =
+                `Profile "${data.profile}" of [${data.profiles.join(', ')}] - adapted: ${adapted} - ` +
+                `${data.corrections} corrections, ${data.changed}/${data.applied} casts changed, ` +
+                `${data.avg_us} us per cast`;
+        })
+        .catch(err => console.error('[Personalize] Load failed:', err));
+}
+
+function postPersonalize(body, message) {
+    fetch('/personalize', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify(body)
+    })
+        .then(r => r.json())
+        .then(data => {
+            showToast(data.success ? message : 'Personalization update failed', data.success ? 'success' : 'error');
+            loadPersonalization();
+        });
+}
+
+function selectProfile() {
+    const name = document.getElementById('profile-name').value.trim();
+    if (!name) {
+        showToast('Enter a profile name first', 'error');
+        return;
+    }
+    postPersonalize({ profile: name }, `Using profile "${name}"`);
+}
+
+function resetProfile() {
+    if (!confirm('Forget every correction of the active profile?')) return;
+    postPersonalize({ reset: true }, 'Profile reset');
+}
+
+function correctLastCast() {
+    const spell = document.getElementById('correct-spell').value;
+    if (!spell) {
+        showToast('Select the spell you cast', 'error');
+        return;
+    }
+    postPersonalize({ correct: spell }, `Last cast learned as ${spell.replace(/_/g, ' ')}`);
+}
+
+SPELL_NAMES.forEach(spell => {
+    const option = document.createElement('option');
+    option.value = spell;
+    option.textContent = spell.replace(/_/g, ' ');
+    document.getElementById('correct-spell').appendChild(option);
+});
+loadPersonalization();
+
+// Toast notification function
+function showToast(message, type = 'success') {
+    // Remove any existing toasts
+    const existingToasts = document.querySelectorAll('.toast');
+    existingToasts.forEach(toast => toast.remove());
+    
+    // Create new toast
+    const toast = document.createElement('div');
+    toast.className = `toast ${type}`;
+    toast.textContent = message;
+    
+    // Add to document
+    document.body.appendChild(toast);
+    
+    // Trigger animation by forcing reflow
+    setTimeout(() => {
+        toast.style.opacity = '1';
+    }, 10);
+    
+    // Remove after 3 seconds
+    setTimeout(() => {
+        toast.style.opacity = '0';
+        setTimeout(() => toast.remove(), 300);
+    }, 3000);
+}
+
+// BLE Management Functions
+let scanResults = [];
+let selectedMac = null;
+
+function startScan() {
+    const btn = document.getElementById('scanBtn');
+    const status = document.getElementById('scanStatus');
+    const results = document.getElementById('scanResults');
+    
+    btn.disabled = true;
+    btn.textContent = '⏳ Scanning...';
+    status.textContent = 'Scanning for BLE devices...';
+    results.innerHTML = '';
+    scanResults = [];
+    selectedMac = null;
+    
+    fetch('/scan', { method: 'POST' })
+        .then(response => response.json())
+        .then(data => {
+            console.log('Scan started:', data);
+            setTimeout(() => {
+                btn.disabled = false;
+                btn.textContent = '🔍 Scan for Wands';
+            }, 10000); // Re-enable after 10 seconds
+        })
+        .catch(error => {
+            console.error('Scan error:', error);
+            status.textContent = 'Scan failed: ' + error;
+            btn.disabled = false;
+            btn.textContent = '🔍 Scan for Wands';
+        });
+}
+
+function addScanResult(address, name, rssi) {
+    // Check if already in list
+    if (scanResults.find(r => r.address === address)) {
+        return;
+    }
+    
+    scanResults.push({ address, name, rssi });
+    
+    // Sort: MCB/MCW wands first, then by RSSI
+    scanResults.sort((a, b) => {
+        const aIsMC = (a.name && (a.name.startsWith('MCB') || a.name.startsWith('MCW')));
+        const bIsMC = (b.name && (b.name.startsWith('MCB') || b.name.startsWith('MCW')));
+        
+        if (aIsMC && !bIsMC) return -1;  // a goes first
+        if (!aIsMC && bIsMC) return 1;   // b goes first
+        
+        // Both are MC or both are not, sort by RSSI (higher is better)
+        return b.rssi - a.rssi;
+    });
+    
+    // Rebuild the display
+    const results = document.getElementById('scanResults');
+    results.innerHTML = '';
+    
+    scanResults.forEach(device => {
+        const item = document.createElement('div');
+        item.className = 'scan-item';
+        const isMCWand = device.name && (device.name.startsWith('MCB') || device.name.startsWith('MCW'));
+        const nameStyle = isMCWand ? 'style="color: #4CAF50; font-weight: bold;"' : '';
+        item.innerHTML = `
+            <div class="scan-info">
+                <div class="mac-address">${device.address}</div>
+                <div ${nameStyle}>${device.name || 'Unknown Device'}</div>
+                <div class="rssi">RSSI: ${device.rssi} dBm</div>
+            </div>
+            <button class="button" onclick="selectWand('${device.address}', '${device.name}')">Select</button>
+        `;
+        results.appendChild(item);
+    });
+}
+
+function scanComplete() {
+    const status = document.getElementById('scanStatus');
+    status.textContent = `Scan complete. Found ${scanResults.length} device(s).`;
+}
+
+function selectWand(address, name) {
+    selectedMac = address;
+    document.getElementById('storedMac').value = address;
+    document.getElementById('connectBtn').disabled = false;
+    document.getElementById('scanStatus').textContent = `Selected: ${name || 'Unknown'} (${address})`;
+    
+    // Save MAC address
+    fetch('/set_mac', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({ mac: address })
+    })
+    .then(response => response.json())
+    .then(data => {
+        console.log('MAC saved:', data);
+        showToast(`Wand selected: ${name || address}`, 'success');
+    })
+    .catch(error => {
+        console.error('Failed to save MAC:', error);
+        showToast('Failed to save MAC address', 'error');
+    });
+}
+
+function loadStoredMac() {
+    fetch('/get_stored_mac')
+        .then(response => response.json())
+        .then(data => {
+            if (data.mac) {
+                document.getElementById('storedMac').value = data.mac;
+                selectedMac = data.mac;
+                document.getElementById('connectBtn').disabled = false;
+            } else {
+                document.getElementById('storedMac').value = '';
+                document.getElementById('scanStatus').textContent = 'No stored MAC address';
+            }
+        })
+        .catch(error => {
+            console.error('Failed to load MAC:', error);
+        });
+}
+
+function connectWand() {
+    if (!selectedMac) {
+        showToast('Please select a wand first', 'error');
+        return;
+    }
+    
+    const btn = document.getElementById('connectBtn');
+    btn.disabled = true;
+    btn.textContent = '⏳ Connecting...';
+    
+    fetch('/connect', { method: 'POST' })
+        .then(response => response.json())
+        .then(data => {
+            console.log('Connect response:', data);
+            document.getElementById('scanStatus').textContent = data.status === 'connecting' ? 
+                'Connection initiated...' : data.message;
+            setTimeout(() => {
+                btn.disabled = false;
+                btn.textContent = '🔗 Connect';
+            }, 3000);
+        })
+        .catch(error => {
+            console.error('Connect error:', error);
+            document.getElementById('scanStatus').textContent = 'Connection failed';
+            btn.disabled = false;
+            btn.textContent = '🔗 Connect';
+        });
+}
+
+function disconnectWand() {
+    fetch('/disconnect', { method: 'POST' })
+        .then(response => response.json())
+        .then(data => {
+            console.log('Disconnect response:', data);
+            document.getElementById('scanStatus').textContent = 'Disconnected (manual reconnect required)';
+            // Update wand status to show disconnected
+            const wandStatus = document.getElementById('wandStatus');
+            wandStatus.textContent = '✗ Disconnected';
+            wandStatus.style.color = '#ff4444';
+        })
+        .catch(error => {
+            console.error('Disconnect error:', error);
+        });
+}
+
+function showLowConfidence(spell, confidence) {
+    const display = document.getElementById('spell-display');
+    display.innerHTML = `<span style="color: #ff8800;">${spell}</span><br>
+                        <small>${(confidence * 100).toFixed(1)}% confidence (low)</small>`;
+}
+
+function showWandInfo(data) {
+    console.log('Wand Info:', data);
+    document.getElementById('wand-type').textContent = data.wand_type || '-';
+    document.getElementById('wand-firmware').textContent = data.firmware || '-';
+    document.getElementById('wand-serial').textContent = data.serial || '-';
+    document.getElementById('wand-sku').textContent = data.sku || '-';
+    document.getElementById('wand-device-id').textContent = data.device_id || '-';
+    
+    if (data.wand_type && data.firmware) {
+        document.getElementById('scanStatus').textContent = 
+            `Connected: ${data.wand_type} Wand (FW: ${data.firmware})`;
+    }
+}
+
+function clearWandInfo() {
+    console.log('Clearing wand info (disconnected)');
+    document.getElementById('wand-type').textContent = '-';
+    document.getElementById('wand-firmware').textContent = '-';
+    document.getElementById('wand-serial').textContent = '-';
+    document.getElementById('wand-sku').textContent = '-';
+    document.getElementById('wand-device-id').textContent = '-';
+    document.getElementById('battery').textContent = '--';
+    document.getElementById('battery').className = 'battery-level';
+    document.getElementById('battery-warning').classList.remove('show');
+    // Clear button states
+    updateButtons(false, false, false, false);
+}
+
+function updateButtons(b1, b2, b3, b4) {
+    document.getElementById('btn1').textContent = b1 ? '●' : '○';
+    document.getElementById('btn2').textContent = b2 ? '●' : '○';
+    document.getElementById('btn3').textContent = b3 ? '●' : '○';
+    document.getElementById('btn4').textContent = b4 ? '●' : '○';
+    document.getElementById('btn1').style.color = b1 ? '#4CAF50' : '#666';
+    document.getElementById('btn2').style.color = b2 ? '#4CAF50' : '#666';
+    document.getElementById('btn3').style.color = b3 ? '#4CAF50' : '#666';
+    document.getElementById('btn4').style.color = b4 ? '#4CAF50' : '#666';
+}
+
+// SPELL_NAMES already declared above in Spell Learning section (line ~1033)
+
+const KEY_OPTIONS = [
+    { group: 'Common', label: 'None', value: 0 },
+    { group: 'Letters', label: 'A', value: 0x04 },
+    { group: 'Letters', label: 'B', value: 0x05 },
+    { group: 'Letters', label: 'C', value: 0x06 },
+    { group: 'Letters', label: 'D', value: 0x07 },
+    { group: 'Letters', label: 'E', value: 0x08 },
+    { group: 'Letters', label: 'F', value: 0x09 },
+    { group: 'Letters', label: 'G', value: 0x0A },
+    { group: 'Letters', label: 'H', value: 0x0B },
+    { group: 'Letters', label: 'I', value: 0x0C },
+    { group: 'Letters', label: 'J', value: 0x0D },
+    { group: 'Letters', label: 'K', value: 0x0E },
+    { group: 'Letters', label: 'L', value: 0x0F },
+    { group: 'Letters', label: 'M', value: 0x10 },
+    { group: 'Letters', label: 'N', value: 0x11 },
+    { group: 'Letters', label: 'O', value: 0x12 },
+    { group: 'Letters', label: 'P', value: 0x13 },
+    { group: 'Letters', label: 'Q', value: 0x14 },
+    { group: 'Letters', label: 'R', value: 0x15 },
+    { group: 'Letters', label: 'S', value: 0x16 },
+    { group: 'Letters', label: 'T', value: 0x17 },
+    { group: 'Letters', label: 'U', value: 0x18 },
+    { group: 'Letters', label: 'V', value: 0x19 },
+    { group: 'Letters', label: 'W', value: 0x1A },
+    { group: 'Letters', label: 'X', value: 0x1B },
+    { group: 'Letters', label: 'Y', value: 0x1C },
+    { group: 'Letters', label: 'Z', value: 0x1D },
+    { group: 'Numbers', label: '1', value: 0x1E },
+    { group: 'Numbers', label: '2', value: 0x1F },
+    { group: 'Numbers', label: '3', value: 0x20 },
+    { group: 'Numbers', label: '4', value: 0x21 },
+    { group: 'Numbers', label: '5', value: 0x22 },
+    { group: 'Numbers', label: '6', value: 0x23 },
+    { group: 'Numbers', label: '7', value: 0x24 },
+    { group: 'Numbers', label: '8', value: 0x25 },
+    { group: 'Numbers', label: '9', value: 0x26 },
+    { group: 'Numbers', label: '0', value: 0x27 },
+    { group: 'Controls', label: 'Enter', value: 0x28 },
+    { group: 'Controls', label: 'Esc', value: 0x29 },
+    { group: 'Controls', label: 'Backspace', value: 0x2A },
+    { group: 'Controls', label: 'Tab', value: 0x2B },
+    { group: 'Controls', label: 'Space', value: 0x2C },
+    { group: 'Punctuation', label: '-', value: 0x2D },
+    { group: 'Punctuation', label: '=', value: 0x2E },
+    { group: 'Punctuation', label: '[', value: 0x2F },
+    { group: 'Punctuation', label: ']', value: 0x30 },
+    { group: 'Punctuation', label: '\\', value: 0x31 },
+    { group: 'Punctuation', label: '#', value: 0x32 },
+    { group: 'Punctuation', label: ';', value: 0x33 },
+    { group: 'Punctuation', label: '\'', value: 0x34 },
+    { group: 'Punctuation', label: '`', value: 0x35 },
+    { group: 'Punctuation', label: ',', value: 0x36 },
+    { group: 'Punctuation', label: '.', value: 0x37 },
+    { group: 'Punctuation', label: '/', value: 0x38 },
+    { group: 'Controls', label: 'Caps Lock', value: 0x39 },
+    { group: 'Function', label: 'F1', value: 0x3A },
+    { group: 'Function', label: 'F2', value: 0x3B },
+    { group: 'Function', label: 'F3', value: 0x3C },
+    { group: 'Function', label: 'F4', value: 0x3D },
+    { group: 'Function', label: 'F5', value: 0x3E },
+    { group: 'Function', label: 'F6', value: 0x3F },
+    { group: 'Function', label: 'F7', value: 0x40 },
+    { group: 'Function', label: 'F8', value: 0x41 },
+    { group: 'Function', label: 'F9', value: 0x42 },
+    { group: 'Function', label: 'F10', value: 0x43 },
+    { group: 'Function', label: 'F11', value: 0x44 },
+    { group: 'Function', label: 'F12', value: 0x45 },
+    { group: 'System', label: 'Print Screen', value: 0x46 },
+    { group: 'System', label: 'Scroll Lock', value: 0x47 },
+    { group: 'System', label: 'Pause', value: 0x48 },
+    { group: 'Navigation', label: 'Insert', value: 0x49 },
+    { group: 'Navigation', label: 'Home', value: 0x4A },
+    { group: 'Navigation', label: 'Page Up', value: 0x4B },
+    { group: 'Navigation', label: 'Delete', value: 0x4C },
+    { group: 'Navigation', label: 'End', value: 0x4D },
+    { group: 'Navigation', label: 'Page Down', value: 0x4E },
+    { group: 'Navigation', label: 'Arrow Right', value: 0x4F },
+    { group: 'Navigation', label: 'Arrow Left', value: 0x50 },
+    { group: 'Navigation', label: 'Arrow Down', value: 0x51 },
+    { group: 'Navigation', label: 'Arrow Up', value: 0x52 },
+    { group: 'Numpad', label: 'Num Lock', value: 0x53 },
+    { group: 'Numpad', label: 'Numpad /', value: 0x54 },
+    { group: 'Numpad', label: 'Numpad *', value: 0x55 },
+    { group: 'Numpad', label: 'Numpad -', value: 0x56 },
+    { group: 'Numpad', label: 'Numpad +', value: 0x57 },
+    { group: 'Numpad', label: 'Numpad Enter', value: 0x58 },
+    { group: 'Numpad', label: 'Numpad 1', value: 0x59 },
+    { group: 'Numpad', label: 'Numpad 2', value: 0x5A },
+    { group: 'Numpad', label: 'Numpad 3', value: 0x5B },
+    { group: 'Numpad', label: 'Numpad 4', value: 0x5C },
+    { group: 'Numpad', label: 'Numpad 5', value: 0x5D },
+    { group: 'Numpad', label: 'Numpad 6', value: 0x5E },
+    { group: 'Numpad', label: 'Numpad 7', value: 0x5F },
+    { group: 'Numpad', label: 'Numpad 8', value: 0x60 },
+    { group: 'Numpad', label: 'Numpad 9', value: 0x61 },
+    { group: 'Numpad', label: 'Numpad 0', value: 0x62 },
+    { group: 'Numpad', label: 'Numpad .', value: 0x63 },
+    { group: 'Function', label: 'F13', value: 0x68 },
+    { group: 'Function', label: 'F14', value: 0x69 },
+    { group: 'Function', label: 'F15', value: 0x6A },
+    { group: 'Function', label: 'F16', value: 0x6B },
+    { group: 'Function', label: 'F17', value: 0x6C },
+    { group: 'Function', label: 'F18', value: 0x6D },
+    { group: 'Function', label: 'F19', value: 0x6E },
+    { group: 'Function', label: 'F20', value: 0x6F },
+    { group: 'Function', label: 'F21', value: 0x70 },
+    { group: 'Function', label: 'F22', value: 0x71 },
+    { group: 'Function', label: 'F23', value: 0x72 },
+    { group: 'Function', label: 'F24', value: 0x73 }
+];
+
+const GAMEPAD_BUTTON_OPTIONS = [
+    { label: 'Disabled', value: 0 },
+    { label: 'Button 1', value: 1 },
+    { label: 'Button 2', value: 2 },
+    { label: 'Button 3', value: 3 },
+    { label: 'Button 4', value: 4 },
+    { label: 'Button 5', value: 5 },
+    { label: 'Button 6', value: 6 },
+    { label: 'Button 7', value: 7 },
+    { label: 'Button 8', value: 8 },
+    { label: 'Button 9', value: 9 },
+    { label: 'Button 10', value: 10 }
+];
+
+function buildKeySelectOptions(select) {
+    const groups = new Map();
+    KEY_OPTIONS.forEach((opt) => {
+        if (!groups.has(opt.group)) {
+            const optgroup = document.createElement('optgroup');
+            optgroup.label = opt.group;
+            groups.set(opt.group, optgroup);
+        }
+        const option = document.createElement('option');
+        option.value = opt.value;
+        option.textContent = opt.label;
+        groups.get(opt.group).appendChild(option);
+    });
+    groups.forEach((optgroup) => select.appendChild(optgroup));
+}
+
+function buildGamepadSelectOptions(select) {
+    GAMEPAD_BUTTON_OPTIONS.forEach((opt) => {
+        const option = document.createElement('option');
+        option.value = opt.value;
+        option.textContent = opt.label;
+        select.appendChild(option);
+    });
+}
+
+// Populate spell mapping dropdowns
+function populateSpellMappings() {
+    const container = document.getElementById('spell-mappings');
+    container.innerHTML = '';
+
+    for (let i = 0; i < SPELL_NAMES.length; i++) {
+        const spell = SPELL_NAMES[i];
+        const select = document.createElement('select');
+        select.id = `spell_${i}`;
+        buildKeySelectOptions(select);
+
+        const label = document.createElement('label');
+        label.style.cssText = 'font-size: 12px; word-break: break-word;';
+        label.textContent = spell.replace(/_/g, ' ');
+
+        const wrapper = document.createElement('div');
+        wrapper.className = 'spell-mapping-item';
+        wrapper.dataset.spellName = spell.toLowerCase().replace(/_/g, ' ');
+        wrapper.appendChild(label);
+        wrapper.appendChild(select);
+        container.appendChild(wrapper);
+    }
+}
+
+function populateGamepadMappings() {
+    const container = document.getElementById('gamepad-mappings');
+    container.innerHTML = '';
+
+    for (let i = 0; i < SPELL_NAMES.length; i++) {
+        const spell = SPELL_NAMES[i];
+        const select = document.createElement('select');
+        select.id = `gpad_spell_${i}`;
+        buildGamepadSelectOptions(select);
+
+        const label = document.createElement('label');
+        label.style.cssText = 'font-size: 12px; word-break: break-word;';
+        label.textContent = spell.replace(/_/g, ' ');
+
+        const wrapper = document.createElement('div');
+        wrapper.className = 'spell-mapping-item';
+        wrapper.dataset.spellName = spell.toLowerCase().replace(/_/g, ' ');
+        wrapper.appendChild(label);
+        wrapper.appendChild(select);
+        container.appendChild(wrapper);
+    }
+}
+
+function filterSpellMappings() {
+    const input = document.getElementById('spell-filter');
+    const filter = input.value.trim().toLowerCase();
+    const items = document.querySelectorAll('#spell-mappings .spell-mapping-item');
+    items.forEach((item) => {
+        const name = item.dataset.spellName || '';
+        item.style.display = name.includes(filter) ? 'flex' : 'none';
+    });
+}
+
+function filterGamepadMappings() {
+    const input = document.getElementById('gamepad-spell-filter');
+    const filter = input.value.trim().toLowerCase();
+    const items = document.querySelectorAll('#gamepad-mappings .spell-mapping-item');
+    items.forEach((item) => {
+        const name = item.dataset.spellName || '';
+        item.style.display = name.includes(filter) ? 'flex' : 'none';
+    });
+}
+
+// Mouse sensitivity slider handler
+document.getElementById('mouse-sensitivity').addEventListener('input', (e) => {
+    const value = parseFloat(e.target.value);
+    document.getElementById('sens-value').textContent = value.toFixed(1) + 'x';
+});
+
+// Gamepad sensitivity slider handler
+document.getElementById('gamepad-sensitivity').addEventListener('input', (e) => {
+    const value = parseFloat(e.target.value);
+    document.getElementById('gpad-sens-value').textContent = value.toFixed(1) + 'x';
+});
+
+// Gamepad deadzone slider handler
+document.getElementById('gamepad-deadzone').addEventListener('input', (e) => {
+    const value = parseFloat(e.target.value);
+    document.getElementById('gpad-deadzone-value').textContent = value.toFixed(2);
+});
+
+// Load and save settings with spell mappings
+function saveSettings() {
+    const invertMouseY = document.getElementById('invert-mouse-y').checked;
+    console.log('💾 Saving settings - invert_mouse_y checkbox state:', invertMouseY);
+    
+    const invertGamepadY = document.getElementById('invert-gamepad-y').checked;
+    console.log('💾 Saving settings - gamepad_invert_y checkbox state:', invertGamepadY);
+    
+    const settings = {
+        mouse_sensitivity: parseFloat(document.getElementById('mouse-sensitivity').value),
+        invert_mouse_y: invertMouseY,
+        hid_mode: parseInt(document.getElementById('hid-mode').value),
+        gamepad_sensitivity: parseFloat(document.getElementById('gamepad-sensitivity').value),
+        gamepad_deadzone: parseFloat(document.getElementById('gamepad-deadzone').value),
+        gamepad_invert_y: invertGamepadY,
+        ha_mqtt_enabled: document.getElementById('ha-mqtt-enabled').checked,
+        mqtt_broker: document.getElementById('mqtt-broker').value,
+        mqtt_username: document.getElementById('mqtt-username').value,
+        mqtt_password: document.getElementById('mqtt-password').value,
+        spells: [],
+        gamepad_spells: []
+    };
+    
+    // Collect all spell keycode mappings
+    for (let i = 0; i < SPELL_NAMES.length; i++) {
+        const select = document.getElementById(`spell_${i}`);
+        const keycode = parseInt(select.value);
+        settings.spells.push(keycode);
+        if (keycode !== 0) {
+            console.log(`Spell[${i}] '${SPELL_NAMES[i]}': keycode=${keycode} (0x${keycode.toString(16).toUpperCase()})`);
+        }
+    }
+
+    // Collect all spell gamepad button mappings
+    for (let i = 0; i < SPELL_NAMES.length; i++) {
+        const select = document.getElementById(`gpad_spell_${i}`);
+        settings.gamepad_spells.push(parseInt(select.value));
+    }
+    
+    fetch('/settings/save', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify(settings)
+    })
+    .then(response => response.json())
+    .then(data => {
+        showToast('Settings saved successfully!', 'success');
+        console.log('Settings saved:', data);
+    })
+    .catch(error => {
+        showToast('Failed to save settings', 'error');
+        console.error('Save error:', error);
+    });
+}
+
+function loadSettings() {
+    fetch('/settings/get')
+        .then(response => response.json())
+        .then(data => {
+            console.log('Settings loaded:', data);
+            console.log('🔍 Received invert_mouse_y from backend:', data.invert_mouse_y);
+            console.log('🔍 Received gamepad_invert_y from backend:', data.gamepad_invert_y);
+            
+            document.getElementById('mouse-sensitivity').value = data.mouse_sensitivity || 1.0;
+            document.getElementById('sens-value').textContent = (data.mouse_sensitivity || 1.0).toFixed(1) + 'x';
+            document.getElementById('invert-mouse-y').checked = (data.invert_mouse_y === true);
+            
+            console.log('✅ Set invert-mouse-y checkbox to:', document.getElementById('invert-mouse-y').checked);
+            
+            document.getElementById('hid-mode').value = (data.hid_mode !== undefined) ? data.hid_mode : 0;
+            document.getElementById('gamepad-sensitivity').value = data.gamepad_sensitivity || 1.0;
+            document.getElementById('gpad-sens-value').textContent = (data.gamepad_sensitivity || 1.0).toFixed(1) + 'x';
+            document.getElementById('gamepad-deadzone').value = (data.gamepad_deadzone !== undefined) ? data.gamepad_deadzone : 0.05;
+            document.getElementById('gpad-deadzone-value').textContent = ((data.gamepad_deadzone !== undefined) ? data.gamepad_deadzone : 0.05).toFixed(2);
+            document.getElementById('invert-gamepad-y').checked = (data.gamepad_invert_y === true);
+            
+            console.log('✅ Set invert-gamepad-y checkbox to:', document.getElementById('invert-gamepad-y').checked);
+            document.getElementById('ha-mqtt-enabled').checked = data.ha_mqtt_enabled !== false;
+            document.getElementById('mqtt-broker').value = data.mqtt_broker || '';
+            document.getElementById('mqtt-username').value = data.mqtt_username || '';
+            document.getElementById('mqtt-password').value = data.mqtt_password || '';
+            
+            // Load spell keycodes
+            if (data.spells && data.spells.length === SPELL_NAMES.length) {
+                let loaded_count = 0;
+                for (let i = 0; i < data.spells.length; i++) {
+                    const select = document.getElementById(`spell_${i}`);
+                    if (select) {
+                        select.value = data.spells[i];
+                        if (data.spells[i] !== 0) {
+                            loaded_count++;
+                            console.log(`Loading spell[${i}] '${SPELL_NAMES[i]}': keycode=${data.spells[i]} (0x${data.spells[i].toString(16).toUpperCase().padStart(2, '0')})`);
+                        }
+                    }
+                }
+                console.log(`✓ Loaded ${loaded_count} spell-to-key mappings`);
+            }
+            if (data.gamepad_spells && data.gamepad_spells.length === SPELL_NAMES.length) {
+                for (let i = 0; i < data.gamepad_spells.length; i++) {
+                    const select = document.getElementById(`gpad_spell_${i}`);
+                    if (select) {
+                        select.value = data.gamepad_spells[i];
+                    }
+                }
+            }
+            showToast('Settings loaded from device', 'success');
+        })
+        .catch(error => {
+            showToast('Failed to load settings', 'error');
+            console.error('Load error:', error);
+        });
+}
+
+function resetSettings() {
+    if (confirm('⚠️ Reset all settings to defaults?')) {
+        fetch('/settings/reset', { method: 'POST' })
+            .then(response => response.json())
+            .then(data => {
+                console.log('Settings reset:', data);
+                showToast('Settings reset to defaults! Reloading...', 'success');
+                // Reload settings from backend to ensure UI is synced
+                setTimeout(() => {
+                    loadSettings();
+                }, 500);
+            })
+            .catch(error => {
+                showToast('Failed to reset settings', 'error');
+                console.error('Reset error:', error);
+            });
+    }
+}
+
+// Initialize UI
+populateSpellMappings();
+populateGamepadMappings();
+
+// Load settings on page load
+setTimeout(loadSettings, 2000);
+
+// Load stored MAC on page load
+setTimeout(loadStoredMac, 1000);
+
+// WiFi Management Functions
+function scanWifi() {
+    const btn = event.target;
+    const status = document.getElementById('wifiScanStatus');
+    const results = document.getElementById('wifiResults');
+    
+    btn.disabled = true;
+    btn.textContent = '⏳ Scanning...';
+    status.textContent = 'Scanning for WiFi networks...';
+    results.innerHTML = '';
+    
+    fetch('/wifi/scan', { method: 'POST' })
+        .then(response => response.json())
+        .then(data => {
+            if (data.networks && data.networks.length > 0) {
+                status.textContent = `Found ${data.networks.length} network(s)`;
+                data.networks.forEach(network => {
+                    const item = document.createElement('div');
+                    item.className = 'scan-item';
+                    item.innerHTML = `
+                        <div class="scan-info">
+                            <div style="font-weight: bold;">${network.ssid}</div>
+                            <div class="rssi">RSSI: ${network.rssi} dBm | Security: ${network.auth}</div>
+                        </div>
+                        <button class="button" onclick="selectWifiNetwork('${network.ssid}')">Select</button>
+                    `;
+                    results.appendChild(item);
+                });
+            } else {
+                status.textContent = 'No networks found';
+            }
+            btn.disabled = false;
+            btn.textContent = '🔍 Scan WiFi Networks';
+        })
+        .catch(error => {
+            status.textContent = 'Scan failed: ' + error;
+            btn.disabled = false;
+            btn.textContent = '🔍 Scan WiFi Networks';
+            showToast('WiFi scan failed', 'error');
+        });
+}
+
+function selectWifiNetwork(ssid) {
+    document.getElementById('wifi-ssid').value = ssid;
+    showToast(`Selected: ${ssid}`, 'success');
+}
+
+function connectWifi() {
+    const ssid = document.getElementById('wifi-ssid').value;
+    const password = document.getElementById('wifi-password').value;
+    const status = document.getElementById('wifiConnectStatus');
+    
+    if (!ssid) {
+        showToast('Please enter WiFi SSID', 'error');
+        return;
+    }
+    
+    if (!confirm(`⚠️ Connecting to ${ssid} will reboot the device. Continue?`)) {
+        return;
+    }
+    
+    status.textContent = 'Saving WiFi settings and rebooting...';
+    
+    fetch('/wifi/connect', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({ ssid: ssid, password: password })
+    })
+    .then(response => response.json())
+    .then(data => {
+        if (data.success) {
+            status.textContent = 'Device rebooting to apply WiFi settings...';
+            showToast('Rebooting to connect to WiFi...', 'success');
+            setTimeout(() => {
+                window.location.reload();
+            }, 5000);
+        } else {
+            status.textContent = 'Connection failed: ' + (data.message || 'Unknown error');
+            showToast('WiFi connection failed', 'error');
+        }
+    })
+    .catch(error => {
+        status.textContent = 'Device rebooting...';
+        showToast('Device rebooting...', 'success');
+        setTimeout(() => {
+            window.location.reload();
+        }, 5000);
+    });
+}
+
+function rebootDevice() {
+    if (!confirm('⚠️ Are you sure you want to reboot the device?')) {
+        return;
+    }
+    
+    showToast('Rebooting device...', 'success');
+    
+    fetch('/system/reboot', { method: 'POST' })
+        .then(response => response.json())
+        .then(data => {
+            showToast('Device rebooting...', 'success');
+            setTimeout(() => {
+                window.location.reload();
+            }, 5000);
+        })
+        .catch(error => {
+            showToast('Reboot command sent', 'success');
+            setTimeout(() => {
+                window.location.reload();
+            }, 5000);
+        });
+}
+
+function switchWifiMode() {
+    const mode = document.getElementById('wifi-mode').value;
+    
+    if (!confirm(`⚠️ Switch to ${mode === 'ap' ? 'Hotspot' : 'Client'} mode? Device will reboot.`)) {
+        return;
+    }
+    
+    showToast('Switching WiFi mode...', 'success');
+    
+    fetch('/system/wifi_mode', {
+        method: 'POST',
+        headers: { 'Content-Type': 'application/json' },
+        body: JSON.stringify({ mode: mode })
+    })
+    .then(response => response.json())
+    .then(data => {
+        showToast('Device rebooting to apply mode change...', 'success');
+        setTimeout(() => {
+            window.location.reload();
+        }, 5000);
+    })
+    .catch(error => {
+        showToast('Mode change command sent, device rebooting...', 'success');
+        setTimeout(() => {
+            window.location.reload();
+        }, 5000);
+    });
+}
+
+function resetToDefaults() {
+    if (!confirm('⚠️ WARNING: This will erase ALL settings including WiFi credentials, wand MAC, and MQTT settings. Continue?')) {
+        return;
+    }
+    
+    if (!confirm('⚠️ FINAL CONFIRMATION: Are you absolutely sure? This cannot be undone!')) {
+        return;
+    }
+    
+    showToast('Resetting to defaults...', 'success');
+    
+    fetch('/system/reset_nvs', { method: 'POST' })
+        .then(response => response.json())
+        .then(data => {
+            showToast('Settings cleared! Device rebooting...', 'success');
+            setTimeout(() => {
+                window.location.href = 'http://192.168.4.1/';
+            }, 5000);
+        })
+        .catch(error => {
+            showToast('Reset command sent, device rebooting...', 'success');
+            setTimeout(() => {
+                window.location.href = 'http://192.168.4.1/';
+            }, 5000);
+        });
+}
+
+// Load current WiFi mode and set dropdown
+function loadWifiMode() {
+    fetch('/system/get_wifi_mode')
+        .then(response => response.json())
+        .then(data => {
+            if (data.success && data.mode) {
+                const dropdown = document.getElementById('wifi-mode');
+                if (dropdown) {
+                    dropdown.value = data.mode;
+                    console.log('Current WiFi mode:', data.mode, 'Force AP:', data.force_ap);
+                }
+            }
+        })
+        .catch(error => {
+            console.error('Failed to load WiFi mode:', error);
+        });
+}
+
+// Check NVS stored values
+function checkNVS() {
+    const debugDiv = document.getElementById('nvs-debug');
+    fetch('/debug/nvs')
+        .then(response => response.json())
+        .then(data => {
+            if (data.success && data.nvs) {
+                debugDiv.style.display = 'block';
+                debugDiv.textContent = JSON.stringify(data.nvs, null, 2);
+                showToast('NVS values retrieved', 'success');
+            } else {
+                showToast('Failed to get NVS values', 'error');
+            }
+        })
+        .catch(error => {
+            showToast('Error reading NVS: ' + error, 'error');
+        });
+}
+
+// Load WiFi mode when page loads
+loadWifiMode();
+
+// Load settings (including MQTT) when page loads
+loadSettings();
+
+// Load cost: first paint and bytes over the wire (304 revalidations transfer only headers)
+window.addEventListener('load', () => {
+    setTimeout(() => {
+        const nav = performance.getEntriesByType('navigation')[0];
+        const paint = performance.getEntriesByName('first-contentful-paint')[0];
+        const bytes = performance.getEntriesByType('resource')
+            .reduce((total, entry) => total + entry.transferSize, nav ? nav.transferSize : 0);
+        console.log(`First paint ${paint ? paint.startTime.toFixed(0) : '?'} ms, ${bytes} bytes transferred`);
+    }, 0);
+});